@@ -121,6 +121,62 @@ class EncoderBenchmarkTest {
         )
     }
 
+    // =========================================================================
+    // swscale Slice Threads
+    // =========================================================================
+
+    @Test
+    fun benchmarkSwscale_SliceThreads() {
+        // Full frame 5K-ish clip down to UHD, the resize case exports still
+        // run through swscale for. yuv444p10le is what ProRes 4444 takes,
+        // yuv420p10le and p010le are 10-bit HEVC in software and hardware
+        val cores = Runtime.getRuntime().availableProcessors()
+        for (format in listOf("yuv444p10le", "yuv420p10le", "p010le", "yuv420p", "yuv422p10le")) {
+            val single = NativeLib.benchmarkSwscale(format, 5208, 2928, 3840, 2160, 1, 20)
+            val sliced = NativeLib.benchmarkSwscale(format, 5208, 2928, 3840, 2160, cores, 20)
+            org.junit.Assert.assertTrue("swscale failed for $format", single > 0 && sliced > 0)
+            Log.i(
+                TAG,
+                "swscale $format 5208x2928 -> 3840x2160: 1 thread ${single / 1000} us, " +
+                    "$cores threads ${sliced / 1000} us per frame (x${"%.2f".format(single.toDouble() / sliced)})"
+            )
+        }
+    }
+
+    @Test
+    fun benchmarkH264_Resize_Software() {
+        // Resized export, the frames go through swscale with slice threads
+        runBenchmark(
+            "H264_Resize_SW",
+            ExportCodec.H264,
+            forceSoftware = true,
+            resize = ResizeSettings(enabled = true, width = 1280, height = 720, algorithm = ScalingAlgorithm.BICUBIC)
+        )
+    }
+
+    @Test
+    fun benchmarkProRes4444_Resize_4K() {
+        // 4K ProRes 4444, converted to yuv444p10le by swscale with slice threads
+        runBenchmark(
+            "ProRes4444_Resize_4K",
+            ExportCodec.PRORES,
+            proResProfile = ProResProfile.PRORES_4444,
+            resize = ResizeSettings(enabled = true, width = 3840, height = 2160, algorithm = ScalingAlgorithm.BICUBIC)
+        )
+    }
+
+    @Test
+    fun benchmarkH265_10bit_Resize_4K_Software() {
+        // 4K HEVC 10-bit, converted to yuv420p10le by swscale with slice threads
+        runBenchmark(
+            "H265_10bit_Resize_4K_SW",
+            ExportCodec.H265,
+            h265BitDepth = H265BitDepth.BIT_10,
+            forceSoftware = true,
+            resize = ResizeSettings(enabled = true, width = 3840, height = 2160, algorithm = ScalingAlgorithm.BICUBIC)
+        )
+    }
+
     // =========================================================================
     // Helper Functions
     // =========================================================================
@@ -156,8 +212,10 @@ class EncoderBenchmarkTest {
         testName: String,
         codec: ExportCodec,
         h265BitDepth: H265BitDepth = H265BitDepth.BIT_8,
+        proResProfile: ProResProfile = ProResProfile.PRORES_422_HQ,
         forceHardware: Boolean = false,
-        forceSoftware: Boolean = false
+        forceSoftware: Boolean = false,
+        resize: ResizeSettings = ResizeSettings()
     ) {
         val type = when {
             forceHardware -> "HARDWARE"
@@ -181,8 +239,10 @@ class EncoderBenchmarkTest {
             h264Container = H264Container.MP4,
             h265BitDepth = h265BitDepth,
             h265Container = H265Container.MP4,
+            proResProfile = proResProfile,
             forceHardware = forceHardware,
-            forceSoftware = forceSoftware
+            forceSoftware = forceSoftware,
+            resize = resize
         )
 
         val startTime = System.currentTimeMillis()
@@ -0,0 +1,74 @@
+package fm.magiclantern.forum.export
+
+import android.util.Log
+import androidx.test.ext.junit.runners.AndroidJUnit4
+import fm.magiclantern.forum.nativeInterface.NativeLib
+import org.junit.Assert.assertNotNull
+import org.junit.Assert.assertTrue
+import org.junit.Test
+import org.junit.runner.RunWith
+
+/**
+ * Conformance of the direct RGB48 -> YUV conversion with swscale.
+ *
+ * Luma has to match swscale up to rounding and dither. Chroma is sited the
+ * same (centre of the block) but swscale filters it vertically with the
+ * bicubic resize kernel instead of averaging 2 rows, so it only has to match
+ * on smooth images; on noise the difference is logged.
+ *
+ * Run with:
+ *   ./gradlew connectedDebugAndroidTest \
+ *     -Pandroid.testInstrumentationRunnerArguments.class=fm.magiclantern.forum.export.YuvConversionTest
+ */
+@RunWith(AndroidJUnit4::class)
+class YuvConversionTest {
+
+    companion object {
+        private const val TAG = "YuvConversion"
+
+        // SWS_CS_* of libswscale
+        private const val SWS_CS_ITU709 = 1
+        private const val SWS_CS_ITU601 = 5
+        private const val SWS_CS_BT2020 = 9
+
+        private const val PATTERN_GRADIENT = 0
+        private const val PATTERN_NOISE = 1
+
+        private val FORMATS = listOf(
+            "yuv420p", "yuv422p", "yuv444p", "nv12",
+            "yuv420p10le", "yuv422p10le", "yuv444p10le", "p010le"
+        )
+        private val MATRICES = listOf(SWS_CS_ITU709, SWS_CS_ITU601, SWS_CS_BT2020)
+    }
+
+    // Allowed difference in 8 bit codes, 10 bit formats get 4 times that
+    private fun tolerance(format: String, codes: Int) =
+        if (format.contains("10")) codes * 4 else codes
+
+    private fun compare(format: String, matrix: Int, pattern: Int): IntArray {
+        // Odd size, so the last chroma column and row cover only part of a block
+        val diff = NativeLib.compareYuvWithSwscale(format, matrix, 321, 179, pattern)
+        assertNotNull("$format is not converted directly", diff)
+        Log.i(TAG, "$format matrix $matrix pattern $pattern: luma ${diff!![0]}, chroma ${diff[1]}")
+        return diff
+    }
+
+    @Test
+    fun gradientsMatchSwscale() {
+        for (format in FORMATS) {
+            for (matrix in MATRICES) {
+                val diff = compare(format, matrix, PATTERN_GRADIENT)
+                assertTrue("$format matrix $matrix luma off by ${diff[0]}", diff[0] <= tolerance(format, 1))
+                assertTrue("$format matrix $matrix chroma off by ${diff[1]}", diff[1] <= tolerance(format, 2))
+            }
+        }
+    }
+
+    @Test
+    fun noiseLumaMatchesSwscale() {
+        for (format in FORMATS) {
+            val diff = compare(format, SWS_CS_ITU709, PATTERN_NOISE)
+            assertTrue("$format luma off by ${diff[0]}", diff[0] <= tolerance(format, 1))
+        }
+    }
+}
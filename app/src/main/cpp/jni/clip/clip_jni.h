@@ -60,6 +60,48 @@ Java_fm_magiclantern_forum_nativeInterface_NativeLib_fillFrame16(
         jint width,
         jint height);
 
+JNIEXPORT jboolean JNICALL
+Java_fm_magiclantern_forum_nativeInterface_NativeLib_fillPreviewFrame16(
+        JNIEnv *env, jclass /*clazz*/,
+        jlong handle,
+        jint frameIndex,
+        jint cores,
+        jobject dstByteBuffer,
+        jint width,
+        jint height);
+
+JNIEXPORT jboolean JNICALL
+Java_fm_magiclantern_forum_nativeInterface_NativeLib_fillRegion16(
+        JNIEnv *env, jclass /*clazz*/,
+        jlong handle,
+        jint frameIndex,
+        jint cores,
+        jobject dstByteBuffer,
+        jint x,
+        jint y,
+        jint w,
+        jint h,
+        jint outWidth,
+        jint outHeight);
+
+JNIEXPORT void JNICALL
+Java_fm_magiclantern_forum_nativeInterface_NativeLib_setCacheStorageMode(
+        JNIEnv *env, jobject /* this */,
+        jlong handle,
+        jint mode);
+
+JNIEXPORT jlongArray JNICALL
+Java_fm_magiclantern_forum_nativeInterface_NativeLib_getCacheStats(
+        JNIEnv *env, jobject /* this */,
+        jlong handle);
+
+JNIEXPORT jboolean JNICALL
+Java_fm_magiclantern_forum_nativeInterface_NativeLib_setDiskCache(
+        JNIEnv *env, jobject /* this */,
+        jlong handle,
+        jstring cacheDir,
+        jlong megaBytes);
+
 JNIEXPORT jlong JNICALL
 Java_fm_magiclantern_forum_nativeInterface_NativeLib_getAudioBufferSize(
         JNIEnv *env, jobject /* this */,
@@ -97,10 +139,26 @@ JNIEXPORT void JNICALL
 Java_fm_magiclantern_forum_nativeInterface_NativeLib_setBaseDir(
         JNIEnv *env, jobject /* this */, jstring baseDir);
 
+JNIEXPORT void JNICALL
+Java_fm_magiclantern_forum_nativeInterface_NativeLib_setDarkFrameMasterDirectory(
+        JNIEnv *env, jobject /* this */, jstring directory);
+
 JNIEXPORT void JNICALL
 Java_fm_magiclantern_forum_nativeInterface_NativeLib_refreshFocusPixelMap(
         JNIEnv *env, jobject /* this */, jlong handle);
 
+JNIEXPORT void JNICALL
+Java_fm_magiclantern_forum_nativeInterface_NativeLib_setPixelMapDirectory(
+        JNIEnv *env, jobject /* this */, jstring directory);
+
+JNIEXPORT void JNICALL
+Java_fm_magiclantern_forum_nativeInterface_NativeLib_setFocusPixelMapFd(
+        JNIEnv *env, jobject /* this */, jlong handle, jint fd);
+
+JNIEXPORT void JNICALL
+Java_fm_magiclantern_forum_nativeInterface_NativeLib_setBadPixelMapFd(
+        JNIEnv *env, jobject /* this */, jlong handle, jint fd);
+
 JNIEXPORT void JNICALL
 Java_fm_magiclantern_forum_nativeInterface_NativeLib_setFocusPixelMode(
         JNIEnv *env, jobject /* this */, jlong handle, jint mode);
@@ -309,22 +309,10 @@ Java_fm_magiclantern_forum_nativeInterface_NativeLib_openClip(
         goto cleanup;
     }
     wrapper->mlv_object = nativeClip;
-    wrapper->processing_buffer_16bit = nullptr;
 
     // This block isolates the variable initializations to prevent the 'goto'
     // error.
     {
-        const int width = getMlvWidth(nativeClip);
-        const int height = getMlvHeight(nativeClip);
-        const size_t rgbSize =
-                static_cast<size_t>(width) * static_cast<size_t>(height) * 3u;
-        wrapper->processing_buffer_16bit = new(std::nothrow) uint16_t[rgbSize];
-        if (!wrapper->processing_buffer_16bit) {
-            __android_log_print(ANDROID_LOG_ERROR, kJniTag,
-                                "Failed to allocate RGB buffer");
-            goto cleanup;
-        }
-
         setMlvProcessing(nativeClip, nativeClip->processing);
         disableMlvCaching(nativeClip);
 
@@ -399,7 +387,6 @@ Java_fm_magiclantern_forum_nativeInterface_NativeLib_openClip(
     cleanup:
     if (!metadata) { // If we failed at any point
         if (wrapper) {
-            delete[] wrapper->processing_buffer_16bit;
             delete wrapper;
         }
         if (nativeClip) {
@@ -525,7 +512,6 @@ Java_fm_magiclantern_forum_nativeInterface_NativeLib_closeClip(
     if (wrapper->mlv_object) {
         freeMlvObject(wrapper->mlv_object);
     }
-    delete[] wrapper->processing_buffer_16bit;
     delete wrapper;
 }
 
@@ -9,10 +9,9 @@
 // The 16-bit value for each channel is stored as 2 bytes in little-endian order,
 // which maps directly to GL_RG8 (low byte = .r, high byte = .g) in the shader.
 // Java side must allocate: capacity = width * height * 3 * sizeof(uint16_t) = 6 bytes/px
-extern "C" JNIEXPORT jboolean JNICALL
-Java_fm_magiclantern_forum_nativeInterface_NativeLib_fillFrame16(
-    JNIEnv *env, jclass /*clazz*/, jlong handle, jint frameIndex, jint cores,
-    jobject dstByteBuffer, jint width, jint height) {
+static jboolean fill_frame16(JNIEnv *env, jlong handle, jint frameIndex,
+                             jint cores, jobject dstByteBuffer, jint width,
+                             jint height, bool preview) {
 
   if (handle == 0 || dstByteBuffer == nullptr || width <= 0 || height <= 0) {
     return JNI_FALSE;
@@ -20,19 +19,21 @@ Java_fm_magiclantern_forum_nativeInterface_NativeLib_fillFrame16(
 
   auto *wrapper = reinterpret_cast<JniClipWrapper *>(handle);
 
-  // Try to acquire the mutex without blocking - if we can't, another render is
-  // in progress. This prevents deadlocks and crashes during rapid view
-  // transitions.
-  std::unique_lock<std::mutex> lock(wrapper->render_mutex, std::try_to_lock);
-  if (!lock.owns_lock()) {
-    return JNI_FALSE;
-  }
+  // Renders run side by side, each one processes on its own copy of the
+  // settings, so no frame is dropped because another one is in flight
+  std::shared_lock<std::shared_mutex> lock(wrapper->render_mutex);
 
   mlvObject_t *nativeClip = wrapper->mlv_object;
   if (!nativeClip) {
     return JNI_FALSE;
   }
 
+  // The preview is always exactly half size, anything else is a caller bug
+  if (preview && (width != getMlvPreviewWidth(nativeClip) ||
+                  height != getMlvPreviewHeight(nativeClip))) {
+    return JNI_FALSE;
+  }
+
   auto *dstBuf =
       reinterpret_cast<uint8_t *>(env->GetDirectBufferAddress(dstByteBuffer));
   const jlong cap = env->GetDirectBufferCapacity(dstByteBuffer);
@@ -44,21 +45,150 @@ Java_fm_magiclantern_forum_nativeInterface_NativeLib_fillFrame16(
     return JNI_FALSE;
   }
 
-  uint16_t *rgbBuf = wrapper->processing_buffer_16bit;
-  if (!rgbBuf) {
+  // Decode straight into the buffer: raw uint16_t bytes are already in the
+  // correct layout for GL_RG8 (little-endian: low byte first, high byte second
+  // per texel).
+  auto *rgbBuf = reinterpret_cast<uint16_t *>(dstBuf);
+  if (preview) {
+    getMlvProcessedPreviewFrame16(nativeClip, frameIndex, rgbBuf, cores);
+  } else {
+    getMlvProcessedFrame16(nativeClip, frameIndex, rgbBuf, cores);
+  }
+
+  return JNI_TRUE;
+}
+
+extern "C" JNIEXPORT jboolean JNICALL
+Java_fm_magiclantern_forum_nativeInterface_NativeLib_fillFrame16(
+    JNIEnv *env, jclass /*clazz*/, jlong handle, jint frameIndex, jint cores,
+    jobject dstByteBuffer, jint width, jint height) {
+  return fill_frame16(env, handle, frameIndex, cores, dstByteBuffer, width,
+                      height, false);
+}
+
+// Same as fillFrame16 at half resolution (width / 2 x height / 2), each 2x2
+// bayer quad becomes one pixel. About 4x cheaper, meant for playback.
+extern "C" JNIEXPORT jboolean JNICALL
+Java_fm_magiclantern_forum_nativeInterface_NativeLib_fillPreviewFrame16(
+    JNIEnv *env, jclass /*clazz*/, jlong handle, jint frameIndex, jint cores,
+    jobject dstByteBuffer, jint width, jint height) {
+  return fill_frame16(env, handle, frameIndex, cores, dstByteBuffer, width,
+                      height, true);
+}
+
+// Part of a frame for zoomed in viewing: x, y, w, h in frame pixels, scaled to
+// outWidth x outHeight. Only a tile around it is debayered and processed.
+extern "C" JNIEXPORT jboolean JNICALL
+Java_fm_magiclantern_forum_nativeInterface_NativeLib_fillRegion16(
+    JNIEnv *env, jclass /*clazz*/, jlong handle, jint frameIndex, jint cores,
+    jobject dstByteBuffer, jint x, jint y, jint w, jint h, jint outWidth,
+    jint outHeight) {
+
+  if (handle == 0 || dstByteBuffer == nullptr || w <= 0 || h <= 0 ||
+      outWidth <= 0 || outHeight <= 0) {
     return JNI_FALSE;
   }
 
-  // Decode the frame into the wrapper's 16-bit RGB buffer
-  getMlvProcessedFrame16(nativeClip, frameIndex, rgbBuf, cores);
+  auto *wrapper = reinterpret_cast<JniClipWrapper *>(handle);
 
-  // Zero-cost upload: raw uint16_t bytes are already in the correct layout
-  // for GL_RG8 (little-endian: low byte first, high byte second per texel).
-  memcpy(dstBuf, rgbBuf, needed);
+  // Same as fill_frame16, can run next to other renders
+  std::shared_lock<std::shared_mutex> lock(wrapper->render_mutex);
+
+  mlvObject_t *nativeClip = wrapper->mlv_object;
+  if (!nativeClip) {
+    return JNI_FALSE;
+  }
+
+  auto *dstBuf =
+      reinterpret_cast<uint8_t *>(env->GetDirectBufferAddress(dstByteBuffer));
+  const jlong cap = env->GetDirectBufferCapacity(dstByteBuffer);
+  const size_t needed = static_cast<size_t>(outWidth) *
+                        static_cast<size_t>(outHeight) * 3u * sizeof(uint16_t);
+
+  if (!dstBuf || cap < static_cast<jlong>(needed)) {
+    return JNI_FALSE;
+  }
+
+  getMlvProcessedRegion16(nativeClip, frameIndex, x, y, w, h, outWidth,
+                          outHeight, reinterpret_cast<uint16_t *>(dstBuf),
+                          cores);
 
   return JNI_TRUE;
 }
 
+// Selects what the RAM frame cache keeps per frame (MLV_CACHE_STORE_*).
+// Bayer modes hold 3-4x more frames but debayer on every hit.
+extern "C" JNIEXPORT void JNICALL
+Java_fm_magiclantern_forum_nativeInterface_NativeLib_setCacheStorageMode(
+    JNIEnv *env, jobject /* this */, jlong handle, jint mode) {
+  if (handle == 0) {
+    return;
+  }
+
+  auto *wrapper = reinterpret_cast<JniClipWrapper *>(handle);
+  std::unique_lock<std::shared_mutex> lock(wrapper->render_mutex);
+  if (wrapper->mlv_object) {
+    setMlvCacheStorageMode(wrapper->mlv_object, mode);
+  }
+}
+
+// Returns [hits, misses, decodeNs, cacheableFrames] so the storage mode can be
+// picked per device: decodeNs / hits is the average cost of a hit.
+extern "C" JNIEXPORT jlongArray JNICALL
+Java_fm_magiclantern_forum_nativeInterface_NativeLib_getCacheStats(
+    JNIEnv *env, jobject /* this */, jlong handle) {
+  if (handle == 0) {
+    return nullptr;
+  }
+
+  auto *wrapper = reinterpret_cast<JniClipWrapper *>(handle);
+  mlvObject_t *nativeClip = wrapper->mlv_object;
+  if (!nativeClip) {
+    return nullptr;
+  }
+
+  uint64_t hits = 0, misses = 0, decodeNs = 0;
+  getMlvCacheStats(nativeClip, &hits, &misses, &decodeNs);
+
+  const jlong stats[4] = {
+      static_cast<jlong>(hits), static_cast<jlong>(misses),
+      static_cast<jlong>(decodeNs),
+      static_cast<jlong>(getMlvRawCacheLimitFrames(nativeClip))};
+
+  jlongArray result = env->NewLongArray(4);
+  if (!result) {
+    return nullptr;
+  }
+  env->SetLongArrayRegion(result, 0, 4, stats);
+  return result;
+}
+
+// Spills frames that don't fit the RAM cache to a file in cacheDir.
+// A null dir or 0 MiB turns the disk tier off.
+extern "C" JNIEXPORT jboolean JNICALL
+Java_fm_magiclantern_forum_nativeInterface_NativeLib_setDiskCache(
+    JNIEnv *env, jobject /* this */, jlong handle, jstring cacheDir,
+    jlong megaBytes) {
+  if (handle == 0) {
+    return JNI_FALSE;
+  }
+
+  auto *wrapper = reinterpret_cast<JniClipWrapper *>(handle);
+  std::unique_lock<std::shared_mutex> lock(wrapper->render_mutex);
+  if (!wrapper->mlv_object) {
+    return JNI_FALSE;
+  }
+
+  const char *dir =
+      cacheDir ? env->GetStringUTFChars(cacheDir, nullptr) : nullptr;
+  int enabled = setMlvDiskCache(wrapper->mlv_object, dir,
+                                megaBytes > 0 ? (uint64_t)megaBytes : 0);
+  if (dir) {
+    env->ReleaseStringUTFChars(cacheDir, dir);
+  }
+  return enabled ? JNI_TRUE : JNI_FALSE;
+}
+
 extern "C" JNIEXPORT jlong JNICALL
 Java_fm_magiclantern_forum_nativeInterface_NativeLib_getAudioBufferSize(
     JNIEnv *env, jobject /* this */, jlong handle) {
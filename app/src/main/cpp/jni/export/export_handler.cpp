@@ -153,6 +153,7 @@ void apply_raw_correction(mlvObject_t *video,
   //        }
 
   // Dark frame
+  llrpSetDarkFrameStackMethod(video, opts.dark_frame_stack);
   llrpSetDarkFrameMode(video, opts.dark_frame_enabled);
   // Note: Dark frame file path would need to be applied via
   // llrpSetDarkFrameFile if the file is accessible during export
@@ -7,10 +7,15 @@ extern "C" {
 #include "../ffmpeg/ffmpeg_handler.h"
 #include "export_handler.h"
 #include <android/log.h>
+#include <algorithm>
 #include <atomic>
+#include <condition_variable>
 #include <cstring>
 #include <jni.h>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 
 static JavaVM *g_vm = nullptr;
 static jobject g_progress_listener = nullptr;
@@ -118,6 +123,8 @@ static void parse_raw_correction(JNIEnv *env, jobject rawCorrectionObj,
       get_string_field(env, rawCorrectionObj, cls, "darkFrameFileName");
   out.dark_frame_enabled =
       get_int_field(env, rawCorrectionObj, cls, "darkFrameEnabled");
+  out.dark_frame_stack =
+      get_int_field(env, rawCorrectionObj, cls, "darkFrameStack");
 
   env->DeleteLocalRef(cls);
 }
@@ -316,6 +323,9 @@ export_options_t parse_export_options(JNIEnv *env, jobject exportOptions) {
     options.resize_width = get_int_field(env, resizeObj, resizeClass, "width");
     options.resize_height =
         get_int_field(env, resizeObj, resizeClass, "height");
+    options.resize_algorithm = get_enum_field(
+        env, resizeObj, resizeClass, "algorithm",
+        "Lfm/magiclantern/forum/features/export/model/ScalingAlgorithm;");
     env->DeleteLocalRef(resizeClass);
   }
   env->DeleteLocalRef(resizeObj);
@@ -415,6 +425,56 @@ static int acquire_audio_fd(void *, const char *relative_name) {
   return fd;
 }
 
+// Batch exports run up to this many clips side by side
+static constexpr int kMaxConcurrentBatchClips = 3;
+// Rough working set of a clip while exporting: raw and debayered float
+// buffers plus the 16 bit output frames in flight
+static constexpr uint64_t kBatchBytesPerPixel = 40;
+
+struct BatchScheduler {
+  std::mutex mutex;
+  std::condition_variable cond;
+  int running = 0;
+  uint64_t reserved = 0;       // Memory estimate of the running clips
+  int result = EXPORT_SUCCESS; // First failure stops new clips starting
+};
+
+static std::atomic<int> *g_batch_progress = nullptr;
+static int g_batch_clip_count = 0;
+static std::atomic<int> g_batch_last_progress{-1};
+static thread_local int t_batch_clip = -1;
+
+// Clips report 0-100 each, the listener gets the average over the batch
+static void batch_progress_callback(int progress) {
+  if (!g_batch_progress || t_batch_clip < 0)
+    return;
+  g_batch_progress[t_batch_clip].store(progress, std::memory_order_relaxed);
+
+  int64_t sum = 0;
+  for (int i = 0; i < g_batch_clip_count; ++i)
+    sum += g_batch_progress[i].load(std::memory_order_relaxed);
+  const int total = static_cast<int>(sum / g_batch_clip_count);
+
+  // Only report when it moves forward, clips finish out of order
+  int last = g_batch_last_progress.load(std::memory_order_relaxed);
+  while (total > last) {
+    if (g_batch_last_progress.compare_exchange_weak(last, total)) {
+      progress_callback(total);
+      break;
+    }
+  }
+}
+
+// The callbacks attach whatever thread they run on, workers have to let go
+// before they exit
+static void detach_export_thread() {
+  JNIEnv *env = nullptr;
+  if (g_vm && g_vm->GetEnv(reinterpret_cast<void **>(&env),
+                           JNI_VERSION_1_6) == JNI_OK) {
+    g_vm->DetachCurrentThread();
+  }
+}
+
 extern "C" JNIEXPORT void JNICALL
 Java_fm_magiclantern_forum_nativeInterface_NativeLib_exportHandler(
     JNIEnv *env, jobject /* thiz */, jlong cacheSize, jint cores,
@@ -558,7 +618,9 @@ Java_fm_magiclantern_forum_nativeInterface_NativeLib_exportHandler(
   }
 }
 
-// Batch export handler - processes multiple clips with shared encoder context
+// Batch export handler - processes multiple clips with shared encoder context.
+// The next clip is opened while earlier ones export, several clips run at
+// once within the core and memory budget
 extern "C" JNIEXPORT void JNICALL
 Java_fm_magiclantern_forum_nativeInterface_NativeLib_exportBatchHandler(
     JNIEnv *env, jobject /* thiz */, jlong cacheSize, jint cores,
@@ -605,11 +667,58 @@ Java_fm_magiclantern_forum_nativeInterface_NativeLib_exportBatchHandler(
       clipDataClass, "colorGrading",
       "Lfm/magiclantern/forum/domain/model/ColorGradingSettings;");
 
+  // Setup file provider once, the callbacks are shared by all clips
+  if (fileProvider) {
+    g_file_provider = env->NewGlobalRef(fileProvider);
+    jclass providerClazz = env->GetObjectClass(g_file_provider);
+    g_open_frame_fd_mid = env->GetMethodID(providerClazz, "openFrameFd",
+                                           "(ILjava/lang/String;)I");
+    g_open_container_fd_mid = env->GetMethodID(
+        providerClazz, "openContainerFd", "(Ljava/lang/String;)I");
+    g_open_audio_fd_mid = env->GetMethodID(providerClazz, "openAudioFd",
+                                           "(Ljava/lang/String;)I");
+    env->DeleteLocalRef(providerClazz);
+  }
+
+  export_fd_provider_t provider = {};
+  if (g_file_provider) {
+    provider.acquire_frame_fd =
+        g_open_frame_fd_mid ? acquire_frame_fd : nullptr;
+    provider.acquire_container_fd =
+        g_open_container_fd_mid ? acquire_container_fd : nullptr;
+    provider.acquire_audio_fd =
+        g_open_audio_fd_mid ? acquire_audio_fd : nullptr;
+    provider.ctx = nullptr;
+  }
+
+  // Several clips export at once, each gets an equal share of the cores
+  const int maxRunning =
+      std::max(1, std::min({kMaxConcurrentBatchClips, clipCount, cores / 2}));
+  const int clipCores = std::max(1, static_cast<int>(cores) / maxRunning);
+  // Caching is off while exporting, so the cache budget bounds the clips
+  const uint64_t memoryBudget =
+      static_cast<uint64_t>(std::max<jlong>(cacheSize, 0)) << 20;
+
+  std::vector<std::atomic<int>> clipProgress(clipCount);
+  for (auto &progress : clipProgress)
+    progress.store(0, std::memory_order_relaxed);
+  g_batch_progress = clipProgress.data();
+  g_batch_clip_count = clipCount;
+  g_batch_last_progress.store(-1, std::memory_order_relaxed);
+
+  BatchScheduler scheduler;
+  std::vector<std::thread> workers;
+
   for (int i = 0; i < clipCount; ++i) {
     if (is_export_cancelled()) {
       lastResult = EXPORT_CANCELLED;
       break;
     }
+    {
+      std::lock_guard<std::mutex> lock(scheduler.mutex);
+      if (scheduler.result != EXPORT_SUCCESS)
+        break;
+    }
 
     jobject clipData = env->GetObjectArrayElement(clipDataArray, i);
 
@@ -638,66 +747,10 @@ Java_fm_magiclantern_forum_nativeInterface_NativeLib_exportBatchHandler(
     parse_color_grading(env, colorGradingObj, clipOptions.color_grading);
     env->DeleteLocalRef(colorGradingObj);
 
-    // Setup file provider for this clip
-    if (fileProvider) {
-      g_file_provider = env->NewGlobalRef(fileProvider);
-      jclass providerClazz = env->GetObjectClass(g_file_provider);
-      g_open_frame_fd_mid = env->GetMethodID(providerClazz, "openFrameFd",
-                                             "(ILjava/lang/String;)I");
-      g_open_container_fd_mid = env->GetMethodID(
-          providerClazz, "openContainerFd", "(Ljava/lang/String;)I");
-      g_open_audio_fd_mid = env->GetMethodID(providerClazz, "openAudioFd",
-                                             "(Ljava/lang/String;)I");
-      env->DeleteLocalRef(providerClazz);
-    }
-
-    // Open clip
+    // Open and index the clip here, while the clips before it are exporting
     mlvObject_t *video =
-        getMlvObject(env, clipFds, fileName, cacheSize, cores, true);
-
-    if (video) {
-      setMlvProcessing(video, video->processing);
-      disableMlvCaching(video);
-      const int focusMode = llrpDetectFocusDotFixMode(video);
-      if (focusMode != 0) {
-        // Sync the per-clip options struct so it isn't overridden by apply_raw_correction
-        clipOptions.raw_correction.focus_pixels = focusMode;
-        clipOptions.raw_correction.enabled = true;
-
-        llrpSetFixRawMode(video, 1);
-        llrpSetFocusPixelMode(video, focusMode);
-        llrpResetFpmStatus(video);
-        llrpResetBpmStatus(video);
-        resetMlvCache(video);
-        resetMlvCachedFrame(video);
-      }
+        getMlvObject(env, clipFds, fileName, cacheSize, clipCores, true);
 
-      export_fd_provider_t provider = {};
-      if (g_file_provider) {
-        provider.acquire_frame_fd =
-            g_open_frame_fd_mid ? acquire_frame_fd : nullptr;
-        provider.acquire_container_fd =
-            g_open_container_fd_mid ? acquire_container_fd : nullptr;
-        provider.acquire_audio_fd =
-            g_open_audio_fd_mid ? acquire_audio_fd : nullptr;
-        provider.ctx = nullptr;
-      }
-
-      // Use batch export job (encoder caching)
-      lastResult = startBatchExportJob(batch_ctx, video, clipOptions, provider,
-                                       progress_callback);
-
-      freeProcessingObject(video->processing);
-      freeMlvObject(video);
-    } else {
-      lastResult = EXPORT_ERROR_GENERIC;
-    }
-
-    // Cleanup per-clip resources
-    if (g_file_provider) {
-      env->DeleteGlobalRef(g_file_provider);
-      g_file_provider = nullptr;
-    }
     env->DeleteLocalRef(clipFds);
     env->DeleteLocalRef(fileName);
     env->DeleteLocalRef(baseName);
@@ -706,9 +759,89 @@ Java_fm_magiclantern_forum_nativeInterface_NativeLib_exportBatchHandler(
       env->DeleteLocalRef(rawCorrectionObj);
     env->DeleteLocalRef(clipData);
 
-    if (lastResult != EXPORT_SUCCESS) {
+    if (!video) {
+      lastResult = EXPORT_ERROR_GENERIC;
+      break;
+    }
+
+    setMlvProcessing(video, video->processing);
+    disableMlvCaching(video);
+    const int focusMode = llrpDetectFocusDotFixMode(video);
+    if (focusMode != 0) {
+      // Sync the per-clip options struct so it isn't overridden by apply_raw_correction
+      clipOptions.raw_correction.focus_pixels = focusMode;
+      clipOptions.raw_correction.enabled = true;
+
+      llrpSetFixRawMode(video, 1);
+      llrpSetFocusPixelMode(video, focusMode);
+      llrpResetFpmStatus(video);
+      llrpResetBpmStatus(video);
+      resetMlvCache(video);
+      resetMlvCachedFrame(video);
+    }
+
+    const uint64_t clipBytes = static_cast<uint64_t>(getMlvWidth(video)) *
+                               getMlvHeight(video) * kBatchBytesPerPixel;
+
+    // Wait for a free slot, one clip always runs even over the budget
+    bool start;
+    {
+      std::unique_lock<std::mutex> lock(scheduler.mutex);
+      scheduler.cond.wait(lock, [&] {
+        return scheduler.result != EXPORT_SUCCESS || is_export_cancelled() ||
+               (scheduler.running < maxRunning &&
+                (scheduler.running == 0 ||
+                 scheduler.reserved + clipBytes <= memoryBudget));
+      });
+      start = scheduler.result == EXPORT_SUCCESS && !is_export_cancelled();
+      if (start) {
+        scheduler.running++;
+        scheduler.reserved += clipBytes;
+      }
+    }
+    if (!start) {
+      freeProcessingObject(video->processing);
+      freeMlvObject(video);
+      if (is_export_cancelled())
+        lastResult = EXPORT_CANCELLED;
       break;
     }
+
+    workers.emplace_back([&, i, video, clipBytes,
+                          clipOptions = std::move(clipOptions)]() {
+      t_batch_clip = i;
+      // Use batch export job (encoder caching)
+      const int result = startBatchExportJob(batch_ctx, video, clipOptions,
+                                             provider, batch_progress_callback);
+      freeProcessingObject(video->processing);
+      freeMlvObject(video);
+      if (result == EXPORT_SUCCESS)
+        batch_progress_callback(100);
+
+      {
+        std::lock_guard<std::mutex> lock(scheduler.mutex);
+        scheduler.running--;
+        scheduler.reserved -= clipBytes;
+        if (result != EXPORT_SUCCESS && scheduler.result == EXPORT_SUCCESS)
+          scheduler.result = result;
+      }
+      scheduler.cond.notify_all();
+      detach_export_thread();
+    });
+  }
+
+  for (auto &worker : workers)
+    worker.join();
+  g_batch_progress = nullptr;
+  g_batch_clip_count = 0;
+
+  // A failed clip takes precedence over one that never got opened
+  if (scheduler.result != EXPORT_SUCCESS)
+    lastResult = scheduler.result;
+
+  if (g_file_provider) {
+    env->DeleteGlobalRef(g_file_provider);
+    g_file_provider = nullptr;
   }
 
   // Cleanup batch context
@@ -10,7 +10,7 @@
 
 struct raw_correction_options_t {
     bool enabled = true;
-    int vertical_stripes = 0;         // 0=Off, 1=Normal, 2=Force
+    int vertical_stripes = 0;         // 0=Off, 1=Normal, 2=Force, 3=Clip
     int focus_pixels = 0;             // 0=Off, 1=On, 2=CropRec
     int fpi_method = 0;               // Focus pixel interpolation method
     int bad_pixels = 0;               // 0=Off, 1=Auto, 2=Force, 3=Map
@@ -28,6 +28,7 @@ struct raw_correction_options_t {
     int dual_iso_black = 4096;        // Dual ISO black level
     std::string dark_frame_file_name; // Dark frame file path
     int dark_frame_enabled = 0;       // 0=Off, 1=Ext, 2=Int
+    int dark_frame_stack = 0;         // 0=Average, 1=Median
 };
 
 #endif // MLVAPP_RAW_CORRECTION_OPTIONS_H
@@ -212,6 +212,8 @@ AVCodecContext *get_batch_codec_context(BatchExportContext &ctx, int width,
                                         int tonemap,
                                         const std::string& transfer_function) {
 
+  std::lock_guard<std::mutex> lock(ctx.mutex);
+
   // Store gamut/tonemap so cached encoder uses correct tags
   ctx.gamut = gamut;
   ctx.tonemap = tonemap;
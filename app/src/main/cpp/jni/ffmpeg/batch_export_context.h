@@ -9,6 +9,7 @@
 #define MLVAPP_BATCH_EXPORT_CONTEXT_H
 
 #include "ffmpeg_presets.h"
+#include <mutex>
 #include <string>
 
 extern "C" {
@@ -45,6 +46,10 @@ struct BatchExportContext {
   int gamut = 0;          // GAMUT_* index from raw_processing.h
   int tonemap = 0;        // TONEMAP_* enum from raw_processing.h
   std::string transfer_function = ""; 
+
+  // Clips of a batch can export at the same time, probing and the cached
+  // encoder are guarded by this so only the first clip pays for the probe
+  std::mutex mutex;
 };
 
 // Initialize batch export context with export options
@@ -58,6 +63,7 @@ bool can_reuse_codec(const BatchExportContext &ctx, int width, int height,
 
 // Get or create codec context for batch export
 // Returns existing context if dimensions match, creates new one otherwise
+// Safe to call from several clip threads at once
 AVCodecContext *get_batch_codec_context(BatchExportContext &ctx, int width,
                                         int height, AVRational fps,
                                         int thread_count,
@@ -9,15 +9,19 @@
 
 #include "ffmpeg_handler.h"
 #include "ffmpeg_color_tags.h"
+#include "ffmpeg_yuv.h"
 #include "../export/export_handler.h"
 #include "../utils.h"
 
 #include <algorithm>
 #include <android/log.h>
 #include <cerrno>
+#include <condition_variable>
 #include <cstring>
 #include <fcntl.h>
+#include <mutex>
 #include <sys/stat.h>
+#include <thread>
 #include <unistd.h>
 #include <vector>
 
@@ -28,6 +32,9 @@ extern "C" {
 
 static const char *LOG_TAG = "FFmpegHandler";
 
+// Image sequence encoders running at once (each keeps one RGB48 frame)
+static const int MAX_IMAGE_ENCODE_WORKERS = 4;
+
 static int fd_write_packet(void *opaque, const uint8_t *buf, int buf_size) {
   auto *io = reinterpret_cast<FdIoContext *>(opaque);
   if (!io)
@@ -75,6 +82,19 @@ std::unique_ptr<FdIoContext> make_fd_io(int fd) {
   return io;
 }
 
+// Processed RGB48 frame. When prescale is set the debayered frame is resized
+// to dst_w x dst_h first, so grading only runs on the output pixels.
+static void get_export_frame(mlvObject_t *video, uint32_t frame_index,
+                             bool prescale, int dst_w, int dst_h,
+                             uint16_t *out) {
+  if (prescale) {
+    getMlvProcessedFrameResized16(video, frame_index, dst_w, dst_h, out,
+                                  getMlvCpuCores(video));
+  } else {
+    getMlvProcessedFrame16(video, frame_index, out, getMlvCpuCores(video));
+  }
+}
+
 void free_fd_io(std::unique_ptr<FdIoContext> &io) {
   if (!io)
     return;
@@ -91,6 +111,187 @@ void free_fd_io(std::unique_ptr<FdIoContext> &io) {
   io.reset();
 }
 
+namespace {
+
+// Image codecs are intra only, so every frame can go to its own encoder.
+// Workers own everything after processing: swscale, encoder, packet.
+struct ImageEncodeWorker {
+  SwsContext *sws_ctx = nullptr;
+  AVCodecContext *codec_ctx = nullptr;
+  AVFrame *frame = nullptr;
+  AVPacket *pkt = nullptr;
+};
+
+// A processed frame waiting for a worker
+struct ImageEncodeJob {
+  uint32_t frame_index = 0;
+  int fd = -1;
+  std::vector<uint16_t> *rgb = nullptr;
+};
+
+// Work queue between the exporting thread and the encode workers. Only the
+// exporting thread calls back into Java (fds, progress), workers never
+// attach to the VM.
+struct ImageEncodeQueue {
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::vector<ImageEncodeJob> jobs;
+  std::vector<std::vector<uint16_t> *> free_buffers;
+  uint32_t done = 0;
+  bool finished = false;
+  int error = 0;
+};
+
+void free_image_encode_worker(ImageEncodeWorker &worker) {
+  if (worker.pkt)
+    av_packet_free(&worker.pkt);
+  if (worker.frame)
+    av_frame_free(&worker.frame);
+  if (worker.codec_ctx)
+    avcodec_free_context(&worker.codec_ctx);
+  if (worker.sws_ctx)
+    sws_freeContext(worker.sws_ctx);
+  worker = ImageEncodeWorker{};
+}
+
+bool init_image_encode_worker(ImageEncodeWorker &worker, const AVCodec *codec,
+                              AVCodecID codec_id, AVPixelFormat dst_format,
+                              int in_w, int in_h, int dst_w, int dst_h,
+                              int scale_flags, int sws_threads,
+                              const ffmpeg_color_tags_t &tags) {
+  worker.sws_ctx = create_export_sws_context(in_w, in_h, dst_w, dst_h,
+                                             dst_format, scale_flags,
+                                             sws_threads);
+  if (!worker.sws_ctx) {
+    LOGE(LOG_TAG, "sws context is null.");
+    return false;
+  }
+  // Set correct RGB→YUV matrix based on processing gamut
+  apply_sws_color_matrix(worker.sws_ctx, tags);
+
+  worker.codec_ctx = avcodec_alloc_context3(codec);
+  if (!worker.codec_ctx) {
+    return false;
+  }
+  worker.codec_ctx->codec_id = codec_id;
+  worker.codec_ctx->pix_fmt = dst_format;
+  worker.codec_ctx->width = dst_w;
+  worker.codec_ctx->height = dst_h;
+  worker.codec_ctx->time_base = AVRational{1, 25};
+  worker.codec_ctx->framerate = AVRational{25, 1};
+  if (avcodec_open2(worker.codec_ctx, codec, nullptr) < 0) {
+    LOGE(LOG_TAG, "Failed to open encoder for codec_id=%d", codec_id);
+    return false;
+  }
+
+  worker.frame = av_frame_alloc();
+  if (!worker.frame) {
+    return false;
+  }
+  worker.frame->format = dst_format;
+  worker.frame->width = dst_w;
+  worker.frame->height = dst_h;
+  if (av_frame_get_buffer(worker.frame, 0) < 0) {
+    LOGE(LOG_TAG, "failed to get a image buffer.");
+    return false;
+  }
+
+  worker.pkt = av_packet_alloc();
+  if (!worker.pkt) {
+    LOGE(LOG_TAG, "Failed to allocate packet");
+    return false;
+  }
+  return true;
+}
+
+// Converts, encodes and writes one frame, closes the fd. 0 on success
+int encode_image_job(ImageEncodeWorker &worker, const ImageEncodeJob &job,
+                     int in_w, int in_h) {
+  int ret = 0;
+
+  if (av_frame_make_writable(worker.frame) < 0) {
+    LOGE(LOG_TAG, "Failed to make frame %u writable", job.frame_index);
+    ret = -1;
+  } else if (export_sws_scale(worker.sws_ctx, job.rgb->data(), in_w, in_h,
+                              worker.frame) < 0) {
+    LOGE(LOG_TAG, "Failed to convert frame %u", job.frame_index);
+    ret = -1;
+  }
+  worker.frame->pts = job.frame_index;
+
+  // Encode frame
+  int enc_ret = 0;
+  if (ret == 0) {
+    enc_ret = avcodec_send_frame(worker.codec_ctx, worker.frame);
+    if (enc_ret < 0) {
+      LOGE(LOG_TAG, "Failed to send frame %u to encoder", job.frame_index);
+      ret = -1;
+    }
+  }
+
+  while (ret == 0) {
+    enc_ret = avcodec_receive_packet(worker.codec_ctx, worker.pkt);
+    if (enc_ret == AVERROR(EAGAIN) || enc_ret == AVERROR_EOF) {
+      break;
+    }
+    if (enc_ret < 0) {
+      LOGE(LOG_TAG, "Failed to receive packet for frame %u", job.frame_index);
+      ret = -1;
+      break;
+    }
+
+    // Write packet data directly to file descriptor (bypass muxer!)
+    ssize_t written = write(job.fd, worker.pkt->data, worker.pkt->size);
+    if (written != worker.pkt->size) {
+      LOGE(LOG_TAG,
+           "Failed to write image data for frame %u: wrote %zd of %d bytes, "
+           "errno=%d (%s)",
+           job.frame_index, written, worker.pkt->size, errno, strerror(errno));
+      ret = -1;
+    }
+    av_packet_unref(worker.pkt);
+    break; // For image codecs, there's only one packet per frame
+  }
+
+  close(job.fd);
+  return ret;
+}
+
+void image_encode_worker_loop(ImageEncodeWorker *worker,
+                              ImageEncodeQueue *queue, int in_w, int in_h) {
+  std::unique_lock<std::mutex> lock(queue->mutex);
+  while (true) {
+    queue->cond.wait(lock,
+                     [&] { return !queue->jobs.empty() || queue->finished; });
+    if (queue->jobs.empty()) {
+      return;
+    }
+    ImageEncodeJob job = queue->jobs.front();
+    queue->jobs.erase(queue->jobs.begin());
+
+    // Skip the work once something failed, the fd still has to be closed
+    if (queue->error != 0) {
+      close(job.fd);
+      queue->free_buffers.push_back(job.rgb);
+      queue->cond.notify_all();
+      continue;
+    }
+
+    lock.unlock();
+    const int ret = encode_image_job(*worker, job, in_w, in_h);
+    lock.lock();
+
+    if (ret != 0 && queue->error == 0) {
+      queue->error = ret;
+    }
+    queue->done++;
+    queue->free_buffers.push_back(job.rgb);
+    queue->cond.notify_all();
+  }
+}
+
+} // namespace
+
 int export_image_sequence(mlvObject_t *video, const export_options_t &options,
                           const export_fd_provider_t &provider,
                           AVCodecID codec_id, AVPixelFormat dst_format,
@@ -106,66 +307,56 @@ int export_image_sequence(mlvObject_t *video, const export_options_t &options,
   int dst_h = 0;
   compute_dimensions(options, src_w, src_h, dst_w, dst_h);
 
+  // Graded at output size already? Then sws only converts the pixel format
+  const bool prescale =
+      resize_before_grading(options, src_w, src_h, dst_w, dst_h);
+  const int in_w = prescale ? dst_w : src_w;
+  const int in_h = prescale ? dst_h : src_h;
+
   const int scale_flags = select_scale_flags(options.resize_algorithm);
-  SwsContext *sws_ctx =
-      sws_getContext(src_w, src_h, AV_PIX_FMT_RGB48LE, dst_w, dst_h, dst_format,
-                     scale_flags, nullptr, nullptr, nullptr);
-  if (!sws_ctx) {
-    LOGE(LOG_TAG, "sws context is null.");
-    return -1;
-  }
-  // Set correct RGB→YUV matrix based on processing gamut
   auto img_tags = resolve_color_tags(options.color_grading.gamut,
                                      options.color_grading.tonemap,
                                      options.color_grading.transfer_function);
-  apply_sws_color_matrix(sws_ctx, img_tags);
 
   // Find encoder once for all frames
   const AVCodec *codec = avcodec_find_encoder(codec_id);
   if (!codec) {
     LOGE(LOG_TAG, "Failed to find encoder for codec_id=%d", codec_id);
-    sws_freeContext(sws_ctx);
     return -1;
   }
 
-  AVCodecContext *codec_ctx = avcodec_alloc_context3(codec);
-  if (!codec_ctx) {
-    sws_freeContext(sws_ctx);
-    return -1;
+  // PNG / JPEG 2000 encoding is much slower than processing, so frames are
+  // processed in order here and encoded by several workers at once. Every
+  // worker holds a frame in flight, which bounds the memory use.
+  const int cores = getMlvCpuCores(video);
+  const int worker_count =
+      std::max(1, std::min(cores, MAX_IMAGE_ENCODE_WORKERS));
+  const int sws_threads = std::max(1, cores / worker_count);
+
+  std::vector<ImageEncodeWorker> workers(worker_count);
+  for (auto &worker : workers) {
+    if (!init_image_encode_worker(worker, codec, codec_id, dst_format, in_w,
+                                  in_h, dst_w, dst_h, scale_flags,
+                                  sws_threads, img_tags)) {
+      for (auto &w : workers) {
+        free_image_encode_worker(w);
+      }
+      return -1;
+    }
   }
 
-  codec_ctx->codec_id = codec_id;
-  codec_ctx->pix_fmt = dst_format;
-  codec_ctx->width = dst_w;
-  codec_ctx->height = dst_h;
-  codec_ctx->time_base = AVRational{1, 25};
-  codec_ctx->framerate = AVRational{25, 1};
-
-  if (avcodec_open2(codec_ctx, codec, nullptr) < 0) {
-    LOGE(LOG_TAG, "Failed to open encoder for codec_id=%d", codec_id);
-    avcodec_free_context(&codec_ctx);
-    sws_freeContext(sws_ctx);
-    return -1;
+  ImageEncodeQueue queue;
+  std::vector<std::vector<uint16_t>> buffers(
+      worker_count, std::vector<uint16_t>(static_cast<size_t>(in_w) * in_h * 3));
+  for (auto &buffer : buffers) {
+    queue.free_buffers.push_back(&buffer);
   }
 
-  AVFrame *frame = av_frame_alloc();
-  if (!frame) {
-    avcodec_free_context(&codec_ctx);
-    sws_freeContext(sws_ctx);
-    return -1;
-  }
-  frame->format = dst_format;
-  frame->width = dst_w;
-  frame->height = dst_h;
-  if (av_frame_get_buffer(frame, 0) < 0) {
-    LOGE(LOG_TAG, "failed to get a image buffer.");
-    av_frame_free(&frame);
-    avcodec_free_context(&codec_ctx);
-    sws_freeContext(sws_ctx);
-    return -1;
+  std::vector<std::thread> threads;
+  for (auto &worker : workers) {
+    threads.emplace_back(image_encode_worker_loop, &worker, &queue, in_w, in_h);
   }
 
-  std::vector<uint16_t> src_buffer(static_cast<size_t>(src_w) * src_h * 3);
   const int total_frames = getMlvFrames(video);
 
   // Resolve cut range
@@ -174,16 +365,14 @@ int export_image_sequence(mlvObject_t *video, const export_options_t &options,
   const uint32_t framesToExport = endFrame - startFrame;
 
   int ret = 0;
+  uint32_t reported = 0;
 
-  // Allocate packet once for the whole sequence
-  AVPacket *pkt = av_packet_alloc();
-  if (!pkt) {
-    LOGE(LOG_TAG, "Failed to allocate packet");
-    av_frame_free(&frame);
-    avcodec_free_context(&codec_ctx);
-    sws_freeContext(sws_ctx);
-    return -1;
-  }
+  auto report_progress = [&](uint32_t done) {
+    if (progress_callback && done != reported) {
+      reported = done;
+      progress_callback(static_cast<int>(done * 100.0f / framesToExport));
+    }
+  };
 
   for (uint32_t i = startFrame; i < endFrame; ++i) {
     if (is_export_cancelled()) {
@@ -191,6 +380,24 @@ int export_image_sequence(mlvObject_t *video, const export_options_t &options,
       break;
     }
 
+    // Wait for a free buffer, report what got finished meanwhile
+    std::vector<uint16_t> *rgb = nullptr;
+    uint32_t done = 0;
+    {
+      std::unique_lock<std::mutex> lock(queue.mutex);
+      queue.cond.wait(lock, [&] {
+        return !queue.free_buffers.empty() || queue.error != 0;
+      });
+      if (queue.error != 0) {
+        ret = queue.error;
+        break;
+      }
+      rgb = queue.free_buffers.back();
+      queue.free_buffers.pop_back();
+      done = queue.done;
+    }
+    report_progress(done);
+
     const uint32_t frame_number = getMlvFrameNumber(video, i);
     char relative_name[256];
     snprintf(relative_name, sizeof(relative_name), "%s_%06u%s",
@@ -201,70 +408,42 @@ int export_image_sequence(mlvObject_t *video, const export_options_t &options,
 
     if (fd < 0) {
       LOGE(LOG_TAG, "Failed to acquire frame fd for %s", relative_name);
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      queue.free_buffers.push_back(rgb);
       ret = -1;
       break;
     }
 
     // Process frame
-    getMlvProcessedFrame16(video, i, src_buffer.data(), getMlvCpuCores(video));
-    uint8_t *src_data[4] = {reinterpret_cast<uint8_t *>(src_buffer.data()),
-                            nullptr, nullptr, nullptr};
-    int src_linesize[4] = {src_w * 3 * static_cast<int>(sizeof(uint16_t)), 0, 0,
-                           0};
-
-    av_frame_make_writable(frame);
-    sws_scale(sws_ctx, src_data, src_linesize, 0, src_h, frame->data,
-              frame->linesize);
-    frame->pts = i - startFrame;
-
-    // Encode frame
-    int enc_ret = avcodec_send_frame(codec_ctx, frame);
-    if (enc_ret < 0) {
-      LOGE(LOG_TAG, "Failed to send frame %d to encoder", i);
-      close(fd);
-      ret = -1;
-      break;
-    }
-
-    while (true) {
-      enc_ret = avcodec_receive_packet(codec_ctx, pkt);
-      if (enc_ret == AVERROR(EAGAIN) || enc_ret == AVERROR_EOF) {
-        break;
-      }
-      if (enc_ret < 0) {
-        LOGE(LOG_TAG, "Failed to receive packet for frame %d", i);
-        ret = -1;
-        break;
-      }
+    get_export_frame(video, i, prescale, dst_w, dst_h, rgb->data());
 
-      // Write packet data directly to file descriptor (bypass muxer!)
-      ssize_t written = write(fd, pkt->data, pkt->size);
-      if (written != pkt->size) {
-        LOGE(LOG_TAG,
-             "Failed to write image data for frame %d: wrote %zd of %d bytes, "
-             "errno=%d (%s)",
-             i, written, pkt->size, errno, strerror(errno));
-        ret = -1;
-      }
-      av_packet_unref(pkt);
-      break; // For image codecs, there's only one packet per frame
+    {
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      queue.jobs.push_back(ImageEncodeJob{i, fd, rgb});
     }
+    queue.cond.notify_all();
+  }
 
-    close(fd);
-
-    if (ret != 0) {
-      break;
-    }
+  // Let the workers finish what is queued
+  {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.finished = true;
+  }
+  queue.cond.notify_all();
+  for (auto &thread : threads) {
+    thread.join();
+  }
 
-    if (progress_callback) {
-      progress_callback(static_cast<int>((i - startFrame + 1) * 100.0f / framesToExport));
-    }
+  if (ret == 0) {
+    ret = queue.error;
+  }
+  if (ret == 0) {
+    report_progress(queue.done);
   }
 
-  av_packet_free(&pkt);
-  av_frame_free(&frame);
-  avcodec_free_context(&codec_ctx);
-  sws_freeContext(sws_ctx);
+  for (auto &worker : workers) {
+    free_image_encode_worker(worker);
+  }
   return ret;
 }
 
@@ -294,6 +473,12 @@ int export_video_container(mlvObject_t *video, const export_options_t &options,
       ++dst_h;
   }
 
+  // Graded at output size already? Then sws only converts the pixel format
+  const bool prescale =
+      resize_before_grading(options, src_w, src_h, dst_w, dst_h);
+  const int in_w = prescale ? dst_w : src_w;
+  const int in_h = prescale ? dst_h : src_h;
+
   AVRational fps = select_fps(options, getMlvFramerate(video));
 
   const std::string output_name = options.source_base_name + preset.extension;
@@ -397,17 +582,22 @@ int export_video_container(mlvObject_t *video, const export_options_t &options,
 
   const int scale_flags = select_scale_flags(options.resize_algorithm);
   SwsContext *sws_ctx =
-      sws_getContext(src_w, src_h, AV_PIX_FMT_RGB48LE, dst_w, dst_h,
-                     actual_pix_fmt, scale_flags, nullptr, nullptr, nullptr);
+      create_export_sws_context(in_w, in_h, dst_w, dst_h, actual_pix_fmt,
+                                scale_flags, getMlvCpuCores(video));
 
   // Set correct RGB→YUV matrix based on processing gamut
+  const auto vid_tags = resolve_color_tags(options.color_grading.gamut,
+                                           options.color_grading.tonemap,
+                                           options.color_grading.transfer_function);
   if (sws_ctx) {
-    auto vid_tags = resolve_color_tags(options.color_grading.gamut,
-                                       options.color_grading.tonemap,
-                                       options.color_grading.transfer_function);
     apply_sws_color_matrix(sws_ctx, vid_tags);
   }
 
+  // Nothing to resize: write the encoder's planes directly instead of
+  // another full frame pass through swscale
+  const bool direct_yuv = in_w == dst_w && in_h == dst_h &&
+                          can_convert_rgb48_to_yuv(actual_pix_fmt);
+
   if (!sws_ctx) {
     ret = EXPORT_ERROR_GENERIC;
   }
@@ -446,7 +636,7 @@ int export_video_container(mlvObject_t *video, const export_options_t &options,
     return EXPORT_ERROR_INSUFFICIENT_MEMORY;
   }
 
-  std::vector<uint16_t> src_buffer(static_cast<size_t>(src_w) * src_h * 3);
+  std::vector<uint16_t> src_buffer(static_cast<size_t>(in_w) * in_h * 3);
   uint32_t frame_idx = startFrame;
   int64_t pts = 0;
 
@@ -456,21 +646,22 @@ int export_video_container(mlvObject_t *video, const export_options_t &options,
       break;
     }
 
-    getMlvProcessedFrame16(video, frame_idx, src_buffer.data(),
-                           getMlvCpuCores(video));
-    const uint8_t *src_data[4] = {
-        reinterpret_cast<const uint8_t *>(src_buffer.data()), nullptr, nullptr,
-        nullptr};
-    int src_linesize[4] = {src_w * 3 * static_cast<int>(sizeof(uint16_t)), 0, 0,
-                           0};
+    get_export_frame(video, frame_idx, prescale, dst_w, dst_h,
+                     src_buffer.data());
 
     if (av_frame_make_writable(frame) < 0) {
       ret = EXPORT_ERROR_FRAME_PROCESSING_FAILED;
       break;
     }
 
-    sws_scale(sws_ctx, src_data, src_linesize, 0, src_h, frame->data,
-              frame->linesize);
+    if (direct_yuv) {
+      convert_rgb48_to_yuv(src_buffer.data(), in_w, in_h, frame,
+                           vid_tags.sws_matrix, getMlvCpuCores(video));
+    } else if (export_sws_scale(sws_ctx, src_buffer.data(), in_w, in_h,
+                                frame) < 0) {
+      ret = EXPORT_ERROR_FRAME_PROCESSING_FAILED;
+      break;
+    }
     frame->pts = pts++;
 
     int enc_ret = avcodec_send_frame(codec_ctx, frame);
@@ -574,6 +765,12 @@ int export_video_container_batch(BatchExportContext &batch_ctx,
       ++dst_h;
   }
 
+  // Graded at output size already? Then sws only converts the pixel format
+  const bool prescale =
+      resize_before_grading(options, src_w, src_h, dst_w, dst_h);
+  const int in_w = prescale ? dst_w : src_w;
+  const int in_h = prescale ? dst_h : src_h;
+
   AVRational fps = select_fps(options, getMlvFramerate(video));
 
   const std::string output_name = options.source_base_name + preset.extension;
@@ -681,17 +878,22 @@ int export_video_container_batch(BatchExportContext &batch_ctx,
 
   const int scale_flags = select_scale_flags(options.resize_algorithm);
   SwsContext *sws_ctx =
-      sws_getContext(src_w, src_h, AV_PIX_FMT_RGB48LE, dst_w, dst_h,
-                     actual_pix_fmt, scale_flags, nullptr, nullptr, nullptr);
+      create_export_sws_context(in_w, in_h, dst_w, dst_h, actual_pix_fmt,
+                                scale_flags, getMlvCpuCores(video));
 
   // Set correct RGB→YUV matrix based on processing gamut
+  const auto batch_tags = resolve_color_tags(options.color_grading.gamut,
+                                             options.color_grading.tonemap,
+                                             options.color_grading.transfer_function);
   if (sws_ctx) {
-    auto batch_tags = resolve_color_tags(options.color_grading.gamut,
-                                         options.color_grading.tonemap,
-                                         options.color_grading.transfer_function);
     apply_sws_color_matrix(sws_ctx, batch_tags);
   }
 
+  // Nothing to resize: write the encoder's planes directly instead of
+  // another full frame pass through swscale
+  const bool direct_yuv = in_w == dst_w && in_h == dst_h &&
+                          can_convert_rgb48_to_yuv(actual_pix_fmt);
+
   if (!sws_ctx) {
     ret = EXPORT_ERROR_GENERIC;
   }
@@ -729,7 +931,7 @@ int export_video_container_batch(BatchExportContext &batch_ctx,
     return EXPORT_ERROR_INSUFFICIENT_MEMORY;
   }
 
-  std::vector<uint16_t> src_buffer(static_cast<size_t>(src_w) * src_h * 3);
+  std::vector<uint16_t> src_buffer(static_cast<size_t>(in_w) * in_h * 3);
   uint32_t frame_idx = startFrame;
   int64_t pts = 0;
 
@@ -739,21 +941,22 @@ int export_video_container_batch(BatchExportContext &batch_ctx,
       break;
     }
 
-    getMlvProcessedFrame16(video, frame_idx, src_buffer.data(),
-                           getMlvCpuCores(video));
-    const uint8_t *src_data[4] = {
-        reinterpret_cast<const uint8_t *>(src_buffer.data()), nullptr, nullptr,
-        nullptr};
-    int src_linesize[4] = {src_w * 3 * static_cast<int>(sizeof(uint16_t)), 0, 0,
-                           0};
+    get_export_frame(video, frame_idx, prescale, dst_w, dst_h,
+                     src_buffer.data());
 
     if (av_frame_make_writable(frame) < 0) {
       ret = EXPORT_ERROR_FRAME_PROCESSING_FAILED;
       break;
     }
 
-    sws_scale(sws_ctx, src_data, src_linesize, 0, src_h, frame->data,
-              frame->linesize);
+    if (direct_yuv) {
+      convert_rgb48_to_yuv(src_buffer.data(), in_w, in_h, frame,
+                           batch_tags.sws_matrix, getMlvCpuCores(video));
+    } else if (export_sws_scale(sws_ctx, src_buffer.data(), in_w, in_h,
+                                frame) < 0) {
+      ret = EXPORT_ERROR_FRAME_PROCESSING_FAILED;
+      break;
+    }
     frame->pts = pts++;
 
     int enc_ret = avcodec_send_frame(codec_ctx, frame);
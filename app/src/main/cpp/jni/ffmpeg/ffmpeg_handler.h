@@ -48,7 +48,7 @@ struct FdIoContext {
 std::unique_ptr<FdIoContext> make_fd_io(int fd);
 void free_fd_io(std::unique_ptr<FdIoContext> &io);
 
-// Image sequence export (TIFF/PNG)
+// Image sequence export (TIFF/PNG/JPEG 2000), frames are encoded in parallel
 int export_image_sequence(mlvObject_t *video, const export_options_t &options,
                           const export_fd_provider_t &provider,
                           AVCodecID codec_id, AVPixelFormat dst_format,
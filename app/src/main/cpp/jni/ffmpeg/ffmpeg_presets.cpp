@@ -178,6 +178,16 @@ void compute_dimensions(const export_options_t &options, int src_width,
   }
 }
 
+bool resize_before_grading(const export_options_t &options, int src_width,
+                           int src_height, int width, int height) {
+  // Matches ScalingAlgorithm.LANCZOS, other algorithms stay with swscale
+  if (options.resize_algorithm != 3) {
+    return false;
+  }
+  return static_cast<int64_t>(width) * height <
+         static_cast<int64_t>(src_width) * src_height;
+}
+
 int select_scale_flags(int algorithmOrdinal) {
   switch (algorithmOrdinal) {
   case 1:
@@ -61,4 +61,9 @@ int select_scale_flags(int algorithmOrdinal);
 void compute_dimensions(const export_options_t &options, int src_width,
                         int src_height, int &width, int &height);
 
+// Lanczos exports smaller than the clip are resized before grading (lancir),
+// so grading only runs on the output pixels
+bool resize_before_grading(const export_options_t &options, int src_width,
+                           int src_height, int width, int height);
+
 #endif // MLVAPP_FFMPEG_PRESETS_H
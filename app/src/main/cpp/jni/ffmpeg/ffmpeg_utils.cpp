@@ -3,6 +3,7 @@
 #include "../ffmpeg/ffmpeg_color_tags.h"
 #include "../utils.h"
 #include <algorithm>
+#include <chrono>
 #include <jni.h>
 #include <string>
 #include <vector>
@@ -327,3 +328,104 @@ Java_fm_magiclantern_forum_nativeInterface_NativeLib_testEncoderConfiguration(
     export_options_t options = parse_export_options(env, exportOptions);
     return test_encoder_configuration(options);
 }
+
+SwsContext *create_export_sws_context(int src_w, int src_h, int dst_w,
+                                      int dst_h, AVPixelFormat dst_format,
+                                      int flags, int threads) {
+  SwsContext *sws_ctx = sws_alloc_context();
+  if (!sws_ctx) {
+    return nullptr;
+  }
+
+  av_opt_set_int(sws_ctx, "srcw", src_w, 0);
+  av_opt_set_int(sws_ctx, "srch", src_h, 0);
+  av_opt_set_int(sws_ctx, "src_format", AV_PIX_FMT_RGB48LE, 0);
+  av_opt_set_int(sws_ctx, "dstw", dst_w, 0);
+  av_opt_set_int(sws_ctx, "dsth", dst_h, 0);
+  av_opt_set_int(sws_ctx, "dst_format", dst_format, 0);
+  av_opt_set_int(sws_ctx, "sws_flags", flags, 0);
+  // Slice threads only kick in through sws_scale_frame
+  av_opt_set_int(sws_ctx, "threads", std::max(1, threads), 0);
+
+  if (sws_init_context(sws_ctx, nullptr, nullptr) < 0) {
+    LOGE(LOG_TAG, "sws_init_context failed (%dx%d -> %dx%d, format %d)",
+         src_w, src_h, dst_w, dst_h, dst_format);
+    sws_freeContext(sws_ctx);
+    return nullptr;
+  }
+  return sws_ctx;
+}
+
+int export_sws_scale(SwsContext *sws_ctx, const uint16_t *rgb, int width,
+                     int height, AVFrame *frame) {
+  AVFrame *src = av_frame_alloc();
+  if (!src) {
+    return AVERROR(ENOMEM);
+  }
+  src->format = AV_PIX_FMT_RGB48LE;
+  src->width = width;
+  src->height = height;
+  src->data[0] = reinterpret_cast<uint8_t *>(const_cast<uint16_t *>(rgb));
+  src->linesize[0] = width * 3 * static_cast<int>(sizeof(uint16_t));
+
+  int ret = sws_scale_frame(sws_ctx, frame, src);
+  if (ret < 0) {
+    char errbuf[AV_ERROR_MAX_STRING_SIZE];
+    av_strerror(ret, errbuf, sizeof(errbuf));
+    LOGE(LOG_TAG, "sws_scale_frame failed: %s", errbuf);
+  }
+
+  // Buffer is not ours, just drop the wrapper
+  av_frame_free(&src);
+  return ret;
+}
+
+// Times export_sws_scale on a width x height RGB48 frame scaled to
+// dst_w x dst_h with the given number of slice threads, returns the average
+// nanoseconds per frame or -1 if swscale could not be set up
+extern "C" JNIEXPORT jlong JNICALL
+Java_fm_magiclantern_forum_nativeInterface_NativeLib_benchmarkSwscale(
+        JNIEnv *env, jobject /* thiz */, jstring pixelFormat, jint width,
+        jint height, jint dstWidth, jint dstHeight, jint threads, jint frames) {
+
+  const char *name = env->GetStringUTFChars(pixelFormat, nullptr);
+  const AVPixelFormat format = av_get_pix_fmt(name);
+  env->ReleaseStringUTFChars(pixelFormat, name);
+  if (format == AV_PIX_FMT_NONE || width <= 0 || height <= 0 || frames <= 0) {
+    return -1;
+  }
+
+  std::vector<uint16_t> rgb(static_cast<size_t>(width) * height * 3);
+  for (size_t i = 0; i < rgb.size(); ++i) {
+    rgb[i] = static_cast<uint16_t>(i * 2654435761u >> 16);
+  }
+
+  SwsContext *sws_ctx = create_export_sws_context(
+      width, height, dstWidth, dstHeight, format, SWS_BICUBIC, threads);
+  AVFrame *frame = av_frame_alloc();
+  jlong result = -1;
+  if (sws_ctx && frame) {
+    frame->format = format;
+    frame->width = dstWidth;
+    frame->height = dstHeight;
+    if (av_frame_get_buffer(frame, 0) >= 0) {
+      // First frame sets up the slice threads, not timed
+      int ret = export_sws_scale(sws_ctx, rgb.data(), width, height, frame);
+      const auto start = std::chrono::steady_clock::now();
+      for (int i = 0; i < frames && ret >= 0; ++i) {
+        ret = export_sws_scale(sws_ctx, rgb.data(), width, height, frame);
+      }
+      const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now() - start).count();
+      if (ret >= 0) {
+        result = ns / frames;
+      }
+    }
+  }
+
+  av_frame_free(&frame);
+  if (sws_ctx) {
+    sws_freeContext(sws_ctx);
+  }
+  return result;
+}
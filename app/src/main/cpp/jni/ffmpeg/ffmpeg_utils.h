@@ -7,6 +7,7 @@
 extern "C" {
 #include "libavcodec/avcodec.h"
 #include "libavformat/avformat.h"
+#include "libswscale/swscale.h"
 }
 
 // Try to open encoder with fallback
@@ -21,6 +22,16 @@ AVCodecContext *try_open_encoder_with_fallback(const VideoPreset &preset,
                                                int tonemap = 0,
                                                const std::string& transfer_function = "");
 
+// swscale context for RGB48LE -> dst_format exports. With threads > 1
+// libswscale splits every frame into slices on its own worker threads.
+SwsContext *create_export_sws_context(int src_w, int src_h, int dst_w,
+                                      int dst_h, AVPixelFormat dst_format,
+                                      int flags, int threads);
+
+// Converts a packed RGB48 buffer (width x height) into frame
+int export_sws_scale(SwsContext *sws_ctx, const uint16_t *rgb, int width,
+                     int height, AVFrame *frame);
+
 // Test encoder configuration for diagnostics
 // Force enables hardware flags to test initialization
 bool test_encoder_configuration(const export_options_t &options);
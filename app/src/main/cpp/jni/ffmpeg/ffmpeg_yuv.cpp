@@ -0,0 +1,343 @@
+//
+// Direct RGB48 -> YUV conversion for the encoder input.
+//
+
+#include "ffmpeg_yuv.h"
+#include "ffmpeg_color_tags.h"
+#include "ffmpeg_utils.h"
+#include "../utils.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <jni.h>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include "libavutil/pixdesc.h"
+#include "libswscale/swscale.h"
+}
+
+static const char *LOG_TAG = "FFmpegYuv";
+
+namespace {
+
+struct yuv_layout_t {
+  int depth;        // Bits per component
+  int shift_x;      // Chroma subsampling (log2)
+  int shift_y;
+  bool semi_planar; // NV12 / P010: interleaved UV plane
+  int msb_shift;    // P010 keeps its 10 bits at the top of 16
+};
+
+bool get_layout(AVPixelFormat format, yuv_layout_t &layout) {
+  switch (format) {
+  case AV_PIX_FMT_YUV420P:
+    layout = {8, 1, 1, false, 0};
+    return true;
+  case AV_PIX_FMT_YUV422P:
+    layout = {8, 1, 0, false, 0};
+    return true;
+  case AV_PIX_FMT_YUV444P:
+    layout = {8, 0, 0, false, 0};
+    return true;
+  case AV_PIX_FMT_NV12:
+    layout = {8, 1, 1, true, 0};
+    return true;
+  case AV_PIX_FMT_YUV420P10LE:
+    layout = {10, 1, 1, false, 0};
+    return true;
+  case AV_PIX_FMT_YUV422P10LE:
+    layout = {10, 1, 0, false, 0};
+    return true;
+  case AV_PIX_FMT_YUV444P10LE:
+    layout = {10, 0, 0, false, 0};
+    return true;
+  case AV_PIX_FMT_P010LE:
+    layout = {10, 1, 1, true, 6};
+    return true;
+  default:
+    return false;
+  }
+}
+
+// Luma weights of the YCbCr matrices swscale knows about
+void get_weights(int sws_matrix, float &kr, float &kb) {
+  switch (sws_matrix) {
+  case SWS_CS_ITU709:
+    kr = 0.2126f;
+    kb = 0.0722f;
+    break;
+  case SWS_CS_BT2020:
+    kr = 0.2627f;
+    kb = 0.0593f;
+    break;
+  case SWS_CS_FCC:
+    kr = 0.30f;
+    kb = 0.11f;
+    break;
+  case SWS_CS_SMPTE240M:
+    kr = 0.212f;
+    kb = 0.087f;
+    break;
+  default: // SWS_CS_ITU601 / DEFAULT
+    kr = 0.299f;
+    kb = 0.114f;
+    break;
+  }
+}
+
+struct yuv_coeffs_t {
+  float yr, yg, yb, y_off;
+  float ur, ug, ub;
+  float vr, vg, vb;
+  float c_off;
+  float max;
+};
+
+yuv_coeffs_t make_coeffs(const yuv_layout_t &layout, int sws_matrix) {
+  float kr, kb;
+  get_weights(sws_matrix, kr, kb);
+  const float kg = 1.0f - kr - kb;
+
+  // Limited range: Y 16..235, C 16..240 (scaled to depth), input 0..65535
+  const float scale = static_cast<float>(1 << (layout.depth - 8));
+  const float y_range = 219.0f * scale / 65535.0f;
+  const float c_range = 224.0f * scale / 65535.0f;
+
+  yuv_coeffs_t c{};
+  c.yr = kr * y_range;
+  c.yg = kg * y_range;
+  c.yb = kb * y_range;
+  c.y_off = 16.0f * scale + 0.5f;
+
+  // Cb = (B - Y) / (2 * (1 - kb)), Cr = (R - Y) / (2 * (1 - kr))
+  const float cb = c_range / (2.0f * (1.0f - kb));
+  const float cr = c_range / (2.0f * (1.0f - kr));
+  c.ur = -kr * cb;
+  c.ug = -kg * cb;
+  c.ub = (1.0f - kb) * cb;
+  c.vr = (1.0f - kr) * cr;
+  c.vg = -kg * cr;
+  c.vb = -kb * cr;
+  c.c_off = 128.0f * scale + 0.5f;
+
+  c.max = static_cast<float>((1 << layout.depth) - 1);
+  return c;
+}
+
+template <typename T>
+inline T clamp_code(float value, float max, int msb_shift) {
+  value = std::min(std::max(value, 0.0f), max);
+  return static_cast<T>(static_cast<int>(value) << msb_shift);
+}
+
+// Converts chroma rows [c_row0, c_row1) and the luma rows they cover
+template <typename T>
+void convert_rows(const uint16_t *rgb, int width, int height, AVFrame *frame,
+                  const yuv_layout_t &layout, const yuv_coeffs_t &c,
+                  int c_row0, int c_row1) {
+  const int cw = (width + (1 << layout.shift_x) - 1) >> layout.shift_x;
+  const int sx = 1 << layout.shift_x;
+  const int sy = 1 << layout.shift_y;
+
+  for (int cy = c_row0; cy < c_row1; ++cy) {
+    const int y0 = cy * sy;
+    const int y1 = std::min(y0 + sy, height);
+
+    // Luma
+    for (int y = y0; y < y1; ++y) {
+      const uint16_t *in = rgb + static_cast<size_t>(y) * width * 3;
+      T *out = reinterpret_cast<T *>(frame->data[0] + y * frame->linesize[0]);
+      for (int x = 0; x < width; ++x) {
+        const float r = in[x * 3 + 0];
+        const float g = in[x * 3 + 1];
+        const float b = in[x * 3 + 2];
+        out[x] = clamp_code<T>(c.yr * r + c.yg * g + c.yb * b + c.y_off, c.max,
+                               layout.msb_shift);
+      }
+    }
+
+    // Chroma, averaged over the block
+    T *out_u = reinterpret_cast<T *>(frame->data[1] + cy * frame->linesize[1]);
+    T *out_v = layout.semi_planar
+                   ? out_u + 1
+                   : reinterpret_cast<T *>(frame->data[2] +
+                                           cy * frame->linesize[2]);
+    const int step = layout.semi_planar ? 2 : 1;
+
+    for (int cx = 0; cx < cw; ++cx) {
+      const int x0 = cx * sx;
+      const int x1 = std::min(x0 + sx, width);
+      float r = 0.0f, g = 0.0f, b = 0.0f;
+      for (int y = y0; y < y1; ++y) {
+        const uint16_t *in = rgb + (static_cast<size_t>(y) * width + x0) * 3;
+        for (int x = x0; x < x1; ++x, in += 3) {
+          r += in[0];
+          g += in[1];
+          b += in[2];
+        }
+      }
+      const float n = 1.0f / static_cast<float>((x1 - x0) * (y1 - y0));
+      r *= n;
+      g *= n;
+      b *= n;
+      out_u[cx * step] = clamp_code<T>(c.ur * r + c.ug * g + c.ub * b + c.c_off,
+                                       c.max, layout.msb_shift);
+      out_v[cx * step] = clamp_code<T>(c.vr * r + c.vg * g + c.vb * b + c.c_off,
+                                       c.max, layout.msb_shift);
+    }
+  }
+}
+
+} // namespace
+
+bool can_convert_rgb48_to_yuv(AVPixelFormat format) {
+  yuv_layout_t layout{};
+  return get_layout(format, layout);
+}
+
+void convert_rgb48_to_yuv(const uint16_t *rgb, int width, int height,
+                          AVFrame *frame, int sws_matrix, int threads) {
+  yuv_layout_t layout{};
+  if (!get_layout(static_cast<AVPixelFormat>(frame->format), layout)) {
+    return;
+  }
+  const yuv_coeffs_t coeffs = make_coeffs(layout, sws_matrix);
+
+  // Split by chroma rows so no two threads touch the same chroma line
+  const int c_rows = (height + (1 << layout.shift_y) - 1) >> layout.shift_y;
+  threads = std::max(1, std::min(threads, c_rows));
+  const int chunk = c_rows / threads;
+
+  auto run = [&](int t) {
+    const int row0 = chunk * t;
+    const int row1 = (t == threads - 1) ? c_rows : row0 + chunk;
+    if (layout.depth > 8) {
+      convert_rows<uint16_t>(rgb, width, height, frame, layout, coeffs, row0,
+                             row1);
+    } else {
+      convert_rows<uint8_t>(rgb, width, height, frame, layout, coeffs, row0,
+                            row1);
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (int t = 1; t < threads; ++t) {
+    workers.emplace_back(run, t);
+  }
+  run(0);
+  for (auto &worker : workers) {
+    worker.join();
+  }
+}
+
+namespace {
+
+// Test frames for the swscale comparison: 0 = smooth gradients, 1 = noise
+std::vector<uint16_t> make_test_rgb(int width, int height, int pattern) {
+  std::vector<uint16_t> rgb(static_cast<size_t>(width) * height * 3);
+  uint32_t seed = 12345;
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      uint16_t *px = &rgb[(static_cast<size_t>(y) * width + x) * 3];
+      if (pattern == 0) {
+        px[0] = static_cast<uint16_t>(65535LL * x / std::max(1, width - 1));
+        px[1] = static_cast<uint16_t>(65535LL * y / std::max(1, height - 1));
+        px[2] = static_cast<uint16_t>(65535LL * (x + y) /
+                                      std::max(1, width + height - 2));
+      } else {
+        for (int c = 0; c < 3; ++c) {
+          seed = seed * 1664525u + 1013904223u;
+          px[c] = static_cast<uint16_t>(seed >> 16);
+        }
+      }
+    }
+  }
+  return rgb;
+}
+
+int read_component(const AVFrame *frame, const AVPixFmtDescriptor *desc,
+                   int c, int x, int y) {
+  const AVComponentDescriptor &comp = desc->comp[c];
+  const uint8_t *p = frame->data[comp.plane] + y * frame->linesize[comp.plane] +
+                     x * comp.step + comp.offset;
+  const int value = comp.depth > 8 ? *reinterpret_cast<const uint16_t *>(p) : *p;
+  return (value >> comp.shift) & ((1 << comp.depth) - 1);
+}
+
+AVFrame *alloc_test_frame(AVPixelFormat format, int width, int height) {
+  AVFrame *frame = av_frame_alloc();
+  if (!frame) {
+    return nullptr;
+  }
+  frame->format = format;
+  frame->width = width;
+  frame->height = height;
+  if (av_frame_get_buffer(frame, 0) < 0) {
+    av_frame_free(&frame);
+  }
+  return frame;
+}
+
+} // namespace
+
+// Converts a test frame with convert_rgb48_to_yuv and with swscale (default
+// bicubic, the export's color matrix setup) and returns the largest luma and
+// chroma differences in codes, or null if the format can't be compared
+extern "C" JNIEXPORT jintArray JNICALL
+Java_fm_magiclantern_forum_nativeInterface_NativeLib_compareYuvWithSwscale(
+    JNIEnv *env, jobject /* thiz */, jstring pixelFormat, jint swsMatrix,
+    jint width, jint height, jint pattern) {
+
+  const char *name = env->GetStringUTFChars(pixelFormat, nullptr);
+  const AVPixelFormat format = av_get_pix_fmt(name);
+  env->ReleaseStringUTFChars(pixelFormat, name);
+  if (!can_convert_rgb48_to_yuv(format) || width <= 0 || height <= 0) {
+    return nullptr;
+  }
+
+  const std::vector<uint16_t> rgb = make_test_rgb(width, height, pattern);
+  AVFrame *direct = alloc_test_frame(format, width, height);
+  AVFrame *scaled = alloc_test_frame(format, width, height);
+  SwsContext *sws_ctx = create_export_sws_context(width, height, width, height,
+                                                  format, SWS_BICUBIC, 1);
+  jintArray result = nullptr;
+
+  if (direct && scaled && sws_ctx) {
+    ffmpeg_color_tags_t tags{};
+    tags.sws_matrix = swsMatrix;
+    apply_sws_color_matrix(sws_ctx, tags);
+
+    convert_rgb48_to_yuv(rgb.data(), width, height, direct, swsMatrix,
+                         static_cast<int>(std::thread::hardware_concurrency()));
+    if (export_sws_scale(sws_ctx, rgb.data(), width, height, scaled) >= 0) {
+      const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(format);
+      jint diff[2] = {0, 0};
+      for (int c = 0; c < 3; ++c) {
+        const int cw = c ? AV_CEIL_RSHIFT(width, desc->log2_chroma_w) : width;
+        const int ch = c ? AV_CEIL_RSHIFT(height, desc->log2_chroma_h) : height;
+        for (int y = 0; y < ch; ++y) {
+          for (int x = 0; x < cw; ++x) {
+            const int d = std::abs(read_component(direct, desc, c, x, y) -
+                                   read_component(scaled, desc, c, x, y));
+            diff[c ? 1 : 0] = std::max(diff[c ? 1 : 0], d);
+          }
+        }
+      }
+      LOGI(LOG_TAG, "%s matrix %d pattern %d: luma %d, chroma %d codes off swscale",
+           av_get_pix_fmt_name(format), swsMatrix, pattern, diff[0], diff[1]);
+      result = env->NewIntArray(2);
+      if (result) {
+        env->SetIntArrayRegion(result, 0, 2, diff);
+      }
+    }
+  }
+
+  if (sws_ctx) {
+    sws_freeContext(sws_ctx);
+  }
+  av_frame_free(&direct);
+  av_frame_free(&scaled);
+  return result;
+}
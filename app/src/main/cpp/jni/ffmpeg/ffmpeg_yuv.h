@@ -0,0 +1,34 @@
+//
+// Direct RGB48 -> YUV conversion for the encoder input.
+//
+// The processed frame is already at output size most of the time (no resize,
+// or resized before grading), in which case swscale only converts the pixel
+// format. This writes the AVFrame planes straight from the RGB48 buffer with
+// the same limited range matrices apply_sws_color_matrix asks swscale for.
+//
+
+#ifndef MLVAPP_FFMPEG_YUV_H
+#define MLVAPP_FFMPEG_YUV_H
+
+#include <cstdint>
+
+extern "C" {
+#include "libavutil/frame.h"
+#include "libavutil/pixfmt.h"
+}
+
+// True if convert_rgb48_to_yuv can write this pixel format
+bool can_convert_rgb48_to_yuv(AVPixelFormat format);
+
+// Converts full range RGB48 (width x height, same size as frame) to limited
+// range YUV in frame. sws_matrix is ffmpeg_color_tags_t::sws_matrix.
+// Chroma is the box average of the pixels it covers, so it is sited at the
+// centre of its 2x1 or 2x2 block. That is where swscale puts it by default too
+// (dst_h/v_chr_pos unset) and horizontally swscale averages pixel pairs just
+// the same. Vertically swscale runs the resize filter (bicubic by default)
+// over about 4 rows instead of averaging 2, so on sharp horizontal edges the
+// chroma differs by a few codes. Neither tags a chroma location in the stream.
+void convert_rgb48_to_yuv(const uint16_t *rgb, int width, int height,
+                          AVFrame *frame, int sws_matrix, int threads);
+
+#endif // MLVAPP_FFMPEG_YUV_H
@@ -99,6 +99,26 @@ Java_fm_magiclantern_forum_nativeInterface_RawCorrectionNative_setDarkFrameMode(
     resetMlvCachedFrame(video);
 }
 
+/**
+ * Set how the dark frame clip is stacked
+ * JNI: setDarkFrameStackMethod(J, I)V
+ */
+extern "C" JNIEXPORT void JNICALL
+Java_fm_magiclantern_forum_nativeInterface_RawCorrectionNative_setDarkFrameStackMethod(
+        JNIEnv *env, jobject /* this */, jlong handle, jint method) {
+
+    mlvObject_t *video = getMlvObjectFromHandle(handle);
+    if (!video || !video->llrawproc) {
+        LOGE(RAW_TAG, "setDarkFrameStackMethod: Invalid MLV object or llrawproc");
+        return;
+    }
+
+    // Method: 0=Average, 1=Median
+    llrpSetDarkFrameStackMethod(video, method);
+    resetMlvCache(video);
+    resetMlvCachedFrame(video);
+}
+
 /**
  * Set focus dots fix mode
  * JNI: setFocusDotsMode(J, I, I)V
@@ -185,7 +205,7 @@ Java_fm_magiclantern_forum_nativeInterface_RawCorrectionNative_setVerticalStripe
         return;
     }
 
-    // Mode: 0=Off, 1=Normal, 2=Force
+    // Mode: 0=Off, 1=Normal, 2=Force, 3=Clip (measured over the clip in the background)
     llrpSetVerticalStripeMode(video, mode);
     resetMlvCache(video);
     resetMlvCachedFrame(video);
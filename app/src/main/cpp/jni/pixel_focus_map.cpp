@@ -79,6 +79,52 @@ Java_fm_magiclantern_forum_nativeInterface_NativeLib_refreshFocusPixelMap(
     resetMlvCachedFrame(nativeClip);
 }
 
+JNIEXPORT void JNICALL
+Java_fm_magiclantern_forum_nativeInterface_NativeLib_setPixelMapDirectory(
+        JNIEnv *env, jobject /* this */, jstring directory) {
+    if (directory == nullptr) {
+        llrpSetPixelMapDirectory(nullptr);
+        return;
+    }
+    const char *path = env->GetStringUTFChars(directory, nullptr);
+    llrpSetPixelMapDirectory(path);
+    env->ReleaseStringUTFChars(directory, path);
+}
+
+JNIEXPORT void JNICALL
+Java_fm_magiclantern_forum_nativeInterface_NativeLib_setFocusPixelMapFd(
+        JNIEnv *env, jobject /* this */, jlong handle, jint fd) {
+    if (handle == 0) {
+        return;
+    }
+    auto *wrapper = reinterpret_cast<JniClipWrapper *>(static_cast<uintptr_t>(handle));
+    if (!wrapper || !wrapper->mlv_object) {
+        return;
+    }
+    auto *nativeClip = wrapper->mlv_object;
+
+    llrpSetFocusPixelMapFd(nativeClip, fd);
+    resetMlvCache(nativeClip);
+    resetMlvCachedFrame(nativeClip);
+}
+
+JNIEXPORT void JNICALL
+Java_fm_magiclantern_forum_nativeInterface_NativeLib_setBadPixelMapFd(
+        JNIEnv *env, jobject /* this */, jlong handle, jint fd) {
+    if (handle == 0) {
+        return;
+    }
+    auto *wrapper = reinterpret_cast<JniClipWrapper *>(static_cast<uintptr_t>(handle));
+    if (!wrapper || !wrapper->mlv_object) {
+        return;
+    }
+    auto *nativeClip = wrapper->mlv_object;
+
+    llrpSetBadPixelMapFd(nativeClip, fd);
+    resetMlvCache(nativeClip);
+    resetMlvCachedFrame(nativeClip);
+}
+
 JNIEXPORT void JNICALL
 Java_fm_magiclantern_forum_nativeInterface_NativeLib_setFocusPixelMode(
         JNIEnv *env, jobject /* this */, jlong handle, jint mode) {
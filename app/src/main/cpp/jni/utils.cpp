@@ -11,4 +11,16 @@ Java_fm_magiclantern_forum_nativeInterface_NativeLib_setBaseDir(
   const char *path = env->GetStringUTFChars(baseDir, nullptr);
   chdir(path);
 }
+
+JNIEXPORT void JNICALL
+Java_fm_magiclantern_forum_nativeInterface_NativeLib_setDarkFrameMasterDirectory(
+    JNIEnv *env, jobject /* this */, jstring directory) {
+  if (directory == nullptr) {
+    llrpSetDarkFrameMasterDirectory(nullptr);
+    return;
+  }
+  const char *path = env->GetStringUTFChars(directory, nullptr);
+  llrpSetDarkFrameMasterDirectory(path);
+  env->ReleaseStringUTFChars(directory, path);
+}
 }
\ No newline at end of file
@@ -429,3 +429,33 @@ void debayerLibRtProcess(uint16_t *debayerto, float *bayerdata, int width, int h
     free(blue2d);
     free(imagefloat2d);
 }
+
+/* Not really a debayer, just takes each quad as it is:
+ *
+ * R  G
+ * G  B
+ *
+ * No interpolation, so no fringes either, perfect for a preview at half size */
+void debayerSuperpixel(uint16_t * __restrict debayerto, uint16_t * __restrict bayerdata, int width, int height, int shift)
+{
+    int out_width = width / 2;
+    int out_height = height / 2;
+
+    for (int y = 0; y < out_height; ++y)
+    {
+        uint16_t * row0 = bayerdata + (y * 2) * width;
+        uint16_t * row1 = row0 + width;
+        uint16_t * out = debayerto + y * out_width * 3;
+
+        for (int x = 0; x < out_width; ++x)
+        {
+            uint32_t r = row0[x*2] << shift;
+            uint32_t g = ((uint32_t)row0[x*2+1] + row1[x*2]) << shift;
+            uint32_t b = row1[x*2+1] << shift;
+            out[0] = LIMIT16(r);
+            out[1] = LIMIT16(g >> 1);
+            out[2] = LIMIT16(b);
+            out += 3;
+        }
+    }
+}
@@ -13,6 +13,8 @@ void debayerAmaze(uint16_t * __restrict debayerto, float * __restrict bayerdata,
 void debayerLibRtProcess(uint16_t *__restrict debayerto, float *__restrict bayerdata, int width, int height, int algorithm, double camMatrix[9]);
 /* AHD debayer */
 void debayerAhd(uint16_t *__restrict debayerto, float *__restrict bayerdata, int width, int height);
+/* Half resolution, every RGGB quad becomes one pixel (output is width/2 x height/2), shift takes bayer to 16 bit */
+void debayerSuperpixel(uint16_t * __restrict debayerto, uint16_t * __restrict bayerdata, int width, int height, int shift);
 
 /* None debayer structure for multithread */
 typedef struct {
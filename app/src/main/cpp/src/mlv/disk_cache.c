@@ -0,0 +1,215 @@
+/* Frames that don't fit in RAM end up here */
+#define _FILE_OFFSET_BITS 64
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "disk_cache.h"
+
+#ifndef STDOUT_SILENT
+#define DEBUG(CODE) CODE
+#else
+#define DEBUG(CODE)
+#endif
+
+#define DISK_CACHE_PAGE 4096ULL
+#define PAGE_ALIGN(X) (((X) + DISK_CACHE_PAGE - 1) & ~(DISK_CACHE_PAGE - 1))
+
+/* pread/pwrite can do less than asked, loop until done */
+static int disk_cache_io(int fd, void * buf, uint64_t size, uint64_t offset, int write_it)
+{
+    uint8_t * ptr = (uint8_t *)buf;
+    while (size)
+    {
+        ssize_t done = write_it ? pwrite(fd, ptr, size, (off_t)offset) : pread(fd, ptr, size, (off_t)offset);
+        if (done < 0 && errno == EINTR) continue;
+        if (done <= 0) return 0;
+        ptr += done;
+        offset += done;
+        size -= done;
+    }
+    return 1;
+}
+
+diskCacheObject_t * initDiskCache(const char * dir, uint32_t frames, uint64_t frame_bytes, uint64_t byte_limit)
+{
+    if (!dir || !frames || !frame_bytes) return NULL;
+
+    uint64_t slot_bytes = PAGE_ALIGN(frame_bytes);
+    uint64_t slots = byte_limit / slot_bytes;
+    if (slots > frames) slots = frames;
+    if (!slots) return NULL;
+
+    char * path = malloc(strlen(dir) + 32);
+    sprintf(path, "%s/mlv_frames_XXXXXX", dir);
+    int fd = mkstemp(path);
+    if (fd < 0)
+    {
+        DEBUG( printf("Disk cache: can not create file in %s\n", dir); )
+        free(path);
+        return NULL;
+    }
+    /* Nobody else needs to see it, space is given back as soon as the fd is closed */
+    unlink(path);
+    free(path);
+
+    /* Sparse, only written slots take up space */
+    if (ftruncate(fd, (off_t)(slots * slot_bytes)) != 0)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    diskCacheObject_t * cache = calloc(1, sizeof(diskCacheObject_t));
+    cache->fd = fd;
+    cache->frames = frames;
+    cache->slots = (uint32_t)slots;
+    cache->frame_bytes = frame_bytes;
+    cache->slot_bytes = slot_bytes;
+
+    cache->entries = malloc(slots * sizeof(disk_cache_entry_t));
+    cache->frame_slot = malloc(frames * sizeof(int32_t));
+    cache->readers = calloc(slots, sizeof(uint16_t));
+    cache->writing = calloc(slots, sizeof(uint8_t));
+    pthread_mutex_init(&cache->mutex, NULL);
+
+    diskCacheClear(cache);
+
+    DEBUG( printf("Disk cache: %i frames (%i MiB)\n", (int)slots, (int)((slots * slot_bytes) >> 20)); )
+
+    return cache;
+}
+
+void freeDiskCache(diskCacheObject_t * cache)
+{
+    if (!cache) return;
+    close(cache->fd);
+    free(cache->entries);
+    free(cache->frame_slot);
+    free(cache->readers);
+    free(cache->writing);
+    pthread_mutex_destroy(&cache->mutex);
+    free(cache);
+}
+
+int diskCacheRead(diskCacheObject_t * cache, uint32_t frame, void * out)
+{
+    if (frame >= cache->frames) return 0;
+
+    pthread_mutex_lock(&cache->mutex);
+    int32_t slot = cache->frame_slot[frame];
+    if (slot < 0)
+    {
+        pthread_mutex_unlock(&cache->mutex);
+        return 0;
+    }
+    cache->readers[slot]++;
+    cache->entries[slot].last_used = ++cache->clock;
+    pthread_mutex_unlock(&cache->mutex);
+
+    int ok = disk_cache_io(cache->fd, out, cache->frame_bytes,
+                           slot * cache->slot_bytes, 0);
+
+    pthread_mutex_lock(&cache->mutex);
+    cache->readers[slot]--;
+    pthread_mutex_unlock(&cache->mutex);
+
+    return ok;
+}
+
+int diskCacheWrite(diskCacheObject_t * cache, uint32_t frame, const void * data, int64_t * evicted)
+{
+    *evicted = -1;
+    if (frame >= cache->frames) return 0;
+
+    pthread_mutex_lock(&cache->mutex);
+
+    if (cache->io_error)
+    {
+        pthread_mutex_unlock(&cache->mutex);
+        return 0;
+    }
+    if (cache->frame_slot[frame] >= 0)
+    {
+        pthread_mutex_unlock(&cache->mutex);
+        return 1;
+    }
+
+    /* Free slot if there is one, otherwise the least recently used one nobody is touching */
+    int64_t slot = -1;
+    uint64_t oldest = UINT64_MAX;
+    for (uint32_t i = 0; i < cache->slots; ++i)
+    {
+        /* Readers can still be on a slot that was cleared */
+        if (cache->writing[i] || cache->readers[i]) continue;
+        if (cache->entries[i].frame == DISK_CACHE_EMPTY)
+        {
+            slot = i;
+            break;
+        }
+        if (cache->entries[i].last_used < oldest)
+        {
+            oldest = cache->entries[i].last_used;
+            slot = i;
+        }
+    }
+
+    if (slot < 0)
+    {
+        pthread_mutex_unlock(&cache->mutex);
+        return 0;
+    }
+
+    disk_cache_entry_t * entry = cache->entries + slot;
+    if (entry->frame != DISK_CACHE_EMPTY)
+    {
+        *evicted = entry->frame;
+        cache->frame_slot[entry->frame] = -1;
+        entry->frame = DISK_CACHE_EMPTY;
+    }
+    cache->writing[slot] = 1;
+    uint32_t generation = cache->generation;
+    pthread_mutex_unlock(&cache->mutex);
+
+    int ok = disk_cache_io(cache->fd, (void *)data, cache->frame_bytes,
+                           slot * cache->slot_bytes, 1);
+
+    pthread_mutex_lock(&cache->mutex);
+    cache->writing[slot] = 0;
+    if (!ok)
+    {
+        DEBUG( printf("Disk cache: write failed (%s), not using it any more\n", strerror(errno)); )
+        __atomic_store_n(&cache->io_error, 1, __ATOMIC_RELAXED);
+    }
+    else if (generation == cache->generation)
+    {
+        entry->frame = frame;
+        entry->last_used = ++cache->clock;
+        cache->frame_slot[frame] = (int32_t)slot;
+    }
+    else ok = 0;
+    pthread_mutex_unlock(&cache->mutex);
+
+    return ok;
+}
+
+void diskCacheClear(diskCacheObject_t * cache)
+{
+    if (!cache) return;
+    pthread_mutex_lock(&cache->mutex);
+    cache->generation++;
+    cache->clock = 0;
+    for (uint32_t i = 0; i < cache->frames; ++i) cache->frame_slot[i] = -1;
+    for (uint32_t i = 0; i < cache->slots; ++i)
+    {
+        cache->entries[i].frame = DISK_CACHE_EMPTY;
+        cache->entries[i].last_used = 0;
+    }
+    pthread_mutex_unlock(&cache->mutex);
+}
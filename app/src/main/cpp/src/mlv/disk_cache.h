@@ -0,0 +1,56 @@
+#ifndef _disk_cache_h
+#define _disk_cache_h
+
+#include <stdint.h>
+#include <pthread.h>
+
+/* Second cache tier: frames that did not fit in RAM go to a file in the app
+ * cache directory. Fixed size slots, the index of what is where is kept in
+ * memory only, frames are read back with one pread */
+
+#define DISK_CACHE_EMPTY 0xFFFFFFFF
+
+/* One per slot */
+typedef struct
+{
+    uint32_t frame;     /* Frame in this slot or DISK_CACHE_EMPTY */
+    uint64_t last_used; /* LRU stamp, bigger is newer */
+} disk_cache_entry_t;
+
+typedef struct
+{
+    int fd;
+    int io_error; /* Set on first failed write (disk full...), tier stays off after that */
+
+    uint32_t frames;      /* Frames in the clip */
+    uint32_t slots;       /* How many frames fit */
+    uint64_t frame_bytes; /* Payload size of one frame */
+    uint64_t slot_bytes;  /* frame_bytes rounded up to a page */
+
+    disk_cache_entry_t * entries;
+    int32_t * frame_slot; /* Slot of every frame, -1 if not on disk */
+    uint16_t * readers;   /* Reads in progress per slot, those can not be evicted */
+    uint8_t * writing;    /* Slot is being written */
+    uint64_t clock;       /* Last LRU stamp given out */
+    uint32_t generation;  /* Bumped by clear, writes that started before it are dropped */
+
+    pthread_mutex_t mutex;
+} diskCacheObject_t;
+
+/* Creates the cache file in dir (it is unlinked straight away, so it goes when closed or on a crash).
+ * Returns NULL if the directory is unusable or byte_limit is less than a frame */
+diskCacheObject_t * initDiskCache(const char * dir, uint32_t frames, uint64_t frame_bytes, uint64_t byte_limit);
+void freeDiskCache(diskCacheObject_t * cache);
+
+/* Reads a frame in to out, returns 1 on hit */
+int diskCacheRead(diskCacheObject_t * cache, uint32_t frame, void * out);
+/* Stores a frame, evicting the least recently used one if full (*evicted is set to
+ * its index, or -1). Returns 1 if stored */
+int diskCacheWrite(diskCacheObject_t * cache, uint32_t frame, const void * data, int64_t * evicted);
+/* Forgets all frames */
+void diskCacheClear(diskCacheObject_t * cache);
+#define getDiskCacheSlots(cache) ((cache)->slots)
+/* Written under the lock, this reads it without one */
+#define hasDiskCacheFailed(cache) __atomic_load_n(&(cache)->io_error, __ATOMIC_RELAXED)
+
+#endif
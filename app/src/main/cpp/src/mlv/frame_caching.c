@@ -2,10 +2,13 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <pthread.h>
 
 #include "video_mlv.h"
+#include "llrawproc/llrawproc.h"
 #include "../debayer/debayer.h"
 #include "../ca_correct/CA_correct_RT.h"
 #include "../debayer/wb_conversion.h"
@@ -22,12 +25,357 @@
 #define DEBUG(CODE)
 #endif
 
+static uint64_t cache_time_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Bits per bayer sample needed to store llrawproc output without loss */
+static int cache_bayer_bits(mlvObject_t * video)
+{
+    int bits = getMlvBitdepth(video);
+    if (llrpHQDualIso(video) || bits <= 0 || bits > 16) bits = 16;
+    return bits;
+}
+
+/* Size of one cached frame in the current storage mode, and the bits per bayer sample it
+ * takes. Only works it out, cache threads keep packing with cache_pack_bits until stopped */
+static uint64_t cache_frame_bytes(mlvObject_t * video, int * pack_bits)
+{
+    uint64_t pixels = (uint64_t)getMlvWidth(video) * getMlvHeight(video);
+
+    switch (video->cache_storage_mode)
+    {
+        case MLV_CACHE_STORE_BAYER16:
+            *pack_bits = 16;
+            return pixels * sizeof(uint16_t);
+        case MLV_CACHE_STORE_BAYER_PACKED:
+            *pack_bits = cache_bayer_bits(video);
+            /* 8 spare bytes, the packer always writes whole 64 bit words */
+            return ((pixels * *pack_bits + 7) / 8 + 8) & ~7ULL;
+        default:
+            *pack_bits = 0;
+            return pixels * 3 * sizeof(uint16_t);
+    }
+}
+
+/* Packs 16 bit bayer samples in to a little endian bit stream, bits wide each */
+static void pack_bayer_frame(uint16_t * __restrict in, uint8_t * __restrict out, uint64_t pixels, int bits)
+{
+    if (bits == 16)
+    {
+        memcpy(out, in, pixels * sizeof(uint16_t));
+        return;
+    }
+
+    uint64_t * dst = (uint64_t *)out;
+    uint64_t acc = 0;
+    int filled = 0;
+    uint32_t mask = (1 << bits) - 1;
+
+    for (uint64_t i = 0; i < pixels; ++i)
+    {
+        uint64_t value = in[i] & mask;
+        acc |= value << filled;
+        filled += bits;
+        if (filled >= 64)
+        {
+            *dst++ = acc;
+            filled -= 64;
+            /* Bits of value that did not fit in the word just written */
+            acc = filled ? (value >> (bits - filled)) : 0;
+        }
+    }
+    if (filled) *dst = acc;
+}
+
+/* Opposite of pack_bayer_frame, straight to the float format debayers want */
+static void unpack_bayer_frame_float(uint8_t * __restrict in, float * __restrict out, uint64_t pixels, int bits, int shift)
+{
+    if (bits == 16)
+    {
+        uint16_t * src = (uint16_t *)in;
+        for (uint64_t i = 0; i < pixels; ++i) out[i] = (float)(src[i] << shift);
+        return;
+    }
+
+    uint64_t * src = (uint64_t *)in;
+    uint64_t acc = *src++;
+    int avail = 64;
+    uint32_t mask = (1 << bits) - 1;
+
+    for (uint64_t i = 0; i < pixels; ++i)
+    {
+        uint32_t value;
+        if (avail >= bits)
+        {
+            value = acc & mask;
+            acc >>= bits;
+            avail -= bits;
+        }
+        else
+        {
+            /* Sample is split between two words */
+            uint64_t next = *src++;
+            value = (uint32_t)((acc | (next << avail)) & mask);
+            acc = next >> (bits - avail);
+            avail += 64 - bits;
+        }
+        out[i] = (float)(value << shift);
+    }
+}
+
+/* Frames that fit in both tiers, that's how wide the window around the playhead is */
+static uint64_t cache_window_size(mlvObject_t * video)
+{
+    uint64_t window = getMlvRawCacheLimitFrames(video);
+    if (video->disk_cache && !hasDiskCacheFailed(video->disk_cache)) window += getDiskCacheSlots(video->disk_cache);
+    return MIN(window, getMlvFrames(video));
+}
+
+/* Window is [start, end), a quarter of it behind the playhead, pushed back in to the clip at the ends */
+static void cache_window(mlvObject_t * video, uint64_t playhead, uint64_t * start, uint64_t * end)
+{
+    uint64_t frames = getMlvFrames(video);
+    uint64_t window = cache_window_size(video);
+    uint64_t behind = window / 4;
+
+    if (playhead >= frames) playhead = frames ? frames - 1 : 0;
+    *start = (playhead > behind) ? playhead - behind : 0;
+    if (*start + window > frames) *start = frames - window;
+    *end = *start + window;
+}
+
+/* Position k in the window to a frame: playhead onwards first, then backwards from it.
+ * Returns -1 past the end of the window */
+static int64_t cache_window_frame(mlvObject_t * video, uint64_t playhead, uint64_t k)
+{
+    uint64_t start, end;
+    cache_window(video, playhead, &start, &end);
+    if (playhead < start || playhead >= end) return -1;
+
+    if (k < end - playhead) return playhead + k;
+    k -= end - playhead;
+    if (k < playhead - start) return playhead - 1 - k;
+    return -1;
+}
+
+/* Sets up cache slots for frame_limit frames of frame_size, everything that was in RAM is forgotten.
+ * Cache threads must not be running */
+static void init_mlv_cache_slots(mlvObject_t * video, uint64_t frame_limit, uint64_t frame_size, int pack_bits)
+{
+    pthread_mutex_lock( &video->g_mutexFind );
+
+    video->cache_frame_bytes = frame_size;
+    video->cache_pack_bits = pack_bits;
+
+    video->rgb_raw_frames = realloc(video->rgb_raw_frames, frame_limit * sizeof(uint16_t *));
+    video->cache_slot_frame = realloc(video->cache_slot_frame, frame_limit * sizeof(int32_t));
+    video->cache_slot_ref = realloc(video->cache_slot_ref, frame_limit * sizeof(uint8_t));
+    video->cache_slot_pins = realloc(video->cache_slot_pins, frame_limit * sizeof(uint16_t));
+    video->cache_free_slots = realloc(video->cache_free_slots, frame_limit * sizeof(int32_t));
+    video->cache_frame_slot = realloc(video->cache_frame_slot, getMlvFrames(video) * sizeof(int32_t));
+
+    for (uint64_t i = 0; i < frame_limit; ++i)
+    {
+        video->rgb_raw_frames[i] = (uint16_t *)((uint8_t *)video->cache_memory_block + (frame_size * i));
+        video->cache_slot_frame[i] = -1;
+        video->cache_slot_ref[i] = 0;
+        video->cache_slot_pins[i] = 0;
+        /* Reversed, so slot 0 gets used first */
+        video->cache_free_slots[i] = frame_limit - 1 - i;
+    }
+    video->cache_free_count = frame_limit;
+    video->cache_clock_hand = 0;
+
+    for (uint64_t i = 0; i < getMlvFrames(video); ++i)
+    {
+        video->cache_frame_slot[i] = -1;
+        if (video->cached_frames && video->cached_frames[i] == MLV_FRAME_IS_CACHED)
+            video->cached_frames[i] = MLV_FRAME_NOT_CACHED;
+    }
+
+    video->cache_work_pos = 0;
+
+    pthread_mutex_unlock( &video->g_mutexFind );
+}
+
+void free_mlv_cache_slots(mlvObject_t * video)
+{
+    free(video->rgb_raw_frames);
+    free(video->cache_slot_frame);
+    free(video->cache_slot_ref);
+    free(video->cache_slot_pins);
+    free(video->cache_free_slots);
+    free(video->cache_frame_slot);
+    video->rgb_raw_frames = NULL;
+    video->cache_slot_frame = NULL;
+    video->cache_slot_ref = NULL;
+    video->cache_slot_pins = NULL;
+    video->cache_free_slots = NULL;
+    video->cache_frame_slot = NULL;
+}
+
+/* Gets a free slot, or evicts one with CLOCK. Frames inside the playhead window get spared on the
+ * first lap of the hand. -1 if every slot is being written or read. Call with g_mutexFind locked */
+static int32_t get_mlv_cache_slot(mlvObject_t * video, int64_t * evicted)
+{
+    *evicted = -1;
+    if (video->cache_free_count) return video->cache_free_slots[--video->cache_free_count];
+
+    uint32_t slots = getMlvRawCacheLimitFrames(video);
+    if (!slots) return -1;
+
+    uint64_t start, end;
+    cache_window(video, video->cache_playhead, &start, &end);
+
+    for (uint32_t sweep = 0; sweep < slots * 3; ++sweep)
+    {
+        uint32_t slot = video->cache_clock_hand;
+        video->cache_clock_hand = (slot + 1) % slots;
+
+        int32_t frame = video->cache_slot_frame[slot];
+        /* Being filled, or being copied out of */
+        if (frame < 0 || video->cache_frame_slot[frame] != (int32_t)slot || video->cache_slot_pins[slot]) continue;
+        if (video->cache_slot_ref[slot])
+        {
+            video->cache_slot_ref[slot] = 0;
+            continue;
+        }
+        if (sweep < slots * 2 && (uint64_t)frame >= start && (uint64_t)frame < end) continue;
+
+        video->cache_frame_slot[frame] = -1;
+        video->cache_slot_frame[slot] = -1;
+        *evicted = frame;
+        return slot;
+    }
+
+    return -1;
+}
+
+/* Tells cache threads where playback is, they cache around it */
+void set_mlv_cache_playhead(mlvObject_t * video, uint64_t frame_index)
+{
+    if (__atomic_load_n(&video->cache_playhead, __ATOMIC_RELAXED) == frame_index) return;
+
+    pthread_mutex_lock( &video->g_mutexFind );
+    video->cache_playhead = frame_index;
+    /* Start over from the playhead, frames that are already there get skipped quickly */
+    __atomic_store_n(&video->cache_work_pos, 0, __ATOMIC_RELEASE);
+    pthread_cond_broadcast( &video->cache_cond );
+    pthread_mutex_unlock( &video->g_mutexFind );
+}
+
 void resetMlvCache(mlvObject_t * video)
 {
     resetMlvCachedFrame(video);
+    /* Packed bayer slots depend on raw settings (HQ dual iso is 16 bit) */
+    if (isMlvActive(video)
+     && video->cache_storage_mode == MLV_CACHE_STORE_BAYER_PACKED
+     && video->cache_pack_bits != cache_bayer_bits(video))
+    {
+        setMlvRawCacheLimitMegaBytes(video, video->cache_limit_mb);
+    }
     mark_mlv_uncached(video);
 }
 
+/* Switch what gets stored for each cached frame, restarts caching if it was on */
+void setMlvCacheStorageMode(mlvObject_t * video, int mode)
+{
+    if (mode < MLV_CACHE_STORE_RGB16 || mode > MLV_CACHE_STORE_BAYER_PACKED) mode = MLV_CACHE_STORE_RGB16;
+    if (mode == video->cache_storage_mode) return;
+
+    video->cache_storage_mode = mode;
+    /* Re-slices the memory block for the new frame size */
+    setMlvRawCacheLimitMegaBytes(video, video->cache_limit_mb);
+    mark_mlv_uncached(video);
+    resetMlvCacheStats(video);
+}
+
+void getMlvCacheStats(mlvObject_t * video, uint64_t * hits, uint64_t * misses, uint64_t * decode_ns)
+{
+    pthread_mutex_lock( &video->g_mutexCount );
+    if (hits) *hits = video->cache_hits;
+    if (misses) *misses = video->cache_misses;
+    if (decode_ns) *decode_ns = video->cache_decode_ns;
+    pthread_mutex_unlock( &video->g_mutexCount );
+}
+
+void resetMlvCacheStats(mlvObject_t * video)
+{
+    pthread_mutex_lock( &video->g_mutexCount );
+    video->cache_hits = 0;
+    video->cache_misses = 0;
+    video->cache_decode_ns = 0;
+    pthread_mutex_unlock( &video->g_mutexCount );
+}
+
+/* Count a frame request, decode_ns is only meaningful for hits */
+void count_mlv_cache_request(mlvObject_t * video, int hit, uint64_t decode_ns)
+{
+    pthread_mutex_lock( &video->g_mutexCount );
+    if (hit)
+    {
+        video->cache_hits++;
+        video->cache_decode_ns += decode_ns;
+    }
+    else video->cache_misses++;
+    pthread_mutex_unlock( &video->g_mutexCount );
+}
+
+/* Frames on disk are always stored debayered */
+int setMlvDiskCache(mlvObject_t * video, const char * cache_dir, uint64_t megaByteLimit)
+{
+    if (!isMlvActive(video)) return 0;
+
+    /* Threads write to the disk cache, so they have to be stopped while it gets swapped */
+    int has_caching = 0;
+    if (!video->stop_caching || isMlvObjectCaching(video))
+    {
+        has_caching = 1;
+        video->stop_caching = 1;
+        while (video->cache_thread_count) usleep(100);
+    }
+
+    pthread_mutex_lock( &video->g_mutexFind );
+    for (uint64_t i = 0; i < getMlvFrames(video); ++i)
+    {
+        if (video->cached_frames[i] == MLV_FRAME_IS_ON_DISK) video->cached_frames[i] = MLV_FRAME_NOT_CACHED;
+    }
+    /* Window size changes with the disk tier */
+    video->cache_work_pos = 0;
+    pthread_mutex_unlock( &video->g_mutexFind );
+
+    freeDiskCache(video->disk_cache);
+    video->disk_cache = NULL;
+
+    if (cache_dir && megaByteLimit)
+    {
+        video->disk_cache = initDiskCache(cache_dir, getMlvFrames(video),
+                                          (uint64_t)getMlvWidth(video) * getMlvHeight(video) * 3 * sizeof(uint16_t),
+                                          megaByteLimit * (1 << 20));
+    }
+
+    if (has_caching)
+    {
+        video->stop_caching = 0;
+        for (int i = 0; i < video->cpu_cores; ++i)
+        {
+            add_mlv_cache_thread(video);
+        }
+    }
+
+    return video->disk_cache != NULL;
+}
+
+int is_mlv_frame_cacheable(mlvObject_t * video, uint64_t frame_index)
+{
+    /* Slots go to whatever frame is around the playhead */
+    return frame_index < getMlvFrames(video) && (getMlvRawCacheLimitFrames(video) || video->disk_cache);
+}
+
 void disableMlvCaching(mlvObject_t * video)
 {
     /* Stop caching and make sure by waiting */
@@ -51,8 +399,6 @@ void enableMlvCaching(mlvObject_t * video)
 /* What I call MegaBytes is actually MebiBytes! I'm so upset to find that out :( */
 void setMlvRawCacheLimitMegaBytes(mlvObject_t * video, uint64_t megaByteLimit)
 {
-    uint64_t frame_pix   = getMlvWidth(video) * getMlvHeight(video) * 3;
-    uint64_t frame_size  = frame_pix * sizeof(uint16_t);
     uint64_t bytes_limit = megaByteLimit * (1 << 20);
 
     video->cache_limit_mb = megaByteLimit;
@@ -60,6 +406,8 @@ void setMlvRawCacheLimitMegaBytes(mlvObject_t * video, uint64_t megaByteLimit)
 
     /* Protection against zero division, cuz that causes "Floating point exception: 8"... 
      * ...LOL there's not even a floating point in sight */
+    int pack_bits = 0;
+    uint64_t frame_size = isMlvActive(video) ? cache_frame_bytes(video, &pack_bits) : 0;
     if (isMlvActive(video) && frame_size != 0)
     {
         uint64_t cache_whole = frame_size * getMlvFrames(video);
@@ -80,9 +428,8 @@ void setMlvRawCacheLimitMegaBytes(mlvObject_t * video, uint64_t megaByteLimit)
 
         /* Resize cache block - to maximum allowed or enough to fit whole clip if it is smaller */
         video->cache_memory_block = realloc(video->cache_memory_block, MIN(bytes_limit, cache_whole));
-        /* Array of frame pointers within the memory block */
-        video->rgb_raw_frames = realloc(video->rgb_raw_frames, frame_limit * sizeof(uint16_t *));
-        for (uint64_t i = 0; i < getMlvRawCacheLimitFrames(video); ++i) video->rgb_raw_frames[i] = video->cache_memory_block + (frame_pix * i);
+        /* Slot pointers within the memory block */
+        init_mlv_cache_slots(video, frame_limit, frame_size, pack_bits);
 
         /* Restart caching if it had caching before */
         if (has_caching)
@@ -102,8 +449,8 @@ void setMlvRawCacheLimitMegaBytes(mlvObject_t * video, uint64_t megaByteLimit)
 /* Not recommended */
 void setMlvRawCacheLimitFrames(mlvObject_t * video, uint64_t frameLimit)
 {
-    uint64_t frame_pix   = getMlvWidth(video) * getMlvHeight(video) * 3;
-    uint64_t frame_size  = frame_pix * sizeof(uint16_t);
+    int pack_bits = 0;
+    uint64_t frame_size = isMlvActive(video) ? cache_frame_bytes(video, &pack_bits) : 0;
 
     /* Do only if clip is loaded */
     if (isMlvActive(video) && frame_size != 0)
@@ -127,9 +474,8 @@ void setMlvRawCacheLimitFrames(mlvObject_t * video, uint64_t frameLimit)
 
         /* Resize cache block - to maximum allowed or enough to fit whole clip if it is smaller */
         video->cache_memory_block = realloc(video->cache_memory_block, MIN(bytes_limit, cache_whole));
-        /* Array of frame pointers within the memory block */
-        video->rgb_raw_frames = realloc(video->rgb_raw_frames, frameLimit * sizeof(uint16_t *));
-        for (uint64_t i = 0; i < getMlvRawCacheLimitFrames(video); ++i) video->rgb_raw_frames[i] = video->cache_memory_block + (frame_pix * i);
+        /* Slot pointers within the memory block */
+        init_mlv_cache_slots(video, frameLimit, frame_size, pack_bits);
 
         /* Restart caching if it had caching before */
         if (has_caching)
@@ -148,11 +494,28 @@ void setMlvRawCacheLimitFrames(mlvObject_t * video, uint64_t frameLimit)
 void mark_mlv_uncached(mlvObject_t * video)
 {
     pthread_mutex_lock( &video->g_mutexFind );
+    video->cache_generation++;
     for (uint64_t i = 0; i < getMlvFrames(video); ++i)
     {
         video->cached_frames[i] = MLV_FRAME_NOT_CACHED;
     }
+
+    /* Give back every slot, except ones a cache thread is still filling (it frees them itself) */
+    if (video->cache_frame_slot)
+    {
+        video->cache_free_count = 0;
+        for (uint64_t slot = 0; slot < getMlvRawCacheLimitFrames(video); ++slot)
+        {
+            int32_t frame = video->cache_slot_frame[slot];
+            if (frame >= 0 && video->cache_frame_slot[frame] != (int32_t)slot) continue;
+            if (frame >= 0) video->cache_frame_slot[frame] = -1;
+            video->cache_slot_frame[slot] = -1;
+            video->cache_free_slots[video->cache_free_count++] = slot;
+        }
+    }
+    video->cache_work_pos = 0;
     pthread_mutex_unlock( &video->g_mutexFind );
+    diskCacheClear(video->disk_cache);
 }
 
 /* Clears cache by freeing then reallocating (RAM usage down until frames written) */
@@ -163,35 +526,83 @@ void clear_mlv_cache(mlvObject_t * video)
     video->cache_memory_block = malloc(video->cache_limit_bytes);
 }
 
-/* Returns 1 on success, or 0 if all are cached */
-int find_mlv_frame_to_cache(mlvObject_t * video, uint64_t * index) /* Outputs to *index */
+/* Returns 1 on success, or 0 if the window around the playhead is all cached.
+ * *to_disk is set for frames that belong in the disk tier */
+int find_mlv_frame_to_cache(mlvObject_t * video, uint64_t * index, int * to_disk) /* Outputs to *index */
 {
-    pthread_mutex_lock( &video->g_mutexFind );
-    /* If a specific frame was requested */
-    if (video->cache_next) 
+    *to_disk = 0;
+
+    /* If a specific frame was requested, it goes to RAM */
+    int64_t requested = __atomic_exchange_n(&video->cache_next, -1, __ATOMIC_ACQ_REL);
+    if (requested >= 0 && (uint64_t)requested < getMlvFrames(video) && getMlvRawCacheLimitFrames(video))
     {
-        *index = video->cache_next;
-        video->cache_next = 0;
+        pthread_mutex_lock( &video->g_mutexFind );
+        if (video->cached_frames[requested] == MLV_FRAME_NOT_CACHED)
+        {
+            video->cached_frames[requested] = MLV_FRAME_BEING_CACHED;
+            *index = requested;
+            pthread_mutex_unlock( &video->g_mutexFind );
+            return 1;
+        }
         pthread_mutex_unlock( &video->g_mutexFind );
-        return 1;
     }
-    else
+
+    uint64_t ram_frames = getMlvRawCacheLimitFrames(video);
+
+    while (!video->stop_caching)
     {
-        for (uint64_t frame = 0; frame < getMlvRawCacheLimitFrames(video); ++frame)
+        uint64_t playhead = __atomic_load_n(&video->cache_playhead, __ATOMIC_ACQUIRE);
+        /* Lock free, every thread gets its own position in the window */
+        uint32_t k = __atomic_fetch_add(&video->cache_work_pos, 1, __ATOMIC_ACQ_REL);
+        int64_t frame = cache_window_frame(video, playhead, k);
+        if (frame < 0)
         {
-            /* Return index if it is not cached */
-            if (video->cached_frames[frame] == MLV_FRAME_NOT_CACHED)
-            {
-                *index = frame;
-                pthread_mutex_unlock( &video->g_mutexFind );
-                return 1;
-            }
+            /* Keep it from wrapping while threads poll an idle window */
+            uint32_t expected = k + 1;
+            __atomic_compare_exchange_n(&video->cache_work_pos, &expected, k, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+            return 0;
         }
+
+        /* Unlocked peek first, most of the window is usually cached already */
+        if (video->cached_frames[frame] != MLV_FRAME_NOT_CACHED) continue;
+
+        pthread_mutex_lock( &video->g_mutexFind );
+        if (video->cached_frames[frame] == MLV_FRAME_NOT_CACHED)
+        {
+            video->cached_frames[frame] = MLV_FRAME_BEING_CACHED;
+            pthread_mutex_unlock( &video->g_mutexFind );
+            *index = frame;
+            /* Nearest frames go to RAM, the rest of the window to disk */
+            *to_disk = (k >= ram_frames && video->disk_cache);
+            return 1;
+        }
+        pthread_mutex_unlock( &video->g_mutexFind );
     }
-    pthread_mutex_unlock( &video->g_mutexFind );
+
     return 0;
 }
 
+/* Waits for the playhead to move (or caching to stop) */
+static void wait_for_mlv_cache_work(mlvObject_t * video)
+{
+    struct timespec until;
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_nsec += 20000000;
+    if (until.tv_nsec >= 1000000000)
+    {
+        until.tv_sec++;
+        until.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock( &video->g_mutexFind );
+    if (!video->stop_caching && video->cache_next < 0
+     && cache_window_frame(video, video->cache_playhead, video->cache_work_pos) < 0)
+    {
+        pthread_cond_timedwait( &video->cache_cond, &video->g_mutexFind, &until );
+    }
+    pthread_mutex_unlock( &video->g_mutexFind );
+}
+
 /* Adds one thread, active total can be checked in mlvObject->cache_thread_count */
 void add_mlv_cache_thread(mlvObject_t * video)
 {
@@ -212,71 +623,177 @@ void an_mlv_cache_thread(mlvObject_t * video)
     uint32_t width = getMlvWidth(video);
     uint32_t pixelsize = width * height;
 
-    /* 2d array uglyness */
-    float  * __restrict imagefloat1d = (float *)malloc(pixelsize * sizeof(float));
-    float ** __restrict imagefloat2d = (float **)malloc(height * sizeof(float *));
-    for (volatile uint32_t y = 0; y < height; ++y) imagefloat2d[y] = (float *)(imagefloat1d+(y*width));
-    float  * __restrict red1d = (float *)malloc(pixelsize * sizeof(float));
-    float ** __restrict red2d = (float **)malloc(height * sizeof(float *));
-    for (volatile uint32_t y = 0; y < height; ++y) red2d[y] = (float *)(red1d+(y*width));
-    float  * __restrict green1d = (float *)malloc(pixelsize * sizeof(float));
-    float ** __restrict green2d = (float **)malloc(height * sizeof(float *));
-    for (volatile uint32_t y = 0; y < height; ++y) green2d[y] = (float *)(green1d+(y*width));
-    float  * __restrict blue1d = (float *)malloc(pixelsize * sizeof(float));
-    float ** __restrict blue2d = (float **)malloc(height * sizeof(float *));
-    for (volatile uint32_t y = 0; y < height; ++y) blue2d[y] = (float *)(blue1d+(y*width));
-
-    pthread_mutex_lock( &video->g_mutexCount );
-    amazeinfo_t amaze_params = {
-        .rawData =  imagefloat2d,
-        .red     =  red2d,
-        .green   =  green2d,
-        .blue    =  blue2d,
-        .winx    =  0,
-        .winy    =  0,
-        .winw    =  getMlvWidth(video),
-        .winh    =  getMlvHeight(video),
-        .cfa     =  0
-    };
-    pthread_mutex_unlock( &video->g_mutexCount );
+    /* Storage mode can not change under a running thread, caching is restarted for that */
+    int store_rgb = (video->cache_storage_mode == MLV_CACHE_STORE_RGB16);
+    /* Same for the disk cache, which always gets AMaZE output */
+    int use_disk = (video->disk_cache != NULL);
+    /* RAM evictions can only move down to disk if they are RGB already */
+    int demote = (use_disk && store_rgb);
+
+    float  * __restrict imagefloat1d = NULL;
+    float ** __restrict imagefloat2d = NULL;
+    float  * __restrict red1d = NULL;
+    float ** __restrict red2d = NULL;
+    float  * __restrict green1d = NULL;
+    float ** __restrict green2d = NULL;
+    float  * __restrict blue1d = NULL;
+    float ** __restrict blue2d = NULL;
+    uint16_t * __restrict bayer = NULL;
+    uint16_t * __restrict disk_frame = NULL;
+    amazeinfo_t amaze_params;
+
+    if (store_rgb || use_disk)
+    {
+        /* 2d array uglyness */
+        imagefloat1d = (float *)malloc(pixelsize * sizeof(float));
+        imagefloat2d = (float **)malloc(height * sizeof(float *));
+        for (volatile uint32_t y = 0; y < height; ++y) imagefloat2d[y] = (float *)(imagefloat1d+(y*width));
+        red1d = (float *)malloc(pixelsize * sizeof(float));
+        red2d = (float **)malloc(height * sizeof(float *));
+        for (volatile uint32_t y = 0; y < height; ++y) red2d[y] = (float *)(red1d+(y*width));
+        green1d = (float *)malloc(pixelsize * sizeof(float));
+        green2d = (float **)malloc(height * sizeof(float *));
+        for (volatile uint32_t y = 0; y < height; ++y) green2d[y] = (float *)(green1d+(y*width));
+        blue1d = (float *)malloc(pixelsize * sizeof(float));
+        blue2d = (float **)malloc(height * sizeof(float *));
+        for (volatile uint32_t y = 0; y < height; ++y) blue2d[y] = (float *)(blue1d+(y*width));
+
+        pthread_mutex_lock( &video->g_mutexCount );
+        amaze_params = (amazeinfo_t) {
+            .rawData =  imagefloat2d,
+            .red     =  red2d,
+            .green   =  green2d,
+            .blue    =  blue2d,
+            .winx    =  0,
+            .winy    =  0,
+            .winw    =  getMlvWidth(video),
+            .winh    =  getMlvHeight(video),
+            .cfa     =  0
+        };
+        pthread_mutex_unlock( &video->g_mutexCount );
+    }
+    if (!store_rgb)
+    {
+        /* Bayer modes only decode, debayering happens when the frame is asked for */
+        bayer = (uint16_t *)malloc(pixelsize * sizeof(uint16_t));
+    }
+    if (use_disk) disk_frame = (uint16_t *)malloc(pixelsize * 3 * sizeof(uint16_t));
 
     while (1 < 2)
     {
         if (video->stop_caching) break;
 
         uint64_t cache_frame;
+        int to_disk;
 
-        /* If cache finder reurns false, it's time t stop caching */
-        if (!find_mlv_frame_to_cache(video, &cache_frame)) break;
+        /* Nothing left to do around the playhead, wait for it to move */
+        if (!find_mlv_frame_to_cache(video, &cache_frame, &to_disk))
+        {
+            wait_for_mlv_cache_work(video);
+            continue;
+        }
 
+        /* Frame is marked as being cached by now, get somewhere to put it */
+        int32_t slot = -1;
+        int64_t evicted = -1;
         pthread_mutex_lock( &video->g_mutexFind );
-        video->cached_frames[cache_frame] = MLV_FRAME_BEING_CACHED;
+        uint32_t generation = video->cache_generation;
+        if (!to_disk)
+        {
+            slot = get_mlv_cache_slot(video, &evicted);
+            if (slot >= 0) video->cache_slot_frame[slot] = cache_frame;
+            if (evicted >= 0) video->cached_frames[evicted] = demote ? MLV_FRAME_BEING_CACHED : MLV_FRAME_NOT_CACHED;
+        }
         pthread_mutex_unlock( &video->g_mutexFind );
 
-        pthread_mutex_lock( &video->cache_mutex ); //cache mutex used first time ;)
-        getMlvRawFrameFloat(video, cache_frame, imagefloat1d);
-        pthread_mutex_unlock( &video->cache_mutex );
+        /* Every RAM slot is busy */
+        if (slot < 0 && !to_disk)
+        {
+            if (!use_disk)
+            {
+                pthread_mutex_lock( &video->g_mutexFind );
+                if (generation == video->cache_generation) video->cached_frames[cache_frame] = MLV_FRAME_NOT_CACHED;
+                pthread_mutex_unlock( &video->g_mutexFind );
+                continue;
+            }
+            to_disk = 1;
+        }
+
+        int64_t disk_evicted = -1;
+
+        /* Frame pushed out of RAM moves down to disk, RGB slots are already in the disk format */
+        if (evicted >= 0 && demote)
+        {
+            int on_disk = diskCacheWrite(video->disk_cache, evicted, video->rgb_raw_frames[slot], &disk_evicted);
+
+            pthread_mutex_lock( &video->g_mutexFind );
+            if (generation == video->cache_generation)
+                video->cached_frames[evicted] = on_disk ? MLV_FRAME_IS_ON_DISK : MLV_FRAME_NOT_CACHED;
+            if (disk_evicted >= 0 && video->cached_frames[disk_evicted] == MLV_FRAME_IS_ON_DISK)
+                video->cached_frames[disk_evicted] = MLV_FRAME_NOT_CACHED;
+            pthread_mutex_unlock( &video->g_mutexFind );
+            disk_evicted = -1;
+        }
+
+        if (store_rgb || to_disk)
+        {
+            /* llrawproc is reentrant, cache threads correct their frames side by side */
+            getMlvRawFrameFloat(video, cache_frame, imagefloat1d);
+
+            /* Single thread AMaZE */
+            demosaic(&amaze_params);
+
+            /* To 16-bit */
+            uint16_t * out = to_disk ? disk_frame : video->rgb_raw_frames[slot];
+            for (uint32_t i = 0; i < pixelsize-10; i++)
+            {
+                uint16_t * pix = out + (i*3);
+                pix[0] = (uint16_t)MIN(red1d[i], 65535);
+                pix[1] = (uint16_t)MIN(green1d[i], 65535);
+                pix[2] = (uint16_t)MIN(blue1d[i], 65535);
+            }
+        }
+        else
+        {
+            if (getMlvRawFrameCorrected(video, cache_frame, bayer)) memset(bayer, 0, pixelsize * sizeof(uint16_t));
 
-        /* Single thread AMaZE */
-        demosaic(&amaze_params);
+            pack_bayer_frame(bayer, (uint8_t *)video->rgb_raw_frames[slot], pixelsize, video->cache_pack_bits);
+        }
 
-        /* To 16-bit */
-        uint16_t * out = video->rgb_raw_frames[cache_frame];
-        for (uint32_t i = 0; i < pixelsize-10; i++)
+        uint8_t state = MLV_FRAME_IS_CACHED;
+        if (to_disk)
         {
-            uint16_t * pix = out + (i*3);
-            pix[0] = (uint16_t)MIN(red1d[i], 65535);
-            pix[1] = (uint16_t)MIN(green1d[i], 65535);
-            pix[2] = (uint16_t)MIN(blue1d[i], 65535);
+            state = diskCacheWrite(video->disk_cache, cache_frame, disk_frame, &disk_evicted) ? MLV_FRAME_IS_ON_DISK : MLV_FRAME_NOT_CACHED;
         }
 
         pthread_mutex_lock( &video->g_mutexFind );
-        video->cached_frames[cache_frame] = MLV_FRAME_IS_CACHED;
+        if (generation != video->cache_generation)
+        {
+            /* Everything was marked uncached while this one was being made, it's stale */
+            if (slot >= 0)
+            {
+                video->cache_slot_frame[slot] = -1;
+                video->cache_free_slots[video->cache_free_count++] = slot;
+            }
+        }
+        else
+        {
+            if (slot >= 0)
+            {
+                video->cache_frame_slot[cache_frame] = slot;
+                video->cache_slot_ref[slot] = 1;
+            }
+            video->cached_frames[cache_frame] = state;
+        }
+        if (disk_evicted >= 0 && video->cached_frames[disk_evicted] == MLV_FRAME_IS_ON_DISK)
+            video->cached_frames[disk_evicted] = MLV_FRAME_NOT_CACHED;
         pthread_mutex_unlock( &video->g_mutexFind );
 
-        DEBUG( printf("Debayered frame %llu/%llu has been cached.\n", cache_frame+1, video->cache_limit_frames); )
+        DEBUG( printf("Debayered frame %llu has been cached (%s).\n", cache_frame+1, to_disk ? "disk" : "RAM"); )
     }
 
+    free(bayer);
+    free(disk_frame);
     free(red1d);
     free(red2d);
     free(green1d);
@@ -298,12 +815,84 @@ void get_mlv_raw_frame_debayered( mlvObject_t * video,
                                   uint16_t * output_frame, 
                                   int debayer_type ) /* 0=bilinear 1=amaze ... */
 {
-    int width = getMlvWidth(video);
-    int height = getMlvHeight(video);
-
     /* Get the raw data in B&W */
     getMlvRawFrameFloat(video, frame_index, temp_memory);
 
+    debayer_mlv_raw_frame(video, temp_memory, output_frame, debayer_type);
+}
+
+/* Gets a frame out of the cache as 16 bit RGB, debayering it if bayer is what the cache holds.
+ * Returns 0 if it is not in RAM (any more) */
+int get_mlv_cached_frame(mlvObject_t * video, uint64_t frame_index, uint16_t * output_frame)
+{
+    uint64_t start = cache_time_ns();
+    uint64_t pixels = (uint64_t)getMlvWidth(video) * getMlvHeight(video);
+
+    /* Pin the slot so it can't be evicted while copying */
+    pthread_mutex_lock( &video->g_mutexFind );
+    int32_t slot = video->cache_frame_slot ? video->cache_frame_slot[frame_index] : -1;
+    if (slot >= 0)
+    {
+        video->cache_slot_pins[slot]++;
+        video->cache_slot_ref[slot] = 1;
+    }
+    pthread_mutex_unlock( &video->g_mutexFind );
+    if (slot < 0) return 0;
+
+    float * raw_frame = NULL;
+    if (video->cache_storage_mode == MLV_CACHE_STORE_RGB16)
+    {
+        memcpy(output_frame, video->rgb_raw_frames[slot], pixels * 3 * sizeof(uint16_t));
+    }
+    else
+    {
+        raw_frame = malloc(pixels * sizeof(float));
+        unpack_bayer_frame_float((uint8_t *)video->rgb_raw_frames[slot], raw_frame, pixels,
+                                 video->cache_pack_bits, 16 - cache_bayer_bits(video));
+    }
+
+    pthread_mutex_lock( &video->g_mutexFind );
+    video->cache_slot_pins[slot]--;
+    pthread_mutex_unlock( &video->g_mutexFind );
+
+    /* Debayering is done on our own copy, slot is free to go */
+    if (raw_frame)
+    {
+        debayer_mlv_raw_frame(video, raw_frame, output_frame, doesMlvAlwaysUseAmaze(video));
+        free(raw_frame);
+    }
+
+    count_mlv_cache_request(video, 1, cache_time_ns() - start);
+    return 1;
+}
+
+int get_mlv_disk_cached_frame(mlvObject_t * video, uint64_t frame_index, uint16_t * output_frame)
+{
+    if (!video->disk_cache) return 0;
+
+    uint64_t start = cache_time_ns();
+    if (!diskCacheRead(video->disk_cache, frame_index, output_frame)) return 0;
+
+    count_mlv_cache_request(video, 1, cache_time_ns() - start);
+    return 1;
+}
+
+/* Debayers a float bayer frame (as from getMlvRawFrameFloat, it gets modified) to 16 bit RGB */
+void debayer_mlv_raw_frame( mlvObject_t * video,
+                            float * temp_memory,
+                            uint16_t * output_frame,
+                            int debayer_type )
+{
+    debayer_mlv_raw_region(video, temp_memory, output_frame, getMlvWidth(video), getMlvHeight(video), debayer_type);
+}
+
+/* Same for a part of the frame, must start on an even pixel so the CFA pattern is the same */
+void debayer_mlv_raw_region( mlvObject_t * video,
+                             float * temp_memory,
+                             uint16_t * output_frame,
+                             int width, int height,
+                             int debayer_type )
+{
     wb_convert_info_t wb_info;
 
     /* WB conversion for ideal debayer result, not for bilinear, easy and non debayer */
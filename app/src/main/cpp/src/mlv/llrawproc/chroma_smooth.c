@@ -3,28 +3,42 @@
 #define CHROMA_SMOOTH_MAX_XY_IJ 2
 #define CHROMA_SMOOTH_FILTER_SIZE 5
 #define CHROMA_SMOOTH_MEDIAN opt_med5
+#define CHROMA_SMOOTH_NETWORK OPT_MED5_NETWORK
+#define CHROMA_SMOOTH_MEDIAN_AT 2
+#define CHROMA_SMOOTH_CELLS_FUNC chroma_smooth_2x2_cells
 #elif defined(CHROMA_SMOOTH_3X3)
 #define CHROMA_SMOOTH_FUNC chroma_smooth_3x3
 #define CHROMA_SMOOTH_MAX_XY_IJ 2
 #define CHROMA_SMOOTH_FILTER_SIZE 9
 #define CHROMA_SMOOTH_MEDIAN opt_med9
+#define CHROMA_SMOOTH_NETWORK OPT_MED9_NETWORK
+#define CHROMA_SMOOTH_MEDIAN_AT 4
+#define CHROMA_SMOOTH_CELLS_FUNC chroma_smooth_3x3_cells
 #else
 #define CHROMA_SMOOTH_FUNC chroma_smooth_5x5
 #define CHROMA_SMOOTH_MAX_XY_IJ 4
 #define CHROMA_SMOOTH_FILTER_SIZE 25
 #define CHROMA_SMOOTH_MEDIAN opt_med25
+#define CHROMA_SMOOTH_NETWORK OPT_MED25_NETWORK
+#define CHROMA_SMOOTH_MEDIAN_AT 12
+#define CHROMA_SMOOTH_CELLS_FUNC chroma_smooth_5x5_cells
 #endif
 
 #ifndef CHROMA_SMOOTH_TYPE
 #define CHROMA_SMOOTH_TYPE uint16_t
 #endif
 
-static void CHROMA_SMOOTH_FUNC(int w, int h, CHROMA_SMOOTH_TYPE * inp, CHROMA_SMOOTH_TYPE * out, int* raw2ev, int* ev2raw, int black, int white)
+#ifndef CHROMA_SMOOTH_CELLS
+/* Filters the RG/GB cells starting on rows y1 to y2 (clipped to where the filter fits),
+ * bands that start on even rows can run in parallel as long as inp and out differ */
+static void CHROMA_SMOOTH_FUNC(int w, int h, int y1, int y2, CHROMA_SMOOTH_TYPE * inp, CHROMA_SMOOTH_TYPE * out, int* raw2ev, int* ev2raw, int black, int white)
 {
     int x,y;
+    int y_start = MAX(y1 + (y1 & 1), 2+CHROMA_SMOOTH_MAX_XY_IJ);
+    int y_end = MIN(y2, h-3-CHROMA_SMOOTH_MAX_XY_IJ);
 
     #pragma omp parallel for collapse(2)
-    for (y = 2+CHROMA_SMOOTH_MAX_XY_IJ; y < h-3-CHROMA_SMOOTH_MAX_XY_IJ; y += 2)
+    for (y = y_start; y < y_end; y += 2)
     {
         for (x = 2+CHROMA_SMOOTH_MAX_XY_IJ; x < w-2-CHROMA_SMOOTH_MAX_XY_IJ; x += 2)
         {
@@ -193,7 +207,133 @@ static void CHROMA_SMOOTH_FUNC(int w, int h, CHROMA_SMOOTH_TYPE * inp, CHROMA_SM
     }
 }
 
+#else
+/* The same filter for the cell row y, with the terms of each cell worked out once (chroma_cells_t)
+ * instead of again for every cell whose area it is in. cells[0] to cells[CHROMA_SMOOTH_MAX_XY_IJ] are
+ * the cell rows y-CHROMA_SMOOTH_MAX_XY_IJ to y+CHROMA_SMOOTH_MAX_XY_IJ, ev_m1 to ev2 the EV rows
+ * y-1 to y+2, and rows y and y+1 are written in place (out0 and out1) */
+static void CHROMA_SMOOTH_CELLS_FUNC(int w, chroma_cells_t * cells, int * ev_m1, int * ev0, int * ev1, int * ev2, uint16_t * out0, uint16_t * out1, int * ev2raw, int black, int white)
+{
+    int x = 2+CHROMA_SMOOTH_MAX_XY_IJ;
+    int x_end = w-2-CHROMA_SMOOTH_MAX_XY_IJ;
+    int i,j,k;
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    /* four cells at once, one in each lane, the median networks run on whole vectors */
+    for (; x + 6 < x_end; x += 8)
+    {
+        int32x4_t med_r[CHROMA_SMOOTH_FILTER_SIZE];
+        int32x4_t med_b[CHROMA_SMOOTH_FILTER_SIZE];
+        int32x4_t de = vdupq_n_s32(0);
+        int drh[4], dbh[4], drv[4], dbv[4], des[4];
+        int cx = x/2;
+
+        k = 0;
+        for (i = -CHROMA_SMOOTH_MAX_XY_IJ; i <= CHROMA_SMOOTH_MAX_XY_IJ; i += 2)
+        {
+            for (j = -CHROMA_SMOOTH_MAX_XY_IJ; j <= CHROMA_SMOOTH_MAX_XY_IJ; j += 2)
+            {
+                #ifdef CHROMA_SMOOTH_2X2
+                if (ABS(i) + ABS(j) == 4)
+                    continue;
+                #endif
+
+                chroma_cells_t * c = &cells[(j+CHROMA_SMOOTH_MAX_XY_IJ)/2];
+                med_r[k] = vld1q_s32(c->rh + cx + i/2);
+                med_b[k] = vld1q_s32(c->bh + cx + i/2);
+                de = vaddq_s32(de, vld1q_s32(c->de + cx + i/2));
+                k++;
+            }
+        }
+        CHROMA_SMOOTH_NETWORK(CHROMA_SMOOTH_VSORT, med_r);
+        CHROMA_SMOOTH_NETWORK(CHROMA_SMOOTH_VSORT, med_b);
+        vst1q_s32(drh, med_r[CHROMA_SMOOTH_MEDIAN_AT]);
+        vst1q_s32(dbh, med_b[CHROMA_SMOOTH_MEDIAN_AT]);
+        vst1q_s32(des, de);
+
+        k = 0;
+        for (i = -CHROMA_SMOOTH_MAX_XY_IJ; i <= CHROMA_SMOOTH_MAX_XY_IJ; i += 2)
+        {
+            for (j = -CHROMA_SMOOTH_MAX_XY_IJ; j <= CHROMA_SMOOTH_MAX_XY_IJ; j += 2)
+            {
+                #ifdef CHROMA_SMOOTH_2X2
+                if (ABS(i) + ABS(j) == 4)
+                    continue;
+                #endif
+
+                chroma_cells_t * c = &cells[(j+CHROMA_SMOOTH_MAX_XY_IJ)/2];
+                med_r[k] = vld1q_s32(c->rv + cx + i/2);
+                med_b[k] = vld1q_s32(c->bv + cx + i/2);
+                k++;
+            }
+        }
+        CHROMA_SMOOTH_NETWORK(CHROMA_SMOOTH_VSORT, med_r);
+        CHROMA_SMOOTH_NETWORK(CHROMA_SMOOTH_VSORT, med_b);
+        vst1q_s32(drv, med_r[CHROMA_SMOOTH_MEDIAN_AT]);
+        vst1q_s32(dbv, med_b[CHROMA_SMOOTH_MEDIAN_AT]);
+
+        for (k = 0; k < 4; k++)
+        {
+            chroma_smooth_put(x + 2*k, ev_m1, ev0, ev1, ev2, out0, out1, drh[k], dbh[k], drv[k], dbv[k], des[k], ev2raw, black, white);
+        }
+    }
+#endif
+
+    for (; x < x_end; x += 2)
+    {
+        int med_r[CHROMA_SMOOTH_FILTER_SIZE];
+        int med_b[CHROMA_SMOOTH_FILTER_SIZE];
+        int de = 0;
+        int cx = x/2;
+
+        k = 0;
+        for (i = -CHROMA_SMOOTH_MAX_XY_IJ; i <= CHROMA_SMOOTH_MAX_XY_IJ; i += 2)
+        {
+            for (j = -CHROMA_SMOOTH_MAX_XY_IJ; j <= CHROMA_SMOOTH_MAX_XY_IJ; j += 2)
+            {
+                #ifdef CHROMA_SMOOTH_2X2
+                if (ABS(i) + ABS(j) == 4)
+                    continue;
+                #endif
+
+                chroma_cells_t * c = &cells[(j+CHROMA_SMOOTH_MAX_XY_IJ)/2];
+                med_r[k] = c->rh[cx + i/2];
+                med_b[k] = c->bh[cx + i/2];
+                de += c->de[cx + i/2];
+                k++;
+            }
+        }
+        int drh = CHROMA_SMOOTH_MEDIAN(med_r);
+        int dbh = CHROMA_SMOOTH_MEDIAN(med_b);
+
+        k = 0;
+        for (i = -CHROMA_SMOOTH_MAX_XY_IJ; i <= CHROMA_SMOOTH_MAX_XY_IJ; i += 2)
+        {
+            for (j = -CHROMA_SMOOTH_MAX_XY_IJ; j <= CHROMA_SMOOTH_MAX_XY_IJ; j += 2)
+            {
+                #ifdef CHROMA_SMOOTH_2X2
+                if (ABS(i) + ABS(j) == 4)
+                    continue;
+                #endif
+
+                chroma_cells_t * c = &cells[(j+CHROMA_SMOOTH_MAX_XY_IJ)/2];
+                med_r[k] = c->rv[cx + i/2];
+                med_b[k] = c->bv[cx + i/2];
+                k++;
+            }
+        }
+        int drv = CHROMA_SMOOTH_MEDIAN(med_r);
+        int dbv = CHROMA_SMOOTH_MEDIAN(med_b);
+
+        chroma_smooth_put(x, ev_m1, ev0, ev1, ev2, out0, out1, drh, dbh, drv, dbv, de, ev2raw, black, white);
+    }
+}
+#endif
+
 #undef CHROMA_SMOOTH_FUNC
 #undef CHROMA_SMOOTH_MAX_XY_IJ
 #undef CHROMA_SMOOTH_FILTER_SIZE
 #undef CHROMA_SMOOTH_MEDIAN
+#undef CHROMA_SMOOTH_NETWORK
+#undef CHROMA_SMOOTH_MEDIAN_AT
+#undef CHROMA_SMOOTH_CELLS_FUNC
@@ -22,8 +22,20 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#if defined(__linux)
+#include <alloca.h>
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include "darkframe.h"
+#include "wirth.h"
 
 #define MIN(a,b) (((a)<(b))?(a):(b))
 #define MAX(a,b) (((a)>(b))?(a):(b))
@@ -38,166 +50,477 @@ static uint64_t file_set_pos(FILE *stream, uint64_t offset, int whence)
 #endif
 }
 
-/* unload the darkframe mlv */
-static void df_unload( mlvObject_t* df_mlv )
+/* Master dark frames ***************************************************************************/
+
+/* The dark frame clip (MLV of any kind or MCRAW) is stacked into one master frame: the mean
+ * of up to DF_AVERAGE_FRAMES frames or the median of up to DF_MEDIAN_FRAMES, picked evenly
+ * over the clip and decoded on cpu_cores threads. The last master is kept for the process,
+ * and when a directory is set it is also written there packed at the clip bit depth, named
+ * after camera, geometry, ISO and shutter, so it is not stacked again and a clip whose dark
+ * frame clip can not be opened any more still finds a master taken with the same settings.
+ * While the dark frame clip is there, a master counts only if it was stacked from that very
+ * file as it is now: same size, mtime, inode and hash of a few blocks */
+
+#define DF_AVERAGE_FRAMES 128
+#define DF_MEDIAN_FRAMES 9
+#define DF_MASTER_VERSION 2
+#define DF_HASH_BLOCK 65536 /* bytes hashed at the start, middle and end of the source clip */
+#define DF_OPEN_FULL 0 /* MLV_OPEN_FULL */
+
+typedef struct {
+    uint8_t  magic[4];       /* DFMC */
+    uint32_t version;
+    uint32_t stack_method;   /* DF_STACK_AVERAGE or DF_STACK_MEDIAN */
+    uint32_t source_frames;  /* frames of the dark frame clip it was stacked from */
+    uint64_t source_size;    /* and its size in bytes, 0 = not known */
+    uint64_t source_mtime;   /* modification time and inode it had when stacked */
+    uint64_t source_inode;
+    uint64_t source_hash;    /* FNV-1a of a few blocks of it, so a clip rewritten in place is told apart */
+    uint32_t data_size;      /* packed frame bytes after the DARK header */
+    uint32_t reserved;
+} df_master_file_t;
+
+static pthread_mutex_t df_master_mutex = PTHREAD_MUTEX_INITIALIZER;
+static char * df_master_directory = NULL;
+/* last master stacked or loaded */
+static df_master_file_t df_kept_info;
+static mlv_dark_hdr_t df_kept_hdr;
+static uint16_t * df_kept_data = NULL;
+
+void df_set_master_directory(const char * directory)
 {
-    /* Close all MLV file chunks */
-    FILE** files = df_mlv->file;
-    int entries = df_mlv->filenum;
-    for(int i = 0; i < entries; i++)
-        if(files[i]) fclose(files[i]);
-    if(files) free(files);
-
-    /* Free all memory */
-    if(df_mlv->video_index) free(df_mlv->video_index);
-    if(df_mlv->audio_index) free(df_mlv->audio_index);
-    if(df_mlv->vers_index) free(df_mlv->vers_index);
-
-    /* Free audio buffer */
-    if(df_mlv->audio_data)
+    pthread_mutex_lock(&df_master_mutex);
+    free(df_master_directory);
+    df_master_directory = (directory && directory[0]) ? strdup(directory) : NULL;
+    pthread_mutex_unlock(&df_master_mutex);
+}
+
+/* DARK header of a clip, also what masters are looked up with */
+static void df_fill_header(mlvObject_t * mlv, mlv_dark_hdr_t * hdr, uint32_t samples)
+{
+    memset(hdr, 0, sizeof(mlv_dark_hdr_t));
+    memcpy(&hdr->blockType, "DARK", 4);
+    hdr->blockSize = sizeof(mlv_dark_hdr_t) + (mlv->RAWI.xRes * mlv->RAWI.yRes * mlv->RAWI.raw_info.bits_per_pixel) / 8;
+    hdr->timestamp = 0xFFFFFFFFFFFFFFFF;
+    hdr->samplesAveraged = samples;
+    hdr->cameraModel = mlv->IDNT.cameraModel;
+    hdr->xRes = mlv->RAWI.xRes;
+    hdr->yRes = mlv->RAWI.yRes;
+    hdr->rawWidth = mlv->RAWI.raw_info.width;
+    hdr->rawHeight = mlv->RAWI.raw_info.height;
+    hdr->bits_per_pixel = mlv->RAWI.raw_info.bits_per_pixel;
+    hdr->black_level = mlv->RAWI.raw_info.black_level;
+    hdr->white_level = mlv->RAWI.raw_info.white_level;
+    hdr->sourceFpsNom = mlv->MLVI.sourceFpsNom;
+    hdr->sourceFpsDenom = mlv->MLVI.sourceFpsDenom;
+    hdr->isoMode = mlv->EXPO.isoMode;
+    hdr->isoValue = mlv->EXPO.isoValue;
+    hdr->isoAnalog = mlv->EXPO.isoAnalog;
+    hdr->digitalGain = mlv->EXPO.digitalGain;
+    hdr->shutterValue = mlv->EXPO.shutterValue;
+    hdr->binning_x = mlv->RAWC.binning_x;
+    hdr->skipping_x = mlv->RAWC.skipping_x;
+    hdr->binning_y = mlv->RAWC.binning_y;
+    hdr->skipping_y = mlv->RAWC.skipping_y;
+}
+
+static int df_same_settings(const mlv_dark_hdr_t * a, const mlv_dark_hdr_t * b)
+{
+    return a->cameraModel == b->cameraModel &&
+           a->xRes == b->xRes && a->yRes == b->yRes &&
+           a->bits_per_pixel == b->bits_per_pixel &&
+           a->isoValue == b->isoValue &&
+           a->shutterValue == b->shutterValue;
+}
+
+/* source is NULL when any master taken with the same settings will do */
+static int df_master_matches(const df_master_file_t * info, const mlv_dark_hdr_t * hdr,
+                             const mlv_dark_hdr_t * key, const df_master_file_t * source)
+{
+    if(!df_same_settings(hdr, key)) return 0;
+    if(!source) return 1;
+    return info->stack_method == source->stack_method &&
+           info->source_frames == source->source_frames &&
+           info->source_size == source->source_size &&
+           info->source_mtime == source->source_mtime &&
+           info->source_inode == source->source_inode &&
+           info->source_hash == source->source_hash;
+}
+
+/* identity of the dark frame clip a master is stacked from: size, mtime, inode and a hash of
+ * its start, middle and end. Read with pread, the file position of fd stays where it is */
+static void df_source_identity(int fd, df_master_file_t * info)
+{
+    struct stat df_stat;
+    if(fstat(fd, &df_stat)) return;
+    info->source_size = df_stat.st_size;
+    info->source_mtime = df_stat.st_mtime;
+    info->source_inode = df_stat.st_ino;
+
+    uint8_t * block = malloc(DF_HASH_BLOCK);
+    if(!block) return;
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    off_t offsets[3] = { 0, df_stat.st_size / 2, MAX(df_stat.st_size - DF_HASH_BLOCK, 0) };
+    for(int i = 0; i < 3; i++)
     {
-        free(df_mlv->audio_data);
-        df_mlv->audio_data = NULL;
+        ssize_t got = pread(fd, block, DF_HASH_BLOCK, offsets[i]);
+        for(ssize_t j = 0; j < got; j++)
+        {
+            hash ^= block[j];
+            hash *= 0x100000001b3ULL;
+        }
     }
+    free(block);
+    info->source_hash = hash;
+}
+
+static void df_master_path(char * path, size_t size, const char * directory, const mlv_dark_hdr_t * key)
+{
+    snprintf(path, size, "%s/%x_%ix%i_%i_iso%u_%llu.dfm", directory, key->cameraModel, key->xRes, key->yRes,
+             key->bits_per_pixel, key->isoValue, (unsigned long long)key->shutterValue);
+}
+
+/* hands a copy of the master to the clip */
+static int df_set_dark_frame(mlvObject_t * video, const mlv_dark_hdr_t * hdr, const uint16_t * data)
+{
+    uint32_t size = hdr->xRes * hdr->yRes * 2;
+    uint16_t * dark_frame_data = malloc(size + 4);
+    if(!dark_frame_data) return 0;
+    memcpy(dark_frame_data, data, size);
+
+    /* Free all data related to the dark frame if needed */
+    df_free(video);
+    memcpy(&video->llrawproc->dark_frame_hdr, hdr, sizeof(mlv_dark_hdr_t));
+    video->llrawproc->dark_frame_size = size;
+    video->llrawproc->dark_frame_data = dark_frame_data;
+    return 1;
+}
+
+/* keeps the master for the process and writes it to the master directory if save is set */
+static void df_keep_master(const df_master_file_t * info, const mlv_dark_hdr_t * hdr, const uint16_t * data, int save)
+{
+    uint32_t pixels = hdr->xRes * hdr->yRes;
+    uint16_t * kept = malloc(pixels * 2 + 4);
+    if(!kept) return;
+    memcpy(kept, data, pixels * 2);
+
+    char file_name[1024] = { 0 };
+    pthread_mutex_lock(&df_master_mutex);
+    free(df_kept_data);
+    df_kept_data = kept;
+    df_kept_info = *info;
+    df_kept_hdr = *hdr;
+    if(save && df_master_directory) df_master_path(file_name, sizeof(file_name), df_master_directory, hdr);
+    pthread_mutex_unlock(&df_master_mutex);
+    if(!file_name[0]) return;
 
-    /* Now free these */
-    if(df_mlv->cached_frames)
+    /* packing writes 32 bit words, so a little spare room at the end */
+    uint8_t * packed = calloc(info->data_size + 4, 1);
+    if(!packed) return;
+    dng_pack_image_bits((uint16_t *)packed, (uint16_t *)data, hdr->xRes, hdr->yRes, hdr->bits_per_pixel, 0);
+
+    FILE * f = fopen(file_name, "wb");
+    if(f)
     {
-        free(df_mlv->cached_frames);
-        df_mlv->cached_frames = NULL;
+        if( fwrite(info, sizeof(df_master_file_t), 1, f) != 1 ||
+            fwrite(hdr, sizeof(mlv_dark_hdr_t), 1, f) != 1 ||
+            fwrite(packed, info->data_size, 1, f) != 1 )
+        {
+            fclose(f);
+            remove(file_name);
+        }
+        else
+        {
+            fclose(f);
+#ifndef STDOUT_SILENT
+            printf("DF: master saved to %s\n", file_name);
+#endif
+        }
     }
-    if(df_mlv->rgb_raw_frames) free(df_mlv->rgb_raw_frames);
-    if(df_mlv->rgb_raw_current_frame) free(df_mlv->rgb_raw_current_frame);
-    if(df_mlv->cache_memory_block) free(df_mlv->cache_memory_block);
-    if(df_mlv->path) free(df_mlv->path);
-
-    /* Mutex things here... */
-    for (int i = 0; i < df_mlv->filenum; ++i)
-        if(df_mlv->main_file_mutex) pthread_mutex_destroy(df_mlv->main_file_mutex + i);
-    if(df_mlv->main_file_mutex) free(df_mlv->main_file_mutex);
-    pthread_mutex_destroy(&df_mlv->g_mutexFind);
-    pthread_mutex_destroy(&df_mlv->g_mutexCount);
-    pthread_mutex_destroy(&df_mlv->cache_mutex);
+    free(packed);
 }
 
-/* load dark frame from external averaged MLV file */
-static int df_load_ext(mlvObject_t * video, char * error_message)
+/* gives the clip a kept or saved master, returns 1 if there was one */
+static int df_use_master(mlvObject_t * video, const mlv_dark_hdr_t * key, const df_master_file_t * source)
 {
-    /* If file name is not set return error */
-    if(!video->llrawproc->dark_frame_filename) return 1;
-    /* Parse dark frame MLV */
-    mlvObject_t df_mlv = { 0 };
-    char err_msg[256] = { 0 };
-    int ret = openMlvClip(&df_mlv, &video->llrawproc->dark_frame_fds[0], 1, video->llrawproc->dark_frame_filename, 2, err_msg);
-    if(ret != 0)
+    char file_name[1024] = { 0 };
+    pthread_mutex_lock(&df_master_mutex);
+    if(df_kept_data && df_master_matches(&df_kept_info, &df_kept_hdr, key, source))
     {
+        int ret = df_set_dark_frame(video, &df_kept_hdr, df_kept_data);
+        pthread_mutex_unlock(&df_master_mutex);
 #ifndef STDOUT_SILENT
-        printf("DF: %s\n", err_msg);
+        if(ret) printf("DF: using kept master of %u frames\n", df_kept_hdr.samplesAveraged);
 #endif
-        if(error_message != NULL) strcpy(error_message, err_msg);
         return ret;
     }
+    if(df_master_directory) df_master_path(file_name, sizeof(file_name), df_master_directory, key);
+    pthread_mutex_unlock(&df_master_mutex);
+    if(!file_name[0]) return 0;
 
-    /* if lossless MLV return error */
-    if(df_mlv.MLVI.videoClass & MLV_VIDEO_CLASS_FLAG_LJ92)
+    FILE * f = fopen(file_name, "rb");
+    if(!f) return 0;
+
+    df_master_file_t info;
+    mlv_dark_hdr_t hdr;
+    if( fread(&info, sizeof(info), 1, f) != 1 || fread(&hdr, sizeof(hdr), 1, f) != 1 ||
+        memcmp(info.magic, "DFMC", 4) || info.version != DF_MASTER_VERSION ||
+        !hdr.bits_per_pixel || hdr.bits_per_pixel > 16 ||
+        info.data_size != (uint32_t)(hdr.xRes * hdr.yRes * hdr.bits_per_pixel) / 8 ||
+        !df_master_matches(&info, &hdr, key, source) )
     {
-        sprintf(err_msg, "Can not use lossless MLV as a dark frame:\n\n%s", video->llrawproc->dark_frame_filename);
+        fclose(f);
+        return 0;
+    }
+
+    uint8_t * packed = malloc(info.data_size + 4);
+    uint16_t * data = malloc(hdr.xRes * hdr.yRes * 2 + 4);
+    int ret = 0;
+    if(packed && data && fread(packed, info.data_size, 1, f) == 1)
+    {
+        dng_unpack_image_bits(data, (uint16_t *)packed, hdr.xRes, hdr.yRes, hdr.bits_per_pixel);
+        ret = df_set_dark_frame(video, &hdr, data);
+        if(ret) df_keep_master(&info, &hdr, data, 0);
 #ifndef STDOUT_SILENT
-        printf("DF: %s\n", err_msg);
+        if(ret) printf("DF: using master %s\n", file_name);
 #endif
-        if(error_message != NULL) strcpy(error_message, err_msg);
-        /* Close darkframe MLV */
-        df_unload( &df_mlv );
-        return 1;
     }
-    /* if resolution mismatch detected */
-    if( (df_mlv.RAWI.xRes != video->RAWI.xRes) || (df_mlv.RAWI.yRes != video->RAWI.yRes) )
+    fclose(f);
+    free(packed);
+    free(data);
+    return ret;
+}
+
+typedef struct
+{
+    mlvObject_t * df_mlv;
+    int method;
+    int frames;           /* frames to stack */
+    uint32_t pixels;
+    uint32_t * sum;       /* average: sum of all frames */
+    uint16_t * stack;     /* median: all frames, one after the other */
+    uint16_t * master;
+    pthread_mutex_t sum_mutex;
+    int next;             /* next frame (or row block of the median), taken with an atomic add */
+    int errors;
+} df_stack_job_t;
+
+#define DF_MEDIAN_BLOCK 4096 /* pixels a median thread takes at a time */
+
+static void * df_decode_thread(void * arg)
+{
+    df_stack_job_t * job = (df_stack_job_t *)arg;
+    mlvObject_t * df_mlv = job->df_mlv;
+    uint16_t * frame = NULL;
+    if(job->method == DF_STACK_AVERAGE)
+    {
+        frame = malloc(job->pixels * 2 + 4);
+        if(!frame)
+        {
+            __atomic_fetch_add(&job->errors, 1, __ATOMIC_RELAXED);
+            return NULL;
+        }
+    }
+
+    int k;
+    while((k = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->frames)
+    {
+        /* frames spread evenly over the clip */
+        uint64_t frame_index = ((uint64_t)k * df_mlv->frames) / job->frames;
+        uint16_t * dest = (job->method == DF_STACK_AVERAGE) ? frame : job->stack + (size_t)k * job->pixels;
+        if(getMlvRawFrameUint16(df_mlv, frame_index, dest))
+        {
+            __atomic_fetch_add(&job->errors, 1, __ATOMIC_RELAXED);
+            continue;
+        }
+        if(job->method == DF_STACK_AVERAGE)
+        {
+            pthread_mutex_lock(&job->sum_mutex);
+            for(uint32_t i = 0; i < job->pixels; i++) job->sum[i] += frame[i];
+            pthread_mutex_unlock(&job->sum_mutex);
+        }
+    }
+
+    free(frame);
+    return NULL;
+}
+
+static void * df_median_thread(void * arg)
+{
+    df_stack_job_t * job = (df_stack_job_t *)arg;
+    int values[DF_MEDIAN_FRAMES];
+    int block;
+    while((uint32_t)(block = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) * DF_MEDIAN_BLOCK < job->pixels)
+    {
+        uint32_t start = block * DF_MEDIAN_BLOCK;
+        uint32_t end = MIN(start + DF_MEDIAN_BLOCK, job->pixels);
+        for(uint32_t i = start; i < end; i++)
+        {
+            for(int k = 0; k < job->frames; k++) values[k] = job->stack[(size_t)k * job->pixels + i];
+            job->master[i] = kth_smallest_int(values, job->frames, job->frames / 2);
+        }
+    }
+    return NULL;
+}
+
+/* stacks the frames of the dark frame clip into master, returns the number of frames or 0 */
+static int df_stack_frames(mlvObject_t * df_mlv, int method, int threads, uint16_t * master)
+{
+    df_stack_job_t job = { 0 };
+    job.df_mlv = df_mlv;
+    job.method = method;
+    job.pixels = df_mlv->RAWI.xRes * df_mlv->RAWI.yRes;
+    job.master = master;
+    job.frames = MIN((int)df_mlv->frames, (method == DF_STACK_MEDIAN) ? DF_MEDIAN_FRAMES : DF_AVERAGE_FRAMES);
+    /* odd count, so the median is a frame value */
+    if(method == DF_STACK_MEDIAN && job.frames > 1 && !(job.frames & 1)) job.frames--;
+    if(job.frames < 1) return 0;
+
+    if(method == DF_STACK_MEDIAN) job.stack = malloc((size_t)job.pixels * job.frames * 2 + 4);
+    else job.sum = calloc(job.pixels, sizeof(uint32_t));
+    if(!job.stack && !job.sum) return 0;
+    pthread_mutex_init(&job.sum_mutex, NULL);
+
+    threads = COERCE(threads, 1, job.frames);
+    pthread_t * thread_id = alloca(threads * sizeof(pthread_t));
+    for(int t = 0; t < threads; t++) pthread_create(&thread_id[t], NULL, df_decode_thread, &job);
+    for(int t = 0; t < threads; t++) pthread_join(thread_id[t], NULL);
+
+    if(!job.errors)
+    {
+        if(method == DF_STACK_MEDIAN)
+        {
+            job.next = 0;
+            for(int t = 0; t < threads; t++) pthread_create(&thread_id[t], NULL, df_median_thread, &job);
+            for(int t = 0; t < threads; t++) pthread_join(thread_id[t], NULL);
+        }
+        else
+        {
+            uint32_t half = job.frames / 2;
+            for(uint32_t i = 0; i < job.pixels; i++) master[i] = (job.sum[i] + half) / job.frames;
+        }
+    }
+
+    pthread_mutex_destroy(&job.sum_mutex);
+    free(job.stack);
+    free(job.sum);
+    return job.errors ? 0 : job.frames;
+}
+
+/* opens the dark frame clip on its own descriptor, the caller's one stays open for next time */
+static mlvObject_t * df_open_clip(int fd, char * df_filename, char * err_msg)
+{
+    int df_fd = dup(fd);
+    char magic[4] = { 0 };
+    if(df_fd < 0 || pread(df_fd, magic, 4, 0) != 4)
+    {
+        sprintf(err_msg, "Could not open file:  %s", df_filename);
+        if(df_fd >= 0) close(df_fd);
+        return NULL;
+    }
+    lseek(df_fd, 0, SEEK_SET);
+
+    mlvObject_t * df_mlv = initMlvObject();
+    /* frames are read once, no caching */
+    df_mlv->stop_caching = 1;
+    setMlvRawCacheLimitMegaBytes(df_mlv, 0);
+
+    int ret;
+    if(!memcmp(magic, "MLVI", 4))
+        ret = openMlvClip(df_mlv, &df_fd, 1, df_filename, DF_OPEN_FULL, err_msg);
+    else
+        ret = openMcrawClip(df_mlv, df_fd, df_filename, DF_OPEN_FULL, err_msg);
+    if(ret != 0)
+    {
+        if(!df_mlv->file) close(df_fd);
+        freeMlvObject(df_mlv);
+        return NULL;
+    }
+    return df_mlv;
+}
+
+/* load dark frame from external MLV or MCRAW, stacking it to a master if there is none yet */
+static int df_load_ext(mlvObject_t * video, char * error_message)
+{
+    llrawprocObject_t * llrawproc = video->llrawproc;
+    char * df_filename = (llrawproc->dark_frame_filename && llrawproc->dark_frame_filename[0]) ? llrawproc->dark_frame_filename : "dark frame";
+    char err_msg[256] = { 0 };
+    mlv_dark_hdr_t key;
+
+    /* without the dark frame clip a master taken with the settings of the clip is used */
+    if(llrawproc->dark_frame_fds[0] < 0)
     {
-        sprintf(err_msg, "Video clip and dark frame resolutions have not matched:\n\n%s", video->llrawproc->dark_frame_filename);
+        df_fill_header(video, &key, 0);
+        if(df_use_master(video, &key, NULL)) return 0;
+        if(!llrawproc->dark_frame_filename) return 1;
+        sprintf(err_msg, "Could not open file:  %s", df_filename);
 #ifndef STDOUT_SILENT
         printf("DF: %s\n", err_msg);
 #endif
         if(error_message != NULL) strcpy(error_message, err_msg);
-        /* Close darkframe MLV */
-        df_unload( &df_mlv );
         return 1;
     }
-    /* if MLV has more than one frame just show the warning */
-    if( df_mlv.MLVI.videoFrameCount > 1 )
+
+    /* Parse dark frame clip */
+    mlvObject_t * df_mlv = df_open_clip(llrawproc->dark_frame_fds[0], df_filename, err_msg);
+    if(!df_mlv)
     {
-        sprintf(err_msg, "For proper use as a dark frame all frames of this MLV have to be averaged first:\n\n%s", video->llrawproc->dark_frame_filename);
 #ifndef STDOUT_SILENT
         printf("DF: %s\n", err_msg);
 #endif
         if(error_message != NULL) strcpy(error_message, err_msg);
+        return 1;
     }
 
-    /* Allocate dark frame data buffer */
-    uint8_t * df_packed_buf = calloc(df_mlv.video_index[0].frame_size, 1);
-    if(!df_packed_buf)
+    /* if resolution mismatch detected */
+    if( (df_mlv->RAWI.xRes != video->RAWI.xRes) || (df_mlv->RAWI.yRes != video->RAWI.yRes) )
     {
-        sprintf(err_msg, "Packed buffer allocation error");
+        sprintf(err_msg, "Video clip and dark frame resolutions have not matched:\n\n%s", df_filename);
 #ifndef STDOUT_SILENT
         printf("DF: %s\n", err_msg);
 #endif
         if(error_message != NULL) strcpy(error_message, err_msg);
-        /* Close darkframe MLV */
-        df_unload( &df_mlv );
+        /* Close darkframe clip */
+        freeMlvObject(df_mlv);
         return 1;
     }
-    /* Load dark frame data to the allocated buffer */
-    file_set_pos(df_mlv.file[0], df_mlv.video_index[0].frame_offset, SEEK_SET);
-    if ( fread(df_packed_buf, df_mlv.video_index[0].frame_size, 1, df_mlv.file[0]) != 1 )
+
+    /* master of this very clip, stacked the same way */
+    df_master_file_t info = { .magic = "DFMC", .version = DF_MASTER_VERSION,
+                              .stack_method = llrawproc->dark_frame_stack, .source_frames = df_mlv->frames };
+    df_source_identity(llrawproc->dark_frame_fds[0], &info);
+    df_fill_header(df_mlv, &key, 0);
+    if(df_use_master(video, &key, &info))
+    {
+        freeMlvObject(df_mlv);
+        return 0;
+    }
+
+    /* Stack all frames into the master */
+    uint16_t * master = calloc(key.xRes * key.yRes * 2 + 4, 1);
+    int samples = master ? df_stack_frames(df_mlv, info.stack_method, video->cpu_cores, master) : 0;
+    freeMlvObject(df_mlv);
+    if(!samples)
     {
-        sprintf(err_msg, "Could not read dark frame from the file:\n\n%s", video->llrawproc->dark_frame_filename);
+        sprintf(err_msg, "Could not read dark frame from the file:\n\n%s", df_filename);
 #ifndef STDOUT_SILENT
         printf("DF: %s\n", err_msg);
 #endif
         if(error_message != NULL) strcpy(error_message, err_msg);
-        free(df_packed_buf);
-        /* Close darkframe MLV */
-        df_unload( &df_mlv );
+        free(master);
         return 1;
     }
-    /* Free all data related to the dark frame if needed */
-    df_free(video);
-    /* Fill DARK block header */
-    memcpy(&video->llrawproc->dark_frame_hdr.blockType, "DARK", 4);
-    video->llrawproc->dark_frame_hdr.blockSize = sizeof(mlv_dark_hdr_t) + df_mlv.video_index[0].frame_size;
-    video->llrawproc->dark_frame_hdr.timestamp = 0xFFFFFFFFFFFFFFFF;
-    video->llrawproc->dark_frame_hdr.samplesAveraged = MAX(df_mlv.VIDF.frameNumber + 1, df_mlv.MLVI.videoFrameCount);
-    video->llrawproc->dark_frame_hdr.cameraModel = df_mlv.IDNT.cameraModel;
-    video->llrawproc->dark_frame_hdr.xRes = df_mlv.RAWI.xRes;
-    video->llrawproc->dark_frame_hdr.yRes = df_mlv.RAWI.yRes;
-    video->llrawproc->dark_frame_hdr.rawWidth = df_mlv.RAWI.raw_info.width;
-    video->llrawproc->dark_frame_hdr.rawHeight = df_mlv.RAWI.raw_info.height;
-    video->llrawproc->dark_frame_hdr.bits_per_pixel = df_mlv.RAWI.raw_info.bits_per_pixel;
-    video->llrawproc->dark_frame_hdr.black_level = df_mlv.RAWI.raw_info.black_level;
-    video->llrawproc->dark_frame_hdr.white_level = df_mlv.RAWI.raw_info.white_level;
-    video->llrawproc->dark_frame_hdr.sourceFpsNom = df_mlv.MLVI.sourceFpsNom;
-    video->llrawproc->dark_frame_hdr.sourceFpsDenom = df_mlv.MLVI.sourceFpsDenom;
-    video->llrawproc->dark_frame_hdr.isoMode = df_mlv.EXPO.isoMode;
-    video->llrawproc->dark_frame_hdr.isoValue = df_mlv.EXPO.isoValue;
-    video->llrawproc->dark_frame_hdr.isoAnalog = df_mlv.EXPO.isoAnalog;
-    video->llrawproc->dark_frame_hdr.digitalGain = df_mlv.EXPO.digitalGain;
-    video->llrawproc->dark_frame_hdr.shutterValue = df_mlv.EXPO.shutterValue;
-    video->llrawproc->dark_frame_hdr.binning_x = df_mlv.RAWC.binning_x;
-    video->llrawproc->dark_frame_hdr.skipping_x = df_mlv.RAWC.skipping_x;
-    video->llrawproc->dark_frame_hdr.binning_y = df_mlv.RAWC.binning_y;
-    video->llrawproc->dark_frame_hdr.skipping_y = df_mlv.RAWC.skipping_y;
-    /* Allocate the dark frame 16bit buffer */
-    video->llrawproc->dark_frame_size = df_mlv.RAWI.xRes * df_mlv.RAWI.yRes * 2;
-    video->llrawproc->dark_frame_data = calloc(video->llrawproc->dark_frame_size + 4, 1);
-    dng_unpack_image_bits(video->llrawproc->dark_frame_data, (uint16_t*)df_packed_buf, df_mlv.RAWI.xRes, df_mlv.RAWI.yRes, df_mlv.RAWI.raw_info.bits_per_pixel);
+
+    key.samplesAveraged = samples;
+    info.data_size = key.blockSize - sizeof(mlv_dark_hdr_t);
+    int ret = df_set_dark_frame(video, &key, master);
+    if(ret) df_keep_master(&info, &key, master, 1);
+    free(master);
 #ifndef STDOUT_SILENT
-    printf("DF: initialized Ext mode\n");
+    if(ret) printf("DF: initialized Ext mode, %s of %d frames\n", info.stack_method == DF_STACK_MEDIAN ? "median" : "mean", samples);
 #endif
-    free(df_packed_buf);
 
-    /* Close darkframe MLV */
-    df_unload( &df_mlv );
-
-    return 0;
+    return ret ? 0 : 1;
 }
 
 /* load dark frame from current MLVs internal DARK block header */
@@ -273,13 +596,41 @@ void df_subtract(mlvObject_t * video, uint16_t * raw_image_buff, size_t raw_imag
     uint16_t white_level = (1 << video->RAWI.raw_info.bits_per_pixel) - 1;
 
     uint32_t pixel_count = raw_image_size / 2;
-#pragma omp parallel for
-    for(uint32_t i = 0; i < pixel_count; i++)
+    uint32_t i = 0;
+
+    /* pixel + black level saturating at 16 bits, minus dark saturating at 0, then clipped to white.
+     * Same as the plain loop as long as pixel + black level can not go over 16 bits */
+    if(black_level + white_level <= 0xFFFF)
+    {
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+        uint16x8_t black = vdupq_n_u16(black_level);
+        uint16x8_t white = vdupq_n_u16(white_level);
+        for(; i + 8 <= pixel_count; i += 8)
+        {
+            uint16x8_t val = vqaddq_u16(vld1q_u16(raw_image_buff + i), black);
+            val = vqsubq_u16(val, vld1q_u16(dark_frame_data + i));
+            vst1q_u16(raw_image_buff + i, vminq_u16(val, white));
+        }
+#elif defined(__SSE2__)
+        __m128i black = _mm_set1_epi16(black_level);
+        __m128i white = _mm_set1_epi16(white_level);
+        for(; i + 8 <= pixel_count; i += 8)
+        {
+            __m128i val = _mm_adds_epu16(_mm_loadu_si128((__m128i *)(raw_image_buff + i)), black);
+            val = _mm_subs_epu16(val, _mm_loadu_si128((__m128i *)(dark_frame_data + i)));
+            /* no unsigned 16 bit min in SSE2 */
+            val = _mm_sub_epi16(val, _mm_subs_epu16(val, white));
+            _mm_storeu_si128((__m128i *)(raw_image_buff + i), val);
+        }
+#endif
+    }
+
+    for(; i < pixel_count; i++)
     {
         int32_t orig_val = raw_image_buff[i];
         int32_t dark_val = dark_frame_data[i];
 
-        raw_image_buff[i] = COERCE( orig_val - dark_val + black_level, 0, white_level );
+        raw_image_buff[i] = COERCE( orig_val - dark_val + (int32_t)black_level, 0, white_level );
     }
 }
 
@@ -24,14 +24,25 @@
 #include "../mlv_object.h"
 
 /* from video_mlv.c */
+extern mlvObject_t * initMlvObject();
+extern void freeMlvObject(mlvObject_t * video);
 extern int openMlvClip(mlvObject_t * video, int * fds, int numFds, char * mlvPath, int open_mode, char * error_message);
+extern int openMcrawClip(mlvObject_t * video, int fd, char * mcrawPath, int open_mode, char * error_message);
+extern int getMlvRawFrameUint16(mlvObject_t * video, uint64_t frameIndex, uint16_t * unpackedFrame);
+/* from frame_caching.c */
+extern void setMlvRawCacheLimitMegaBytes(mlvObject_t * video, uint64_t megaByteLimit);
 /* from dng.c */
 extern void dng_unpack_image_bits(uint16_t * input_buffer, uint16_t * output_buffer, int width, int height, uint32_t bpp);
+extern void dng_pack_image_bits(uint16_t * output_buffer, uint16_t * input_buffer, int width, int height, uint32_t bpp, int big_endian);
 
 void df_init_filename(mlvObject_t * video, char * df_filename);
 void df_free_filename(mlvObject_t * video);
 
 enum { DF_OFF, DF_EXT, DF_INT };
+/* how the frames of an external dark frame clip are stacked into the master */
+enum { DF_STACK_AVERAGE, DF_STACK_MEDIAN };
+/* directory stacked masters are kept in for the whole process, NULL = only in memory */
+void df_set_master_directory(const char * directory);
 int df_validate(mlvObject_t * video, char * df_filename, char * error_message);
 int df_init(mlvObject_t * video);
 void df_free(mlvObject_t * video);
@@ -28,6 +28,9 @@
 #include "opt_med.h"
 #include "wirth.h"
 #include <pthread.h>
+#if defined(__linux)
+#include <alloca.h>
+#endif
 #include "../../debayer/debayer.h"
 
 #define EV_RESOLUTION 65536
@@ -243,11 +246,17 @@ int diso_get_preview(uint16_t * image_data, uint16_t width, uint16_t height, int
 
 
 //from cr2hdr 20bit version
-//this is not thread safe (yet)
+//frames can run in parallel as long as each one has its own diso_context_t
 
 #define BRIGHT_ROW (is_bright[y % 4])
 #define COUNT(x) ((int)(sizeof(x)/sizeof((x)[0])))
 
+/* per frame refinement of the clip calibration: share of the difference a frame gets,
+ * and how far from the clip values it can go (EV, 20 bit black) */
+#define DISO_REFINE_WEIGHT 0.25
+#define DISO_REFINE_MAX_EV 0.1
+#define DISO_REFINE_MAX_BLACK 256
+
 #define raw_get_pixel(x,y) (image_data[(x) + (y) * raw_info.width])
 #define raw_get_pixel16(x,y) (image_data[(x) + (y) * raw_info.width])
 #define raw_get_pixel_14to20(x,y) ((((uint32_t)image_data[(x) + (y) * raw_info.width]) << 6) & 0xFFFFF)
@@ -415,10 +424,12 @@ void fast_randn_init()
     }
 }
 
+/* position in randn05_cache, frames take w * h samples of it in one go */
+static int randn05_pos = 0;
+
 float fast_randn05()
 {
-    static int k = 0;
-    return randn05_cache[(k++) & 1023];
+    return randn05_cache[__atomic_fetch_add(&randn05_pos, 1, __ATOMIC_RELAXED) & 1023];
 }
 
 static int identify_rggb_or_gbrg(struct raw_info raw_info, uint16_t * image_data)
@@ -960,7 +971,7 @@ static void match_by_histogram(struct raw_info raw_info, uint32_t * raw_buffer_3
     *black_delta = b * 16;
 }
 
-static int match_exposures(struct raw_info raw_info, uint32_t * raw_buffer_32, int dark_frame, int iso1, int iso2, int * auto_correction, double * ev_correction, int * black_delta, int * white_darkened, int * is_bright)
+static int match_exposures(struct raw_info raw_info, uint32_t * raw_buffer_32, int dark_frame, int iso1, int iso2, const diso_calibration_t * calibration, int refine, int * auto_correction, double * ev_correction, int * black_delta, int * white_darkened, int * is_bright)
 {
     int black = raw_info.black_level;
     int white = MIN(raw_info.white_level, *white_darkened);
@@ -991,9 +1002,29 @@ static int match_exposures(struct raw_info raw_info, uint32_t * raw_buffer_32, i
             _black_delta = ((high_iso / 100) * 64) - ((low_iso / 100) * 64);
         }
     }
-    else if (*auto_correction == -2)
+    else if (*auto_correction == -2 && (*ev_correction == 1 || *black_delta == -1))
     {
-        match_by_histogram(raw_info, raw_buffer_32, &_ev_correction, &_black_delta, white_darkened, is_bright);
+        if (calibration)
+        {
+            /* matched once for the clip, a frame may only pull it a little bit its own way,
+             * so the correction can't flicker from frame to frame */
+            _ev_correction = calibration->ev_correction;
+            _black_delta = calibration->black_delta;
+
+            if (refine)
+            {
+                double frame_ev_correction = 0.0;
+                int frame_black_delta = 0;
+                match_by_histogram(raw_info, raw_buffer_32, &frame_ev_correction, &frame_black_delta, white_darkened, is_bright);
+
+                _ev_correction += DISO_REFINE_WEIGHT * COERCE(frame_ev_correction - _ev_correction, -DISO_REFINE_MAX_EV, DISO_REFINE_MAX_EV);
+                _black_delta += DISO_REFINE_WEIGHT * COERCE(frame_black_delta - _black_delta, -DISO_REFINE_MAX_BLACK, DISO_REFINE_MAX_BLACK);
+            }
+        }
+        else
+        {
+            match_by_histogram(raw_info, raw_buffer_32, &_ev_correction, &_black_delta, white_darkened, is_bright);
+        }
     }
 
     if (*ev_correction != 1)
@@ -1051,27 +1082,178 @@ static int match_exposures(struct raw_info raw_info, uint32_t * raw_buffer_32, i
     return 1;
 }
 
-static inline uint32_t * convert_to_20bit(struct raw_info raw_info, uint16_t * image_data)
+/* Everything one full 20 bit frame needs besides the context */
+typedef struct
+{
+    struct raw_info raw_info;
+    uint16_t * image_data;
+    diso_context_t * ctx;
+    int * is_bright;
+    int black;
+    int white;
+    int white_darkened;
+    int dark_noise;
+    int * raw2ev;
+    int * ev2raw;
+    double * fullres_curve;
+
+    /* context buffers this frame uses, the smooth ones are fullres/halfres without chroma
+     * smoothing and alias_map is NULL when it is off */
+    uint32_t * fullres_smooth;
+    uint32_t * halfres_smooth;
+    uint16_t * alias_map;
+
+    /* mix_images */
+    double corr_ev;
+    double overlap;
+
+    /* amaze_interpolate */
+    int semi_overexposed, not_overexposed, deep_shadow, not_shadow;
+
+    /* hdr_chroma_smooth */
+    int chroma_smooth_method;
+    uint32_t * smooth_input;
+    uint32_t * smooth_output;
+
+    /* convert_20_to_16bit */
+    int randn05_start;
+} diso_job_t;
+
+/* One band of rows (or LUT entries) of a parallel pass */
+typedef struct
+{
+    void (*pass)(diso_job_t *, int, int);
+    diso_job_t * job;
+    int y1, y2;
+} diso_band_t;
+
+static void * diso_band_thread(void * arg)
+{
+    diso_band_t * band = (diso_band_t *)arg;
+    band->pass(band->job, band->y1, band->y2);
+    return NULL;
+}
+
+/* Runs pass over [y1, y2) split in to one band per thread. Bands start on the parity of
+ * y1, so passes working on 2x2 cells never share a cell */
+static void diso_run_bands(int threads, int y1, int y2, void (*pass)(diso_job_t *, int, int), diso_job_t * job)
+{
+    int rows = y2 - y1;
+    if (threads > rows / 16) threads = rows / 16;
+    if (threads < 2)
+    {
+        if (rows > 0) pass(job, y1, y2);
+        return;
+    }
+
+    int band_rows = (rows + threads - 1) / threads;
+    band_rows += band_rows & 1;
+
+    pthread_t * thread_id = alloca(threads * sizeof(pthread_t));
+    diso_band_t * bands = alloca(threads * sizeof(diso_band_t));
+
+    int started = 0;
+    for (int t = 0; t < threads; ++t)
+    {
+        int start = y1 + t * band_rows;
+        if (start >= y2) break;
+        bands[t] = (diso_band_t) { pass, job, start, MIN(start + band_rows, y2) };
+        pthread_create(&thread_id[t], NULL, diso_band_thread, &bands[t]);
+        started++;
+    }
+
+    for (int t = 0; t < started; ++t)
+    {
+        pthread_join(thread_id[t], NULL);
+    }
+}
+
+diso_context_t * diso_new_context(void)
 {
+    diso_context_t * ctx = calloc(1, sizeof(diso_context_t));
+    ctx->lut_black = -1;
+    ctx->fullres_curve_black = -1;
+    return ctx;
+}
+
+void diso_free_context(diso_context_t * ctx)
+{
+    if (!ctx) return;
+    free(ctx->raw_buffer_32);
+    free(ctx->dark);
+    free(ctx->bright);
+    free(ctx->fullres);
+    free(ctx->halfres);
+    free(ctx->fullres_smooth);
+    free(ctx->halfres_smooth);
+    free(ctx->gray);
+    free(ctx->overexposed);
+    free(ctx->alias_map);
+    free(ctx->aux);
+    free(ctx->edge_direction);
+    free(ctx->squeezed);
+    free(ctx->squeeze_source);
+    free(ctx->amaze_rows);
+    free(ctx->amaze_planes);
+    free(ctx->raw2ev);
+    free(ctx->ev2raw_0);
+    free(ctx->fullres_curve);
+    free(ctx->mix_curve);
+    free(ctx);
+}
+
+/* (Re)allocates the frame buffers if the frame size changed */
+static void diso_context_size(diso_context_t * ctx, int w, int h)
+{
+    if (ctx->width == w && ctx->height == h) return;
+
+    size_t px = (size_t)w * h;
+    ctx->raw_buffer_32  = realloc(ctx->raw_buffer_32,  px * sizeof(uint32_t));
+    ctx->dark           = realloc(ctx->dark,           px * sizeof(uint32_t));
+    ctx->bright         = realloc(ctx->bright,         px * sizeof(uint32_t));
+    ctx->fullres        = realloc(ctx->fullres,        px * sizeof(uint32_t));
+    ctx->halfres        = realloc(ctx->halfres,        px * sizeof(uint32_t));
+    ctx->fullres_smooth = realloc(ctx->fullres_smooth, px * sizeof(uint32_t));
+    ctx->halfres_smooth = realloc(ctx->halfres_smooth, px * sizeof(uint32_t));
+    ctx->gray           = realloc(ctx->gray,           px * sizeof(uint32_t));
+    ctx->overexposed    = realloc(ctx->overexposed,    px * sizeof(uint16_t));
+    ctx->alias_map      = realloc(ctx->alias_map,      px * sizeof(uint16_t));
+    ctx->aux            = realloc(ctx->aux,            px * sizeof(uint16_t));
+    ctx->edge_direction = realloc(ctx->edge_direction, px * sizeof(uint8_t));
+    ctx->squeezed       = realloc(ctx->squeezed,       h * sizeof(int));
+    ctx->squeeze_source = realloc(ctx->squeeze_source, h * sizeof(int));
+
+    /* AMaZe planes: rawData, red, green, blue, rows padded by 16 */
+    int wx = w + 16;
+    ctx->amaze_rows   = realloc(ctx->amaze_rows,   4 * h * sizeof(float *));
+    ctx->amaze_planes = realloc(ctx->amaze_planes, 4 * (size_t)h * wx * sizeof(float));
+    for (int i = 0; i < 4 * h; i++)
+    {
+        ctx->amaze_rows[i] = ctx->amaze_planes + (size_t)i * wx;
+    }
+
+    ctx->width = w;
+    ctx->height = h;
+}
+
+static void convert_to_20bit_pass(diso_job_t * job, int y1, int y2)
+{
+    struct raw_info raw_info = job->raw_info;
+    uint16_t * image_data = job->image_data;
+    uint32_t * __restrict raw_buffer_32 = job->ctx->raw_buffer_32;
     int w = raw_info.width;
-    int h = raw_info.height;
-    /* promote from 14 to 20 bits (original raw buffer holds 14-bit values stored as uint16_t) */
-    uint32_t * raw_buffer_32 = malloc(w * h * sizeof(raw_buffer_32[0]));
-    
-    #pragma omp parallel for collapse(2)
-    for (int y = 0; y < h; y ++)
+
+    for (int y = y1; y < y2; y ++)
         for (int x = 0; x < w; x ++)
             raw_buffer_32[x + y*w] = raw_get_pixel_14to20(x, y);
-    
-    return raw_buffer_32;
 }
 
-static inline void build_ev2raw_lut(int * raw2ev, int * ev2raw_0, int black, int white)
+static void raw2ev_pass(diso_job_t * job, int i1, int i2)
 {
-    int* ev2raw = ev2raw_0 + 10*EV_RESOLUTION;
-    
-    #pragma omp parallel for
-    for (int i = 0; i < 1<<20; i++)
+    int * raw2ev = job->ctx->raw2ev;
+    int black = job->black;
+
+    for (int i = i1; i < i2; i++)
     {
         double signal = MAX(i/64.0 - black/64.0, -1023);
         if (signal > 0)
@@ -1079,34 +1261,66 @@ static inline void build_ev2raw_lut(int * raw2ev, int * ev2raw_0, int black, int
         else
             raw2ev[i] = -(int)round(log2(1-signal) * EV_RESOLUTION);
     }
-    
-    #pragma omp parallel for
-    for (int i = -10*EV_RESOLUTION; i < 0; i++)
-    {
-        ev2raw[i] = COERCE(black+64 - round(64*pow(2, ((double)-i/EV_RESOLUTION))), 0, black);
-    }
-    
-    #pragma omp parallel for
-    for (int i = 0; i < 14*EV_RESOLUTION; i++)
+}
+
+static void ev2raw_pass(diso_job_t * job, int i1, int i2)
+{
+    int * raw2ev = job->ctx->raw2ev;
+    int * ev2raw = job->ctx->ev2raw_0 + 10*EV_RESOLUTION;
+    int black = job->black;
+    int white = job->white;
+
+    for (int i = i1; i < i2; i++)
     {
-        ev2raw[i] = COERCE(black-64 + round(64*pow(2, ((double)i/EV_RESOLUTION))), black, (1<<20)-1);
-        
-        if (i >= raw2ev[white])
+        if (i < 0)
+        {
+            ev2raw[i] = COERCE(black+64 - round(64*pow(2, ((double)-i/EV_RESOLUTION))), 0, black);
+        }
+        else
         {
-            ev2raw[i] = MAX(ev2raw[i], white);
+            ev2raw[i] = COERCE(black-64 + round(64*pow(2, ((double)i/EV_RESOLUTION))), black, (1<<20)-1);
+
+            if (i >= raw2ev[white])
+            {
+                ev2raw[i] = MAX(ev2raw[i], white);
+            }
         }
     }
-    
-    /* keep "bad" pixels, if any */
-    ev2raw[raw2ev[0]] = 0;
-    ev2raw[raw2ev[0]] = 0;
-    
+}
+
+/* for fast EV - raw conversion, rebuilt only when the levels change */
+static inline void build_ev2raw_lut(diso_job_t * job, int threads)
+{
+    diso_context_t * ctx = job->ctx;
+
+    if (!ctx->raw2ev)
+    {
+        ctx->raw2ev = malloc((1<<20) * sizeof(int));           /* EV x EV_RESOLUTION */
+        ctx->ev2raw_0 = malloc(24*EV_RESOLUTION * sizeof(int)); /* handles sub-black values (negative EV) */
+    }
+
+    if (ctx->lut_black != job->black || ctx->lut_white != job->white)
+    {
+        diso_run_bands(threads, 0, 1<<20, raw2ev_pass, job);
+        diso_run_bands(threads, -10*EV_RESOLUTION, 14*EV_RESOLUTION, ev2raw_pass, job);
+
+        /* keep "bad" pixels, if any */
+        int * ev2raw = ctx->ev2raw_0 + 10*EV_RESOLUTION;
+        ev2raw[ctx->raw2ev[0]] = 0;
+
+        ctx->lut_black = job->black;
+        ctx->lut_white = job->white;
+    }
+
+    job->raw2ev = ctx->raw2ev;
+    job->ev2raw = ctx->ev2raw_0 + 10*EV_RESOLUTION;
+
     /* check raw <--> ev conversion */
     //~ printf("%d %d %d %d %d %d %d *%d* %d %d %d %d %d\n", raw2ev[0],         raw2ev[16000],         raw2ev[32000],         raw2ev[131068],         raw2ev[131069],         raw2ev[131070],         raw2ev[131071],         raw2ev[131072],         raw2ev[131073],         raw2ev[131074],         raw2ev[131075],         raw2ev[131076],         raw2ev[132000]);
     //~ printf("%d %d %d %d %d %d %d *%d* %d %d %d %d %d\n", ev2raw[raw2ev[0]], ev2raw[raw2ev[16000]], ev2raw[raw2ev[32000]], ev2raw[raw2ev[131068]], ev2raw[raw2ev[131069]], ev2raw[raw2ev[131070]], ev2raw[raw2ev[131071]], ev2raw[raw2ev[131072]], ev2raw[raw2ev[131073]], ev2raw[raw2ev[131074]], ev2raw[raw2ev[131075]], ev2raw[raw2ev[131076]], ev2raw[raw2ev[132000]]);
 }
 
-static inline double compute_noise(struct raw_info raw_info, uint16_t * image_data, double * noise_std, double * dark_noise, double * bright_noise, double * dark_noise_ev, double * bright_noise_ev)
+static inline void measure_noise(struct raw_info raw_info, uint16_t * image_data, double * noise_std)
 {
     double noise_avg = 0.0;
     for (int y = 0; y < 4; y++)
@@ -1114,37 +1328,48 @@ static inline double compute_noise(struct raw_info raw_info, uint16_t * image_da
 #ifndef STDOUT_SILENT
     printf("Noise levels    : %.02f %.02f %.02f %.02f (14-bit)\n", noise_std[0], noise_std[1], noise_std[2], noise_std[3]);
 #endif
+}
+
+static inline void noise_levels(double * noise_std, double * dark_noise, double * bright_noise, double * dark_noise_ev, double * bright_noise_ev)
+{
     *dark_noise = MIN(MIN(noise_std[0], noise_std[1]), MIN(noise_std[2], noise_std[3]));
     *bright_noise = MAX(MAX(noise_std[0], noise_std[1]), MAX(noise_std[2], noise_std[3]));
     *dark_noise_ev = log2(*dark_noise);
     *bright_noise_ev = log2(*bright_noise);
-    return noise_avg;
 }
 
-static inline double * build_fullres_curve(int black)
+static void fullres_curve_pass(diso_job_t * job, int i1, int i2)
 {
-    /* fullres mixing curve */
-    static double fullres_curve[1<<20];
-    static int previous_black = -1;
-    
-    if(previous_black == black) return fullres_curve;
-    
-    previous_black = black;
-    
+    double * fullres_curve = job->ctx->fullres_curve;
+    int black = job->black;
+
     const double fullres_start = 4;
     const double fullres_transition = 4;
     //const double fullres_thr = 0.8;
-    
-    #pragma omp parallel for
-    for (int i = 0; i < (1<<20); i++)
+
+    for (int i = i1; i < i2; i++)
     {
         double ev2 = log2(MAX(i/64.0 - black/64.0, 1));
         double c2 = -cos(COERCE(ev2 - fullres_start, 0, fullres_transition)*M_PI/fullres_transition);
         double f = (c2+1) / 2;
         fullres_curve[i] = f;
     }
-    
-    return fullres_curve;
+}
+
+/* fullres mixing curve */
+static inline void build_fullres_curve(diso_job_t * job, int threads)
+{
+    diso_context_t * ctx = job->ctx;
+
+    if (!ctx->fullres_curve) ctx->fullres_curve = malloc((1<<20) * sizeof(double));
+
+    if (ctx->fullres_curve_black != job->black)
+    {
+        diso_run_bands(threads, 0, 1<<20, fullres_curve_pass, job);
+        ctx->fullres_curve_black = job->black;
+    }
+
+    job->fullres_curve = ctx->fullres_curve;
 }
 
 /* define edge directions for interpolation */
@@ -1174,7 +1399,7 @@ edge_directions[] = {       /* note: all y coords should be multiplied by s */
 
 static inline int edge_interp(float ** plane, int * squeezed, int * raw2ev, int dir, int x, int y, int s)
 {
-    
+
     int dxa = edge_directions[dir].a.x;
     int dya = edge_directions[dir].a.y * s;
     int pa = COERCE((int)plane[squeezed[y+dya]][x+dxa], 0, 0xFFFFF);
@@ -1182,7 +1407,7 @@ static inline int edge_interp(float ** plane, int * squeezed, int * raw2ev, int
     int dyb = edge_directions[dir].b.y * s;
     int pb = COERCE((int)plane[squeezed[y+dyb]][x+dxb], 0, 0xFFFFF);
     int pi = (raw2ev[pa] * 2 + raw2ev[pb]) / 3;
-    
+
     return pi;
 }
 
@@ -1192,81 +1417,293 @@ static void* demosaic_wrapper(void* arg) {
     return NULL;
 }
 
-static inline void amaze_interpolate(struct raw_info raw_info, uint32_t * raw_buffer_32, uint32_t* dark, uint32_t* bright, int black, int white, int white_darkened, int * is_bright, int threads)
+/* squeeze the dark image by deleting fields from the bright exposure, and the bright one the same way;
+ * goes over the squeezed rows, so each one is written once, from the row that was squeezed there last */
+static void amaze_squeeze_pass(diso_job_t * job, int y1, int y2)
+{
+    struct raw_info raw_info = job->raw_info;
+    uint32_t * raw_buffer_32 = job->ctx->raw_buffer_32;
+    int * squeeze_source = job->ctx->squeeze_source;
+    float ** rawData = job->ctx->amaze_rows;
+    int black = job->black;
+    int w = raw_info.width;
+
+    for (int yh = y1; yh < y2; yh ++)
+    {
+        int y = squeeze_source[yh];
+        if (y < 0)
+            continue;
+
+        float * row = rawData[yh];
+        for (int x = 0; x < w; x++)
+        {
+            int p = raw_get_pixel32(x, y);
+
+            if (x%2 != y%2) /* divide green channel by 2 to approximate the final WB better */
+                p = (p - black) / 2 + black;
+
+            row[x] = p;
+        }
+    }
+}
+
+/* undo green channel scaling and clamp the other channels */
+static void amaze_clamp_pass(diso_job_t * job, int y1, int y2)
+{
+    diso_context_t * ctx = job->ctx;
+    int w = job->raw_info.width;
+    int h = job->raw_info.height;
+    int black = job->black;
+    float ** red   = ctx->amaze_rows + h;
+    float ** green = ctx->amaze_rows + 2*h;
+    float ** blue  = ctx->amaze_rows + 3*h;
+
+    for (int y = y1; y < y2; y ++)
+    {
+        for (int x = 0; x < w; x ++)
+        {
+            green[y][x] = COERCE((green[y][x] - black) * 2 + black, 0, 0xFFFFF);
+            red[y][x] = COERCE(red[y][x], 0, 0xFFFFF);
+            blue[y][x] = COERCE(blue[y][x], 0, 0xFFFFF);
+        }
+    }
+}
+
+/* convert to grayscale and de-squeeze for easier processing */
+static void amaze_desqueeze_pass(diso_job_t * job, int y1, int y2)
+{
+    diso_context_t * ctx = job->ctx;
+    int w = job->raw_info.width;
+    int h = job->raw_info.height;
+    float ** red   = ctx->amaze_rows + h;
+    float ** green = ctx->amaze_rows + 2*h;
+    float ** blue  = ctx->amaze_rows + 3*h;
+    int * squeezed = ctx->squeezed;
+    uint32_t * gray = ctx->gray;
+    uint8_t * edge_direction = ctx->edge_direction;
+    int d0 = COUNT(edge_directions)/2;
+
+    for (int y = y1; y < y2; y ++)
+    {
+        for (int x = 0; x < w; x ++)
+        {
+            gray[x + y*w] = green[squeezed[y]][x]/2 + red[squeezed[y]][x]/4 + blue[squeezed[y]][x]/4;
+        }
+        memset(edge_direction + y*w, d0, w);
+    }
+}
+
+static void amaze_edge_pass(diso_job_t * job, int y1, int y2)
+{
+    struct raw_info raw_info = job->raw_info;
+    uint32_t * raw_buffer_32 = job->ctx->raw_buffer_32;
+    uint32_t * gray = job->ctx->gray;
+    uint8_t * edge_direction = job->ctx->edge_direction;
+    double * fullres_curve = job->fullres_curve;
+    int * raw2ev = job->raw2ev;
+    int * is_bright = job->is_bright;
+    int white_darkened = job->white_darkened;
+    int w = raw_info.width;
+    int d0 = COUNT(edge_directions)/2;
+
+    int semi_overexposed = 0;
+    int not_overexposed = 0;
+    int deep_shadow = 0;
+    int not_shadow = 0;
+
+    for (int y = y1; y < y2; y ++)
+    {
+        int s = (is_bright[y%4] == is_bright[(y+1)%4]) ? -1 : 1;    /* points to the closest row having different exposure */
+        for (int x = 5; x < w-5; x ++)
+        {
+            int e_best = INT_MAX;
+            int d_best = d0;
+            int dmin = 0;
+            int dmax = COUNT(edge_directions)-1;
+            int search_area = 5;
+
+            /* only use high accuracy on the dark exposure where the bright ISO is overexposed */
+            if (!BRIGHT_ROW)
+            {
+                /* interpolating bright exposure */
+                if (fullres_curve[raw_get_pixel32(x, y)] > fullres_thr)
+                {
+                    /* no high accuracy needed, just interpolate vertically */
+                    not_shadow++;
+                    dmin = d0;
+                    dmax = d0;
+                }
+                else
+                {
+                    /* deep shadows, unlikely to use fullres, so we need a good interpolation */
+                    deep_shadow++;
+                }
+            }
+            else if (raw_get_pixel32(x, y) < (unsigned int)white_darkened)
+            {
+                /* interpolating dark exposure, but we also have good data from the bright one */
+                not_overexposed++;
+                dmin = d0;
+                dmax = d0;
+            }
+            else
+            {
+                /* interpolating dark exposure, but the bright one is clipped */
+                semi_overexposed++;
+            }
+
+            if (dmin == dmax)
+            {
+                d_best = dmin;
+            }
+            else
+            {
+                for (int d = dmin; d <= dmax; d++)
+                {
+                    int e = 0;
+                    for (int j = -search_area; j <= search_area; j++)
+                    {
+                        int dx1 = edge_directions[d].ack.x + j;
+                        int dy1 = edge_directions[d].ack.y * s;
+                        int p1 = raw2ev[gray[x+dx1 + (y+dy1)*w]];
+                        int dx2 = edge_directions[d].a.x + j;
+                        int dy2 = edge_directions[d].a.y * s;
+                        int p2 = raw2ev[gray[x+dx2 + (y+dy2)*w]];
+                        int dx3 = edge_directions[d].b.x + j;
+                        int dy3 = edge_directions[d].b.y * s;
+                        int p3 = raw2ev[gray[x+dx3 + (y+dy3)*w]];
+                        int dx4 = edge_directions[d].bck.x + j;
+                        int dy4 = edge_directions[d].bck.y * s;
+                        int p4 = raw2ev[gray[x+dx4 + (y+dy4)*w]];
+                        e += ABS(p1-p2) + ABS(p2-p3) + ABS(p3-p4);
+                    }
+
+                    /* add a small penalty for diagonal directions */
+                    /* (the improvement should be significant in order to choose one of these) */
+                    e += ABS(d - d0) * EV_RESOLUTION/8;
+
+                    if (e < e_best)
+                    {
+                        e_best = e;
+                        d_best = d;
+                    }
+                }
+            }
+
+            edge_direction[x + y*w] = d_best;
+        }
+    }
+
+    __atomic_add_fetch(&job->semi_overexposed, semi_overexposed, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&job->not_overexposed, not_overexposed, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&job->deep_shadow, deep_shadow, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&job->not_shadow, not_shadow, __ATOMIC_RELAXED);
+}
+
+static void amaze_interp_pass(diso_job_t * job, int y1, int y2)
 {
+    struct raw_info raw_info = job->raw_info;
+    diso_context_t * ctx = job->ctx;
+    uint32_t * raw_buffer_32 = ctx->raw_buffer_32;
+    uint8_t * edge_direction = ctx->edge_direction;
+    int * squeezed = ctx->squeezed;
+    int * raw2ev = job->raw2ev;
+    int * ev2raw = job->ev2raw;
+    int * is_bright = job->is_bright;
     int w = raw_info.width;
     int h = raw_info.height;
-    
-    int* squeezed = malloc(h * sizeof(int));
-    memset(squeezed, 0, h * sizeof(int));
-    
-    float** rawData = malloc(h * sizeof(rawData[0]));
-    float** red     = malloc(h * sizeof(red[0]));
-    float** green   = malloc(h * sizeof(green[0]));
-    float** blue    = malloc(h * sizeof(blue[0]));
-    
-    #pragma omp parallel for
-    for (int i = 0; i < h; i++)
+    float ** red   = ctx->amaze_rows + h;
+    float ** green = ctx->amaze_rows + 2*h;
+    float ** blue  = ctx->amaze_rows + 3*h;
+
+    for (int y = y1; y < y2; y ++)
     {
-        int wx = w + 16;
-        rawData[i] =   malloc(wx * sizeof(rawData[0][0]));
-        memset(rawData[i], 0, wx * sizeof(rawData[0][0]));
-        red[i]     = malloc(wx * sizeof(red[0][0]));
-        green[i]   = malloc(wx * sizeof(green[0][0]));
-        blue[i]    = malloc(wx * sizeof(blue[0][0]));
+        uint32_t* native = BRIGHT_ROW ? ctx->bright : ctx->dark;
+        uint32_t* interp = BRIGHT_ROW ? ctx->dark : ctx->bright;
+        int is_rg = (y % 2 == 0); /* RG or GB? */
+        int s = (is_bright[y%4] == is_bright[(y+1)%4]) ? -1 : 1;    /* points to the closest row having different exposure */
+
+        //~ printf("Interpolating %s line %d from [near] %d (squeezed %d) and [far] %d (squeezed %d)\n", BRIGHT_ROW ? "BRIGHT" : "DARK", y, y+s, yh_near, y-2*s, yh_far);
+
+        for (int x = 2; x < w-2; x += 2)
+        {
+            for (int k = 0; k < 2; k++, x++)
+            {
+                float** plane = is_rg ? (x%2 == 0 ? red   : green)
+                : (x%2 == 0 ? green : blue );
+
+                int dir = edge_direction[x + y*w];
+
+                /* vary the interpolation direction and average the result (reduces aliasing) */
+                int pi0 = edge_interp(plane, squeezed, raw2ev, dir, x, y, s);
+                int pip = edge_interp(plane, squeezed, raw2ev, MIN(dir+1, COUNT(edge_directions)-1), x, y, s);
+                int pim = edge_interp(plane, squeezed, raw2ev, MAX(dir-1,0), x, y, s);
+
+                interp[x   + y * w] = ev2raw[(2*pi0+pip+pim)/4];
+                native[x   + y * w] = raw_get_pixel32(x, y);
+            }
+            x -= 2;
+        }
     }
-    
-    /* squeeze the dark image by deleting fields from the bright exposure */
+}
+
+static inline void amaze_interpolate(diso_job_t * job, int threads)
+{
+    struct raw_info raw_info = job->raw_info;
+    diso_context_t * ctx = job->ctx;
+    int * is_bright = job->is_bright;
+    int w = raw_info.width;
+    int h = raw_info.height;
+    int * squeezed = ctx->squeezed;
+
+    float** rawData = ctx->amaze_rows;
+    float** red     = ctx->amaze_rows + h;
+    float** green   = ctx->amaze_rows + 2*h;
+    float** blue    = ctx->amaze_rows + 3*h;
+
+    memset(squeezed, 0, h * sizeof(int));
+    memset(ctx->amaze_planes, 0, (size_t)h * (w + 16) * sizeof(float));
+
+    /* where every row goes in the squeezed image, dark rows first; the bright rows
+     * come after them, and take over the squeezed rows both of them land on */
+    int * squeeze_source = ctx->squeeze_source;
+    for (int yh = 0; yh < h; yh ++)
+        squeeze_source[yh] = -1;
+
     int yh = -1;
     for (int y = 0; y < h; y ++)
     {
         if (BRIGHT_ROW)
             continue;
-        
+
         if (yh < 0) /* make sure we start at the same parity (RGGB cell) */
             yh = y;
-        
-        for (int x = 0; x < w; x++)
-        {
-            int p = raw_get_pixel32(x, y);
-            
-            if (x%2 != y%2) /* divide green channel by 2 to approximate the final WB better */
-                p = (p - black) / 2 + black;
-            
-            rawData[yh][x] = p;
-        }
-        
+
         squeezed[y] = yh;
-        
+        squeeze_source[yh] = y;
+
         yh++;
     }
-    
+
     /* now the same for the bright exposure */
     yh = -1;
     for (int y = 0; y < h; y ++)
     {
         if (!BRIGHT_ROW)
             continue;
-        
+
         if (yh < 0) /* make sure we start with the same parity (RGGB cell) */
             yh = h/4*2 + y;
-        
-        for (int x = 0; x < w; x++)
-        {
-            int p = raw_get_pixel32(x, y);
-            
-            if (x%2 != y%2) /* divide green channel by 2 to approximate the final WB better */
-                p = (p - black) / 2 + black;
-            
-            rawData[yh][x] = p;
-        }
-        
+
         squeezed[y] = yh;
-        
+        squeeze_source[yh] = y;
+
         yh++;
         if (yh >= h) break; /* just in case */
     }
 
+    diso_run_bands(threads, 0, h, amaze_squeeze_pass, job);
+
     // Multithreaded debayer
     int* startchunk_y = malloc(threads * sizeof(int));
     int* endchunk_y = malloc(threads * sizeof(int));
@@ -1300,7 +1737,7 @@ static inline void amaze_interpolate(struct raw_info raw_info, uint32_t * raw_bu
             0,
             0
         };
-        
+
         pthread_create(&thread_id[thread], NULL, demosaic_wrapper, &amaze_arguments[thread]);
     }
 
@@ -1312,323 +1749,136 @@ static inline void amaze_interpolate(struct raw_info raw_info, uint32_t * raw_bu
     free(endchunk_y);
     free(thread_id);
     free(amaze_arguments);
-    
-    /* undo green channel scaling and clamp the other channels */
-    #pragma omp parallel for collapse(2)
-    for (int y = 0; y < h; y ++)
-    {
-        for (int x = 0; x < w; x ++)
-        {
-            green[y][x] = COERCE((green[y][x] - black) * 2 + black, 0, 0xFFFFF);
-            red[y][x] = COERCE(red[y][x], 0, 0xFFFFF);
-            blue[y][x] = COERCE(blue[y][x], 0, 0xFFFFF);
-        }
-    }
+
+    diso_run_bands(threads, 0, h, amaze_clamp_pass, job);
 #ifndef STDOUT_SILENT
     printf("Edge-directed interpolation...\n");
 #endif
     //~ printf("Grayscale...\n");
-    /* convert to grayscale and de-squeeze for easier processing */
-    uint32_t * gray = malloc(w * h * sizeof(gray[0]));
+    diso_run_bands(threads, 0, h, amaze_desqueeze_pass, job);
 
-    #pragma omp parallel for collapse(2)
-    for (int y = 0; y < h; y ++)
-        for (int x = 0; x < w; x ++)
-            gray[x + y*w] = green[squeezed[y]][x]/2 + red[squeezed[y]][x]/4 + blue[squeezed[y]][x]/4;
-    
-    
-    uint8_t* edge_direction = malloc(w * h * sizeof(edge_direction[0]));
-    int d0 = COUNT(edge_directions)/2;
-
-    #pragma omp parallel for collapse(2)
-    for (int y = 0; y < h; y ++)
-        for (int x = 0; x < w; x ++)
-            edge_direction[x + y*w] = d0;
-    
-    double * fullres_curve = build_fullres_curve(black);
-    
     //~ printf("Cross-correlation...\n");
-    
-    /* for fast EV - raw conversion */
-    static int raw2ev[1<<20];   /* EV x EV_RESOLUTION */
-    static int ev2raw_0[24*EV_RESOLUTION];
-    static int previous_black = -1;
-    
-    /* handle sub-black values (negative EV) */
-    int* ev2raw = ev2raw_0 + 10*EV_RESOLUTION;
-    
-    LOCK(ev2raw_mutex)
+    job->semi_overexposed = job->not_overexposed = job->deep_shadow = job->not_shadow = 0;
+    diso_run_bands(threads, 5, h-5, amaze_edge_pass, job);
+#ifndef STDOUT_SILENT
+    printf("Semi-overexposed: %.02f%%\n", job->semi_overexposed * 100.0 / (job->semi_overexposed + job->not_overexposed));
+    printf("Deep shadows    : %.02f%%\n", job->deep_shadow * 100.0 / (job->deep_shadow + job->not_shadow));
+#endif
+    //~ printf("Actual interpolation...\n");
+    diso_run_bands(threads, 2, h-2, amaze_interp_pass, job);
+}
+
+static void mean23_pass(diso_job_t * job, int y1, int y2)
+{
+    struct raw_info raw_info = job->raw_info;
+    uint32_t * raw_buffer_32 = job->ctx->raw_buffer_32;
+    uint32_t * dark = job->ctx->dark;
+    uint32_t * bright = job->ctx->bright;
+    int * raw2ev = job->raw2ev;
+    int * ev2raw = job->ev2raw;
+    int * is_bright = job->is_bright;
+    int white_darkened = job->white_darkened;
+    int w = raw_info.width;
+
+    for (int y = y1; y < y2; y ++)
     {
-        int semi_overexposed = 0;
-        int not_overexposed = 0;
-        int deep_shadow = 0;
-        int not_shadow = 0;
+        uint32_t* native = BRIGHT_ROW ? bright : dark;
+        uint32_t* interp = BRIGHT_ROW ? dark : bright;
+        int is_rg = (y % 2 == 0); /* RG or GB? */
+        int white = !BRIGHT_ROW ? white_darkened : raw_info.white_level;
 
-        if(black != previous_black)
+        for (int x = 2; x < w-3; x += 2)
         {
-            build_ev2raw_lut(raw2ev, ev2raw_0, black, white);
-            previous_black = black;
-        }
-        #pragma omp parallel for
-        for (int y = 5; y < h-5; y ++)
-        {
-            int s = (is_bright[y%4] == is_bright[(y+1)%4]) ? -1 : 1;    /* points to the closest row having different exposure */
-            for (int x = 5; x < w-5; x ++)
+
+            /* red/blue: interpolate from (x,y+2) and (x,y-2) */
+            /* green: interpolate from (x+1,y+1),(x-1,y+1),(x,y-2) or (x+1,y-1),(x-1,y-1),(x,y+2), whichever has the correct brightness */
+
+            int s = (is_bright[y%4] == is_bright[(y+1)%4]) ? -1 : 1;
+
+            if (is_rg)
             {
-                int e_best = INT_MAX;
-                int d_best = d0;
-                int dmin = 0;
-                int dmax = COUNT(edge_directions)-1;
-                int search_area = 5;
-                
-                /* only use high accuracy on the dark exposure where the bright ISO is overexposed */
-                if (!BRIGHT_ROW)
-                {
-                    /* interpolating bright exposure */
-                    if (fullres_curve[raw_get_pixel32(x, y)] > fullres_thr)
-                    {
-#pragma omp atomic
-                        /* no high accuracy needed, just interpolate vertically */
-                        not_shadow++;
-                        dmin = d0;
-                        dmax = d0;
-                    }
-                    else
-                    {
-#pragma omp atomic
-                        /* deep shadows, unlikely to use fullres, so we need a good interpolation */
-                        deep_shadow++;
-                    }
-                }
-                else if (raw_get_pixel32(x, y) < (unsigned int)white_darkened)
-                {
-#pragma omp atomic
-                    /* interpolating dark exposure, but we also have good data from the bright one */
-                    not_overexposed++;
-                    dmin = d0;
-                    dmax = d0;
-                }
-                else
-                {
-#pragma omp atomic
-                    /* interpolating dark exposure, but the bright one is clipped */
-                    semi_overexposed++;
-                }
-                
-                if (dmin == dmax)
-                {
-                    d_best = dmin;
-                }
-                else
-                {
-                    for (int d = dmin; d <= dmax; d++)
-                    {
-                        int e = 0;
-                        for (int j = -search_area; j <= search_area; j++)
-                        {
-                            int dx1 = edge_directions[d].ack.x + j;
-                            int dy1 = edge_directions[d].ack.y * s;
-                            int p1 = raw2ev[gray[x+dx1 + (y+dy1)*w]];
-                            int dx2 = edge_directions[d].a.x + j;
-                            int dy2 = edge_directions[d].a.y * s;
-                            int p2 = raw2ev[gray[x+dx2 + (y+dy2)*w]];
-                            int dx3 = edge_directions[d].b.x + j;
-                            int dy3 = edge_directions[d].b.y * s;
-                            int p3 = raw2ev[gray[x+dx3 + (y+dy3)*w]];
-                            int dx4 = edge_directions[d].bck.x + j;
-                            int dy4 = edge_directions[d].bck.y * s;
-                            int p4 = raw2ev[gray[x+dx4 + (y+dy4)*w]];
-                            e += ABS(p1-p2) + ABS(p2-p3) + ABS(p3-p4);
-                        }
-                        
-                        /* add a small penalty for diagonal directions */
-                        /* (the improvement should be significant in order to choose one of these) */
-                        e += ABS(d - d0) * EV_RESOLUTION/8;
-                        
-                        if (e < e_best)
-                        {
-                            e_best = e;
-                            d_best = d;
-                        }
-                    }
-                }
-                
-                edge_direction[x + y*w] = d_best;
+                int ra = raw_get_pixel32(x, y-2);
+                int rb = raw_get_pixel32(x, y+2);
+                int ri = mean2(raw2ev[ra], raw2ev[rb], raw2ev[white], 0);
+
+                int ga = raw_get_pixel32(x+1+1, y+s);
+                int gb = raw_get_pixel32(x+1-1, y+s);
+                int gc = raw_get_pixel32(x+1, y-2*s);
+                int gi = mean3(raw2ev[ga], raw2ev[gb], raw2ev[gc], raw2ev[white], 0);
+
+                interp[x   + y * w] = ev2raw[ri];
+                interp[x+1 + y * w] = ev2raw[gi];
             }
-        }
-#ifndef STDOUT_SILENT
-        printf("Semi-overexposed: %.02f%%\n", semi_overexposed * 100.0 / (semi_overexposed + not_overexposed));
-        printf("Deep shadows    : %.02f%%\n", deep_shadow * 100.0 / (deep_shadow + not_shadow));
-#endif
-        //~ printf("Actual interpolation...\n");
-        
-        #pragma omp parallel for
-        for (int y = 2; y < h-2; y ++)
-        {
-            uint32_t* native = BRIGHT_ROW ? bright : dark;
-            uint32_t* interp = BRIGHT_ROW ? dark : bright;
-            int is_rg = (y % 2 == 0); /* RG or GB? */
-            int s = (is_bright[y%4] == is_bright[(y+1)%4]) ? -1 : 1;    /* points to the closest row having different exposure */
-            
-            //~ printf("Interpolating %s line %d from [near] %d (squeezed %d) and [far] %d (squeezed %d)\n", BRIGHT_ROW ? "BRIGHT" : "DARK", y, y+s, yh_near, y-2*s, yh_far);
-            
-            for (int x = 2; x < w-2; x += 2)
+            else
             {
-                for (int k = 0; k < 2; k++, x++)
-                {
-                    float** plane = is_rg ? (x%2 == 0 ? red   : green)
-                    : (x%2 == 0 ? green : blue );
-                    
-                    int dir = edge_direction[x + y*w];
-                    
-                    /* vary the interpolation direction and average the result (reduces aliasing) */
-                    int pi0 = edge_interp(plane, squeezed, raw2ev, dir, x, y, s);
-                    int pip = edge_interp(plane, squeezed, raw2ev, MIN(dir+1, COUNT(edge_directions)-1), x, y, s);
-                    int pim = edge_interp(plane, squeezed, raw2ev, MAX(dir-1,0), x, y, s);
-                    
-                    interp[x   + y * w] = ev2raw[(2*pi0+pip+pim)/4];
-                    native[x   + y * w] = raw_get_pixel32(x, y);
-                }
-                x -= 2;
+                int ba = raw_get_pixel32(x+1  , y-2);
+                int bb = raw_get_pixel32(x+1  , y+2);
+                int bi = mean2(raw2ev[ba], raw2ev[bb], raw2ev[white], 0);
+
+                int ga = raw_get_pixel32(x+1, y+s);
+                int gb = raw_get_pixel32(x-1, y+s);
+                int gc = raw_get_pixel32(x, y-2*s);
+                int gi = mean3(raw2ev[ga], raw2ev[gb], raw2ev[gc], raw2ev[white], 0);
+
+                interp[x   + y * w] = ev2raw[gi];
+                interp[x+1 + y * w] = ev2raw[bi];
             }
+
+            native[x   + y * w] = raw_get_pixel32(x, y);
+            native[x+1 + y * w] = raw_get_pixel32(x+1, y);
         }
     }
-    UNLOCK(ev2raw_mutex)
-    
-    #pragma omp parallel for
-    for (int i = 0; i < h; i++)
-    {
-        free(rawData[i]);
-        free(red[i]);
-        free(green[i]);
-        free(blue[i]);
-    }
-    
-    free(squeezed); squeezed = 0;
-    free(rawData); rawData = 0;
-    free(red); red = 0;
-    free(green); green = 0;
-    free(blue); blue = 0;
-    free(gray); gray = 0;
-    free(edge_direction);
 }
 
-static inline void mean23_interpolate(struct raw_info raw_info, uint32_t * raw_buffer_32, uint32_t* dark, uint32_t* bright, int black, int white, int white_darkened, int * is_bright)
+static inline void mean23_interpolate(diso_job_t * job, int threads)
 {
-    int w = raw_info.width;
-    int h = raw_info.height;
 #ifndef STDOUT_SILENT
     printf("Interpolation   : mean23\n");
 #endif
-    /* for fast EV - raw conversion */
-    static int raw2ev[1<<20];   /* EV x EV_RESOLUTION */
-    static int ev2raw_0[24*EV_RESOLUTION];
-    static int previous_black = -1;
-    
-    /* handle sub-black values (negative EV) */
-    int* ev2raw = ev2raw_0 + 10*EV_RESOLUTION;
-    
-    LOCK(ev2raw_mutex)
-    {
-        if(black != previous_black)
-        {
-            build_ev2raw_lut(raw2ev, ev2raw_0, black, white);
-            previous_black = black;
-        }
-        #pragma omp parallel for
-        for (int y = 2; y < h-2; y ++)
-        {
-            uint32_t* native = BRIGHT_ROW ? bright : dark;
-            uint32_t* interp = BRIGHT_ROW ? dark : bright;
-            int is_rg = (y % 2 == 0); /* RG or GB? */
-            int white = !BRIGHT_ROW ? white_darkened : raw_info.white_level;
-            
-            for (int x = 2; x < w-3; x += 2)
-            {
-                
-                /* red/blue: interpolate from (x,y+2) and (x,y-2) */
-                /* green: interpolate from (x+1,y+1),(x-1,y+1),(x,y-2) or (x+1,y-1),(x-1,y-1),(x,y+2), whichever has the correct brightness */
-                
-                int s = (is_bright[y%4] == is_bright[(y+1)%4]) ? -1 : 1;
-                
-                if (is_rg)
-                {
-                    int ra = raw_get_pixel32(x, y-2);
-                    int rb = raw_get_pixel32(x, y+2);
-                    int ri = mean2(raw2ev[ra], raw2ev[rb], raw2ev[white], 0);
-                    
-                    int ga = raw_get_pixel32(x+1+1, y+s);
-                    int gb = raw_get_pixel32(x+1-1, y+s);
-                    int gc = raw_get_pixel32(x+1, y-2*s);
-                    int gi = mean3(raw2ev[ga], raw2ev[gb], raw2ev[gc], raw2ev[white], 0);
-                    
-                    interp[x   + y * w] = ev2raw[ri];
-                    interp[x+1 + y * w] = ev2raw[gi];
-                }
-                else
-                {
-                    int ba = raw_get_pixel32(x+1  , y-2);
-                    int bb = raw_get_pixel32(x+1  , y+2);
-                    int bi = mean2(raw2ev[ba], raw2ev[bb], raw2ev[white], 0);
-                    
-                    int ga = raw_get_pixel32(x+1, y+s);
-                    int gb = raw_get_pixel32(x-1, y+s);
-                    int gc = raw_get_pixel32(x, y-2*s);
-                    int gi = mean3(raw2ev[ga], raw2ev[gb], raw2ev[gc], raw2ev[white], 0);
-                    
-                    interp[x   + y * w] = ev2raw[gi];
-                    interp[x+1 + y * w] = ev2raw[bi];
-                }
-                
-                native[x   + y * w] = raw_get_pixel32(x, y);
-                native[x+1 + y * w] = raw_get_pixel32(x+1, y);
-            }
-        }
-    }
-    UNLOCK(ev2raw_mutex)
+    diso_run_bands(threads, 2, job->raw_info.height-2, mean23_pass, job);
 }
 
 static inline void border_interpolate(struct raw_info raw_info, uint32_t * raw_buffer_32, uint32_t* dark, uint32_t* bright, int * is_bright)
 {
     int w = raw_info.width;
     int h = raw_info.height;
-    
+
     /* border interpolation */
     for (int y = 0; y < 3; y ++)
     {
         uint32_t* native = BRIGHT_ROW ? bright : dark;
         uint32_t* interp = BRIGHT_ROW ? dark : bright;
-        
+
         for (int x = 0; x < w; x ++)
         {
             interp[x + y * w] = raw_get_pixel32(x, y+2);
             native[x + y * w] = raw_get_pixel32(x, y);
         }
     }
-    
+
     for (int y = h-4; y < h; y ++)
     {
         uint32_t* native = BRIGHT_ROW ? bright : dark;
         uint32_t* interp = BRIGHT_ROW ? dark : bright;
-        
+
         for (int x = 0; x < w; x ++)
         {
             interp[x + y * w] = raw_get_pixel32(x, y-2);
             native[x + y * w] = raw_get_pixel32(x, y);
         }
     }
-    
+
     for (int y = 2; y < h; y ++)
     {
         uint32_t* native = BRIGHT_ROW ? bright : dark;
         uint32_t* interp = BRIGHT_ROW ? dark : bright;
-        
+
         for (int x = 0; x < 2; x ++)
         {
             interp[x + y * w] = raw_get_pixel32(x, y-2);
             native[x + y * w] = raw_get_pixel32(x, y);
         }
-        
+
         for (int x = w-3; x < w; x ++)
         {
             interp[x + y * w] = raw_get_pixel32(x-2, y-2);
@@ -1637,60 +1887,65 @@ static inline void border_interpolate(struct raw_info raw_info, uint32_t * raw_b
     }
 }
 
-static inline void fullres_reconstruction(struct raw_info raw_info, uint32_t * fullres, uint32_t* dark, uint32_t* bright, uint32_t white_darkened, int * is_bright)
+/* reconstruct a full-resolution image (discard interpolated fields whenever possible) */
+/* this has full detail and lowest possible aliasing, but it has high shadow noise and color artifacts when high-iso starts clipping */
+static void fullres_pass(diso_job_t * job, int y1, int y2)
 {
-    int w = raw_info.width;
-    int h = raw_info.height;
-    
-    /* reconstruct a full-resolution image (discard interpolated fields whenever possible) */
-    /* this has full detail and lowest possible aliasing, but it has high shadow noise and color artifacts when high-iso starts clipping */
-#ifndef STDOUT_SILENT
-    printf("Full-res reconstruction...\n");
-#endif
-    #pragma omp parallel for collapse(2)
-    for (int y = 0; y < h; y ++)
+    uint32_t * __restrict fullres = job->ctx->fullres;
+    uint32_t * __restrict dark = job->ctx->dark;
+    uint32_t * __restrict bright = job->ctx->bright;
+    uint32_t white_darkened = job->white_darkened;
+    int * is_bright = job->is_bright;
+    int w = job->raw_info.width;
+
+    for (int y = y1; y < y2; y ++)
     {
-        for (int x = 0; x < w; x ++)
+        if (BRIGHT_ROW)
         {
-            if (BRIGHT_ROW)
+            for (int x = 0; x < w; x ++)
             {
                 uint32_t f = bright[x + y*w];
                 /* if the brighter copy is overexposed, the guessed pixel for sure has higher brightness */
                 fullres[x + y*w] = f < white_darkened ? f : MAX(f, dark[x + y*w]);
             }
-            else
-            {
-                fullres[x + y*w] = dark[x + y*w];
-            }
+        }
+        else
+        {
+            memcpy(fullres + y*w, dark + y*w, w * sizeof(uint32_t));
         }
     }
 }
 
-static inline void build_alias_map(struct raw_info raw_info, uint16_t* alias_map, uint32_t* fullres_smooth, uint32_t* halfres_smooth, uint32_t* bright, int dark_noise, int black, int * raw2ev)
+static inline void fullres_reconstruction(diso_job_t * job, int threads)
 {
-    if(!alias_map) return;
-    
-    int w = raw_info.width;
-    int h = raw_info.height;
-    
-    double * fullres_curve = build_fullres_curve(black);
 #ifndef STDOUT_SILENT
-    printf("Building alias map...\n");
+    printf("Full-res reconstruction...\n");
 #endif
-    uint16_t* alias_aux = malloc(w * h * sizeof(uint16_t));
-    
-    /* build the aliasing maps (where it's likely to get aliasing) */
-    /* do this by comparing fullres and halfres images */
-    /* if the difference is small, we'll prefer halfres for less noise, otherwise fullres for less aliasing */
-    #pragma omp parallel for collapse(2)
-    for (int y = 0; y < h; y ++)
+    diso_run_bands(threads, 0, job->raw_info.height, fullres_pass, job);
+}
+
+/* build the aliasing maps (where it's likely to get aliasing) */
+/* do this by comparing fullres and halfres images */
+/* if the difference is small, we'll prefer halfres for less noise, otherwise fullres for less aliasing */
+static void alias_map_pass(diso_job_t * job, int y1, int y2)
+{
+    uint16_t * alias_map = job->alias_map;
+    uint32_t * fullres_smooth = job->fullres_smooth;
+    uint32_t * halfres_smooth = job->halfres_smooth;
+    uint32_t * bright = job->ctx->bright;
+    double * fullres_curve = job->fullres_curve;
+    int * raw2ev = job->raw2ev;
+    int dark_noise = job->dark_noise;
+    int w = job->raw_info.width;
+
+    for (int y = y1; y < y2; y ++)
     {
         for (int x = 0; x < w; x ++)
         {
             /* do not compute alias map where we'll use fullres detail anyway */
             if (fullres_curve[bright[x + y*w]] > fullres_thr)
                 continue;
-            
+
             int f = fullres_smooth[x + y*w];
             int h = halfres_smooth[x + y*w];
             int fe = raw2ev[f];
@@ -1701,46 +1956,56 @@ static inline void build_alias_map(struct raw_info raw_info, uint16_t* alias_map
             alias_map[x + y*w] = MIN(MIN(e_lin/2, e_log/16), 65530);
         }
     }
-    
-    memcpy(alias_aux, alias_map, w * h * sizeof(uint16_t));
-#ifndef STDOUT_SILENT
-    printf("Filtering alias map...\n");
-#endif
-    #pragma omp parallel for collapse(2)
-    for (int y = 6; y < h-6; y ++)
+}
+
+static void alias_map_filter_pass(diso_job_t * job, int y1, int y2)
+{
+    uint16_t * alias_map = job->alias_map;
+    uint16_t * alias_aux = job->ctx->aux;
+    uint32_t * bright = job->ctx->bright;
+    double * fullres_curve = job->fullres_curve;
+    int w = job->raw_info.width;
+
+    for (int y = y1; y < y2; y ++)
     {
         for (int x = 6; x < w-6; x ++)
         {
             /* do not compute alias map where we'll use fullres detail anyway */
             if (fullres_curve[bright[x + y*w]] > fullres_thr)
                 continue;
-            
+
             /* use 5th max (out of 37) to filter isolated pixels */
             int neighbours[] = {
                                                                               -alias_map[x-2 + (y-6) * w], -alias_map[x+0 + (y-6) * w], -alias_map[x+2 + (y-6) * w],
                                                  -alias_map[x-4 + (y-4) * w], -alias_map[x-2 + (y-4) * w], -alias_map[x+0 + (y-4) * w], -alias_map[x+2 + (y-4) * w], -alias_map[x+4 + (y-4) * w],
-                    -alias_map[x-6 + (y-2) * w], -alias_map[x-4 + (y-2) * w], -alias_map[x-2 + (y-2) * w], -alias_map[x+0 + (y-2) * w], -alias_map[x+2 + (y-2) * w], -alias_map[x+4 + (y-2) * w], -alias_map[x+6 + (y-2) * w], 
-                    -alias_map[x-6 + (y+0) * w], -alias_map[x-4 + (y+0) * w], -alias_map[x-2 + (y+0) * w], -alias_map[x+0 + (y+0) * w], -alias_map[x+2 + (y+0) * w], -alias_map[x+4 + (y+0) * w], -alias_map[x+6 + (y+0) * w], 
-                    -alias_map[x-6 + (y+2) * w], -alias_map[x-4 + (y+2) * w], -alias_map[x-2 + (y+2) * w], -alias_map[x+0 + (y+2) * w], -alias_map[x+2 + (y+2) * w], -alias_map[x+4 + (y+2) * w], -alias_map[x+6 + (y+2) * w], 
+                    -alias_map[x-6 + (y-2) * w], -alias_map[x-4 + (y-2) * w], -alias_map[x-2 + (y-2) * w], -alias_map[x+0 + (y-2) * w], -alias_map[x+2 + (y-2) * w], -alias_map[x+4 + (y-2) * w], -alias_map[x+6 + (y-2) * w],
+                    -alias_map[x-6 + (y+0) * w], -alias_map[x-4 + (y+0) * w], -alias_map[x-2 + (y+0) * w], -alias_map[x+0 + (y+0) * w], -alias_map[x+2 + (y+0) * w], -alias_map[x+4 + (y+0) * w], -alias_map[x+6 + (y+0) * w],
+                    -alias_map[x-6 + (y+2) * w], -alias_map[x-4 + (y+2) * w], -alias_map[x-2 + (y+2) * w], -alias_map[x+0 + (y+2) * w], -alias_map[x+2 + (y+2) * w], -alias_map[x+4 + (y+2) * w], -alias_map[x+6 + (y+2) * w],
                                                  -alias_map[x-4 + (y+4) * w], -alias_map[x-2 + (y+4) * w], -alias_map[x+0 + (y+4) * w], -alias_map[x+2 + (y+4) * w], -alias_map[x+4 + (y+4) * w],
                                                                               -alias_map[x-2 + (y+6) * w], -alias_map[x+0 + (y+6) * w], -alias_map[x+2 + (y+6) * w],
             };
             alias_aux[x + y * w] = -kth_smallest_int(neighbours, COUNT(neighbours), 5);
         }
     }
-#ifndef STDOUT_SILENT
-    printf("Smoothing alias map...\n");
-#endif
-    /* gaussian blur */
-    #pragma omp parallel for collapse(2)
-    for (int y = 6; y < h-6; y ++)
+}
+
+/* gaussian blur */
+static void alias_map_blur_pass(diso_job_t * job, int y1, int y2)
+{
+    uint16_t * alias_map = job->alias_map;
+    uint16_t * alias_aux = job->ctx->aux;
+    uint32_t * bright = job->ctx->bright;
+    double * fullres_curve = job->fullres_curve;
+    int w = job->raw_info.width;
+
+    for (int y = y1; y < y2; y ++)
     {
         for (int x = 6; x < w-6; x ++)
         {
             /* do not compute alias map where we'll use fullres detail anyway */
             if (fullres_curve[bright[x + y*w]] > fullres_thr)
                 continue;
-            
+
             int c =
             (alias_aux[x+0 + (y+0) * w])+
             (alias_aux[x+0 + (y-2) * w] + alias_aux[x-2 + (y+0) * w] + alias_aux[x+2 + (y+0) * w] + alias_aux[x+0 + (y+2) * w]) * 820 / 1024 +
@@ -1754,10 +2019,15 @@ static inline void build_alias_map(struct raw_info raw_info, uint16_t* alias_map
             alias_map[x + y * w] = c;
         }
     }
-    
-    /* make it grayscale */
-    #pragma omp parallel for collapse(2)
-    for (int y = 2; y < h-2; y += 2)
+}
+
+/* make it grayscale */
+static void alias_map_gray_pass(diso_job_t * job, int y1, int y2)
+{
+    uint16_t * alias_map = job->alias_map;
+    int w = job->raw_info.width;
+
+    for (int y = y1; y < y2; y += 2)
     {
         for (int x = 2; x < w-2; x += 2)
         {
@@ -1766,17 +2036,37 @@ static inline void build_alias_map(struct raw_info raw_info, uint16_t* alias_map
             int c = alias_map[x   + (y+1) * w];
             int d = alias_map[x+1 + (y+1) * w];
             int C = MAX(MAX(a,b), MAX(c,d));
-            
+
             C = MIN(C, ALIAS_MAP_MAX);
-            
+
             alias_map[x   +     y * w] =
             alias_map[x+1 +     y * w] =
             alias_map[x   + (y+1) * w] =
             alias_map[x+1 + (y+1) * w] = C;
         }
     }
-    
-    free(alias_aux);
+}
+
+static inline void build_alias_map(diso_job_t * job, int threads)
+{
+    int w = job->raw_info.width;
+    int h = job->raw_info.height;
+#ifndef STDOUT_SILENT
+    printf("Building alias map...\n");
+#endif
+    diso_run_bands(threads, 0, h, alias_map_pass, job);
+
+    memcpy(job->ctx->aux, job->ctx->alias_map, w * h * sizeof(uint16_t));
+#ifndef STDOUT_SILENT
+    printf("Filtering alias map...\n");
+#endif
+    diso_run_bands(threads, 6, h-6, alias_map_filter_pass, job);
+#ifndef STDOUT_SILENT
+    printf("Smoothing alias map...\n");
+#endif
+    diso_run_bands(threads, 6, h-6, alias_map_blur_pass, job);
+
+    diso_run_bands(threads, 2, h-2, alias_map_gray_pass, job);
 }
 
 #define CHROMA_SMOOTH_TYPE uint32_t
@@ -1793,24 +2083,39 @@ static inline void build_alias_map(struct raw_info raw_info, uint16_t* alias_map
 #include "chroma_smooth.c"
 #undef CHROMA_SMOOTH_5X5
 
-static inline void hdr_chroma_smooth(struct raw_info raw_info, uint32_t * input, uint32_t * output, int method, int * raw2ev, int * ev2raw)
+static void hdr_chroma_smooth_pass(diso_job_t * job, int y1, int y2)
 {
-    int w = raw_info.width;
-    int h = raw_info.height;
-    int black = raw_info.black_level;
-    int white = raw_info.white_level;
-    
-    switch (method) {
+    int w = job->raw_info.width;
+    int h = job->raw_info.height;
+    int black = job->raw_info.black_level;
+    int white = job->raw_info.white_level;
+    uint32_t * input = job->smooth_input;
+    uint32_t * output = job->smooth_output;
+
+    switch (job->chroma_smooth_method) {
         case 2:
-            chroma_smooth_2x2(w, h, input, output, raw2ev, ev2raw, black, white);
+            chroma_smooth_2x2(w, h, y1, y2, input, output, job->raw2ev, job->ev2raw, black, white);
             break;
         case 3:
-            chroma_smooth_3x3(w, h, input, output, raw2ev, ev2raw, black, white);
+            chroma_smooth_3x3(w, h, y1, y2, input, output, job->raw2ev, job->ev2raw, black, white);
             break;
         case 5:
-            chroma_smooth_5x5(w, h, input, output, raw2ev, ev2raw, black, white);
+            chroma_smooth_5x5(w, h, y1, y2, input, output, job->raw2ev, job->ev2raw, black, white);
             break;
-            
+    }
+}
+
+static inline void hdr_chroma_smooth(diso_job_t * job, uint32_t * input, uint32_t * output, int threads)
+{
+    switch (job->chroma_smooth_method) {
+        case 2:
+        case 3:
+        case 5:
+            job->smooth_input = input;
+            job->smooth_output = output;
+            diso_run_bands(threads, 0, job->raw_info.height, hdr_chroma_smooth_pass, job);
+            break;
+
         default:
 #ifndef STDOUT_SILENT
             err_printf("Unsupported chroma smooth method\n");
@@ -1819,25 +2124,111 @@ static inline void hdr_chroma_smooth(struct raw_info raw_info, uint32_t * input,
     }
 }
 
-static inline int mix_images(struct raw_info raw_info, uint32_t* fullres, uint32_t* fullres_smooth, uint32_t* halfres, uint32_t* halfres_smooth, uint16_t* alias_map, uint32_t* dark, uint32_t* bright, uint16_t * overexposed, int dark_noise, uint32_t white_darkened, double corr_ev, double lowiso_dr, uint32_t black, uint32_t white, int chroma_smooth_method)
+/* mixing curve */
+static void mix_curve_pass(diso_job_t * job, int i1, int i2)
 {
-    int w = raw_info.width;
-    int h = raw_info.height;
-    
+    double * mix_curve = job->ctx->mix_curve;
+    double max_ev = log2(job->white/64 - job->black/64);
+    double overlap = job->overlap;
+
+    for (int i = i1; i < i2; i++)
+    {
+        double ev = log2(MAX(i/64.0 - job->black/64.0, 1)) + job->corr_ev;
+        double c = -cos(MAX(MIN(ev-(max_ev-overlap),overlap),0)*M_PI/overlap);
+        double k = (c+1) / 2;
+        mix_curve[i] = k;
+    }
+}
+
+static void mix_pass(diso_job_t * job, int y1, int y2)
+{
+    diso_context_t * ctx = job->ctx;
+    uint32_t * __restrict halfres = ctx->halfres;
+    uint32_t * __restrict dark = ctx->dark;
+    uint32_t * __restrict bright = ctx->bright;
+    uint16_t * __restrict overexposed = ctx->overexposed;
+    double * mix_curve = ctx->mix_curve;
+    int * raw2ev = job->raw2ev;
+    int * ev2raw = job->ev2raw;
+    uint32_t white_darkened = job->white_darkened;
+    uint32_t white = job->white;
+    int w = job->raw_info.width;
+
+    for (int y = y1; y < y2; y ++)
+    {
+        for (int x = 0; x < w; x ++)
+        {
+            /* bright and dark source pixels  */
+            /* they may be real or interpolated */
+            /* they both have the same brightness (they were adjusted before this loop), so we are ready to mix them */
+            int b = bright[x + y*w];
+            int d = dark[x + y*w];
+
+            /* go from linear to EV space */
+            int bev = raw2ev[b];
+            int dev = raw2ev[d];
+
+            /* blending factor */
+            double k = COERCE(mix_curve[b & 0xFFFFF], 0, 1);
+
+            /* mix bright and dark exposures */
+            int mixed = bev * (1-k) + dev * k;
+            halfres[x + y*w] = ev2raw[mixed];
+        }
+
+        for (int x = 0; x < w; x ++)
+        {
+            overexposed[x + y * w] = bright[x + y * w] >= white_darkened || dark[x + y * w] >= white ? 100 : 0;
+        }
+    }
+}
+
+/* "blur" the overexposed map */
+static void overexposed_blur_pass(diso_job_t * job, int y1, int y2)
+{
+    uint16_t * __restrict overexposed = job->ctx->overexposed;
+    uint16_t * __restrict over_aux = job->ctx->aux;
+    int w = job->raw_info.width;
+
+    for (int y = y1; y < y2; y ++)
+    {
+        for (int x = 3; x < w-3; x ++)
+        {
+            overexposed[x + y * w] =
+            (over_aux[x+0 + (y+0) * w])+
+            (over_aux[x+0 + (y-1) * w] + over_aux[x-1 + (y+0) * w] + over_aux[x+1 + (y+0) * w] + over_aux[x+0 + (y+1) * w]) * 820 / 1024 +
+            (over_aux[x-1 + (y-1) * w] + over_aux[x+1 + (y-1) * w] + over_aux[x-1 + (y+1) * w] + over_aux[x+1 + (y+1) * w]) * 657 / 1024 +
+            //~ (over_aux[x+0 + (y-2) * w] + over_aux[x-2 + (y+0) * w] + over_aux[x+2 + (y+0) * w] + over_aux[x+0 + (y+2) * w]) * 421 / 1024 +
+            //~ (over_aux[x-1 + (y-2) * w] + over_aux[x+1 + (y-2) * w] + over_aux[x-2 + (y-1) * w] + over_aux[x+2 + (y-1) * w] + over_aux[x-2 + (y+1) * w] + over_aux[x+2 + (y+1) * w] + over_aux[x-1 + (y+2) * w] + over_aux[x+1 + (y+2) * w]) * 337 / 1024 +
+            //~ (over_aux[x-2 + (y-2) * w] + over_aux[x+2 + (y-2) * w] + over_aux[x-2 + (y+2) * w] + over_aux[x+2 + (y+2) * w]) * 173 / 1024 +
+            //~ (over_aux[x+0 + (y-3) * w] + over_aux[x-3 + (y+0) * w] + over_aux[x+3 + (y+0) * w] + over_aux[x+0 + (y+3) * w]) * 139 / 1024 +
+            //~ (over_aux[x-1 + (y-3) * w] + over_aux[x+1 + (y-3) * w] + over_aux[x-3 + (y-1) * w] + over_aux[x+3 + (y-1) * w] + over_aux[x-3 + (y+1) * w] + over_aux[x+3 + (y+1) * w] + over_aux[x-1 + (y+3) * w] + over_aux[x+1 + (y+3) * w]) * 111 / 1024 +
+            //~ (over_aux[x-2 + (y-3) * w] + over_aux[x+2 + (y-3) * w] + over_aux[x-3 + (y-2) * w] + over_aux[x+3 + (y-2) * w] + over_aux[x-3 + (y+2) * w] + over_aux[x+3 + (y+2) * w] + over_aux[x-2 + (y+3) * w] + over_aux[x+2 + (y+3) * w]) * 57 / 1024;
+            0;
+        }
+    }
+}
+
+static inline int mix_images(diso_job_t * job, double lowiso_dr, int threads)
+{
+    diso_context_t * ctx = job->ctx;
+    int w = job->raw_info.width;
+    int h = job->raw_info.height;
+
     /* mix the two images */
     /* highlights:  keep data from dark image only */
     /* shadows:     keep data from bright image only */
     /* midtones:    mix data from both, to bring back the resolution */
-    
+
     /* estimate ISO overlap */
     /*
      ISO 100:       ###...........  (11 stops)
      ISO 1600:  ####..........      (10 stops)
      Combined:  XX##..............  (14 stops)
      */
-    double clipped_ev = corr_ev;
+    double clipped_ev = job->corr_ev;
     double overlap = lowiso_dr - clipped_ev;
-    
+
     /* you get better colors, less noise, but a little more jagged edges if we underestimate the overlap amount */
     /* maybe expose a tuning factor? (preference towards resolution or colors) */
     overlap -= MIN(3, overlap - 3);
@@ -1860,234 +2251,244 @@ static inline int mix_images(struct raw_info raw_info, uint32_t* fullres, uint32
 #ifndef STDOUT_SILENT
     printf("Half-res blending...\n");
 #endif
-    /* mixing curve */
-    double max_ev = log2(white/64 - black/64);
-    double * mix_curve = malloc((1<<20) * sizeof(double));
-    
-    #pragma omp parallel for
-    for (int i = 0; i < 1<<20; i++)
+    /* mixing curve, the noise based overlap moves a bit every frame but often repeats */
+    if (!ctx->mix_curve) ctx->mix_curve = malloc((1<<20) * sizeof(double));
+    job->overlap = overlap;
+    if (ctx->mix_black != job->black || ctx->mix_white != job->white
+        || ctx->mix_corr_ev != job->corr_ev || ctx->mix_overlap != overlap)
     {
-        double ev = log2(MAX(i/64.0 - black/64.0, 1)) + corr_ev;
-        double c = -cos(MAX(MIN(ev-(max_ev-overlap),overlap),0)*M_PI/overlap);
-        double k = (c+1) / 2;
-        mix_curve[i] = k;
+        diso_run_bands(threads, 0, 1<<20, mix_curve_pass, job);
+        ctx->mix_black = job->black;
+        ctx->mix_white = job->white;
+        ctx->mix_corr_ev = job->corr_ev;
+        ctx->mix_overlap = overlap;
     }
 
+    /* halfres and the overexposure map */
+    diso_run_bands(threads, 0, h, mix_pass, job);
 
-    /* for fast EV - raw conversion */
-    static int raw2ev[1<<20];   /* EV x EV_RESOLUTION */
-    static int ev2raw_0[24*EV_RESOLUTION];
-    static uint32_t previous_black = -1;
-    
-    /* handle sub-black values (negative EV) */
-    int* ev2raw = ev2raw_0 + 10*EV_RESOLUTION;
-    
-    LOCK(ev2raw_mutex)
+    if (job->chroma_smooth_method)
     {
-        if(black != previous_black)
-        {
-            build_ev2raw_lut(raw2ev, ev2raw_0, black, white);
-            previous_black = black;
-        }
-        
-        #pragma omp parallel for collapse(2)
-        for (int y = 0; y < h; y ++)
-        {
-            for (int x = 0; x < w; x ++)
-            {
-                /* bright and dark source pixels  */
-                /* they may be real or interpolated */
-                /* they both have the same brightness (they were adjusted before this loop), so we are ready to mix them */
-                int b = bright[x + y*w];
-                int d = dark[x + y*w];
-                
-                /* go from linear to EV space */
-                int bev = raw2ev[b];
-                int dev = raw2ev[d];
-                
-                /* blending factor */
-                double k = COERCE(mix_curve[b & 0xFFFFF], 0, 1);
-                
-                /* mix bright and dark exposures */
-                int mixed = bev * (1-k) + dev * k;
-                halfres[x + y*w] = ev2raw[mixed];
-            }
-        }
-        if (chroma_smooth_method)
-        {
 #ifndef STDOUT_SILENT
-            printf("Chroma smoothing...\n");
+        printf("Chroma smoothing...\n");
 #endif
-            memcpy(fullres_smooth, fullres, w * h * sizeof(uint32_t));
-            memcpy(halfres_smooth, halfres, w * h * sizeof(uint32_t));
-            hdr_chroma_smooth(raw_info, fullres, fullres_smooth, chroma_smooth_method, raw2ev, ev2raw);
-            hdr_chroma_smooth(raw_info, halfres, halfres_smooth, chroma_smooth_method, raw2ev, ev2raw);
-        }
-        if(alias_map)
-        {
-            build_alias_map(raw_info, alias_map, fullres_smooth, halfres_smooth, bright, dark_noise, black, raw2ev);
-        }
+        memcpy(job->fullres_smooth, ctx->fullres, w * h * sizeof(uint32_t));
+        memcpy(job->halfres_smooth, ctx->halfres, w * h * sizeof(uint32_t));
+        hdr_chroma_smooth(job, ctx->fullres, job->fullres_smooth, threads);
+        hdr_chroma_smooth(job, ctx->halfres, job->halfres_smooth, threads);
     }
-    UNLOCK(ev2raw_mutex)
-    
-    #pragma omp parallel for collapse(2)
-    for (int y = 0; y < h; y ++)
-    {
-        for (int x = 0; x < w; x ++)
-        {
-            overexposed[x + y * w] = bright[x + y * w] >= white_darkened || dark[x + y * w] >= white ? 100 : 0;
-        }
-    }
-    
-    /* "blur" the overexposed map */
-    uint16_t* over_aux = malloc(w * h * sizeof(uint16_t));
-    memcpy(over_aux, overexposed, w * h * sizeof(uint16_t));
-    
-    #pragma omp parallel for collapse(2)
-    for (int y = 3; y < h-3; y ++)
+    if (job->alias_map)
     {
-        for (int x = 3; x < w-3; x ++)
-        {
-            overexposed[x + y * w] =
-            (over_aux[x+0 + (y+0) * w])+
-            (over_aux[x+0 + (y-1) * w] + over_aux[x-1 + (y+0) * w] + over_aux[x+1 + (y+0) * w] + over_aux[x+0 + (y+1) * w]) * 820 / 1024 +
-            (over_aux[x-1 + (y-1) * w] + over_aux[x+1 + (y-1) * w] + over_aux[x-1 + (y+1) * w] + over_aux[x+1 + (y+1) * w]) * 657 / 1024 +
-            //~ (over_aux[x+0 + (y-2) * w] + over_aux[x-2 + (y+0) * w] + over_aux[x+2 + (y+0) * w] + over_aux[x+0 + (y+2) * w]) * 421 / 1024 +
-            //~ (over_aux[x-1 + (y-2) * w] + over_aux[x+1 + (y-2) * w] + over_aux[x-2 + (y-1) * w] + over_aux[x+2 + (y-1) * w] + over_aux[x-2 + (y+1) * w] + over_aux[x+2 + (y+1) * w] + over_aux[x-1 + (y+2) * w] + over_aux[x+1 + (y+2) * w]) * 337 / 1024 +
-            //~ (over_aux[x-2 + (y-2) * w] + over_aux[x+2 + (y-2) * w] + over_aux[x-2 + (y+2) * w] + over_aux[x+2 + (y+2) * w]) * 173 / 1024 +
-            //~ (over_aux[x+0 + (y-3) * w] + over_aux[x-3 + (y+0) * w] + over_aux[x+3 + (y+0) * w] + over_aux[x+0 + (y+3) * w]) * 139 / 1024 +
-            //~ (over_aux[x-1 + (y-3) * w] + over_aux[x+1 + (y-3) * w] + over_aux[x-3 + (y-1) * w] + over_aux[x+3 + (y-1) * w] + over_aux[x-3 + (y+1) * w] + over_aux[x+3 + (y+1) * w] + over_aux[x-1 + (y+3) * w] + over_aux[x+1 + (y+3) * w]) * 111 / 1024 +
-            //~ (over_aux[x-2 + (y-3) * w] + over_aux[x+2 + (y-3) * w] + over_aux[x-3 + (y-2) * w] + over_aux[x+3 + (y-2) * w] + over_aux[x-3 + (y+2) * w] + over_aux[x+3 + (y+2) * w] + over_aux[x-2 + (y+3) * w] + over_aux[x+2 + (y+3) * w]) * 57 / 1024;
-            0;
-        }
+        build_alias_map(job, threads);
     }
-    
-    free(over_aux); over_aux = 0;
-    free(mix_curve);
-    
+
+    memcpy(ctx->aux, ctx->overexposed, w * h * sizeof(uint16_t));
+    diso_run_bands(threads, 3, h-3, overexposed_blur_pass, job);
+
     return 1;
 }
 
-static inline void final_blend(struct raw_info raw_info, uint32_t* raw_buffer_32, uint32_t* fullres, uint32_t* fullres_smooth, uint32_t* halfres_smooth, uint32_t* dark, uint32_t* bright, uint16_t* overexposed, uint16_t* alias_map, int black, int white, int dark_noise)
+static void final_blend_pass(diso_job_t * job, int y1, int y2)
 {
-    /* fullres mixing curve */
-    double * fullres_curve = build_fullres_curve(black);
-    
+    struct raw_info raw_info = job->raw_info;
+    diso_context_t * ctx = job->ctx;
+    uint32_t * raw_buffer_32 = ctx->raw_buffer_32;
+    uint32_t * fullres = ctx->fullres;
+    uint32_t * fullres_smooth = job->fullres_smooth;
+    uint32_t * halfres_smooth = job->halfres_smooth;
+    uint32_t * dark = ctx->dark;
+    uint32_t * bright = ctx->bright;
+    uint16_t * overexposed = ctx->overexposed;
+    uint16_t * alias_map = job->alias_map;
+    double * fullres_curve = job->fullres_curve;
+    int * raw2ev = job->raw2ev;
+    int * ev2raw = job->ev2raw;
+    int black = job->black;
+    int dark_noise = job->dark_noise;
     int w = raw_info.width;
-    int h = raw_info.height;
-    
-    /* for fast EV - raw conversion */
-    static int raw2ev[1<<20];   /* EV x EV_RESOLUTION */
-    static int ev2raw_0[24*EV_RESOLUTION];
-    static int previous_black = -1;
-    
-    /* handle sub-black values (negative EV) */
-    int* ev2raw = ev2raw_0 + 10*EV_RESOLUTION;
-    
-    LOCK(ev2raw_mutex)
+
+    for (int y = y1; y < y2; y ++)
     {
-        if(black != previous_black)
-        {
-            build_ev2raw_lut(raw2ev, ev2raw_0, black, white);
-            previous_black = black;
-        }
-#ifndef STDOUT_SILENT
-        printf("Final blending...\n");
-#endif
-        #pragma omp parallel for collapse(2)
-        for (int y = 0; y < h; y ++)
+        for (int x = 0; x < w; x ++)
         {
-            for (int x = 0; x < w; x ++)
+            /* high-iso image (for measuring signal level) */
+            int b = bright[x + y*w];
+
+            /* half-res image (interpolated and chroma filtered, best for low-contrast shadows) */
+            int hr = halfres_smooth[x + y*w];
+
+            /* full-res image (non-interpolated, except where one ISO is blown out) */
+            int fr = fullres[x + y*w];
+
+            /* full res with some smoothing applied to hide aliasing artifacts */
+            int frs = fullres_smooth[x + y*w];
+
+            /* go from linear to EV space */
+            int hrev = raw2ev[hr];
+            int frev = raw2ev[fr];
+            int frsev = raw2ev[frs];
+
+            int output = 0;
+
+            /* blending factor */
+            double f = fullres_curve[b & 0xFFFFF];
+
+            double c = 0;
+
+            if (alias_map)
             {
-                /* high-iso image (for measuring signal level) */
-                int b = bright[x + y*w];
-                
-                /* half-res image (interpolated and chroma filtered, best for low-contrast shadows) */
-                int hr = halfres_smooth[x + y*w];
-                
-                /* full-res image (non-interpolated, except where one ISO is blown out) */
-                int fr = fullres[x + y*w];
-                
-                /* full res with some smoothing applied to hide aliasing artifacts */
-                int frs = fullres_smooth[x + y*w];
-                
-                /* go from linear to EV space */
-                int hrev = raw2ev[hr];
-                int frev = raw2ev[fr];
-                int frsev = raw2ev[frs];
-                
-                int output = 0;
-                
-                /* blending factor */
-                double f = fullres_curve[b & 0xFFFFF];
-                
-                double c = 0;
-                
-                if (alias_map)
-                {
-                    int co = alias_map[x + y*w];
-                    c = COERCE(co / (double) ALIAS_MAP_MAX, 0, 1);
-                }
-                
-                double ovf = COERCE(overexposed[x + y*w] / 200.0, 0, 1);
-                c = MAX(c, ovf);
-                
-                double noisy_or_overexposed = MAX(ovf, 1-f);
-                
-                /* use data from both ISOs in high-detail areas, even if it's noisier (less aliasing) */
-                f = MAX(f, c);
-                
-                /* use smoothing in noisy near-overexposed areas to hide color artifacts */
-                double fev = noisy_or_overexposed * frsev + (1-noisy_or_overexposed) * frev;
-                
-                /* limit the use of fullres in dark areas (fixes some black spots, but may increase aliasing) */
-                int sig = (dark[x + y*w] + bright[x + y*w]) / 2;
-                f = MAX(0, MIN(f, (double)(sig - black) / (4*dark_noise)));
-                
-                /* blend "half-res" and "full-res" images smoothly to avoid banding*/
-                output = hrev * (1-f) + fev * f;
-                
-                /* show full-res map (for debugging) */
-                //~ output = f * 14*EV_RESOLUTION;
-                
-                /* show alias map (for debugging) */
-                //~ output = c * 14*EV_RESOLUTION;
-                
-                //~ output = hotpixel[x+y*w] ? 14*EV_RESOLUTION : 0;
-                //~ output = raw2ev[dark[x+y*w]];
-                /* safeguard */
-                output = COERCE(output, -10*EV_RESOLUTION, 14*EV_RESOLUTION-1);
-                
-                
-                /* back to linear space and commit */
-                raw_set_pixel32(x, y, ev2raw[output]);
+                int co = alias_map[x + y*w];
+                c = COERCE(co / (double) ALIAS_MAP_MAX, 0, 1);
             }
+
+            double ovf = COERCE(overexposed[x + y*w] / 200.0, 0, 1);
+            c = MAX(c, ovf);
+
+            double noisy_or_overexposed = MAX(ovf, 1-f);
+
+            /* use data from both ISOs in high-detail areas, even if it's noisier (less aliasing) */
+            f = MAX(f, c);
+
+            /* use smoothing in noisy near-overexposed areas to hide color artifacts */
+            double fev = noisy_or_overexposed * frsev + (1-noisy_or_overexposed) * frev;
+
+            /* limit the use of fullres in dark areas (fixes some black spots, but may increase aliasing) */
+            int sig = (dark[x + y*w] + bright[x + y*w]) / 2;
+            f = MAX(0, MIN(f, (double)(sig - black) / (4*dark_noise)));
+
+            /* blend "half-res" and "full-res" images smoothly to avoid banding*/
+            output = hrev * (1-f) + fev * f;
+
+            /* show full-res map (for debugging) */
+            //~ output = f * 14*EV_RESOLUTION;
+
+            /* show alias map (for debugging) */
+            //~ output = c * 14*EV_RESOLUTION;
+
+            //~ output = hotpixel[x+y*w] ? 14*EV_RESOLUTION : 0;
+            //~ output = raw2ev[dark[x+y*w]];
+            /* safeguard */
+            output = COERCE(output, -10*EV_RESOLUTION, 14*EV_RESOLUTION-1);
+
+
+            /* back to linear space and commit */
+            raw_set_pixel32(x, y, ev2raw[output]);
         }
     }
-    UNLOCK(ev2raw_mutex)
 }
 
-static inline void convert_20_to_16bit(struct raw_info raw_info, uint16_t * image_data, uint32_t * raw_buffer_32)
+static inline void final_blend(diso_job_t * job, int threads)
+{
+#ifndef STDOUT_SILENT
+    printf("Final blending...\n");
+#endif
+    diso_run_bands(threads, 0, job->raw_info.height, final_blend_pass, job);
+}
+
+/* go back from 20-bit to 16-bit output */
+static void convert_20_to_16bit_pass(diso_job_t * job, int y1, int y2)
+{
+    uint16_t * __restrict image_data = job->image_data;
+    uint32_t * __restrict raw_buffer_32 = job->ctx->raw_buffer_32;
+    int w = job->raw_info.width;
+
+    /* same noise sequence a single pass over the frame would have used */
+    int k = job->randn05_start + y1 * w;
+
+    for (int y = y1; y < y2; y++)
+        for (int x = 0; x < w; x++)
+            image_data[x + y*w] = COERCE((int)(raw_buffer_32[x + y*w] / 16.0 + randn05_cache[(k++) & 1023] + 0.5), 0, 0xFFFF);
+}
+
+static inline void convert_20_to_16bit(diso_job_t * job, int threads)
+{
+    int w = job->raw_info.width;
+    int h = job->raw_info.height;
+
+    job->randn05_start = __atomic_fetch_add(&randn05_pos, w * h, __ATOMIC_RELAXED);
+    diso_run_bands(threads, 0, h, convert_20_to_16bit_pass, job);
+}
+
+/* the 4 line patterns an iso_pattern of 1..4 stands for, 1 = bright */
+static const int iso_patterns[4][4] = {{1, 1, 0, 0}, {1, 0, 0, 1}, {0, 0, 1, 1}, {0, 1, 1, 0}};
+
+/* Measures on one frame what a clip calibration holds: ISO pattern, black noise and the
+ * histogram exposure match. Levels and dark frame mode are left to the caller */
+int diso_calibrate_frame(struct raw_info raw_info, uint16_t * image_data, diso_calibration_t * calibration)
 {
     int w = raw_info.width;
     int h = raw_info.height;
-    /* go back from 20-bit to 16-bit output */
-    //raw_info.buffer = raw_buffer_16;
-    raw_info.black_level /= 16;
-    raw_info.white_level /= 16;
-    
-    #pragma omp parallel for collapse(2)
-    for (int y = 0; y < h; y++)
-        for (int x = 0; x < w; x++)
-            raw_set_pixel_20to16_rand(x, y, raw_buffer_32[x + y*w]);
+
+    calibration->valid = 0;
+    if (w <= 0 || h <= 0) return 0;
+
+    int rggb = ((raw_info.cfa_pattern == 0) || (raw_info.cfa_pattern == 0x02010100)) ? 1 : 0;
+
+    if (!rggb) /* this code assumes RGGB, so we need to skip one line */
+    {
+        image_data += raw_info.pitch;
+        raw_info.active_area.y1++;
+        raw_info.active_area.y2--;
+        raw_info.height--;
+        h--;
+    }
+
+    int is_bright[4];
+    if (!identify_bright_and_dark_fields(raw_info, image_data, rggb, is_bright)) return 0;
+
+    calibration->iso_pattern = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        if (memcmp(is_bright, iso_patterns[i], sizeof(is_bright)) == 0)
+        {
+            calibration->iso_pattern = i + 1;
+            break;
+        }
+    }
+    if (!calibration->iso_pattern) return 0;
+
+    /* same levels as diso_get_full20bit */
+    int white = raw_info.white_level;
+    raw_info.black_level *= 64;
+    raw_info.white_level = white * 64;
+    int white_darkened = white / 2 * 64;
+
+    measure_noise(raw_info, image_data, calibration->noise_std);
+
+    /* matching only needs the 20 bit copy, not the planes of a whole context */
+    diso_context_t ctx = { .raw_buffer_32 = malloc((size_t)w * h * sizeof(uint32_t)) };
+    if (!ctx.raw_buffer_32) return 0;
+
+    diso_job_t job = {
+        .raw_info = raw_info,
+        .image_data = image_data,
+        .ctx = &ctx,
+        .is_bright = is_bright,
+    };
+    diso_run_bands(1, 0, h, convert_to_20bit_pass, &job);
+
+    double ev_correction = 0.0;
+    int black_delta = 0;
+    match_by_histogram(raw_info, ctx.raw_buffer_32, &ev_correction, &black_delta, &white_darkened, is_bright);
+
+    /* same limits match_exposures applies, so frames that found no match can't skew the medians */
+    calibration->ev_correction = COERCE(ev_correction, 0, 6.0);
+    calibration->black_delta = COERCE(black_delta, 0, 100 * 64);
+    free(ctx.raw_buffer_32);
+
+    calibration->valid = 1;
+    return 1;
 }
 
-int diso_get_full20bit(struct raw_info raw_info, uint16_t * image_data, int dark_frame, int iso1, int iso2, int * iso_pattern, int * auto_correction, double * ev_correction, int * black_delta, int interp_method, int use_alias_map, int use_fullres, int chroma_smooth_method, int threads)
+/* calibration: what was measured for the whole clip, NULL measures everything on this frame,
+ * refine: match exposures on this frame too and let it move the clip values slightly */
+int diso_get_full20bit(diso_context_t * ctx, struct raw_info raw_info, uint16_t * image_data, int dark_frame, int iso1, int iso2, const diso_calibration_t * calibration, int refine, int * iso_pattern, int * auto_correction, double * ev_correction, int * black_delta, int interp_method, int use_alias_map, int use_fullres, int chroma_smooth_method, int threads)
 {
     int w = raw_info.width;
     int h = raw_info.height;
-    
+
     if (w <= 0 || h <= 0) return 0;
+    if (threads < 1) threads = 1;
 
     /* RGGB or GBRG? */
     //int rggb = identify_rggb_or_gbrg(raw_info, image_data);
@@ -2101,12 +2502,16 @@ int diso_get_full20bit(struct raw_info raw_info, uint16_t * image_data, int dark
         raw_info.height--;
         h--;
     }
-    
-    const int iso_patterns[4][4] = {{1, 1, 0, 0}, {1, 0, 0, 1}, {0, 0, 1, 1}, {0, 1, 1, 0}};
 
     int is_bright[4];
 
-    if (!*iso_pattern)
+    if (calibration && (!*iso_pattern || *iso_pattern == 5))
+    {
+        /* detected on the calibration frames */
+        memcpy(is_bright, iso_patterns[calibration->iso_pattern - 1], sizeof(is_bright));
+        if (!*iso_pattern) *iso_pattern = -calibration->iso_pattern;
+    }
+    else if (!*iso_pattern)
     {
         if (!identify_bright_and_dark_fields(raw_info, image_data, rggb, is_bright)) return 0;
 
@@ -2125,6 +2530,11 @@ int diso_get_full20bit(struct raw_info raw_info, uint16_t * image_data, int dark
     {
         memcpy(is_bright, iso_patterns[*iso_pattern - 1], sizeof(is_bright));
     }
+    else if (*iso_pattern < 0 && *iso_pattern >= -4)
+    {
+        /* detected on an earlier frame */
+        memcpy(is_bright, iso_patterns[-*iso_pattern - 1], sizeof(is_bright));
+    }
     else if (*iso_pattern == 5)
     {
         if (!identify_bright_and_dark_fields(raw_info, image_data, rggb, is_bright))
@@ -2136,77 +2546,87 @@ int diso_get_full20bit(struct raw_info raw_info, uint16_t * image_data, int dark
     {
         return 0;
     }
-    
+
     int ret = 0;
-    
+
     /* will use 20-bit processing and 16-bit output, instead of 14 */
     raw_info.black_level *= 64;
     raw_info.white_level *= 64;
-    
+
     int black = raw_info.black_level;
     int white = raw_info.white_level / 64;
-    
+
     int white_bright = white / 2;
     //white_detect(raw_info, image_data, &white, &white_bright, is_bright);
     white *= 64;
     white_bright *= 64;
     raw_info.white_level = white;
-    
+
     double noise_std[4];
     double dark_noise, bright_noise, dark_noise_ev, bright_noise_ev;
-    double noise_avg = compute_noise(raw_info, image_data, noise_std, &dark_noise, &bright_noise, &dark_noise_ev, &bright_noise_ev);
-    
+    if (calibration)
+    {
+        memcpy(noise_std, calibration->noise_std, sizeof(noise_std));
+    }
+    else
+    {
+        measure_noise(raw_info, image_data, noise_std);
+    }
+    noise_levels(noise_std, &dark_noise, &bright_noise, &dark_noise_ev, &bright_noise_ev);
+
+    /* all planes live in the context, they only get allocated again when the frame size changes */
+    diso_context_size(ctx, w, h);
+
+    diso_job_t job = {
+        .raw_info = raw_info,
+        .image_data = image_data,
+        .ctx = ctx,
+        .is_bright = is_bright,
+        .black = black,
+        .white = white,
+        .chroma_smooth_method = chroma_smooth_method,
+    };
+
     /* promote from 14 to 20 bits (original raw buffer holds 14-bit values stored as uint16_t) */
-    uint32_t * raw_buffer_32 = convert_to_20bit(raw_info, image_data);
-    
+    diso_run_bands(threads, 0, h, convert_to_20bit_pass, &job);
+    uint32_t * raw_buffer_32 = ctx->raw_buffer_32;
+
     /* we have now switched to 20-bit, update noise numbers */
     dark_noise *= 64;
     bright_noise *= 64;
     dark_noise_ev += 6;
     bright_noise_ev += 6;
-    
+
     /* dark and bright exposures, interpolated */
-    uint32_t* dark   = malloc(w * h * sizeof(uint32_t));
-    uint32_t* bright = malloc(w * h * sizeof(uint32_t));
-    memset(dark, 0, w * h * sizeof(uint32_t));
-    memset(bright, 0, w * h * sizeof(uint32_t));
-    
-    /* fullres image (minimizes aliasing) */
-    uint32_t* fullres = malloc(w * h * sizeof(uint32_t));
-    memset(fullres, 0, w * h * sizeof(uint32_t));
-    uint32_t* fullres_smooth = fullres;
-    
-    /* halfres image (minimizes noise and banding) */
-    uint32_t* halfres = malloc(w * h * sizeof(uint32_t));
-    memset(halfres, 0, w * h * sizeof(uint32_t));
-    uint32_t* halfres_smooth = halfres;
-    
-    if (chroma_smooth_method)
-    {
-        if (use_fullres)
-        {
-            fullres_smooth = malloc(w * h * sizeof(uint32_t));
-        }
-        halfres_smooth = malloc(w * h * sizeof(uint32_t));
-    }
-    
-    /* overexposure map */
-    uint16_t * overexposed = malloc(w * h * sizeof(uint16_t));
-    memset(overexposed, 0, w * h * sizeof(uint16_t));
-    
-    uint16_t* alias_map = NULL;
+    memset(ctx->dark, 0, w * h * sizeof(uint32_t));
+    memset(ctx->bright, 0, w * h * sizeof(uint32_t));
+
+    /* fullres image (minimizes aliasing), only filled when it is used */
+    if (!use_fullres) memset(ctx->fullres, 0, w * h * sizeof(uint32_t));
+
+    /* halfres image (minimizes noise and banding) and the smoothed versions of both */
+    job.fullres_smooth = chroma_smooth_method ? ctx->fullres_smooth : ctx->fullres;
+    job.halfres_smooth = chroma_smooth_method ? ctx->halfres_smooth : ctx->halfres;
+
     if (use_alias_map)
     {
-        alias_map = malloc(w * h * sizeof(uint16_t));
-        memset(alias_map, 0, w * h * sizeof(uint16_t));
+        job.alias_map = ctx->alias_map;
+        memset(job.alias_map, 0, w * h * sizeof(uint16_t));
     }
-    
+
+    build_ev2raw_lut(&job, threads);
+    build_fullres_curve(&job, threads);
+
     //~ printf("Exposure matching...\n");
     /* estimate ISO difference between bright and dark exposures */
     int white_darkened = white_bright;
-    int expo_matched = match_exposures(raw_info, raw_buffer_32, dark_frame, iso1, iso2, auto_correction, ev_correction, black_delta, &white_darkened, is_bright);
+    int expo_matched = match_exposures(raw_info, raw_buffer_32, dark_frame, iso1, iso2, calibration, refine, auto_correction, ev_correction, black_delta, &white_darkened, is_bright);
     double corr_ev = ABS(*ev_correction);
 
+    job.white_darkened = white_darkened;
+    job.dark_noise = dark_noise;
+    job.corr_ev = corr_ev;
+
 #ifndef STDOUT_SILENT
     if (expo_matched)
     {
@@ -2216,6 +2636,8 @@ int diso_get_full20bit(struct raw_info raw_info, uint16_t * image_data, int dark
     {
         printf("Exposures not matched");
     }
+#else
+    (void)expo_matched;
 #endif
     /* estimate dynamic range */
     double lowiso_dr = log2(white - black) - dark_noise_ev;
@@ -2232,30 +2654,31 @@ int diso_get_full20bit(struct raw_info raw_info, uint16_t * image_data, int dark
 
     if (interp_method == 0)
     {
-        amaze_interpolate(raw_info, raw_buffer_32, dark, bright, black, white, white_darkened, is_bright, threads);
+        amaze_interpolate(&job, threads);
     }
     else
     {
-        mean23_interpolate(raw_info, raw_buffer_32, dark, bright, black, white, white_darkened, is_bright);
+        mean23_interpolate(&job, threads);
     }
 
-    border_interpolate(raw_info, raw_buffer_32, dark, bright, is_bright);
+    border_interpolate(raw_info, raw_buffer_32, ctx->dark, ctx->bright, is_bright);
 
-    if (use_fullres) fullres_reconstruction(raw_info, fullres, dark, bright, white_darkened, is_bright);
+    if (use_fullres) fullres_reconstruction(&job, threads);
 
-    if (mix_images(raw_info, fullres, fullres_smooth, halfres, halfres_smooth, alias_map, dark, bright, overexposed, dark_noise, white_darkened, corr_ev, lowiso_dr, black, white, chroma_smooth_method))
+    if (mix_images(&job, lowiso_dr, threads))
     {
         /* let's check the ideal noise levels (on the halfres image, which in black areas is identical to the bright one) */
 #ifndef STDOUT_SILENT
         //#pragma omp parallel for collapse(2)
         for (int y = 3; y < h-2; y ++)
             for (int x = 2; x < w-2; x ++)
-                raw_set_pixel32(x, y, bright[x + y*w]);
-        
+                raw_set_pixel32(x, y, ctx->bright[x + y*w]);
+
+        double noise_avg;
         compute_black_noise(raw_info, image_data, 8, raw_info.active_area.x1 - 8, raw_info.active_area.y1 + 20, raw_info.active_area.y2 - 20, 1, 1, &noise_avg, &noise_std[0]);
         double ideal_noise_std = noise_std[0];
 #endif
-        final_blend(raw_info, raw_buffer_32, fullres, fullres_smooth, halfres_smooth, dark, bright, overexposed, alias_map, black, white, dark_noise);
+        final_blend(&job, threads);
 
         /* let's see how much dynamic range we actually got */
 #ifndef STDOUT_SILENT
@@ -2263,10 +2686,10 @@ int diso_get_full20bit(struct raw_info raw_info, uint16_t * image_data, int dark
         printf("Noise level     : %.02f (20-bit), ideally %.02f\n", noise_std[0], ideal_noise_std);
         printf("Dynamic range   : %.02f EV (cooked)\n", log2(white - black) - log2(noise_std[0]));
 #endif
-        convert_20_to_16bit(raw_info, image_data, raw_buffer_32);
+        convert_20_to_16bit(&job, threads);
         ret = 1;
     }
-    
+
     if (!rggb) /* back to GBRG */
     {
         raw_info.active_area.y1--;
@@ -2274,17 +2697,6 @@ int diso_get_full20bit(struct raw_info raw_info, uint16_t * image_data, int dark
         raw_info.height++;
         h++;
     }
-    
-    free(dark);
-    free(bright);
-    free(fullres);
-    free(halfres);
-    free(alias_map);
-    free(overexposed);
-    free(raw_buffer_32);
-    if (fullres_smooth && fullres_smooth != fullres) free(fullres_smooth);
-    if (halfres_smooth && halfres_smooth != halfres) free(halfres_smooth);
-    
+
     return ret;
 }
-
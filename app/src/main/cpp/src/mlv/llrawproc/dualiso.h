@@ -25,7 +25,54 @@
 #include <sys/types.h>
 #include "../raw.h"
 
+/* Planes and lookup tables of the full 20 bit processing, kept between frames so they are
+ * not allocated and built again every time. One frame at a time per context */
+typedef struct diso_context {
+    int width, height;  /* frame size the planes are allocated for */
+    uint32_t * raw_buffer_32;
+    uint32_t * dark, * bright;
+    uint32_t * fullres, * halfres;
+    uint32_t * fullres_smooth, * halfres_smooth;
+    uint32_t * gray;
+    uint16_t * overexposed, * alias_map;
+    uint16_t * aux;     /* copy of the alias or overexposure map while it is filtered */
+    uint8_t * edge_direction;
+    int * squeezed;       /* row of the squeezed AMaZe image each row goes to */
+    int * squeeze_source; /* and the other way around, -1 for rows nothing goes to */
+    float ** amaze_rows; /* row pointers of the 4 AMaZe planes (raw, red, green, blue) */
+    float * amaze_planes;
+
+    /* 20 bit EV LUTs and curves, with the levels they were built for */
+    int * raw2ev, * ev2raw_0;
+    int lut_black, lut_white;
+    double * fullres_curve;
+    int fullres_curve_black;
+    double * mix_curve;
+    int mix_black, mix_white;
+    double mix_corr_ev, mix_overlap;
+
+    struct diso_context * next; /* for keeping idle contexts in a list */
+} diso_context_t;
+
+/* Dual iso calibration of a clip. The ISO pattern, black noise and histogram exposure match
+ * don't change during a recording, so they are measured once on a few frames spread over
+ * the clip and every frame uses them. Stored as it is in the MAPP file, fixed size fields only */
+typedef struct {
+    int32_t valid;          /* 0 = not measured, 1 = measured, -1 = could not be measured */
+    int32_t iso_pattern;    /* 1..4, same numbering as the iso_pattern setting */
+    int32_t black_level;    /* clip raw levels and dark frame mode it was measured with */
+    int32_t white_level;
+    int32_t dark_frame;
+    int32_t black_delta;    /* match by histogram: 20 bit black offset */
+    double  ev_correction;  /* match by histogram: EV difference, positive */
+    double  noise_std[4];   /* black noise of the 4 line types, 14 bit */
+} diso_calibration_t;
+
+diso_context_t * diso_new_context(void);
+void diso_free_context(diso_context_t * ctx);
+
 int diso_get_preview(uint16_t * image_data, uint16_t width, uint16_t height, int32_t black, int32_t white, int diso_check);
-int diso_get_full20bit(struct raw_info raw_info, uint16_t * image_data, int dark_frame, int iso1, int iso2, int * iso_pattern, int * auto_correction, double * ev_correction, int * black_delta, int interp_method, int use_alias_map, int use_fullres, int chroma_smooth_method, int threads);
+int diso_calibrate_frame(struct raw_info raw_info, uint16_t * image_data, diso_calibration_t * calibration);
+int diso_get_full20bit(diso_context_t * ctx, struct raw_info raw_info, uint16_t * image_data, int dark_frame, int iso1, int iso2, const diso_calibration_t * calibration, int refine, int * iso_pattern, int * auto_correction, double * ev_correction, int * black_delta, int interp_method, int use_alias_map, int use_fullres, int chroma_smooth_method, int threads);
 
 #endif
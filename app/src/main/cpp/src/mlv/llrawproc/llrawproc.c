@@ -23,6 +23,11 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+#if defined(__linux)
+#include <alloca.h>
+#endif
 
 #include "llrawproc.h"
 #include "pixelproc.h"
@@ -31,6 +36,7 @@
 #include "dualiso.h"
 #include "hist.h"
 #include "darkframe.h"
+#include "../video_mlv.h"
 #include "../../processing/raw_processing.h"
 
 #define MIN(a,b) (((a)<(b))?(a):(b))
@@ -52,15 +58,22 @@ static void deflicker(mlvObject_t * video, uint16_t * raw_image_buff, size_t raw
     video->RAWI.raw_info.exposure_bias[1] = 10000;
 }
 
-/* convert uncompressed 10/12bit raw data to 14bit for subsequent processing */
-static void make_14bit(uint16_t * raw_image_buff, size_t raw_image_size, struct raw_info * raw_info)
+/* levels of uncompressed 10/12bit raw data after make_14bit */
+static void make_14bit_levels(struct raw_info * raw_info)
 {
-    uint32_t pixel_count = raw_image_size / 2;
     int bits_shift = 14 - raw_info->bits_per_pixel;
     raw_info->black_level <<= bits_shift;
     raw_info->white_level <<= bits_shift;
     raw_info->bits_per_pixel = 14;
     raw_info->frame_size = raw_info->width * raw_info->height * 14 / 8;
+}
+
+/* convert uncompressed 10/12bit raw data to 14bit for subsequent processing */
+static void make_14bit(uint16_t * raw_image_buff, size_t raw_image_size, struct raw_info * raw_info)
+{
+    uint32_t pixel_count = raw_image_size / 2;
+    int bits_shift = 14 - raw_info->bits_per_pixel;
+    make_14bit_levels(raw_info);
 
     #pragma omp parallel for
     for(uint32_t i = 0; i < pixel_count; ++i)
@@ -113,8 +126,8 @@ static void _scale_restricted_range(struct raw_info * raw_info, uint16_t * image
     }
 }
 
-/* rescale restricted to imaginary 10-12bit levels of lossless raw data to about real 14bit range */
-static void scale_restricted_range(struct raw_info * raw_info, uint16_t * image_data, int low_iso, int high_iso)
+/* white level of restricted lossless raw data after scale_restricted_range, returns the scale ratio */
+static double scale_restricted_levels(struct raw_info * raw_info, int low_iso, int high_iso)
 {
     int32_t bd = ceil(log2(raw_info->white_level - raw_info->black_level));
 
@@ -133,6 +146,14 @@ static void scale_restricted_range(struct raw_info * raw_info, uint16_t * image_
 
     raw_info->white_level = scaled_white_level;
 
+    return scale_ratio;
+}
+
+/* rescale restricted to imaginary 10-12bit levels of lossless raw data to about real 14bit range */
+static void scale_restricted_range(struct raw_info * raw_info, uint16_t * image_data, int low_iso, int high_iso)
+{
+    double scale_ratio = scale_restricted_levels(raw_info, low_iso, high_iso);
+
     uint32_t pixel_count = raw_info->width * raw_info->height;
 
     #pragma omp parallel for
@@ -142,6 +163,327 @@ static void scale_restricted_range(struct raw_info * raw_info, uint16_t * image_
     }
 }
 
+/* dual iso works on the whole frame, not only the active area */
+static void diso_frame_area(mlvObject_t * video, struct raw_info * raw_info)
+{
+    raw_info->width = video->RAWI.xRes;
+    raw_info->height = video->RAWI.yRes;
+    raw_info->pitch = video->RAWI.xRes;
+    raw_info->active_area.x1 = 0;
+    raw_info->active_area.y1 = 0;
+    raw_info->active_area.x2 = raw_info->width;
+    raw_info->active_area.y2 = raw_info->height;
+}
+
+/* frames the dual iso calibration is measured on, spread over the clip */
+#define DISO_CALIBRATION_FRAMES 5
+
+/* one calibration frame, measured in a thread of its own */
+typedef struct
+{
+    mlvObject_t * video;
+    uint32_t frame_index;
+    diso_calibration_t calibration;
+} diso_sample_t;
+
+static void * diso_sample_thread(void * arg)
+{
+    diso_sample_t * sample = (diso_sample_t *)arg;
+    mlvObject_t * video = sample->video;
+    llrawprocObject_t * llrawproc = video->llrawproc;
+    size_t frame_size = video->RAWI.xRes * video->RAWI.yRes * sizeof(uint16_t);
+
+    sample->calibration.valid = 0;
+
+    uint16_t * frame = malloc(frame_size);
+    if (!frame) return NULL;
+    if (getMlvRawFrameUint16(video, sample->frame_index, frame))
+    {
+        free(frame);
+        return NULL;
+    }
+
+    /* the same steps a frame goes through before dual iso processing, except pixel fixes */
+    if (llrawproc->df_status == 1)
+    {
+        df_subtract(video, frame, frame_size);
+    }
+
+    struct raw_info raw_info = video->RAWI.raw_info;
+    if (raw_info.bits_per_pixel < 14)
+    {
+        make_14bit(frame, frame_size, &raw_info);
+    }
+
+    diso_frame_area(video, &raw_info);
+
+    if ((video->MLVI.videoClass & MLV_VIDEO_CLASS_FLAG_LJ92) && raw_info.white_level < 15000)
+    {
+        int low_iso = MIN(llrawproc->diso1, llrawproc->diso2);
+        int high_iso = MAX(llrawproc->diso1, llrawproc->diso2);
+        scale_restricted_range(&raw_info, frame, low_iso, high_iso);
+    }
+
+    diso_calibrate_frame(raw_info, frame, &sample->calibration);
+
+    free(frame);
+    return NULL;
+}
+
+static double median_double(double * values, int n)
+{
+    for (int i = 1; i < n; i++)
+    {
+        double v = values[i];
+        int j = i;
+        for (; j > 0 && values[j - 1] > v; j--) values[j] = values[j - 1];
+        values[j] = v;
+    }
+    return (n & 1) ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+}
+
+/* returns 1 if the dual iso calibration was made for the clip as it is now (or could not be made) */
+static int diso_calibration_ready(mlvObject_t * video)
+{
+    diso_calibration_t * calibration = &video->llrawproc->diso_calibration;
+
+    return calibration->valid &&
+           calibration->black_level == video->RAWI.raw_info.black_level &&
+           calibration->white_level == video->RAWI.raw_info.white_level &&
+           calibration->dark_frame == video->llrawproc->dark_frame;
+}
+
+/* Measures the dual iso calibration on a few frames at once, every frame of the clip uses it
+ * after that. Result goes in to the MAPP file too. Caller holds plan_lock for writing */
+static void diso_calibrate_clip(mlvObject_t * video)
+{
+    llrawprocObject_t * llrawproc = video->llrawproc;
+    diso_calibration_t * calibration = &llrawproc->diso_calibration;
+
+    int samples = MIN(DISO_CALIBRATION_FRAMES, (int)video->frames);
+    int threads = MAX(video->cpu_cores, 1);
+
+    diso_sample_t * sample = alloca(MAX(samples, 1) * sizeof(diso_sample_t));
+    pthread_t * thread_id = alloca(MAX(samples, 1) * sizeof(pthread_t));
+
+    /* reading frames overwrites VIDF, the frame being corrected still needs its own */
+    mlv_vidf_hdr_t vidf = video->VIDF;
+
+    /* every sample holds a whole frame in memory, so no more at once than there are cores */
+    for (int first = 0; first < samples; first += threads)
+    {
+        int last = MIN(first + threads, samples);
+        for (int i = first; i < last; i++)
+        {
+            sample[i].video = video;
+            sample[i].frame_index = (uint32_t)(((uint64_t)video->frames * (2 * i + 1)) / (2 * samples));
+            pthread_create(&thread_id[i], NULL, diso_sample_thread, &sample[i]);
+        }
+        for (int i = first; i < last; i++)
+        {
+            pthread_join(thread_id[i], NULL);
+        }
+    }
+
+    video->VIDF = vidf;
+
+    /* the pattern most frames found, then medians over the frames that found it */
+    int votes[5] = { 0 };
+    for (int i = 0; i < samples; i++)
+    {
+        if (sample[i].calibration.valid) votes[sample[i].calibration.iso_pattern]++;
+    }
+    int pattern = 1;
+    for (int p = 2; p <= 4; p++)
+    {
+        if (votes[p] > votes[pattern]) pattern = p;
+    }
+
+    calibration->valid = -1;
+    if (votes[pattern])
+    {
+        double * values = alloca(samples * sizeof(double));
+        int n;
+
+        calibration->iso_pattern = pattern;
+
+        n = 0;
+        for (int i = 0; i < samples; i++)
+            if (sample[i].calibration.valid && sample[i].calibration.iso_pattern == pattern) values[n++] = sample[i].calibration.ev_correction;
+        calibration->ev_correction = median_double(values, n);
+
+        n = 0;
+        for (int i = 0; i < samples; i++)
+            if (sample[i].calibration.valid && sample[i].calibration.iso_pattern == pattern) values[n++] = sample[i].calibration.black_delta;
+        calibration->black_delta = (int32_t)median_double(values, n);
+
+        for (int y = 0; y < 4; y++)
+        {
+            n = 0;
+            for (int i = 0; i < samples; i++)
+                if (sample[i].calibration.valid && sample[i].calibration.iso_pattern == pattern) values[n++] = sample[i].calibration.noise_std[y];
+            calibration->noise_std[y] = median_double(values, n);
+        }
+
+        calibration->valid = 1;
+    }
+
+#ifndef STDOUT_SILENT
+    printf("Dual iso calibration: %s, pattern %d, %.02f EV, black delta %d (%d of %d frames)\n",
+           (calibration->valid == 1) ? "ok" : "failed", calibration->iso_pattern, calibration->ev_correction, calibration->black_delta, votes[pattern], samples);
+#endif
+
+    /* also keep what it was measured for when it failed, so it is not tried again for every frame */
+    calibration->black_level = video->RAWI.raw_info.black_level;
+    calibration->white_level = video->RAWI.raw_info.white_level;
+    calibration->dark_frame = llrawproc->dark_frame;
+
+    if (calibration->valid == 1) updateMlvMapp(video);
+}
+
+/* frames stripes mode 3 measures the coefficients on, spread over the clip */
+#define STRIPES_SAMPLE_FRAMES 8
+
+typedef struct stripes_sampling
+{
+    mlvObject_t * video;
+    uint32_t generation;
+    pthread_t thread_id;
+    int done;                       /* atomic, set when the thread is about to return */
+    struct stripes_sampling * next;
+} stripes_sampling_t;
+
+/* Measures the stripe coefficients on frames spread over the clip while frames go on being
+ * corrected with the ones from the frame that built the plan, then replaces them */
+static void * stripes_sampling_thread(void * arg)
+{
+    stripes_sampling_t * sampling = (stripes_sampling_t *)arg;
+    mlvObject_t * video = sampling->video;
+    llrawprocObject_t * llrawproc = video->llrawproc;
+    size_t frame_size = video->RAWI.xRes * video->RAWI.yRes * sizeof(uint16_t);
+    int samples = MIN(STRIPES_SAMPLE_FRAMES, (int)video->frames);
+    /* leaves cores to the frames being corrected meanwhile */
+    int threads = MAX(video->cpu_cores / 2, 1);
+
+    stripes_stats * stats = stripes_new_stats();
+    uint16_t * frame = malloc(frame_size);
+    int measured = 0;
+    for (int i = 0; stats && frame && i < samples && !__atomic_load_n(&llrawproc->stripes_cancel, __ATOMIC_ACQUIRE); i++)
+    {
+        uint32_t frame_index = (uint32_t)(((uint64_t)video->frames * (2 * i + 1)) / (2 * samples));
+        if (getMlvRawFrameUint16(video, frame_index, frame)) continue;
+
+        /* the same steps a frame goes through before stripes correction */
+        pthread_rwlock_rdlock(&llrawproc->plan_lock);
+        int current = (llrawproc->stripes_generation == sampling->generation);
+        if (current && llrawproc->df_status == 1)
+        {
+            df_subtract(video, frame, frame_size);
+        }
+        pthread_rwlock_unlock(&llrawproc->plan_lock);
+        if (!current) break;
+
+        struct raw_info raw_info = video->RAWI.raw_info;
+        if (raw_info.bits_per_pixel < 14)
+        {
+            make_14bit(frame, frame_size, &raw_info);
+        }
+
+        stripes_add_frame(stats, frame, raw_info.black_level, raw_info.white_level, raw_info.frame_size, video->RAWI.xRes, video->RAWI.yRes, threads);
+        measured++;
+    }
+    free(frame);
+
+    int replaced = 0;
+    pthread_rwlock_wrlock(&llrawproc->plan_lock);
+    if (measured && !__atomic_load_n(&llrawproc->stripes_cancel, __ATOMIC_ACQUIRE) && llrawproc->vertical_stripes == VS_CLIP &&
+        llrawproc->stripes_generation == sampling->generation)
+    {
+        stripes_get_correction(&llrawproc->stripe_corrections, stats);
+        replaced = 1;
+    }
+    pthread_rwlock_unlock(&llrawproc->plan_lock);
+    stripes_free_stats(stats);
+
+#ifndef STDOUT_SILENT
+    printf("Vertical stripes measured on %d of %d frames%s\n", measured, samples, replaced ? "" : ", not used");
+#endif
+
+    /* frames corrected with the coefficients of one frame are made again, by the next frame
+     * requested: the cache can only be touched where its memory can't be swapped meanwhile */
+    if (replaced) __atomic_store_n(&llrawproc->stripes_cache_outdated, 1, __ATOMIC_RELEASE);
+
+    __atomic_store_n(&sampling->done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/* starts measuring stripes over the clip, an older measurement still running gets ignored.
+ * Threads that are done are joined here. Caller holds plan_lock for writing */
+static void stripes_start_sampling(mlvObject_t * video)
+{
+    llrawprocObject_t * llrawproc = video->llrawproc;
+
+    stripes_sampling_t ** link = &llrawproc->stripes_samplings;
+    while (*link)
+    {
+        stripes_sampling_t * old = *link;
+        if (!__atomic_load_n(&old->done, __ATOMIC_ACQUIRE))
+        {
+            link = &old->next;
+            continue;
+        }
+        pthread_join(old->thread_id, NULL);
+        *link = old->next;
+        free(old);
+    }
+
+    stripes_sampling_t * sampling = malloc(sizeof(stripes_sampling_t));
+    if (!sampling) return;
+    sampling->video = video;
+    sampling->generation = ++llrawproc->stripes_generation;
+    sampling->done = 0;
+
+    if (pthread_create(&sampling->thread_id, NULL, stripes_sampling_thread, sampling))
+    {
+        free(sampling);
+        return;
+    }
+    sampling->next = llrawproc->stripes_samplings;
+    llrawproc->stripes_samplings = sampling;
+}
+
+/* Everything one frame's corrections read and update. For the frame that builds the plan
+ * the pointers go in to llrawproc, so what it measures (stripe coefficients, pixel maps,
+ * dual iso pattern) is kept for the clip. All other frames get private copies */
+typedef struct
+{
+    stripes_correction * stripe_corrections;
+    int * compute_stripes;
+    pixel_map * focus_pixel_map;
+    int * fpm_status;
+    pixel_map * bad_pixel_map;
+    int * bpm_status;
+    int * diso_pattern;
+    int * diso_auto_correction;
+    double * diso_ev_correction;
+    int * diso_black_delta;
+
+    /* private copies, pixel arrays of the maps stay shared (only read) */
+    stripes_correction own_stripe_corrections;
+    int own_compute_stripes;
+    pixel_map own_focus_pixel_map;
+    int own_fpm_status;
+    pixel_map own_bad_pixel_map;
+    int own_bpm_status;
+    int own_diso_pattern;
+    int own_diso_auto_correction;
+    double own_diso_ev_correction;
+    int own_diso_black_delta;
+
+    /* bad pixel force mode searches every frame in to a map of its own */
+    int own_bad_pixels;
+} llrp_frame_t;
+
 /* initialise low level raw processing struct */
 llrawprocObject_t * initLLRawProcObject()
 {
@@ -168,42 +510,282 @@ llrawprocObject_t * initLLRawProcObject()
     llrawproc->diso_averaging = 0;
     llrawproc->diso_alias_map = 0;
     llrawproc->diso_frblending = 1;
+    llrawproc->diso_refine = 0;
     llrawproc->dark_frame = 0;
+    llrawproc->dark_frame_stack = DF_STACK_AVERAGE;
 
     llrawproc->dark_frame_filename = NULL;
+    llrawproc->dark_frame_fds[0] = -1;
     llrawproc->dark_frame_data = NULL;
     llrawproc->dark_frame_size = 0;
+    llrawproc->df_status = 0;
 
     llrawproc->raw2ev = NULL;
     llrawproc->ev2raw = NULL;
 
     llrawproc->prev_black_level = -1;
 
+    llrawproc->diso_raw2ev = NULL;
+    llrawproc->diso_ev2raw = NULL;
+    llrawproc->diso_lut_black_level = -1;
+
     llrawproc->focus_pixel_map.type = PIX_FOCUS;
     llrawproc->focus_pixel_map.pixels = NULL;
     llrawproc->bad_pixel_map.type = PIX_BAD;
     llrawproc->bad_pixel_map.pixels = NULL;
+    llrawproc->focus_pixel_map_fd = -1;
+    llrawproc->bad_pixel_map_fd = -1;
+
+    pthread_rwlock_init(&llrawproc->plan_lock, NULL);
+    llrawproc->plan_stale = 1;
+
+    llrawproc->diso_contexts = NULL;
+    pthread_mutex_init(&llrawproc->diso_contexts_mutex, NULL);
 
     return llrawproc;
 }
 
+/* stops what runs in the background, before the clip's files get closed */
+void llrpStopBackgroundWork(mlvObject_t * video)
+{
+    llrawprocObject_t * llrawproc = video->llrawproc;
+    __atomic_store_n(&llrawproc->stripes_cancel, 1, __ATOMIC_RELEASE);
+
+    /* the threads take plan_lock themselves, so they are joined without it */
+    pthread_rwlock_wrlock(&llrawproc->plan_lock);
+    stripes_sampling_t * sampling = llrawproc->stripes_samplings;
+    llrawproc->stripes_samplings = NULL;
+    pthread_rwlock_unlock(&llrawproc->plan_lock);
+
+    while (sampling)
+    {
+        stripes_sampling_t * next = sampling->next;
+        pthread_join(sampling->thread_id, NULL);
+        free(sampling);
+        sampling = next;
+    }
+}
+
+int llrpCacheOutdated(mlvObject_t * video)
+{
+    return __atomic_exchange_n(&video->llrawproc->stripes_cache_outdated, 0, __ATOMIC_ACQ_REL);
+}
+
 void freeLLRawProcObject(mlvObject_t * video)
 {
     df_free_filename(video);
     df_free(video);
     free_luts(video->llrawproc->raw2ev, video->llrawproc->ev2raw);
+    free_luts(video->llrawproc->diso_raw2ev, video->llrawproc->diso_ev2raw);
     free_pixel_maps(&(video->llrawproc->focus_pixel_map), &(video->llrawproc->bad_pixel_map));
+    pthread_rwlock_destroy(&video->llrawproc->plan_lock);
+    while (video->llrawproc->diso_contexts)
+    {
+        diso_context_t * ctx = video->llrawproc->diso_contexts;
+        video->llrawproc->diso_contexts = ctx->next;
+        diso_free_context(ctx);
+    }
+    pthread_mutex_destroy(&video->llrawproc->diso_contexts_mutex);
     free(video->llrawproc);
 }
 
-/* all low level raw processing takes place here */
-void applyLLRawProcObject(mlvObject_t * video, uint16_t * raw_image_buff, size_t raw_image_size)
+/* returns 1 if frames can be corrected with the plan as it is, caller holds plan_lock */
+static int llrp_plan_ready(mlvObject_t * video)
 {
-    /* if 'fix_raw == false' skip raw processing alltogether */
-    if(!video->llrawproc->fix_raw) return;
+    llrawprocObject_t * llrawproc = video->llrawproc;
+
+    if (llrawproc->plan_stale) return 0;
+
+    /* levels the LUTs were made for */
+    if (llrawproc->plan_black_level != video->RAWI.raw_info.black_level ||
+        llrawproc->plan_white_level != video->RAWI.raw_info.white_level ||
+        llrawproc->plan_bits_per_pixel != video->RAWI.raw_info.bits_per_pixel) return 0;
+
+    /* stripe coefficients are still to be measured */
+    if (llrawproc->vertical_stripes && llrawproc->compute_stripes) return 0;
+
+    /* focus pixel map is not loaded or generated yet */
+    if (llrawproc->focus_pixels && llrawproc->fpm_status < 2) return 0;
+
+    /* bad pixel map is not loaded or searched yet, force mode searches every frame anyway */
+    if (llrawproc->bad_pixels && llrawproc->bad_pixels != 2 && llrawproc->bpm_status < 2) return 0;
+
+    /* dual iso pattern is not known yet, exposure matching is done on every frame from the calibration */
+    if (llrawproc->diso_validity && llrawproc->dual_iso == 1 && !llrawproc->diso_pattern) return 0;
+
+    /* dual iso calibration is not measured for these levels or dark frame setting yet */
+    if (llrawproc->diso_validity && llrawproc->dual_iso == 1 && !diso_calibration_ready(video)) return 0;
+
+    return 1;
+}
+
+/* (re)build what frames share: dark frame, LUTs, dual iso and DNG levels. Caller holds plan_lock for writing */
+static void llrp_build_plan(mlvObject_t * video)
+{
+    llrawprocObject_t * llrawproc = video->llrawproc;
+
+    /* load the dark frame only once per dark frame setting */
+    if (!llrawproc->df_status)
+    {
+        /* Int mode reads from the clip, Ext mode has its own files */
+        int df_int = (llrawproc->dark_frame == DF_INT);
+        if (df_int) pthread_mutex_lock(video->main_file_mutex);
+        llrawproc->df_status = df_init(video) ? 2 : 1;
+        if (df_int) pthread_mutex_unlock(video->main_file_mutex);
+    }
+
+    /* levels the way the frames will have them */
+    struct raw_info raw_info = video->RAWI.raw_info;
+    if(raw_info.bits_per_pixel < 14)
+    {
+        make_14bit_levels(&raw_info);
+    }
+
+    /* initialise or update the LUTs if the black level has changed */
+    if (llrawproc->prev_black_level != raw_info.black_level)
+    {
+        free_luts(llrawproc->raw2ev, llrawproc->ev2raw);
+        llrawproc->raw2ev = get_raw2ev(raw_info.black_level);
+        llrawproc->ev2raw = get_ev2raw(raw_info.black_level);
+
+        llrawproc->prev_black_level = raw_info.black_level;
+    }
+
+    /* initialize dual iso black and white levels */
+    llrawproc->dng_bit_depth = video->RAWI.raw_info.bits_per_pixel;
+    llrawproc->dng_black_level = video->RAWI.raw_info.black_level;
+    llrawproc->dng_white_level = video->RAWI.raw_info.white_level;
+
+    if(llrawproc->diso_validity && llrawproc->dual_iso)
+    {
+        /* restricted lossless raw data gets scaled, processing has to know the new levels */
+        if((video->MLVI.videoClass & MLV_VIDEO_CLASS_FLAG_LJ92) && raw_info.white_level < 15000)
+        {
+            int low_iso = MIN(llrawproc->diso1, llrawproc->diso2);
+            int high_iso = MAX(llrawproc->diso1, llrawproc->diso2);
+
+            scale_restricted_levels(&raw_info, low_iso, high_iso);
+
+#ifndef STDOUT_SILENT
+            printf("\nChanging processing B/W levels...\n");
+            printf("Proc_Black = %d, Proc_White = %d <= BEFORE CHANGING\n", video->processing->black_level, video->processing->white_level);
+#endif
+            processingSetBlackAndWhiteLevel(video->processing, raw_info.black_level, raw_info.white_level, 14); // black and white levels are 14bit after scaling
+#ifndef STDOUT_SILENT
+            printf("Proc_Black = %d, Proc_White = %d <= AFTER CHANGING\n", video->processing->black_level, video->processing->white_level);
+#endif
+        }
+
+        if (llrawproc->dual_iso == 1) // Full 20bit processing mode
+        {
+            /* for full20bit set diso levels and bit depth to 16 bit, needed for cDNG export */
+            int bits_shift = 16 - raw_info.bits_per_pixel;
+            llrawproc->dng_black_level = raw_info.black_level << bits_shift;
+            llrawproc->dng_white_level = raw_info.white_level << bits_shift;
+            llrawproc->dng_bit_depth = 16;
+
+            /* ISO pattern, noise and exposure match are the same for the whole clip */
+            if (!diso_calibration_ready(video)) diso_calibrate_clip(video);
+
+            /* pixel fixes after dual iso processing need LUTs for the 16bit black level */
+            if (llrawproc->diso_lut_black_level != llrawproc->dng_black_level)
+            {
+                free_luts(llrawproc->diso_raw2ev, llrawproc->diso_ev2raw);
+                llrawproc->diso_raw2ev = get_raw2ev(llrawproc->dng_black_level);
+                llrawproc->diso_ev2raw = get_ev2raw(llrawproc->dng_black_level);
+
+                llrawproc->diso_lut_black_level = llrawproc->dng_black_level;
+            }
+        }
+    }
+
+    /* stripes mode 3: this frame measures the coefficients for now, frames over the clip later */
+    if (llrawproc->vertical_stripes == VS_CLIP && llrawproc->compute_stripes && video->frames > 1)
+    {
+        stripes_start_sampling(video);
+    }
+
+    /* pixel maps are placed with the crop position of the frame that built the plan */
+    llrawproc->plan_pan_x = video->VIDF.panPosX;
+    llrawproc->plan_pan_y = video->VIDF.panPosY;
+
+    llrawproc->plan_black_level = video->RAWI.raw_info.black_level;
+    llrawproc->plan_white_level = video->RAWI.raw_info.white_level;
+    llrawproc->plan_bits_per_pixel = video->RAWI.raw_info.bits_per_pixel;
+    llrawproc->plan_stale = 0;
+}
+
+/* exposure match results are per frame, even for the frame building the plan: the settings
+ * keep their auto values, so every frame matches (and refines) on its own */
+static void llrp_frame_exposure_match(llrawprocObject_t * llrawproc, llrp_frame_t * frame)
+{
+    frame->own_diso_auto_correction = llrawproc->diso_auto_correction;
+    frame->own_diso_ev_correction = llrawproc->diso_ev_correction;
+    frame->own_diso_black_delta = llrawproc->diso_black_delta;
+
+    frame->diso_auto_correction = &frame->own_diso_auto_correction;
+    frame->diso_ev_correction = &frame->own_diso_ev_correction;
+    frame->diso_black_delta = &frame->own_diso_black_delta;
+}
+
+/* frame that builds the plan works on llrawproc itself */
+static void llrp_frame_shared(llrawprocObject_t * llrawproc, llrp_frame_t * frame)
+{
+    frame->stripe_corrections = &llrawproc->stripe_corrections;
+    frame->compute_stripes = &llrawproc->compute_stripes;
+    frame->focus_pixel_map = &llrawproc->focus_pixel_map;
+    frame->fpm_status = &llrawproc->fpm_status;
+    frame->bad_pixel_map = &llrawproc->bad_pixel_map;
+    frame->bpm_status = &llrawproc->bpm_status;
+    frame->diso_pattern = &llrawproc->diso_pattern;
+    llrp_frame_exposure_match(llrawproc, frame);
+    frame->own_bad_pixels = 0;
+}
+
+/* any other frame gets copies, anything it measures again is thrown away after the frame */
+static void llrp_frame_private(llrawprocObject_t * llrawproc, llrp_frame_t * frame)
+{
+    frame->own_stripe_corrections = llrawproc->stripe_corrections;
+    frame->own_compute_stripes = 0;
+    frame->own_focus_pixel_map = llrawproc->focus_pixel_map;
+    frame->own_fpm_status = llrawproc->fpm_status;
+    frame->own_bad_pixel_map = llrawproc->bad_pixel_map;
+    frame->own_bpm_status = llrawproc->bpm_status;
+    frame->own_diso_pattern = llrawproc->diso_pattern;
+
+    frame->stripe_corrections = &frame->own_stripe_corrections;
+    frame->compute_stripes = &frame->own_compute_stripes;
+    frame->focus_pixel_map = &frame->own_focus_pixel_map;
+    frame->fpm_status = &frame->own_fpm_status;
+    frame->bad_pixel_map = &frame->own_bad_pixel_map;
+    frame->bpm_status = &frame->own_bpm_status;
+    frame->diso_pattern = &frame->own_diso_pattern;
+    llrp_frame_exposure_match(llrawproc, frame);
+    frame->own_bad_pixels = 0;
+}
 
-    /* subtract dark frame if Ext or Int mode specified and df_init is successful */
-    if (!df_init(video))
+/* bad pixel force mode never keeps its map between frames */
+static void llrp_frame_bad_pixels(llrawprocObject_t * llrawproc, llrp_frame_t * frame)
+{
+    if (llrawproc->bad_pixels != 2) return;
+
+    frame->own_bad_pixel_map.type = PIX_BAD;
+    frame->own_bad_pixel_map.count = 0;
+    frame->own_bad_pixel_map.capacity = 0;
+    frame->own_bad_pixel_map.pixels = NULL;
+    frame->own_bpm_status = 1;
+    frame->bad_pixel_map = &frame->own_bad_pixel_map;
+    frame->bpm_status = &frame->own_bpm_status;
+    frame->own_bad_pixels = 1;
+}
+
+/* the actual corrections, caller holds plan_lock */
+static void llrp_correct_frame(mlvObject_t * video, llrp_frame_t * frame, uint16_t * raw_image_buff, size_t raw_image_size)
+{
+    llrawprocObject_t * llrawproc = video->llrawproc;
+
+    /* subtract dark frame if Ext or Int mode specified and it could be loaded */
+    if (llrawproc->df_status == 1)
     {
 #ifndef STDOUT_SILENT
         printf("Subtracting Dark Frame... ");
@@ -223,211 +805,197 @@ void applyLLRawProcObject(mlvObject_t * video, uint16_t * raw_image_buff, size_t
         make_14bit(raw_image_buff, raw_image_size, &raw_info);
     }
 
-    /* initialize dual iso black and white levels */
-    llrpResetDngBWLevels(video);
-
-    /* initialise or update the LUTs if the black level has changed */
-    if (video->llrawproc->prev_black_level != raw_info.black_level)
-    {
-        free_luts(video->llrawproc->raw2ev, video->llrawproc->ev2raw);
-        video->llrawproc->raw2ev = get_raw2ev(raw_info.black_level);
-        video->llrawproc->ev2raw = get_ev2raw(raw_info.black_level);
-
-        video->llrawproc->prev_black_level = raw_info.black_level;
-    }
-
     /* fix vertical stripes */
-    if (video->llrawproc->vertical_stripes)
+    if (llrawproc->vertical_stripes)
     {
-        fix_vertical_stripes(&video->llrawproc->stripe_corrections,
+        fix_vertical_stripes(frame->stripe_corrections,
                              raw_image_buff,
                              raw_info.black_level,
                              raw_info.white_level,
                              raw_info.frame_size,
                              video->RAWI.xRes,
                              video->RAWI.yRes,
-                             video->llrawproc->vertical_stripes,
-                             &video->llrawproc->compute_stripes);
+                             llrawproc->vertical_stripes,
+                             frame->compute_stripes,
+                             video->cpu_cores);
     }
 
     /* fix focus pixels */
-    if (video->llrawproc->focus_pixels && video->llrawproc->fpm_status < 3)
+    if (llrawproc->focus_pixels && *frame->fpm_status < 3)
     {
         /* detect crop_rec mode */
-        int crop_rec = (llrpDetectFocusDotFixMode(video) == 2) ? 1 : (video->llrawproc->focus_pixels == 2);
+        int crop_rec = (llrpDetectFocusDotFixMode(video) == 2) ? 1 : (llrawproc->focus_pixels == 2);
         /* if raw data is lossless set unified mode */
         int unified_mode = (video->MLVI.videoClass & MLV_VIDEO_CLASS_FLAG_LJ92) ? 5 : 0;
-        fix_focus_pixels(&video->llrawproc->focus_pixel_map,
-                         &video->llrawproc->fpm_status,
+        fix_focus_pixels(frame->focus_pixel_map,
+                         frame->fpm_status,
                          raw_image_buff,
                          video->IDNT.cameraModel,
                          video->RAWI.xRes,
                          video->RAWI.yRes,
-                         video->VIDF.panPosX,
-                         video->VIDF.panPosY,
+                         llrawproc->plan_pan_x,
+                         llrawproc->plan_pan_y,
                          video->RAWI.raw_info.width,
                          video->RAWI.raw_info.height,
                          crop_rec,
                          unified_mode,
-                         video->llrawproc->fpi_method,
-                         (video->llrawproc->dual_iso),
-                         video->llrawproc->raw2ev,
-                         video->llrawproc->ev2raw);
+                         llrawproc->fpi_method,
+                         (llrawproc->dual_iso),
+                         llrawproc->focus_pixel_map_fd,
+                         llrawproc->raw2ev,
+                         llrawproc->ev2raw,
+                         video->cpu_cores);
     }
 
     /* fix bad pixels */
-    if (video->llrawproc->bad_pixels && video->llrawproc->bpm_status < 3)
+    if (llrawproc->bad_pixels && *frame->bpm_status < 3)
     {
-        fix_bad_pixels(&video->llrawproc->bad_pixel_map,
-                       &video->llrawproc->bpm_status,
+        fix_bad_pixels(frame->bad_pixel_map,
+                       frame->bpm_status,
                        raw_image_buff,
                        video->IDNT.cameraModel,
                        video->RAWI.xRes,
                        video->RAWI.yRes,
-                       video->VIDF.panPosX,
-                       video->VIDF.panPosY,
+                       llrawproc->plan_pan_x,
+                       llrawproc->plan_pan_y,
                        video->RAWI.raw_info.width,
                        video->RAWI.raw_info.height,
                        raw_info.black_level,
-                       video->llrawproc->bad_pixels,
-                       video->llrawproc->bps_method,
-                       video->llrawproc->bpi_method,
-                       (video->llrawproc->dual_iso),
-                       video->llrawproc->raw2ev,
-                       video->llrawproc->ev2raw);
+                       llrawproc->bad_pixels,
+                       llrawproc->bps_method,
+                       llrawproc->bpi_method,
+                       (llrawproc->dual_iso),
+                       llrawproc->bad_pixel_map_fd,
+                       llrawproc->raw2ev,
+                       llrawproc->ev2raw,
+                       video->cpu_cores);
     }
 
     /* fix pattern noise */
-    if (!video->llrawproc->diso_validity && video->llrawproc->pattern_noise)
+    if (!llrawproc->diso_validity && llrawproc->pattern_noise)
     {
 #ifndef STDOUT_SILENT
         printf("Fixing pattern noise... ");
 #endif
-        fix_pattern_noise((int16_t *)raw_image_buff, video->RAWI.xRes, video->RAWI.yRes, raw_info.white_level, 0);
+        fix_pattern_noise((int16_t *)raw_image_buff, video->RAWI.xRes, video->RAWI.yRes, raw_info.white_level, 0, video->cpu_cores);
 #ifndef STDOUT_SILENT
         printf("Done\n\n");
 #endif
     }
 
     /* if dual iso valid/forced and processing is turned on */
-    if(video->llrawproc->diso_validity && video->llrawproc->dual_iso)
-    {
-        raw_info.width = video->RAWI.xRes;
-        raw_info.height = video->RAWI.yRes;
-        raw_info.pitch = video->RAWI.xRes;
-        raw_info.active_area.x1 = 0;
-        raw_info.active_area.y1 = 0;
-        raw_info.active_area.x2 = raw_info.width;
-        raw_info.active_area.y2 = raw_info.height;
-        
+    if(llrawproc->diso_validity && llrawproc->dual_iso)
+    {
+        diso_frame_area(video, &raw_info);
+
         /* detect if lossless raw data is restricted to imaginary 8-12bit levels */
         int restricted_lossless = (video->MLVI.videoClass & MLV_VIDEO_CLASS_FLAG_LJ92) && raw_info.white_level < 15000;
 
+        /* processing B/W levels were changed to the scaled ones when the plan was built */
         if(restricted_lossless)
         {
 #ifndef STDOUT_SILENT
             printf("\nScaling raw data range...\n");
             printf("Raw_Black = %d, Raw_White = %d <= BEFORE SCALING\n", raw_info.black_level, raw_info.white_level);
 #endif
-            int low_iso = MIN(video->llrawproc->diso1, video->llrawproc->diso2);
-            int high_iso = MAX(video->llrawproc->diso1, video->llrawproc->diso2);
+            int low_iso = MIN(llrawproc->diso1, llrawproc->diso2);
+            int high_iso = MAX(llrawproc->diso1, llrawproc->diso2);
 
             scale_restricted_range(&raw_info, raw_image_buff, low_iso, high_iso);
 
 #ifndef STDOUT_SILENT
             printf("Raw_Black = %d, Raw_White = %d <= AFTER SCALING\n", raw_info.black_level, raw_info.white_level);
-            printf("\nChanging processing B/W levels...\n");
-            printf("Proc_Black = %d, Proc_White = %d <= BEFORE CHANGING\n", video->processing->black_level, video->processing->white_level);
-#endif
-            processingSetBlackAndWhiteLevel(video->processing, raw_info.black_level, raw_info.white_level, 14); // black and white levels are 14bit after scaling above
-#ifndef STDOUT_SILENT
-            printf("Proc_Black = %d, Proc_White = %d <= AFTER CHANGING\n", video->processing->black_level, video->processing->white_level);
 #endif
         }
 
         /* dual iso processing */
-        if (video->llrawproc->dual_iso == 1) // Full 20bit processing mode
+        if (llrawproc->dual_iso == 1) // Full 20bit processing mode
         {
-            diso_get_full20bit(raw_info,
+            /* reuse an idle context, so the planes and LUTs are not made again for every frame */
+            pthread_mutex_lock(&llrawproc->diso_contexts_mutex);
+            diso_context_t * diso_ctx = llrawproc->diso_contexts;
+            if (diso_ctx) llrawproc->diso_contexts = diso_ctx->next;
+            pthread_mutex_unlock(&llrawproc->diso_contexts_mutex);
+            if (!diso_ctx) diso_ctx = diso_new_context();
+
+            diso_get_full20bit(diso_ctx,
+                               raw_info,
                                raw_image_buff,
-                               video->llrawproc->dark_frame,
-                               video->llrawproc->diso1,
-                               video->llrawproc->diso2,
-                               &video->llrawproc->diso_pattern,
-                               &video->llrawproc->diso_auto_correction,
-                               &video->llrawproc->diso_ev_correction,
-                               &video->llrawproc->diso_black_delta,
-                               video->llrawproc->diso_averaging,
-                               video->llrawproc->diso_alias_map,
-                               video->llrawproc->diso_frblending,
-                               video->llrawproc->chroma_smooth,
+                               llrawproc->dark_frame,
+                               llrawproc->diso1,
+                               llrawproc->diso2,
+                               (llrawproc->diso_calibration.valid == 1) ? &llrawproc->diso_calibration : NULL,
+                               llrawproc->diso_refine,
+                               frame->diso_pattern,
+                               frame->diso_auto_correction,
+                               frame->diso_ev_correction,
+                               frame->diso_black_delta,
+                               llrawproc->diso_averaging,
+                               llrawproc->diso_alias_map,
+                               llrawproc->diso_frblending,
+                               llrawproc->chroma_smooth,
                                video->cpu_cores);
 
-            /* for full20bit set diso levels and bit depth to 16 bit, needed for cDNG export */
-            int bits_shift = 16 - raw_info.bits_per_pixel;
-            video->llrawproc->dng_black_level = raw_info.black_level << bits_shift;
-            video->llrawproc->dng_white_level = raw_info.white_level << bits_shift;
-            video->llrawproc->dng_bit_depth = 16;
+            pthread_mutex_lock(&llrawproc->diso_contexts_mutex);
+            diso_ctx->next = llrawproc->diso_contexts;
+            llrawproc->diso_contexts = diso_ctx;
+            pthread_mutex_unlock(&llrawproc->diso_contexts_mutex);
 
-            /* for dualiso blacklevel may have been changed. Correct values needed for following pixel fixes */
-            free_luts(video->llrawproc->raw2ev, video->llrawproc->ev2raw);
-            video->llrawproc->raw2ev = get_raw2ev(video->llrawproc->dng_black_level);
-            video->llrawproc->ev2raw = get_ev2raw(video->llrawproc->dng_black_level);
+            /* for dualiso blacklevel may have been changed, following pixel fixes use the 16bit LUTs */
 
             /* fix focus pixels */
-            if (video->llrawproc->focus_pixels && video->llrawproc->fpm_status < 3)
+            if (llrawproc->focus_pixels && *frame->fpm_status < 3)
             {
                 /* detect crop_rec mode */
-                int crop_rec = (llrpDetectFocusDotFixMode(video) == 2) ? 1 : (video->llrawproc->focus_pixels == 2);
+                int crop_rec = (llrpDetectFocusDotFixMode(video) == 2) ? 1 : (llrawproc->focus_pixels == 2);
                 /* if raw data is lossless set unified mode */
                 int unified_mode = (video->MLVI.videoClass & MLV_VIDEO_CLASS_FLAG_LJ92) ? 5 : 0;
-                fix_focus_pixels(&video->llrawproc->focus_pixel_map,
-                                 &video->llrawproc->fpm_status,
+                fix_focus_pixels(frame->focus_pixel_map,
+                                 frame->fpm_status,
                                  raw_image_buff,
                                  video->IDNT.cameraModel,
                                  video->RAWI.xRes,
                                  video->RAWI.yRes,
-                                 video->VIDF.panPosX,
-                                 video->VIDF.panPosY,
+                                 llrawproc->plan_pan_x,
+                                 llrawproc->plan_pan_y,
                                  video->RAWI.raw_info.width,
                                  video->RAWI.raw_info.height,
                                  crop_rec,
                                  unified_mode,
                                  2,
                                  0,
-                                 video->llrawproc->raw2ev,
-                                 video->llrawproc->ev2raw);
+                                 llrawproc->focus_pixel_map_fd,
+                                 llrawproc->diso_raw2ev,
+                                 llrawproc->diso_ev2raw,
+                                 video->cpu_cores);
             }
 
             /* fix bad pixels */
-            if (video->llrawproc->bad_pixels && video->llrawproc->bpm_status < 3)
+            if (llrawproc->bad_pixels && *frame->bpm_status < 3)
             {
-                fix_bad_pixels(&video->llrawproc->bad_pixel_map,
-                               &video->llrawproc->bpm_status,
+                fix_bad_pixels(frame->bad_pixel_map,
+                               frame->bpm_status,
                                raw_image_buff,
                                video->IDNT.cameraModel,
                                video->RAWI.xRes,
                                video->RAWI.yRes,
-                               video->VIDF.panPosX,
-                               video->VIDF.panPosY,
+                               llrawproc->plan_pan_x,
+                               llrawproc->plan_pan_y,
                                video->RAWI.raw_info.width,
                                video->RAWI.raw_info.height,
                                raw_info.black_level,
-                               video->llrawproc->bad_pixels,
-                               video->llrawproc->bps_method,
+                               llrawproc->bad_pixels,
+                               llrawproc->bps_method,
                                2,
                                0,
-                               video->llrawproc->raw2ev,
-                               video->llrawproc->ev2raw);
+                               llrawproc->bad_pixel_map_fd,
+                               llrawproc->diso_raw2ev,
+                               llrawproc->diso_ev2raw,
+                               video->cpu_cores);
             }
-
-            /* revert LUTs */
-            free_luts(video->llrawproc->raw2ev, video->llrawproc->ev2raw);
-            video->llrawproc->raw2ev = get_raw2ev(raw_info.black_level);
-            video->llrawproc->ev2raw = get_ev2raw(raw_info.black_level);
         }
         /*
-        else if (video->llrawproc->dual_iso == 2) // Preview mode
+        else if (llrawproc->dual_iso == 2) // Preview mode
         {
             diso_get_preview(raw_image_buff,
                              raw_info.width,
@@ -440,43 +1008,83 @@ void applyLLRawProcObject(mlvObject_t * video, uint16_t * raw_image_buff, size_t
     }
 
     /* do chroma smoothing */
-    if (video->llrawproc->chroma_smooth && video->llrawproc->dual_iso != 1) // do not smooth 20bit dualiso raw
+    if (llrawproc->chroma_smooth && llrawproc->dual_iso != 1) // do not smooth 20bit dualiso raw
     {
 #ifndef STDOUT_SILENT
-            printf("\nUsing chroma smooth method: '%dx%d'\n\n", video->llrawproc->chroma_smooth, video->llrawproc->chroma_smooth);
+            printf("\nUsing chroma smooth method: '%dx%d'\n\n", llrawproc->chroma_smooth, llrawproc->chroma_smooth);
 #endif
-        chroma_smooth(video->llrawproc->chroma_smooth,
+        chroma_smooth(llrawproc->chroma_smooth,
                       raw_image_buff,
                       video->RAWI.xRes,
                       video->RAWI.yRes,
                       raw_info.black_level,
                       raw_info.white_level,
-                      video->llrawproc->raw2ev,
-                      video->llrawproc->ev2raw);
+                      llrawproc->raw2ev,
+                      llrawproc->ev2raw,
+                      video->cpu_cores);
     }
 
     /* undo 14bit conversion of uncompressed 10/12bit raw data, except when 20bit dual iso processing is active */
-    if(video->RAWI.raw_info.bits_per_pixel < 14 && video->llrawproc->dual_iso != 1)
+    if(video->RAWI.raw_info.bits_per_pixel < 14 && llrawproc->dual_iso != 1)
     {
         undo_14bit(raw_image_buff, raw_image_size, video->RAWI.raw_info.bits_per_pixel);
     }
 
     /* deflicker RAW data by changing 'tcBaselineExposure' tag in the exported DNG */
     /*
-    if (video->llrawproc->deflicker_target)
+    if (llrawproc->deflicker_target)
     {
 #ifndef STDOUT_SILENT
-        printf("Per-frame exposure compensation: 'ON'\nDeflicker target: '%d'\n\n", video->llrawproc->deflicker_target);
+        printf("Per-frame exposure compensation: 'ON'\nDeflicker target: '%d'\n\n", llrawproc->deflicker_target);
 #endif
         deflicker(video, raw_image_buff, raw_image_size);
     }
     */
 
+    if (frame->own_bad_pixels) free(frame->own_bad_pixel_map.pixels);
+
 #ifndef STDOUT_SILENT
     printf("raw_image_buff[1000] = %u, Proc_Black = %d, Proc_White = %d, Raw_Black = %d, Raw_White = %d <= THE END OF LLRAWPROC\n", raw_image_buff[1000], video->processing->black_level, video->processing->white_level, video->RAWI.raw_info.black_level, video->RAWI.raw_info.white_level);
 #endif
 }
 
+/* all low level raw processing takes place here, can be called for several frames at once */
+void applyLLRawProcObject(mlvObject_t * video, uint16_t * raw_image_buff, size_t raw_image_size)
+{
+    llrawprocObject_t * llrawproc = video->llrawproc;
+
+    /* if 'fix_raw == false' skip raw processing alltogether */
+    if(!llrawproc->fix_raw) return;
+
+    llrp_frame_t frame;
+
+    pthread_rwlock_rdlock(&llrawproc->plan_lock);
+    while (!llrp_plan_ready(video))
+    {
+        pthread_rwlock_unlock(&llrawproc->plan_lock);
+        pthread_rwlock_wrlock(&llrawproc->plan_lock);
+        if (!llrp_plan_ready(video))
+        {
+            /* first frame after a settings change: build the plan, then measure
+             * on this frame what can only be measured on a real image */
+            llrp_build_plan(video);
+            llrp_frame_shared(llrawproc, &frame);
+            llrp_frame_bad_pixels(llrawproc, &frame);
+            llrp_correct_frame(video, &frame, raw_image_buff, raw_image_size);
+            pthread_rwlock_unlock(&llrawproc->plan_lock);
+            return;
+        }
+        /* another frame built it meanwhile */
+        pthread_rwlock_unlock(&llrawproc->plan_lock);
+        pthread_rwlock_rdlock(&llrawproc->plan_lock);
+    }
+
+    llrp_frame_private(llrawproc, &frame);
+    llrp_frame_bad_pixels(llrawproc, &frame);
+    llrp_correct_frame(video, &frame, raw_image_buff, raw_image_size);
+    pthread_rwlock_unlock(&llrawproc->plan_lock);
+}
+
 /* Detect focus dot fix mode according to RAWC block info (binning + skipping) and camera ID
    Return value 0 = off, 1 = On, 2 = CropRec */
 int llrpDetectFocusDotFixMode(mlvObject_t * video)
@@ -504,6 +1112,15 @@ int llrpDetectFocusDotFixMode(mlvObject_t * video)
     }
 }
 
+/* settings the plan depends on only change while no frame is being corrected */
+static void llrp_set_plan_setting(mlvObject_t * video, int * setting, int value)
+{
+    pthread_rwlock_wrlock(&video->llrawproc->plan_lock);
+    *setting = value;
+    video->llrawproc->plan_stale = 1;
+    pthread_rwlock_unlock(&video->llrawproc->plan_lock);
+}
+
 /* LLRawProcObject variable handling */
 int llrpGetFixRawMode(mlvObject_t * video)
 {
@@ -522,12 +1139,17 @@ int llrpGetVerticalStripeMode(mlvObject_t * video)
 
 void llrpSetVerticalStripeMode(mlvObject_t * video, int value)
 {
+    pthread_rwlock_wrlock(&video->llrawproc->plan_lock);
+    /* switching to clip mode measures the clip even if the first frame was measured already */
+    if (value == VS_CLIP && video->llrawproc->vertical_stripes != VS_CLIP) video->llrawproc->compute_stripes = 1;
     video->llrawproc->vertical_stripes = value;
+    video->llrawproc->plan_stale = 1;
+    pthread_rwlock_unlock(&video->llrawproc->plan_lock);
 }
 
 void llrpComputeStripesOn(mlvObject_t * video)
 {
-    video->llrawproc->compute_stripes = 1;
+    llrp_set_plan_setting(video, &video->llrawproc->compute_stripes, 1);
 }
 
 int llrpGetFocusPixelMode(mlvObject_t * video)
@@ -537,7 +1159,7 @@ int llrpGetFocusPixelMode(mlvObject_t * video)
 
 void llrpSetFocusPixelMode(mlvObject_t * video, int value)
 {
-    video->llrawproc->focus_pixels = value;
+    llrp_set_plan_setting(video, &video->llrawproc->focus_pixels, value);
 }
 
 int llrpGetFocusPixelInterpolationMethod(mlvObject_t * video)
@@ -557,7 +1179,7 @@ int llrpGetBadPixelMode(mlvObject_t * video)
 
 void llrpSetBadPixelMode(mlvObject_t * video, int value)
 {
-    video->llrawproc->bad_pixels = value;
+    llrp_set_plan_setting(video, &video->llrawproc->bad_pixels, value);
 }
 
 int llrpGetBadPixelSearchMethod(mlvObject_t *video)
@@ -617,7 +1239,7 @@ int llrpGetDualIsoMode(mlvObject_t * video)
 
 void llrpSetDualIsoMode(mlvObject_t * video, int value)
 {
-    video->llrawproc->dual_iso = value;
+    llrp_set_plan_setting(video, &video->llrawproc->dual_iso, value);
 }
 
 int llrpGetDualIsoInterpolationMethod(mlvObject_t * video)
@@ -650,6 +1272,16 @@ void llrpSetDualIsoFullResBlendingMode(mlvObject_t * video, int value)
     video->llrawproc->diso_frblending = value;
 }
 
+int llrpGetDualIsoRefineMode(mlvObject_t * video)
+{
+    return video->llrawproc->diso_refine;
+}
+
+void llrpSetDualIsoRefineMode(mlvObject_t * video, int value)
+{
+    video->llrawproc->diso_refine = value;
+}
+
 int llrpGetDualIsoValidity(mlvObject_t * video)
 {
     return video->llrawproc->diso_validity;
@@ -659,6 +1291,9 @@ void llrpSetDualIsoValidity(mlvObject_t * video, int diso_force)
 {
     int iso1 = (int)video->EXPO.isoValue;
 
+    pthread_rwlock_wrlock(&video->llrawproc->plan_lock);
+    video->llrawproc->plan_stale = 1;
+
     if (iso1 < 100)
     {
         iso1 = 100;
@@ -702,6 +1337,7 @@ void llrpSetDualIsoValidity(mlvObject_t * video, int diso_force)
     {
         video->llrawproc->diso_validity = DISO_INVALID;
     }
+    pthread_rwlock_unlock(&video->llrawproc->plan_lock);
 }
 
 int llrpHQDualIso(mlvObject_t * video)
@@ -711,31 +1347,66 @@ int llrpHQDualIso(mlvObject_t * video)
 
 void llrpResetDngBWLevels(mlvObject_t * video)
 {
+    pthread_rwlock_wrlock(&video->llrawproc->plan_lock);
     video->llrawproc->dng_bit_depth = video->RAWI.raw_info.bits_per_pixel;
     video->llrawproc->dng_black_level = video->RAWI.raw_info.black_level;
     video->llrawproc->dng_white_level = video->RAWI.raw_info.white_level;
+    video->llrawproc->plan_stale = 1;
+    pthread_rwlock_unlock(&video->llrawproc->plan_lock);
 }
 
 void llrpResetFpmStatus(mlvObject_t * video)
 {
+    pthread_rwlock_wrlock(&video->llrawproc->plan_lock);
     reset_fpm_status(&(video->llrawproc->focus_pixel_map), &(video->llrawproc->fpm_status));
+    pthread_rwlock_unlock(&video->llrawproc->plan_lock);
 }
 
 void llrpResetBpmStatus(mlvObject_t * video)
 {
+    pthread_rwlock_wrlock(&video->llrawproc->plan_lock);
+    reset_bpm_status(&(video->llrawproc->bad_pixel_map), &(video->llrawproc->bpm_status));
+    pthread_rwlock_unlock(&video->llrawproc->plan_lock);
+}
+
+void llrpSetPixelMapDirectory(const char * directory)
+{
+    pixel_maps_set_directory(directory);
+}
+
+/* maps from a picked file are loaded again by the next frame */
+void llrpSetFocusPixelMapFd(mlvObject_t * video, int fd)
+{
+    pthread_rwlock_wrlock(&video->llrawproc->plan_lock);
+    video->llrawproc->focus_pixel_map_fd = fd;
+    reset_fpm_status(&(video->llrawproc->focus_pixel_map), &(video->llrawproc->fpm_status));
+    pthread_rwlock_unlock(&video->llrawproc->plan_lock);
+}
+
+void llrpSetBadPixelMapFd(mlvObject_t * video, int fd)
+{
+    pthread_rwlock_wrlock(&video->llrawproc->plan_lock);
+    video->llrawproc->bad_pixel_map_fd = fd;
     reset_bpm_status(&(video->llrawproc->bad_pixel_map), &(video->llrawproc->bpm_status));
+    pthread_rwlock_unlock(&video->llrawproc->plan_lock);
 }
 
-/* dark frame stuff */
+/* dark frame stuff, it is loaded again by the next frame */
 void llrpInitDarkFrameExtFileName(mlvObject_t * video, char * df_filename)
 {
+    pthread_rwlock_wrlock(&video->llrawproc->plan_lock);
     df_free_filename(video);
     df_init_filename(video, df_filename);
+    video->llrawproc->df_status = 0;
+    pthread_rwlock_unlock(&video->llrawproc->plan_lock);
 }
 
 void llrpFreeDarkFrameExtFileName(mlvObject_t * video)
 {
+    pthread_rwlock_wrlock(&video->llrawproc->plan_lock);
     df_free_filename(video);
+    video->llrawproc->df_status = 0;
+    pthread_rwlock_unlock(&video->llrawproc->plan_lock);
 }
 
 int llrpGetDarkFrameMode(mlvObject_t * video)
@@ -745,7 +1416,28 @@ int llrpGetDarkFrameMode(mlvObject_t * video)
 
 void llrpSetDarkFrameMode(mlvObject_t * video, int value)
 {
+    pthread_rwlock_wrlock(&video->llrawproc->plan_lock);
     video->llrawproc->dark_frame = value;
+    video->llrawproc->df_status = 0;
+    pthread_rwlock_unlock(&video->llrawproc->plan_lock);
+}
+
+int llrpGetDarkFrameStackMethod(mlvObject_t * video)
+{
+    return video->llrawproc->dark_frame_stack;
+}
+
+void llrpSetDarkFrameStackMethod(mlvObject_t * video, int value)
+{
+    pthread_rwlock_wrlock(&video->llrawproc->plan_lock);
+    video->llrawproc->dark_frame_stack = value;
+    video->llrawproc->df_status = 0;
+    pthread_rwlock_unlock(&video->llrawproc->plan_lock);
+}
+
+void llrpSetDarkFrameMasterDirectory(const char * directory)
+{
+    df_set_master_directory(directory);
 }
 
 int llrpGetDarkFrameExtStatus(mlvObject_t * video)
@@ -762,5 +1454,10 @@ int llrpGetDarkFrameIntStatus(mlvObject_t * video)
 
 int llrpValidateExtDarkFrame(mlvObject_t * video, char * df_filename, char * error_message)
 {
-    return df_validate(video, df_filename, error_message);
+    /* validating loads and frees the dark frame in llrawproc */
+    pthread_rwlock_wrlock(&video->llrawproc->plan_lock);
+    int ret = df_validate(video, df_filename, error_message);
+    video->llrawproc->df_status = 0;
+    pthread_rwlock_unlock(&video->llrawproc->plan_lock);
+    return ret;
 }
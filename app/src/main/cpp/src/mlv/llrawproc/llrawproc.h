@@ -26,6 +26,10 @@
 
 llrawprocObject_t * initLLRawProcObject();
 void freeLLRawProcObject(mlvObject_t * video);
+/* stops background measurements, needed before the clip's files are closed */
+void llrpStopBackgroundWork(mlvObject_t * video);
+/* returns 1 once after background measurements changed the corrections of frames already cached */
+int llrpCacheOutdated(mlvObject_t * video);
 
 /* all low level raw processing takes place here */
 void applyLLRawProcObject(mlvObject_t * video, uint16_t * raw_image_buff, size_t raw_image_size);
@@ -39,7 +43,7 @@ enum { FR_OFF, FR_ON };
 int llrpGetFixRawMode(mlvObject_t * video);
 void llrpSetFixRawMode(mlvObject_t * video, int value);
 
-enum { VS_OFF, VS_ON, VS_FORCE };
+enum { VS_OFF, VS_ON, VS_FORCE, VS_CLIP };
 int llrpGetVerticalStripeMode(mlvObject_t * video);
 void llrpSetVerticalStripeMode(mlvObject_t * video, int value);
 void llrpComputeStripesOn(mlvObject_t * video);
@@ -90,6 +94,10 @@ void llrpSetDualIsoAliasMapMode(mlvObject_t * video, int value);
 int llrpGetDualIsoFullResBlendingMode(mlvObject_t * video);
 void llrpSetDualIsoFullResBlendingMode(mlvObject_t * video, int value);
 
+/* refine the clip calibration with a little of what every frame measures itself */
+int llrpGetDualIsoRefineMode(mlvObject_t * video);
+void llrpSetDualIsoRefineMode(mlvObject_t * video, int value);
+
 enum { DISO_INVALID, DISO_FORCED, DISO_VALID }; // Return values
 int llrpGetDualIsoValidity(mlvObject_t * video);
 void llrpSetDualIsoValidity(mlvObject_t * video, int diso_force);
@@ -102,6 +110,12 @@ void llrpResetDngBWLevels(mlvObject_t * video);
 void llrpResetFpmStatus(mlvObject_t * video);
 void llrpResetBpmStatus(mlvObject_t * video);
 
+/* pixel maps: directory .fpm/.bpm files are looked for in (and compiled ones are kept in),
+ * for the whole process. A picked file (fd stays owned by the caller) is used instead, -1 = none */
+void llrpSetPixelMapDirectory(const char * directory);
+void llrpSetFocusPixelMapFd(mlvObject_t * video, int fd);
+void llrpSetBadPixelMapFd(mlvObject_t * video, int fd);
+
 /* dark frame stuff */
 void llrpInitDarkFrameExtFileName(mlvObject_t * video, char * df_filename);
 void llrpFreeDarkFrameExtFileName(mlvObject_t * video);
@@ -109,6 +123,12 @@ void llrpFreeDarkFrameExtFileName(mlvObject_t * video);
 int llrpGetDarkFrameMode(mlvObject_t * video);
 void llrpSetDarkFrameMode(mlvObject_t * video, int value);
 
+/* ext dark frame clips are stacked into a master, 0 = average, 1 = median. Masters are kept
+ * for the whole process, and in the directory (if set) for next time */
+int llrpGetDarkFrameStackMethod(mlvObject_t * video);
+void llrpSetDarkFrameStackMethod(mlvObject_t * video, int value);
+void llrpSetDarkFrameMasterDirectory(const char * directory);
+
 int llrpGetDarkFrameExtStatus(mlvObject_t * video);
 int llrpGetDarkFrameIntStatus(mlvObject_t * video);
 
@@ -23,8 +23,10 @@
 #define _llrawproc_object_h
 
 #include <sys/types.h>
+#include <pthread.h>
 #include "pixelproc.h"
 #include "stripes.h"
+#include "dualiso.h"
 #include "../mlv.h"
 
 /* Low level raw processing object */
@@ -32,7 +34,8 @@ typedef struct
 {
     /* flags */ 
     int fix_raw;          // apply raw fixes or not, 0 = do not apply, 1 = apply
-    int vertical_stripes; // fix vertical stripes, 0 = do not fix", 1 = fix, 2 = compute stripes for every frame
+    int vertical_stripes; // fix vertical stripes, 0 = do not fix", 1 = fix, 2 = compute stripes for every frame,
+                          // 3 = fix, computed from frames spread over the clip in the background
     int compute_stripes;  // 0 = do not compute stripes, 1 = compute stripes
     int focus_pixels;     // fix focus pixels, 0 = do not fix, 1 = fix, 2 = generates focus pixel map for crop_rec mode
     int fpi_method;       // focus pixel interpolation method: 0 = mlvfs, 1 = raw2dng
@@ -65,7 +68,9 @@ typedef struct
     int diso_averaging;   // dual iso interpolation method, 0 = amaze-edge, 1 = mean23
     int diso_alias_map;   // flag for Alias Map switchin on/off
     int diso_frblending;  // flag for Fullres Blending switching on/off
+    int diso_refine;      // refine the clip calibration on every frame, 0 = off, 1 = on
     int dark_frame;       // flag for Dark Frame subtraction mode 0 = off, 1 = ext, 2 = int
+    int dark_frame_stack; // how an ext dark frame clip is stacked, 0 = average, 1 = median
 
     /* cDNG bit depth and black/white levels */
     int dng_bit_depth;
@@ -74,7 +79,8 @@ typedef struct
 
     /* external dark frame file name */
     char * dark_frame_filename;
-    /* Android: pre-opened file descriptor for dark frame (from Java SAF layer) */
+    /* Android: pre-opened file descriptor for dark frame (from Java SAF layer), -1 = none,
+     * then a kept master taken with the same camera settings as the clip is used */
     int dark_frame_fds[1];
     /* external dark frame block header */
     mlv_dark_hdr_t dark_frame_hdr;
@@ -82,6 +88,9 @@ typedef struct
     uint16_t * dark_frame_data;
     uint32_t dark_frame_size;
 
+    /* dark frame status: 0 = not loaded, 1 = loaded, 2 = off or could not be loaded */
+    int df_status;
+
     /* LUTs */
     int * raw2ev;
     int * ev2raw;
@@ -89,12 +98,47 @@ typedef struct
     /* used to check whether the black level has changed (for updating the LUTs) */
     int32_t prev_black_level;
 
+    /* LUTs for the 16 bit black level after full 20bit dual iso and the black level they are for */
+    int * diso_raw2ev;
+    int * diso_ev2raw;
+    int32_t diso_lut_black_level;
+
     /* pixel maps */
     pixel_map focus_pixel_map;
     pixel_map bad_pixel_map;
+    /* Android: pre-opened .fpm/.bpm files (from Java SAF layer), -1 = look in the pixel map directory */
+    int focus_pixel_map_fd;
+    int bad_pixel_map_fd;
 
     /* stripe corrections */
     stripes_correction stripe_corrections;
+    /* stripes mode 3: threads measuring the clip (1, more only for a moment after settings
+     * change), joined once they are done or when the clip is closed, the measurement they are
+     * for, cancel flag set when the clip is closed (atomic), and set (atomic) when a thread
+     * replaced the coefficients the cached frames were made with */
+    struct stripes_sampling * stripes_samplings;
+    uint32_t stripes_generation;
+    int stripes_cancel;
+    int stripes_cache_outdated;
+
+    /* Correction plan: LUTs, pixel maps, stripe coefficients, dark frame, dual iso calibration
+     * and dng levels above are only written with plan_lock held for writing. Frames are
+     * corrected with it held for reading, so any number of them can run at once */
+    pthread_rwlock_t plan_lock;
+    int plan_stale;              // set when a setting the plan depends on changes
+    int32_t plan_black_level;    // RAWI levels the plan was built for
+    int32_t plan_white_level;
+    int32_t plan_bits_per_pixel;
+    uint16_t plan_pan_x;         // crop position pixel maps are placed with
+    uint16_t plan_pan_y;
+
+    /* Dual iso calibration of the clip, measured on a few frames when the plan is built
+     * (or loaded from the MAPP file), valid: 0 = not measured, 1 = ok, -1 = could not be measured */
+    diso_calibration_t diso_calibration;
+
+    /* Idle full 20bit dual iso contexts (buffers and LUTs), a frame takes one while it runs */
+    struct diso_context * diso_contexts;
+    pthread_mutex_t diso_contexts_mutex;
 
 } llrawprocObject_t;
 
@@ -12,6 +12,9 @@ typedef int pixelvalue ;
 #define PIX_SORT(a,b) { if ((a)>(b)) PIX_SWAP((a),(b)); }
 #define PIX_SWAP(a,b) { pixelvalue temp=(a);(a)=(b);(b)=temp; }
 
+/* OPT_MEDn_NETWORK(S, p) is the network of opt_medn() with S(a,b) as the compare and swap,
+ * so the same network can also be run on vectors holding several medians at once */
+
 /*----------------------------------------------------------------------------
  Function :   opt_med3()
  In       :   pointer to array of 3 pixel values
@@ -38,11 +41,15 @@ static inline pixelvalue opt_med3(pixelvalue * p)
  on the nature of the input signal.
  ---------------------------------------------------------------------------*/
 
+#define OPT_MED5_NETWORK(S, p) \
+    S(p[0], p[1]) ; S(p[3], p[4]) ; S(p[0], p[3]) ; \
+    S(p[1], p[4]) ; S(p[1], p[2]) ; S(p[2], p[3]) ; \
+    S(p[1], p[2]) ;
+
 static inline pixelvalue opt_med5(pixelvalue * p)
 {
-    PIX_SORT(p[0],p[1]) ; PIX_SORT(p[3],p[4]) ; PIX_SORT(p[0],p[3]) ;
-    PIX_SORT(p[1],p[4]) ; PIX_SORT(p[1],p[2]) ; PIX_SORT(p[2],p[3]) ;
-    PIX_SORT(p[1],p[2]) ; return(p[2]) ;
+    OPT_MED5_NETWORK(PIX_SORT, p) ;
+    return(p[2]) ;
 }
 
 /*----------------------------------------------------------------------------
@@ -104,15 +111,19 @@ static inline pixelvalue opt_med7(pixelvalue * p)
  in middle position, but other elements are NOT sorted.
  ---------------------------------------------------------------------------*/
 
+#define OPT_MED9_NETWORK(S, p) \
+    S(p[1], p[2]) ; S(p[4], p[5]) ; S(p[7], p[8]) ; \
+    S(p[0], p[1]) ; S(p[3], p[4]) ; S(p[6], p[7]) ; \
+    S(p[1], p[2]) ; S(p[4], p[5]) ; S(p[7], p[8]) ; \
+    S(p[0], p[3]) ; S(p[5], p[8]) ; S(p[4], p[7]) ; \
+    S(p[3], p[6]) ; S(p[1], p[4]) ; S(p[2], p[5]) ; \
+    S(p[4], p[7]) ; S(p[4], p[2]) ; S(p[6], p[4]) ; \
+    S(p[4], p[2]) ;
+
 static inline pixelvalue opt_med9(pixelvalue * p)
 {
-    PIX_SORT(p[1], p[2]) ; PIX_SORT(p[4], p[5]) ; PIX_SORT(p[7], p[8]) ;
-    PIX_SORT(p[0], p[1]) ; PIX_SORT(p[3], p[4]) ; PIX_SORT(p[6], p[7]) ;
-    PIX_SORT(p[1], p[2]) ; PIX_SORT(p[4], p[5]) ; PIX_SORT(p[7], p[8]) ;
-    PIX_SORT(p[0], p[3]) ; PIX_SORT(p[5], p[8]) ; PIX_SORT(p[4], p[7]) ;
-    PIX_SORT(p[3], p[6]) ; PIX_SORT(p[1], p[4]) ; PIX_SORT(p[2], p[5]) ;
-    PIX_SORT(p[4], p[7]) ; PIX_SORT(p[4], p[2]) ; PIX_SORT(p[6], p[4]) ;
-    PIX_SORT(p[4], p[2]) ; return(p[4]) ;
+    OPT_MED9_NETWORK(PIX_SORT, p) ;
+    return(p[4]) ;
 }
 
 
@@ -126,45 +137,45 @@ static inline pixelvalue opt_med9(pixelvalue * p)
  Code taken from Graphic Gems.
  ---------------------------------------------------------------------------*/
 
+#define OPT_MED25_NETWORK(S, p) \
+    S(p[0], p[1]) ; S(p[3], p[4]) ; S(p[2], p[4]) ; \
+    S(p[2], p[3]) ; S(p[6], p[7]) ; S(p[5], p[7]) ; \
+    S(p[5], p[6]) ; S(p[9], p[10]) ; S(p[8], p[10]) ; \
+    S(p[8], p[9]) ; S(p[12], p[13]) ; S(p[11], p[13]) ; \
+    S(p[11], p[12]) ; S(p[15], p[16]) ; S(p[14], p[16]) ; \
+    S(p[14], p[15]) ; S(p[18], p[19]) ; S(p[17], p[19]) ; \
+    S(p[17], p[18]) ; S(p[21], p[22]) ; S(p[20], p[22]) ; \
+    S(p[20], p[21]) ; S(p[23], p[24]) ; S(p[2], p[5]) ; \
+    S(p[3], p[6]) ; S(p[0], p[6]) ; S(p[0], p[3]) ; \
+    S(p[4], p[7]) ; S(p[1], p[7]) ; S(p[1], p[4]) ; \
+    S(p[11], p[14]) ; S(p[8], p[14]) ; S(p[8], p[11]) ; \
+    S(p[12], p[15]) ; S(p[9], p[15]) ; S(p[9], p[12]) ; \
+    S(p[13], p[16]) ; S(p[10], p[16]) ; S(p[10], p[13]) ; \
+    S(p[20], p[23]) ; S(p[17], p[23]) ; S(p[17], p[20]) ; \
+    S(p[21], p[24]) ; S(p[18], p[24]) ; S(p[18], p[21]) ; \
+    S(p[19], p[22]) ; S(p[8], p[17]) ; S(p[9], p[18]) ; \
+    S(p[0], p[18]) ; S(p[0], p[9]) ; S(p[10], p[19]) ; \
+    S(p[1], p[19]) ; S(p[1], p[10]) ; S(p[11], p[20]) ; \
+    S(p[2], p[20]) ; S(p[2], p[11]) ; S(p[12], p[21]) ; \
+    S(p[3], p[21]) ; S(p[3], p[12]) ; S(p[13], p[22]) ; \
+    S(p[4], p[22]) ; S(p[4], p[13]) ; S(p[14], p[23]) ; \
+    S(p[5], p[23]) ; S(p[5], p[14]) ; S(p[15], p[24]) ; \
+    S(p[6], p[24]) ; S(p[6], p[15]) ; S(p[7], p[16]) ; \
+    S(p[7], p[19]) ; S(p[13], p[21]) ; S(p[15], p[23]) ; \
+    S(p[7], p[13]) ; S(p[7], p[15]) ; S(p[1], p[9]) ; \
+    S(p[3], p[11]) ; S(p[5], p[17]) ; S(p[11], p[17]) ; \
+    S(p[9], p[17]) ; S(p[4], p[10]) ; S(p[6], p[12]) ; \
+    S(p[7], p[14]) ; S(p[4], p[6]) ; S(p[4], p[7]) ; \
+    S(p[12], p[14]) ; S(p[10], p[14]) ; S(p[6], p[7]) ; \
+    S(p[10], p[12]) ; S(p[6], p[10]) ; S(p[6], p[17]) ; \
+    S(p[12], p[17]) ; S(p[7], p[17]) ; S(p[7], p[10]) ; \
+    S(p[12], p[18]) ; S(p[7], p[12]) ; S(p[10], p[18]) ; \
+    S(p[12], p[20]) ; S(p[10], p[20]) ; S(p[10], p[12]) ;
+
 static inline pixelvalue opt_med25(pixelvalue * p)
 {
-    
-    
-    PIX_SORT(p[0], p[1]) ;   PIX_SORT(p[3], p[4]) ;   PIX_SORT(p[2], p[4]) ;
-    PIX_SORT(p[2], p[3]) ;   PIX_SORT(p[6], p[7]) ;   PIX_SORT(p[5], p[7]) ;
-    PIX_SORT(p[5], p[6]) ;   PIX_SORT(p[9], p[10]) ;  PIX_SORT(p[8], p[10]) ;
-    PIX_SORT(p[8], p[9]) ;   PIX_SORT(p[12], p[13]) ; PIX_SORT(p[11], p[13]) ;
-    PIX_SORT(p[11], p[12]) ; PIX_SORT(p[15], p[16]) ; PIX_SORT(p[14], p[16]) ;
-    PIX_SORT(p[14], p[15]) ; PIX_SORT(p[18], p[19]) ; PIX_SORT(p[17], p[19]) ;
-    PIX_SORT(p[17], p[18]) ; PIX_SORT(p[21], p[22]) ; PIX_SORT(p[20], p[22]) ;
-    PIX_SORT(p[20], p[21]) ; PIX_SORT(p[23], p[24]) ; PIX_SORT(p[2], p[5]) ;
-    PIX_SORT(p[3], p[6]) ;   PIX_SORT(p[0], p[6]) ;   PIX_SORT(p[0], p[3]) ;
-    PIX_SORT(p[4], p[7]) ;   PIX_SORT(p[1], p[7]) ;   PIX_SORT(p[1], p[4]) ;
-    PIX_SORT(p[11], p[14]) ; PIX_SORT(p[8], p[14]) ;  PIX_SORT(p[8], p[11]) ;
-    PIX_SORT(p[12], p[15]) ; PIX_SORT(p[9], p[15]) ;  PIX_SORT(p[9], p[12]) ;
-    PIX_SORT(p[13], p[16]) ; PIX_SORT(p[10], p[16]) ; PIX_SORT(p[10], p[13]) ;
-    PIX_SORT(p[20], p[23]) ; PIX_SORT(p[17], p[23]) ; PIX_SORT(p[17], p[20]) ;
-    PIX_SORT(p[21], p[24]) ; PIX_SORT(p[18], p[24]) ; PIX_SORT(p[18], p[21]) ;
-    PIX_SORT(p[19], p[22]) ; PIX_SORT(p[8], p[17]) ;  PIX_SORT(p[9], p[18]) ;
-    PIX_SORT(p[0], p[18]) ;  PIX_SORT(p[0], p[9]) ;   PIX_SORT(p[10], p[19]) ;
-    PIX_SORT(p[1], p[19]) ;  PIX_SORT(p[1], p[10]) ;  PIX_SORT(p[11], p[20]) ;
-    PIX_SORT(p[2], p[20]) ;  PIX_SORT(p[2], p[11]) ;  PIX_SORT(p[12], p[21]) ;
-    PIX_SORT(p[3], p[21]) ;  PIX_SORT(p[3], p[12]) ;  PIX_SORT(p[13], p[22]) ;
-    PIX_SORT(p[4], p[22]) ;  PIX_SORT(p[4], p[13]) ;  PIX_SORT(p[14], p[23]) ;
-    PIX_SORT(p[5], p[23]) ;  PIX_SORT(p[5], p[14]) ;  PIX_SORT(p[15], p[24]) ;
-    PIX_SORT(p[6], p[24]) ;  PIX_SORT(p[6], p[15]) ;  PIX_SORT(p[7], p[16]) ;
-    PIX_SORT(p[7], p[19]) ;  PIX_SORT(p[13], p[21]) ; PIX_SORT(p[15], p[23]) ;
-    PIX_SORT(p[7], p[13]) ;  PIX_SORT(p[7], p[15]) ;  PIX_SORT(p[1], p[9]) ;
-    PIX_SORT(p[3], p[11]) ;  PIX_SORT(p[5], p[17]) ;  PIX_SORT(p[11], p[17]) ;
-    PIX_SORT(p[9], p[17]) ;  PIX_SORT(p[4], p[10]) ;  PIX_SORT(p[6], p[12]) ;
-    PIX_SORT(p[7], p[14]) ;  PIX_SORT(p[4], p[6]) ;   PIX_SORT(p[4], p[7]) ;
-    PIX_SORT(p[12], p[14]) ; PIX_SORT(p[10], p[14]) ; PIX_SORT(p[6], p[7]) ;
-    PIX_SORT(p[10], p[12]) ; PIX_SORT(p[6], p[10]) ;  PIX_SORT(p[6], p[17]) ;
-    PIX_SORT(p[12], p[17]) ; PIX_SORT(p[7], p[17]) ;  PIX_SORT(p[7], p[10]) ;
-    PIX_SORT(p[12], p[18]) ; PIX_SORT(p[7], p[12]) ;  PIX_SORT(p[10], p[18]) ;
-    PIX_SORT(p[12], p[20]) ; PIX_SORT(p[10], p[20]) ; PIX_SORT(p[10], p[12]) ;
-    
-    return (p[12]);
+    OPT_MED25_NETWORK(PIX_SORT, p) ;
+    return(p[12]) ;
 }
 
 
@@ -22,11 +22,17 @@
 #include "stdio.h"
 #include "stdlib.h"
 #include "string.h"
+#include "pthread.h"
 #include "wirth.h"
 #include "math.h"
 #include "patternnoise.h"
+#if defined(__linux)
+#include <alloca.h>
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
 
-static int g_debug_flags;
 //#ifndef WIN32
 #define MIN(a,b) \
 ({ __typeof__ ((a)+(b)) _a = (a); \
@@ -45,345 +51,556 @@ _a > _b ? _a : _b; })
 #define COERCE(x,lo,hi) MAX(MIN((x),(hi)),(lo))
 #define COUNT(x)        ((int)(sizeof(x)/sizeof((x)[0])))
 
-/* out = a - b */
-static void subtract(int16_t * a, int16_t * b, int16_t * out, int w, int h)
+/* The four half-res channels are taken from the Bayer image, blurred, and their column offsets
+ * found and applied when they are put back. Every step runs on worker threads, over rows of
+ * tiles, rows of the channels or blocks of their columns, so all four channels go at once.
+ * For the row noise the channels are taken transposed, in tiles, instead of transposing the
+ * whole image and back */
+#define PN_TILE         32   /* channel pixels per side of a transposed tile */
+#define PN_BAND_ROWS    16   /* channel rows blurred at a time */
+#define PN_COLUMN_BLOCK 32   /* channel columns whose offsets are found at a time */
+
+#define NMAX 128
+
+typedef struct pn_job pn_job_t;
+typedef void (*pn_item_func)(pn_job_t * job, int item, int * scratch);
+
+struct pn_job
 {
-    #pragma omp parallel for
-    for (int i = 0; i < w*h; i++)
+    int16_t * raw;
+    int w, h;               /* size of the Bayer image */
+    int white;
+    int debug_flags;
+
+    int transposed;         /* channels hold the image transposed, so their columns are its rows */
+    int cw, ch;             /* channel size */
+    int16_t * channel[4];   /* r, g1, g2, b */
+    int16_t * smooth[4];    /* same after the horizontal blur */
+    int * col_offsets[4];   /* offset of every column, NULL = put the channels back as they are */
+    int mc[4];              /* median of the column offsets */
+
+    pn_item_func func;
+    int items;
+    int next_item;          /* taken with an atomic add */
+};
+
+typedef struct
+{
+    pn_job_t * job;
+    int * scratch;
+} pn_worker_t;
+
+static void * pn_thread(void * arg)
+{
+    pn_worker_t * worker = (pn_worker_t *)arg;
+    pn_job_t * job = worker->job;
+    int item;
+    while ((item = __atomic_fetch_add(&job->next_item, 1, __ATOMIC_RELAXED)) < job->items)
     {
-        out[i] = a[i] - b[i];
+        job->func(job, item, worker->scratch);
     }
+    return NULL;
 }
 
-/* out = (a + b) / 2 */
-static void average(int16_t * a, int16_t * b, int16_t * out, int w, int h)
+static void pn_run(pn_job_t * job, pn_item_func func, int items, pn_worker_t * workers, int threads)
 {
-    #pragma omp parallel for
-    for (int i = 0; i < w*h; i++)
+    job->func = func;
+    job->items = items;
+    job->next_item = 0;
+
+    threads = MIN(threads, items);
+    if (threads < 2)
     {
-        out[i] = ((int)a[i] + (int)b[i]) / 2;
+        pn_thread(&workers[0]);
+        return;
     }
+
+    pthread_t * thread_id = alloca(threads * sizeof(pthread_t));
+    for (int t = 0; t < threads; t++) pthread_create(&thread_id[t], NULL, pn_thread, &workers[t]);
+    for (int t = 0; t < threads; t++) pthread_join(thread_id[t], NULL);
 }
 
-/* w and h are the size of input buffer; the output buffer will have the dimensions swapped */
-static void transpose(int16_t * in, int16_t * out, int w, int h)
+/* extract the four color channels from a Bayer image, assuming [RGGB] order: the channel
+ * at (dx, dy) of the image, or of the transposed image, holds pixel (x, y) at (x/2, y/2) */
+static void pn_extract_item(pn_job_t * job, int item, int * scratch)
 {
-    #pragma omp parallel for collapse(2)
-    for (int y = 0; y < h; y++)
+    (void)scratch;
+    int cw = job->cw;
+    int y0 = item * 2 * PN_TILE;
+    int y1 = MIN(y0 + 2 * PN_TILE, job->transposed ? 2 * cw : 2 * job->ch);
+    int x_end = job->transposed ? 2 * job->ch : 2 * cw;
+
+    if (!job->transposed)
     {
-        for (int x = 0; x < w; x++)
+        for (int y = y0; y < y1; y++)
         {
-            out[y + x*h] = in[x + y*w];
+            const int16_t * row = job->raw + (size_t)y * job->w;
+            int16_t * even = job->channel[2 * (y & 1)] + (size_t)(y / 2) * cw;
+            int16_t * odd  = job->channel[2 * (y & 1) + 1] + (size_t)(y / 2) * cw;
+            for (int x = 0; x < cw; x++)
+            {
+                even[x] = row[2*x];
+                odd[x]  = row[2*x + 1];
+            }
         }
+        return;
     }
+
+    /* image row y is column y/2 of the channels, one tile at a time */
+    for (int x0 = 0; x0 < x_end; x0 += 2 * PN_TILE)
+    {
+        int x1 = MIN(x0 + 2 * PN_TILE, x_end);
+        for (int y = y0; y < y1; y++)
+        {
+            const int16_t * row = job->raw + (size_t)y * job->w;
+            int16_t * even = job->channel[y & 1] + y / 2;
+            int16_t * odd  = job->channel[(y & 1) + 2] + y / 2;
+            for (int x = x0; x < x1; x += 2)
+            {
+                even[(size_t)(x / 2) * cw] = row[x];
+                odd [(size_t)(x / 2) * cw] = row[x + 1];
+            }
+        }
+    }
+}
+
+/* value of channel c at column x when it is put back */
+static inline int16_t pn_fixed(pn_job_t * job, int c, int x, int value)
+{
+    if (!job->col_offsets[c]) return value;
+
+    /* apply the column offset, then remove the median of the offsets, to prevent color cast */
+    /* FIXME: clamping to 32766 causes overflow */
+    value = COERCE(value + job->col_offsets[c][x], -32767, 32767);
+    return COERCE(value - job->mc[c], 0, 32760);
 }
 
-static void horizontal_gradient(int16_t * in, int16_t * out, int w, int h)
+/* set the color channels back into the Bayer image, the reverse of pn_extract_item */
+static void pn_set_item(pn_job_t * job, int item, int * scratch)
 {
-    #pragma omp parallel for
-    for (int i = 2; i < w*h-2; i++)
+    (void)scratch;
+    int cw = job->cw;
+    int y0 = item * 2 * PN_TILE;
+    int y1 = MIN(y0 + 2 * PN_TILE, job->transposed ? 2 * cw : 2 * job->ch);
+    int x_end = job->transposed ? 2 * job->ch : 2 * cw;
+
+    if (!job->transposed)
     {
-        out[i] = in[i-2] - in[i+2];
+        for (int y = y0; y < y1; y++)
+        {
+            int16_t * row = job->raw + (size_t)y * job->w;
+            int ce = 2 * (y & 1);
+            int co = 2 * (y & 1) + 1;
+            const int16_t * even = job->channel[ce] + (size_t)(y / 2) * cw;
+            const int16_t * odd  = job->channel[co] + (size_t)(y / 2) * cw;
+            for (int x = 0; x < cw; x++)
+            {
+                row[2*x]     = pn_fixed(job, ce, x, even[x]);
+                row[2*x + 1] = pn_fixed(job, co, x, odd[x]);
+            }
+        }
+        return;
     }
-    
-    out[0] = out[1] = out[w*h-1] = out[w*h-2] = 0;
+
+    for (int x0 = 0; x0 < x_end; x0 += 2 * PN_TILE)
+    {
+        int x1 = MIN(x0 + 2 * PN_TILE, x_end);
+        for (int y = y0; y < y1; y++)
+        {
+            int16_t * row = job->raw + (size_t)y * job->w;
+            int ce = y & 1;
+            int co = (y & 1) + 2;
+            const int16_t * even = job->channel[ce] + y / 2;
+            const int16_t * odd  = job->channel[co] + y / 2;
+            for (int x = x0; x < x1; x += 2)
+            {
+                row[x]     = pn_fixed(job, ce, y / 2, even[(size_t)(x / 2) * cw]);
+                row[x + 1] = pn_fixed(job, co, y / 2, odd [(size_t)(x / 2) * cw]);
+            }
+        }
+    }
+}
+
+/* sorted values of a range of pixels, kept up to date as the range moves along the row */
+typedef struct
+{
+    int16_t v[NMAX];
+    int n;
+} pn_window_t;
+
+static inline void pn_window_insert(pn_window_t * s, int16_t value)
+{
+    int i = s->n++;
+    while (i > 0 && s->v[i-1] > value)
+    {
+        s->v[i] = s->v[i-1];
+        i--;
+    }
+    s->v[i] = value;
+}
+
+static inline void pn_window_remove(pn_window_t * s, int16_t value)
+{
+    int i = 0;
+    while (s->v[i] != value) i++;
+    s->n--;
+    memmove(&s->v[i], &s->v[i+1], (s->n - i) * sizeof(s->v[0]));
+}
+
+/* same element median_short_wirth() picks */
+static inline int pn_window_median(pn_window_t * s)
+{
+    return s->v[(s->n & 1) ? (s->n / 2) : (s->n / 2 - 1)];
 }
 
-static void horizontal_edge_aware_blur_rggb(
-                                            int16_t * in_r,  int16_t * in_g1,  int16_t * in_g2,  int16_t * in_b,
-                                            int16_t * out_r, int16_t * out_g1, int16_t * out_g2, int16_t * out_b,
-                                            int w, int h, int strength, int thr)
+/* average green, red-green and blue-green of a row, (a + b) / 2 and a - b on int16_t */
+static void pn_row_differences(const int16_t * r, const int16_t * g1, const int16_t * g2, const int16_t * b,
+                               int16_t * avg_g, int16_t * dif_rg, int16_t * dif_bg, int w)
 {
-    #define NMAX 128
-    int16_t g1[NMAX];
-    int16_t g2[NMAX];
-    int16_t rg[NMAX];
-    int16_t bg[NMAX];
-    if (strength > NMAX)
+    int x = 0;
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    for (; x + 8 <= w; x += 8)
     {
-#ifndef STDOUT_SILENT
-        printf("FIXME: blur too strong\n");
+        int16x8_t va = vld1q_s16(g1 + x);
+        int16x8_t vb = vld1q_s16(g2 + x);
+        /* halving add rounds down, C division towards zero: add 1 back to odd negative sums */
+        int16x8_t avg = vhaddq_s16(va, vb);
+        int16x8_t odd_negative = vandq_s16(vandq_s16(veorq_s16(va, vb), vshrq_n_s16(avg, 15)), vdupq_n_s16(1));
+        avg = vaddq_s16(avg, odd_negative);
+        vst1q_s16(avg_g + x, avg);
+        vst1q_s16(dif_rg + x, vsubq_s16(vld1q_s16(r + x), avg));
+        vst1q_s16(dif_bg + x, vsubq_s16(vld1q_s16(b + x), avg));
+    }
 #endif
-        return;
+
+    for (; x < w; x++)
+    {
+        avg_g[x] = ((int)g1[x] + (int)g2[x]) / 2;
+        dif_rg[x] = r[x] - avg_g[x];
+        dif_bg[x] = b[x] - avg_g[x];
     }
-    
+}
+
+/* strong horizontal denoising (1-D median blur on G, R-G and B-G, stop on edge) */
+static void pn_blur_item(pn_job_t * job, int item, int * scratch)
+{
+    int w = job->cw;
+    int strength = 50;
+    int thr = 500;
+
+    int16_t * avg_g  = (int16_t *)scratch;
+    int16_t * dif_rg = avg_g + w;
+    int16_t * dif_bg = dif_rg + w;
+    pn_window_t s_g1, s_g2, s_rg, s_bg;
+
     strength /= 2;
-    
-    /* precompute average green, red-green and blue-green */
-    int16_t * avg_g  = malloc(w * h * sizeof(avg_g[0]));
-    int16_t * dif_rg = malloc(w * h * sizeof(dif_rg[0]));
-    int16_t * dif_bg = malloc(w * h * sizeof(dif_bg[0]));
-    average(in_g1, in_g2, avg_g, w, h);
-    subtract(in_r, avg_g, dif_rg, w, h);
-    subtract(in_b, avg_g, dif_bg, w, h);
 
-    for (int y = 0; y < h; y++)
+    int y1 = MIN((item + 1) * PN_BAND_ROWS, job->ch);
+    for (int y = item * PN_BAND_ROWS; y < y1; y++)
     {
-        int prev_xl = -1;
-        int prev_xr = -1;
+        const int16_t * in_r  = job->channel[0] + (size_t)y * w;
+        const int16_t * in_g1 = job->channel[1] + (size_t)y * w;
+        const int16_t * in_g2 = job->channel[2] + (size_t)y * w;
+        const int16_t * in_b  = job->channel[3] + (size_t)y * w;
+        int16_t * out_r  = job->smooth[0] + (size_t)y * w;
+        int16_t * out_g1 = job->smooth[1] + (size_t)y * w;
+        int16_t * out_g2 = job->smooth[2] + (size_t)y * w;
+        int16_t * out_b  = job->smooth[3] + (size_t)y * w;
+
+        pn_row_differences(in_r, in_g1, in_g2, in_b, avg_g, dif_rg, dif_bg, w);
+
+        /* the windows hold pixels win_l to win_r, none yet */
+        int win_l = 1;
+        int win_r = 0;
+        s_g1.n = s_g2.n = s_rg.n = s_bg.n = 0;
         for (int x = 0; x < w; x++)
         {
-            int p0 = avg_g[x + y*w];
-            int num = 0;
-            
+            int p0 = avg_g[x];
+
             /* range of pixels similar to p0 */
             /* it will contain at least 1 pixel, and at most from 2*strength + 1 pixels */
             int xl = x-1;
             int xr = x+1;
-            
+
             /* go to the right, until crossing the threshold */
             while (xr < MIN(x + strength, w))
             {
-                int p = avg_g[xr + y*w];
-                if (abs(p - p0) > thr)
+                if (abs(avg_g[xr] - p0) > thr)
                     break;
                 xr++;
             }
-            
+
             /* same, to the left */
             while (xl >= MAX(x - strength, 0))
             {
-                int p = avg_g[xl + y*w];
-                if (abs(p - p0) > thr)
+                if (abs(avg_g[xl] - p0) > thr)
                     break;
                 xl--;
             }
-            
-            if(xl == prev_xl && xr == prev_xr)
+
+            if (xl + 1 == win_l && xr - 1 == win_r)
             {
-                //don't recompute the median if we selected the same pixels
-                out_g1[x + y*w] = out_g1[x - 1 + y*w];
-                out_g2[x + y*w] = out_g2[x - 1 + y*w];
-                out_r [x + y*w] = out_r [x - 1 + y*w];
-                out_b [x + y*w] = out_b [x - 1 + y*w];
+                /* same pixels selected as for the previous one */
+                out_g1[x] = out_g1[x - 1];
+                out_g2[x] = out_g2[x - 1];
+                out_r [x] = out_r [x - 1];
+                out_b [x] = out_b [x - 1];
+                continue;
+            }
+
+            int l = xl + 1;
+            int r = xr - 1;
+            int moved = abs(l - win_l) + abs(r - win_r);
+            if (l <= win_r && r >= win_l && moved <= r - l + 1)
+            {
+                /* the range moved a little, update the sorted pixels at its ends only */
+                for (int i = win_l; i < l; i++)
+                {
+                    pn_window_remove(&s_g1, in_g1[i]); pn_window_remove(&s_g2, in_g2[i]);
+                    pn_window_remove(&s_rg, dif_rg[i]); pn_window_remove(&s_bg, dif_bg[i]);
+                }
+                for (int i = r + 1; i <= win_r; i++)
+                {
+                    pn_window_remove(&s_g1, in_g1[i]); pn_window_remove(&s_g2, in_g2[i]);
+                    pn_window_remove(&s_rg, dif_rg[i]); pn_window_remove(&s_bg, dif_bg[i]);
+                }
+                for (int i = l; i < win_l; i++)
+                {
+                    pn_window_insert(&s_g1, in_g1[i]); pn_window_insert(&s_g2, in_g2[i]);
+                    pn_window_insert(&s_rg, dif_rg[i]); pn_window_insert(&s_bg, dif_bg[i]);
+                }
+                for (int i = win_r + 1; i <= r; i++)
+                {
+                    pn_window_insert(&s_g1, in_g1[i]); pn_window_insert(&s_g2, in_g2[i]);
+                    pn_window_insert(&s_rg, dif_rg[i]); pn_window_insert(&s_bg, dif_bg[i]);
+                }
             }
             else
             {
-                num = xr - xl - 1;
-                int size = num * sizeof(int16_t);
-                memcpy(g1, &(in_g1[xl + 1 + y*w]), size);
-                memcpy(g2, &(in_g2[xl + 1 + y*w]), size);
-                memcpy(rg, &(dif_rg[xl + 1 + y*w]), size);
-                memcpy(bg, &(dif_bg[xl + 1 + y*w]), size);
-                
-                int mg1 = median_short_wirth(g1, num);
-                int mg2 = median_short_wirth(g2, num);
-                int mg = (mg1 + mg2) / 2;
-                out_g1[x + y*w] = mg1;
-                out_g2[x + y*w] = mg2;
-                out_r [x + y*w] = median_short_wirth(rg, num) + mg;
-                out_b [x + y*w] = median_short_wirth(bg, num) + mg;
+                s_g1.n = s_g2.n = s_rg.n = s_bg.n = 0;
+                for (int i = l; i <= r; i++)
+                {
+                    pn_window_insert(&s_g1, in_g1[i]); pn_window_insert(&s_g2, in_g2[i]);
+                    pn_window_insert(&s_rg, dif_rg[i]); pn_window_insert(&s_bg, dif_bg[i]);
+                }
             }
-            
-            prev_xl = xl;
-            prev_xr = xr;
+            win_l = l;
+            win_r = r;
+
+            int mg1 = pn_window_median(&s_g1);
+            int mg2 = pn_window_median(&s_g2);
+            int mg = (mg1 + mg2) / 2;
+            out_g1[x] = mg1;
+            out_g2[x] = mg2;
+            out_r [x] = pn_window_median(&s_rg) + mg;
+            out_b [x] = pn_window_median(&s_bg) + mg;
         }
     }
-    
-    free(avg_g);
-    free(dif_rg);
-    free(dif_bg);
 }
 
-/* Find and apply a scalar offset to each column, to reduce pattern noise */
-/* original: input and output */
-/* denoised: input only */
-static void fix_column_noise(int16_t * original, int16_t * denoised, int w, int h, int white)
+/* certain areas will give false readings, mask them out */
+static inline int pn_masked(const int16_t * original, int i, int n, int white)
 {
-    /* let's say the difference between original and denoised is mostly noise */
-    int16_t * noise = malloc(w * h * sizeof(noise[0]));
-    subtract(original, denoised, noise, w, h);
-    
-    /* from this noise, keep the FPN part (constant offset for each line/column) */
-    int* col_offsets = malloc(w * sizeof(col_offsets[0]));
-    int* noise_row = malloc(MAX(w,h) * sizeof(noise_row[0]));
-    int  noise_row_num = 0;
-    
-    /* certain areas will give false readings, mask them out */
-    int16_t * mask  = malloc(w * h * sizeof(mask[0]));
-    int16_t * hgrad = malloc(w * h * sizeof(mask[0]));
-    
-    horizontal_gradient(original, hgrad, w, h);
-
-    #pragma omp parallel for collapse(2)
+    /* horizontal gradient, over the whole buffer as if it was one long row */
+    int16_t hgrad = (i >= 2 && i < n - 2) ? original[i-2] - original[i+2] : 0;
+
+    return
+    (abs(hgrad) > 500) ||      /* mask out pixels on a strong edge, that is clearly not pattern noise */
+    (original[i] >= white);    /* mask out bright pixels (caveat: you really need to set the correct white level for this to work) */
+}
+
+/* Find a scalar offset for each column, to reduce pattern noise */
+/* the difference between original and denoised is mostly noise, and the FPN part of it
+ * is the constant offset of each column, the median of the column */
+static void pn_columns_item(pn_job_t * job, int item, int * scratch)
+{
+    int blocks = (job->cw + PN_COLUMN_BLOCK - 1) / PN_COLUMN_BLOCK;
+    int c = item / blocks;
+    int w = job->cw;
+    int h = job->ch;
+    int n = w * h;
+    int x0 = (item % blocks) * PN_COLUMN_BLOCK;
+    int x1 = MIN(x0 + PN_COLUMN_BLOCK, w);
+    const int16_t * original = job->channel[c];
+    const int16_t * denoised = job->smooth[c];
+    int white = job->white;
+
+    /* noise of every column, row after row, scratch holds h values per column */
+    int noise_row_num[PN_COLUMN_BLOCK] = { 0 };
+
     for (int y = 0; y < h; y++)
     {
-        for (int x = 0; x < w; x++)
+        int x = x0;
+        int i = x + y*w;
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+        /* the gradient reaches 2 pixels into the rows around, first and last rows go below */
+        if (y > 0 && y < h - 1)
         {
-            int pixel = original[x + y*w];
-            int hgradient = abs(hgrad[x + y*w]);
-            
-            mask[x + y*w] =
-            (hgradient > 500) ||   /* mask out pixels on a strong edge, that is clearly not pattern noise */
-            (pixel >= white);      /* mask out bright pixels (caveat: you really need to set the correct white level for this to work) */
+            int16x8_t vwhite = vdupq_n_s16(COERCE(white - 1, -32768, 32767));
+            int16x8_t vthr = vdupq_n_s16(500);
+            int16_t noise[8];
+            uint16_t mask[8];
+            for (; x + 8 <= x1; x += 8, i += 8)
+            {
+                int16x8_t o = vld1q_s16(original + i);
+                int16x8_t hgrad = vsubq_s16(vld1q_s16(original + i - 2), vld1q_s16(original + i + 2));
+                /* saturating abs, as abs(-32768) > 500 */
+                uint16x8_t m = vorrq_u16(vcgtq_s16(vqabsq_s16(hgrad), vthr), vcgtq_s16(o, vwhite));
+                vst1q_s16(noise, vsubq_s16(o, vld1q_s16(denoised + i)));
+                vst1q_u16(mask, m);
+                for (int k = 0; k < 8; k++)
+                {
+                    if (!mask[k])
+                    {
+                        int col = x + k - x0;
+                        scratch[col * h + noise_row_num[col]++] = noise[k];
+                    }
+                }
+            }
         }
-    }
-    
-    if (g_debug_flags & FIXPN_DBG_DENOISED)
-    {
-        /* debug: show denoised image */
-        for (int i = 0; i < w*h; i++)
-            original[i] = denoised[i];
-        goto end;
-    }
-    else if (g_debug_flags & FIXPN_DBG_NOISE)
-    {
-        /* debug: show the noise image */
-        for (int i = 0; i < w*h; i++)
+#endif
+
+        for (; x < x1; x++, i++)
         {
-            if (mask[i]) noise[i] = -100;
-            original[i] = noise[i] + 100;
+            if (!pn_masked(original, i, n, white))
+            {
+                int col = x - x0;
+                scratch[col * h + noise_row_num[col]++] = (int16_t)(original[i] - denoised[i]);
+            }
         }
-        goto end;
     }
-    else if (g_debug_flags & FIXPN_DBG_MASK)
+
+    for (int x = x0; x < x1; x++)
     {
-        /* debug: show the mask */
-        for (int i = 0; i < w*h; i++)
-            original[i] = mask[i] * 1000;
-        goto end;
+        int col = x - x0;
+        job->col_offsets[c][x] = (noise_row_num[col] < 10) ? 0 : -median_int_wirth(scratch + col * h, noise_row_num[col]);
     }
-    
-    /* take the median value for each column, in the noise image */
-    for (int x = 0; x < w; x++)
+}
+
+/* debug: show the denoised image, the noise image or the mask instead of fixing the channel */
+static void pn_debug_channel(pn_job_t * job, int c)
+{
+    int n = job->cw * job->ch;
+    int16_t * original = job->channel[c];
+    int16_t * denoised = job->smooth[c];
+    int16_t * mask = malloc(n * sizeof(mask[0]));
+    if (!mask) return;
+
+    for (int i = 0; i < n; i++)
+        mask[i] = pn_masked(original, i, n, job->white);
+
+    for (int i = 0; i < n; i++)
     {
-        noise_row_num = 0;
-        for (int y = 0; y < h; y++)
+        if (job->debug_flags & FIXPN_DBG_DENOISED)
         {
-            if (mask[x + y*w] == 0)
-            {
-                noise_row[noise_row_num++] = noise[x + y*w];
-            }
+            original[i] = denoised[i];
         }
-        
-        int offset = (noise_row_num < 10) ? 0 : -median_int_wirth(noise_row, noise_row_num);
-        
-        col_offsets[x] = offset;
-    }
-    
-    /* almost done, now apply the offsets */
-    #pragma omp parallel for collapse(2)
-    for (int y = 0; y < h; y++)
-    {
-        for (int x = 0; x < w; x++)
+        else if (job->debug_flags & FIXPN_DBG_NOISE)
         {
-            original[x + y*w] = COERCE((int)original[x + y*w] + col_offsets[x], -32767, 32767);
+            int16_t noise = mask[i] ? -100 : original[i] - denoised[i];
+            original[i] = noise + 100;
+        }
+        else
+        {
+            original[i] = mask[i] * 1000;
         }
     }
-    
-    /* remove median from offsets, to prevent color cast */
-    /* note: median modifies the array, so we do this after applying the offsets to the image */
-    int mc = median_int_wirth(col_offsets, w);
 
-    #pragma omp parallel for
-    for (int i = 0; i < w*h; i++)
-    {
-        /* FIXME: clamping to 32766 causes overflow */
-        original[i] = COERCE((int)original[i] - mc, 0, 32760);
-    }
-    
-end:
-    free(noise);
-    free(col_offsets);
-    free(noise_row);
     free(mask);
-    free(hgrad);
 }
 
-/* extract a color channel from a Bayer image */
-/* w and h are the size of the input buffer; output will be half-res */
-/* dx and dy can be 0 or 1 */
-static void extract_channel(int16_t * in, int16_t * out, int w, int h, int dx, int dy)
+static void fix_column_noise_rggb(pn_job_t * job, pn_worker_t * workers, int threads)
 {
-    #pragma omp parallel for collapse(2)
-    for (int y = dy; y < h; y += 2)
+    int cw = job->cw;
+    int ch = job->ch;
+    int tile_rows = (2 * (job->transposed ? cw : ch) + 2 * PN_TILE - 1) / (2 * PN_TILE);
+
+    /* extract half-res color channels from Bayer data */
+    pn_run(job, pn_extract_item, tile_rows, workers, threads);
+
+    /* strong horizontal denoising (1-D median blur on G, R-G and B-G, stop on edge) */
+    pn_run(job, pn_blur_item, (ch + PN_BAND_ROWS - 1) / PN_BAND_ROWS, workers, threads);
+
+    /* after blurring horizontally, the difference reveals vertical FPN */
+    if (job->debug_flags & (FIXPN_DBG_DENOISED | FIXPN_DBG_NOISE | FIXPN_DBG_MASK))
     {
-        for (int x = dx; x < w; x += 2)
+        for (int c = 0; c < 4; c++)
         {
-            out[(x/2) + (y/2)*(w/2)] = in[x + y*w];
+            pn_debug_channel(job, c);
+            job->col_offsets[c] = NULL;
         }
     }
-}
-
-/* set a color channel into a Bayer image */
-/* w and h are the size of the output buffer (full-size image); input will be half-res */
-/* dx and dy can be 0 or 1 */
-static void set_channel(int16_t * out, int16_t * in, int w, int h, int dx, int dy)
-{
-    #pragma omp parallel for collapse(2)
-    for (int y = dy; y < h; y += 2)
+    else
     {
-        for (int x = dx; x < w; x += 2)
+        pn_run(job, pn_columns_item, 4 * ((cw + PN_COLUMN_BLOCK - 1) / PN_COLUMN_BLOCK), workers, threads);
+
+        /* median of the offsets, on a copy as the median reorders the array */
+        for (int c = 0; c < 4; c++)
         {
-            out[x + y*w] = in[(x/2) + (y/2)*(w/2)];
+            memcpy(workers[0].scratch, job->col_offsets[c], cw * sizeof(int));
+            job->mc[c] = median_int_wirth(workers[0].scratch, cw);
         }
     }
-}
 
-static void fix_column_noise_rggb(int16_t * raw, int w, int h, int white)
-{
-    /* assume Bayer order [RGGB] */
-    int16_t * r        = malloc(w/2 * h/2 * sizeof(r[0]));   /* red channel (bottom left) */
-    int16_t * g1       = malloc(w/2 * h/2 * sizeof(r[0]));   /* top-left green */
-    int16_t * g2       = malloc(w/2 * h/2 * sizeof(r[0]));   /* bottom-right green */
-    int16_t * b        = malloc(w/2 * h/2 * sizeof(r[0]));   /* blue channel (top right) */
-    int16_t * rs       = malloc(w/2 * h/2 * sizeof(r[0]));   /* r  after smoothing */
-    int16_t * g1s      = malloc(w/2 * h/2 * sizeof(r[0]));   /* g1 after smoothing */
-    int16_t * g2s      = malloc(w/2 * h/2 * sizeof(r[0]));   /* g2 after smoothing */
-    int16_t * bs       = malloc(w/2 * h/2 * sizeof(r[0]));   /* b  after smoothing */
-    
-    /* extract half-res color channels from Bayer data */
-    extract_channel(raw, r,  w, h, 0, 0);
-    extract_channel(raw, g1, w, h, 1, 0);
-    extract_channel(raw, g2, w, h, 0, 1);
-    extract_channel(raw, b,  w, h, 1, 1);
-    
-    /* strong horizontal denoising (1-D median blur on G, R-G and B-G, stop on edge */
-    /* (this step takes a lot of time) */
-    horizontal_edge_aware_blur_rggb(r, g1, g2, b, rs, g1s, g2s, bs, w/2, h/2, 50, 500);
-    
-    /* after blurring horizontally, the difference reveals vertical FPN */
-    fix_column_noise(r,  rs,  w/2, h/2, white);
-    fix_column_noise(g1, g1s, w/2, h/2, white);
-    fix_column_noise(g2, g2s, w/2, h/2, white);
-    fix_column_noise(b,  bs,  w/2, h/2, white);
-    
-    /* commit changes */
-    set_channel(raw, r,  w, h, 0, 0);
-    set_channel(raw, g1, w, h, 1, 0);
-    set_channel(raw, g2, w, h, 0, 1);
-    set_channel(raw, b,  w, h, 1, 1);
-    
-    /* cleanup */
-    free(r);
-    free(g1);
-    free(g2);
-    free(b);
-    free(rs);
-    free(g1s);
-    free(g2s);
-    free(bs);
+    /* commit changes, with the column offsets applied */
+    pn_run(job, pn_set_item, tile_rows, workers, threads);
 }
 
-void fix_pattern_noise(int16_t * raw, int w, int h, int white, int debug_flags)
+void fix_pattern_noise(int16_t * raw, int w, int h, int white, int debug_flags, int threads)
 {
-    g_debug_flags = debug_flags;
-    
-    /* fix vertical noise, then transpose and repeat for the horizontal one */
-    /* not very efficient, but at least avoids duplicate code */
-    /* note: when debugging, we process only one direction */
-    if (!g_debug_flags || !(g_debug_flags & FIXPN_DBG_ROWNOISE))
+    /* the channels cover the even part of the image */
+    int cw = w / 2;
+    int ch = h / 2;
+    if (cw < 4 || ch < 4) return;
+
+    pn_job_t job = { .raw = raw, .w = w, .h = h, .white = white, .debug_flags = debug_flags };
+    size_t plane_size = (size_t)cw * ch;
+    int16_t * planes = malloc(8 * plane_size * sizeof(int16_t));
+    int * col_offsets = malloc(4 * MAX(cw, ch) * sizeof(int));
+
+    /* scratch of every thread: the noise of a block of columns, or 3 rows of the blur */
+    threads = MAX(threads, 1);
+    size_t scratch_size = MAX((size_t)PN_COLUMN_BLOCK * MAX(cw, ch), (size_t)2 * MAX(cw, ch));
+    int * scratch = malloc(threads * scratch_size * sizeof(int));
+
+    if (!planes || !col_offsets || !scratch)
+    {
+        free(planes);
+        free(col_offsets);
+        free(scratch);
+        return;
+    }
+
+    pn_worker_t * workers = alloca(threads * sizeof(pn_worker_t));
+    for (int t = 0; t < threads; t++)
     {
-        fix_column_noise_rggb(raw, w, h, white);
+        workers[t].job = &job;
+        workers[t].scratch = scratch + t * scratch_size;
     }
-    
-    if (!g_debug_flags || (g_debug_flags & FIXPN_DBG_ROWNOISE))
+
+    /* fix vertical noise, then process the transposed channels the same way for the horizontal one */
+    /* note: when debugging, we process only one direction */
+    for (int transposed = 0; transposed < 2; transposed++)
     {
-        /* transpose, process just like before, then transpose back */
-        int16_t * raw_t = malloc(w * h * sizeof(raw[0]));
-        transpose(raw, raw_t, w, h);
-        fix_column_noise_rggb(raw_t, h, w, white);
-        transpose(raw_t, raw, h, w);
-        free(raw_t);
+        if (debug_flags && ((debug_flags & FIXPN_DBG_ROWNOISE) ? 1 : 0) != transposed)
+            continue;
+
+        job.transposed = transposed;
+        job.cw = transposed ? ch : cw;
+        job.ch = transposed ? cw : ch;
+        for (int c = 0; c < 4; c++)
+        {
+            job.channel[c] = planes + c * plane_size;
+            job.smooth[c] = planes + (4 + c) * plane_size;
+            job.col_offsets[c] = col_offsets + c * job.cw;
+        }
+
+        fix_column_noise_rggb(&job, workers, threads);
     }
+
+    free(planes);
+    free(col_offsets);
+    free(scratch);
 }
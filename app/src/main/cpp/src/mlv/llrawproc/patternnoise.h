@@ -13,7 +13,7 @@
 
 #include "stdint.h"
 
-void fix_pattern_noise(int16_t * raw, int w, int h, int white, int debug_flags);
+void fix_pattern_noise(int16_t * raw, int w, int h, int white, int debug_flags, int threads);
 
 /* debug flags */
 #define FIXPN_DBG_COLNOISE  0
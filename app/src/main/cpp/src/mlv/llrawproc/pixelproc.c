@@ -25,6 +25,16 @@
 #include <string.h>
 #include <math.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#if defined(__linux)
+#include <alloca.h>
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
 
 #include "../raw.h"
 #include "opt_med.h"
@@ -38,6 +48,65 @@
 #define COERCE(x,lo,hi) MAX(MIN((x),(hi)),(lo))
 #define ABS(a) ((a) > 0 ? (a) : -(a))
 
+/* One row of RG/GB cells (red at x, y and blue at x+1, y+1), indexed by x/2: red and blue minus
+ * the green interpolated horizontally (rh, bh) and vertically (rv, bv), and the vertical minus the
+ * horizontal interpolation error (de), all in EV. The filter area of a cell is made of these */
+typedef struct
+{
+    int * rh;
+    int * bh;
+    int * rv;
+    int * bv;
+    int * de;
+} chroma_cells_t;
+
+#define CHROMA_SMOOTH_VSORT(a,b) { int32x4_t t = vminq_s32((a),(b)); (b) = vmaxq_s32((a),(b)); (a) = t; }
+
+/* Last part of the filter for the cell at x, from the medians of its area and the sum of de over it */
+static inline void chroma_smooth_put(int x, int * ev_m1, int * ev0, int * ev1, int * ev2, uint16_t * out0, uint16_t * out1,
+                                     int drh, int dbh, int drv, int dbv, int de, int * ev2raw, int black, int white)
+{
+    int g1 = ev0[x+1];
+    int g2 = ev1[x];
+    int g3 = ev0[x-1];
+    int g4 = ev_m1[x];
+    int g5 = ev1[x+2];
+    int g6 = ev2[x+1];
+
+    /* which of the two interpolations will we choose? */
+    int grv = (g2+g4)/2;
+    int grh = (g1+g3)/2;
+    int gbv = (g1+g6)/2;
+    int gbh = (g2+g5)/2;
+    int gr = de < 0 ? grv : grh;
+    int gb = de < 0 ? gbv : gbh;
+    int dr = de < 0 ? drv : drh;
+    int db = de < 0 ? dbv : dbh;
+
+    int r0 = out0[x];
+    int b0 = out1[x+1];
+
+    /* if we are close to the noise floor, use both directions */
+    int thr = 64;
+    if (r0 < black+thr || b0 < black+thr || ABS(drv - drh) < thr || ABS(grv-grh) < thr || ABS(gbv-gbh) < thr)
+    {
+        dr = (drv+drh)/2;
+        db = (dbv+dbh)/2;
+        gr = (g1+g2+g3+g4)/4;
+        gb = (g1+g2+g5+g6)/4;
+    }
+
+    /* don't touch overexposed areas */
+    if (r0 < white)
+        out0[x] = ev2raw[COERCE(gr + dr, -10*EV_RESOLUTION, 14*EV_RESOLUTION-1)];
+
+    if (b0 < white)
+        out1[x+1] = ev2raw[COERCE(gb + db, -10*EV_RESOLUTION, 14*EV_RESOLUTION-1)];
+}
+
+/* only the cell versions of the filter, the row versions are dual iso's */
+#define CHROMA_SMOOTH_CELLS
+
 #define CHROMA_SMOOTH_2X2
 #include "chroma_smooth.c"
 #undef CHROMA_SMOOTH_2X2
@@ -101,36 +170,243 @@ void free_luts(int * raw2ev, int * ev2raw)
     }
 }
 
-void chroma_smooth(int method, uint16_t * image_data, int width, int height, int black, int white, int * raw2ev, int * ev2raw)
+/* Chroma smoothing runs in bands of cell rows, each band keeping the EV of only the last 8 source rows
+ * and the cell rows its filter area spans. Bands are written in place, so the source rows a band
+ * reads from its neighbours are copied before any band starts. Bands don't depend on the thread
+ * count, so neither does the result */
+#define CHROMA_BAND_ROWS 128
+
+typedef struct
 {
-    if(raw2ev == NULL) return;
-    
-    uint16_t * buf = (uint16_t *)malloc(width*height*sizeof(uint16_t));
-    if (!buf)
+    int method;
+    int radius;             /* CHROMA_SMOOTH_MAX_XY_IJ of the method */
+    uint16_t * image_data;
+    int w, h;
+    int black, white;
+    int * raw2ev;
+    int * ev2raw;
+
+    int y_start, y_end;     /* cell rows the filter fits on */
+    int band_rows;
+    int bands;
+    uint16_t * borders;     /* source rows border-radius-1 to border+radius+1 of every band border */
+    int next_band;          /* taken with an atomic add */
+} chroma_job_t;
+
+typedef struct
+{
+    chroma_job_t * job;
+    int * window;           /* 8 EV rows and radius+1 cell rows */
+} chroma_worker_t;
+
+static size_t chroma_window_size(int w, int radius)
+{
+    return 8 * (size_t)w + (radius + 1) * 5 * (size_t)(w/2 + 1);
+}
+
+/* source row as it was before smoothing started */
+static const uint16_t * chroma_source_row(chroma_job_t * job, int band, int y0, int y1, int row)
+{
+    int border_rows = 2*job->radius + 3;
+    if (row < y0 && band > 0)
+        return job->borders + ((size_t)(band - 1) * border_rows + row - y0 + job->radius + 1) * job->w;
+    if (row >= y1 && band < job->bands - 1)
+        return job->borders + ((size_t)band * border_rows + row - y1 + job->radius + 1) * job->w;
+    return job->image_data + (size_t)row * job->w;
+}
+
+/* per cell terms of the cell row starting on the EV row ev0 */
+static void chroma_cells_row(int w, const int * ev_m1, const int * ev0, const int * ev1, const int * ev2, chroma_cells_t * cells)
+{
+    int x = 2;
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    /* four cells at once, even and odd columns split by the interleaved loads */
+    for (; x + 9 < w; x += 8)
     {
-        return;
+        int32x4x2_t r0  = vld2q_s32(ev0 + x);       /* R (x, y) and G (x+1, y) */
+        int32x4x2_t r0l = vld2q_s32(ev0 + x - 2);   /* G (x-1, y) */
+        int32x4x2_t r1  = vld2q_s32(ev1 + x);       /* G (x, y+1) and B (x+1, y+1) */
+        int32x4x2_t r1r = vld2q_s32(ev1 + x + 2);   /* G (x+2, y+1) */
+        int32x4x2_t rm1 = vld2q_s32(ev_m1 + x);     /* G (x, y-1) */
+        int32x4x2_t r2  = vld2q_s32(ev2 + x);       /* G (x+1, y+2) */
+
+        int32x4_t g1 = r0.val[1], g2 = r1.val[0], g3 = r0l.val[1];
+        int32x4_t g4 = rm1.val[0], g5 = r1r.val[0], g6 = r2.val[1];
+
+        /* C division by 2 of a sum, rounding towards zero */
+        #define CHROMA_HALF(s) vshrq_n_s32(vaddq_s32((s), vreinterpretq_s32_u32(vshrq_n_u32(vreinterpretq_u32_s32(s), 31))), 1)
+        int cx = x/2;
+        vst1q_s32(cells->rh + cx, vsubq_s32(r0.val[0], CHROMA_HALF(vaddq_s32(g1, g3))));
+        vst1q_s32(cells->bh + cx, vsubq_s32(r1.val[1], CHROMA_HALF(vaddq_s32(g2, g5))));
+        vst1q_s32(cells->rv + cx, vsubq_s32(r0.val[0], CHROMA_HALF(vaddq_s32(g2, g4))));
+        vst1q_s32(cells->bv + cx, vsubq_s32(r1.val[1], CHROMA_HALF(vaddq_s32(g1, g6))));
+        #undef CHROMA_HALF
+        vst1q_s32(cells->de + cx, vsubq_s32(vaddq_s32(vabdq_s32(g2, g4), vabdq_s32(g1, g6)),
+                                            vaddq_s32(vabdq_s32(g1, g3), vabdq_s32(g2, g5))));
     }
-    memcpy(buf, image_data, width*height*sizeof(uint16_t));
-    
+#endif
+
+    for (; x + 2 < w; x += 2)
+    {
+        int g1 = ev0[x+1];
+        int g2 = ev1[x];
+        int g3 = ev0[x-1];
+        int g4 = ev_m1[x];
+        int g5 = ev1[x+2];
+        int g6 = ev2[x+1];
+        int cx = x/2;
+        cells->rh[cx] = ev0[x] - (g1+g3)/2;
+        cells->bh[cx] = ev1[x+1] - (g2+g5)/2;
+        cells->rv[cx] = ev0[x] - (g2+g4)/2;
+        cells->bv[cx] = ev1[x+1] - (g1+g6)/2;
+        cells->de[cx] = ABS(g2-g4) + ABS(g1-g6) - ABS(g1-g3) - ABS(g2-g5);
+    }
+}
+
+static void chroma_smooth_band(chroma_job_t * job, int band, int * window)
+{
+    int w = job->w;
+    int radius = job->radius;
+    int y0 = job->y_start + band * job->band_rows;
+    int y1 = MIN(y0 + job->band_rows, job->y_end);
+
+    int * ev[8];
+    for (int i = 0; i < 8; i++) ev[i] = window + i * w;
+    chroma_cells_t cells[5];
+    for (int i = 0; i <= radius; i++)
+    {
+        int * plane = window + 8 * w + i * 5 * (w/2 + 1);
+        chroma_cells_t c = { plane, plane + (w/2 + 1), plane + 2 * (w/2 + 1), plane + 3 * (w/2 + 1), plane + 4 * (w/2 + 1) };
+        cells[i] = c;
+    }
+
+    /* the cell rows c go radius rows ahead of the cell row y being filtered */
+    int loaded = y0 - radius - 2;
+    for (int c = y0 - radius; c - radius < y1; c += 2)
+    {
+        /* EV of the source rows c-1 to c+2, the rows ev[] still holds go back to y-1 */
+        while (loaded < c + 2)
+        {
+            loaded++;
+            const uint16_t * src = chroma_source_row(job, band, y0, y1, loaded);
+            int * dst = ev[loaded & 7];
+            for (int x = 0; x < w; x++) dst[x] = job->raw2ev[src[x]];
+        }
+        chroma_cells_row(w, ev[(c-1) & 7], ev[c & 7], ev[(c+1) & 7], ev[(c+2) & 7], &cells[(c/2) % (radius + 1)]);
+
+        int y = c - radius;
+        if (y < y0) continue;
+
+        chroma_cells_t area[5];
+        for (int i = 0; i <= radius; i++) area[i] = cells[(y/2 - radius/2 + i) % (radius + 1)];
+
+        uint16_t * out0 = job->image_data + (size_t)y * w;
+        uint16_t * out1 = out0 + w;
+        switch (job->method)
+        {
+            case 2:
+                chroma_smooth_2x2_cells(w, area, ev[(y-1) & 7], ev[y & 7], ev[(y+1) & 7], ev[(y+2) & 7], out0, out1, job->ev2raw, job->black, job->white);
+                break;
+            case 3:
+                chroma_smooth_3x3_cells(w, area, ev[(y-1) & 7], ev[y & 7], ev[(y+1) & 7], ev[(y+2) & 7], out0, out1, job->ev2raw, job->black, job->white);
+                break;
+            case 5:
+                chroma_smooth_5x5_cells(w, area, ev[(y-1) & 7], ev[y & 7], ev[(y+1) & 7], ev[(y+2) & 7], out0, out1, job->ev2raw, job->black, job->white);
+                break;
+        }
+    }
+}
+
+static void * chroma_smooth_thread(void * arg)
+{
+    chroma_worker_t * worker = (chroma_worker_t *)arg;
+    chroma_job_t * job = worker->job;
+    int band;
+    while ((band = __atomic_fetch_add(&job->next_band, 1, __ATOMIC_RELAXED)) < job->bands)
+    {
+        chroma_smooth_band(job, band, worker->window);
+    }
+    return NULL;
+}
+
+void chroma_smooth(int method, uint16_t * image_data, int width, int height, int black, int white, int * raw2ev, int * ev2raw, int threads)
+{
+    if(raw2ev == NULL) return;
+
+    chroma_job_t job = { method, 0, image_data, width, height, black, white, raw2ev, ev2raw, 0, 0, 0, 0, NULL, 0 };
     switch (method) {
         case 2:
-            chroma_smooth_2x2(width, height, buf, image_data, raw2ev, ev2raw, black, white);
-            break;
         case 3:
-            chroma_smooth_3x3(width, height, buf, image_data, raw2ev, ev2raw, black, white);
+            job.radius = 2;
             break;
         case 5:
-            chroma_smooth_5x5(width, height, buf, image_data, raw2ev, ev2raw, black, white);
+            job.radius = 4;
             break;
-            
+
         default:
 #ifndef STDOUT_SILENT
             err_printf("Unsupported chroma smooth method\n");
 #endif
-            break;
+            return;
     }
-    
-    free(buf);
+
+    /* same rows as chroma_smooth_NxN(width, height, 0, height, ...) filters */
+    job.y_start = 2 + job.radius;
+    job.y_end = height - 3 - job.radius;
+    if (job.y_end <= job.y_start || width < 2 * job.radius + 6) return;
+
+    /* one band when there is nothing to run next to it, so no borders to copy */
+    threads = MAX(threads, 1);
+    job.band_rows = (threads > 1) ? CHROMA_BAND_ROWS : job.y_end - job.y_start + 1;
+    job.bands = (job.y_end - job.y_start + job.band_rows - 1) / job.band_rows;
+    threads = MIN(threads, job.bands);
+
+    size_t window_size = chroma_window_size(width, job.radius);
+    int * windows = malloc(threads * window_size * sizeof(int));
+    if (!windows)
+    {
+        return;
+    }
+
+    if (job.bands > 1)
+    {
+        int border_rows = 2 * job.radius + 3;
+        job.borders = malloc((size_t)(job.bands - 1) * border_rows * width * sizeof(uint16_t));
+        if (!job.borders)
+        {
+            free(windows);
+            return;
+        }
+        for (int b = 1; b < job.bands; b++)
+        {
+            int border = job.y_start + b * job.band_rows;
+            memcpy(job.borders + (size_t)(b - 1) * border_rows * width,
+                   image_data + (size_t)(border - job.radius - 1) * width,
+                   border_rows * width * sizeof(uint16_t));
+        }
+    }
+
+    chroma_worker_t * workers = alloca(threads * sizeof(chroma_worker_t));
+    pthread_t * thread_id = alloca(threads * sizeof(pthread_t));
+    for (int t = 0; t < threads; t++)
+    {
+        workers[t].job = &job;
+        workers[t].window = windows + t * window_size;
+    }
+
+    if (threads < 2)
+    {
+        chroma_smooth_thread(&workers[0]);
+    }
+    else
+    {
+        for (int t = 0; t < threads; t++) pthread_create(&thread_id[t], NULL, chroma_smooth_thread, &workers[t]);
+        for (int t = 0; t < threads; t++) pthread_join(thread_id[t], NULL);
+    }
+
+    free(job.borders);
+    free(windows);
 }
 
 /* find color of the raw pixel */
@@ -400,49 +676,457 @@ malloc_error:
     return 0;
 }
 
-static int load_pixel_map(pixel_map * map, uint32_t camera_id, int raw_width, int raw_height)
+/* Pixel maps are kept for the whole process, so clips from the same camera and mode don't
+ * load or generate them again. Maps found as .fpm/.bpm text (or generated) are also written
+ * to the pixel map directory compiled: in list order, which is the order pixels are fixed in,
+ * as runs of pixels on one row with distances as varints.
+ * Both remember the mtime and size of the text map, and are made again when it changes */
+
+#define PIXEL_MAP_FILE_VERSION 3
+
+typedef struct {
+    uint8_t  magic[4];   /* PXMC */
+    uint32_t version;
+    uint32_t type;       /* PIX_FOCUS or PIX_BAD */
+    uint32_t camera_id;
+    int32_t  raw_width;
+    int32_t  raw_height;
+    int32_t  mode;       /* video mode the map was generated for */
+    uint32_t count;      /* pixels */
+    uint32_t data_size;  /* bytes of row data that follow */
+    uint32_t reserved;
+    int64_t  source_mtime; /* .fpm/.bpm it was compiled from, both 0 for generated maps */
+    uint64_t source_size;
+} pixel_map_file_t;
+
+typedef struct cached_pixel_map {
+    int type;
+    uint32_t camera_id;
+    int32_t raw_width;
+    int32_t raw_height;
+    int mode;
+    size_t count;
+    pixel_xy * pixels;
+    int64_t source_mtime;
+    uint64_t source_size;
+    struct cached_pixel_map * next;
+} cached_pixel_map;
+
+static pthread_mutex_t pixel_maps_mutex = PTHREAD_MUTEX_INITIALIZER;
+static cached_pixel_map * pixel_maps_cache = NULL;
+static char * pixel_maps_directory = NULL;
+
+void pixel_maps_set_directory(const char * directory)
 {
-    const char * file_ext = ".fpm";
-#ifndef STDOUT_SILENT
-    const char * map_type = "focus";
-#endif
-    if(map->type)
+    pthread_mutex_lock(&pixel_maps_mutex);
+    free(pixel_maps_directory);
+    pixel_maps_directory = (directory && directory[0]) ? strdup(directory) : NULL;
+    pthread_mutex_unlock(&pixel_maps_mutex);
+}
+
+void pixel_maps_clear_cache(void)
+{
+    pthread_mutex_lock(&pixel_maps_mutex);
+    while (pixel_maps_cache)
     {
-        file_ext = ".bpm";
-#ifndef STDOUT_SILENT
-        map_type = "bad";
-#endif
+        cached_pixel_map * entry = pixel_maps_cache;
+        pixel_maps_cache = entry->next;
+        free(entry->pixels);
+        free(entry);
+    }
+    pthread_mutex_unlock(&pixel_maps_mutex);
+}
+
+/* Text map a map was made from, NULL for generated maps */
+static void pixel_map_source_stamp(const struct stat * source, int64_t * mtime, uint64_t * size)
+{
+    *mtime = source ? (int64_t)source->st_mtim.tv_sec * 1000000000 + source->st_mtim.tv_nsec : 0;
+    *size = source ? (uint64_t)source->st_size : 0;
+}
+
+static uint8_t * put_varint(uint8_t * p, uint32_t value)
+{
+    while (value >= 0x80)
+    {
+        *p++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    *p++ = (uint8_t)value;
+    return p;
+}
+
+static const uint8_t * get_varint(const uint8_t * p, const uint8_t * end, uint32_t * value)
+{
+    *value = 0;
+    for (int shift = 0; p < end && shift < 35; shift += 7)
+    {
+        uint8_t byte = *p++;
+        *value |= (uint32_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return p;
+    }
+    return NULL;
+}
+
+/* distances can go back, zigzag keeps small negative ones short */
+static inline uint32_t zigzag(int value)
+{
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static inline int unzigzag(uint32_t value)
+{
+    return (int)(value >> 1) ^ -(int)(value & 1);
+}
+
+/* row data of a map: row distance, pixels in the run, then column distances */
+static uint8_t * compile_pixel_map(const pixel_xy * pixels, size_t count, uint32_t * data_size)
+{
+    /* varints are 5 bytes at most, every pixel can start a row of its own */
+    uint8_t * data = malloc(count * 15 + 1);
+    if (!data) return NULL;
+
+    uint8_t * p = data;
+    int prev_y = 0;
+    size_t m = 0;
+    while (m < count)
+    {
+        int y = pixels[m].y;
+        size_t n = m;
+        while (n < count && pixels[n].y == y) n++;
+
+        p = put_varint(p, zigzag(y - prev_y));
+        p = put_varint(p, n - m);
+        int prev_x = 0;
+        for (; m < n; m++)
+        {
+            p = put_varint(p, zigzag(pixels[m].x - prev_x));
+            prev_x = pixels[m].x;
+        }
+        prev_y = y;
     }
 
+    *data_size = p - data;
+    return data;
+}
+
+static int decompile_pixel_map(pixel_map * map, const uint8_t * data, uint32_t data_size, uint32_t count)
+{
+    pixel_xy * pixels = malloc(sizeof(pixel_xy) * MAX(count, 1));
+    if (!pixels) return 0;
+
+    const uint8_t * p = data;
+    const uint8_t * end = data + data_size;
+    uint32_t m = 0;
+    int y = 0;
+    while (m < count)
+    {
+        uint32_t dy, n;
+        if (!(p = get_varint(p, end, &dy)) || !(p = get_varint(p, end, &n)) || n > count - m) goto corrupt;
+        y += unzigzag(dy);
+        int x = 0;
+        for (uint32_t k = 0; k < n; k++)
+        {
+            uint32_t dx;
+            if (!(p = get_varint(p, end, &dx))) goto corrupt;
+            x += unzigzag(dx);
+            pixels[m].x = x;
+            pixels[m].y = y;
+            m++;
+        }
+    }
+
+    free(map->pixels);
+    map->pixels = pixels;
+    map->count = count;
+    map->capacity = MAX(count, 1);
+    return 1;
+
+corrupt:
+    free(pixels);
+    return 0;
+}
+
+/* .fpm/.bpm text: optional "#FPM <camera id>" header, then one "x y" pair per line */
+static int parse_pixel_map(pixel_map * map, char * text, uint32_t camera_id)
+{
+    char * p = text;
+
+    if (!strncmp(p, "#FPM", 4))
+    {
+        /* if .fpm has header compare cameraID from this header to cameraID from MLV, if different then return 0 */
+        uint32_t cam_id = strtoul(p + 4, NULL, 16);
+        if (cam_id != 0 && cam_id != camera_id) return 0;
+        p += strcspn(p, "\n");
+    }
+
+    while (*p)
+    {
+        char * e;
+        long x = strtol(p, &e, 10);
+        if (e != p)
+        {
+            p = e + strspn(e, " \t");
+            long y = strtol(p, &e, 10);
+            if (e != p && !add_pixel_to_map(map, x, y)) return 0; //malloc error
+        }
+        p += strcspn(p, "\n");
+        if (*p) p++;
+    }
+
+    return 1;
+}
+
+/* whole file in to memory, NUL terminated for the text parser */
+static char * read_pixel_map_fd(int fd, size_t * size)
+{
+    size_t capacity = 65536;
+    char * buf = malloc(capacity + 1);
+    *size = 0;
+    while (buf)
+    {
+        ssize_t got = pread(fd, buf + *size, capacity - *size, *size);
+        if (got < 0) break;
+        if (got == 0)
+        {
+            buf[*size] = 0;
+            return buf;
+        }
+        *size += got;
+        if (*size == capacity)
+        {
+            capacity *= 2;
+            char * grown = realloc(buf, capacity + 1);
+            if (!grown) break;
+            buf = grown;
+        }
+    }
+    free(buf);
+    return NULL;
+}
+
+static char * read_pixel_map_file(const char * file_name, size_t * size)
+{
+    int fd = open(file_name, O_RDONLY);
+    if (fd < 0) return NULL;
+    char * buf = read_pixel_map_fd(fd, size);
+    close(fd);
+    return buf;
+}
+
+/* compiled map buf was made from the text map source as it is now */
+static int compiled_pixel_map_matches(const char * buf, size_t size, const struct stat * source)
+{
+    pixel_map_file_t header;
+    if (size < sizeof(header) || memcmp(buf, "PXMC", 4)) return 0;
+    memcpy(&header, buf, sizeof(header));
+
+    int64_t source_mtime;
+    uint64_t source_size;
+    pixel_map_source_stamp(source, &source_mtime, &source_size);
+    return header.source_mtime == source_mtime && header.source_size == source_size;
+}
+
+/* compiled map or text, whatever the file turns out to be */
+static int load_pixel_map_data(pixel_map * map, char * buf, size_t size, uint32_t camera_id, int raw_width, int raw_height)
+{
+    pixel_map_file_t header;
+    if (size >= sizeof(header) && !memcmp(buf, "PXMC", 4))
+    {
+        memcpy(&header, buf, sizeof(header));
+        if (header.version != PIXEL_MAP_FILE_VERSION || header.type != (uint32_t)map->type ||
+            header.camera_id != camera_id || header.raw_width != raw_width || header.raw_height != raw_height ||
+            header.data_size > size - sizeof(header)) return 0;
+        return decompile_pixel_map(map, (uint8_t *)buf + sizeof(header), header.data_size, header.count);
+    }
+
+    map->count = 0;
+    return parse_pixel_map(map, buf, camera_id) && map->count;
+}
+
+static void pixel_map_path(char * path, size_t size, const char * directory, uint32_t camera_id, int raw_width, int raw_height, const char * suffix)
+{
+    if (directory)
+        snprintf(path, size, "%s/%x_%ix%i%s", directory, camera_id, raw_width, raw_height, suffix);
+    else
+        snprintf(path, size, "%x_%ix%i%s", camera_id, raw_width, raw_height, suffix);
+}
+
+/* writes the compiled map next to the text ones, only when a directory was given */
+static void save_compiled_pixel_map(const pixel_map * map, uint32_t camera_id, int raw_width, int raw_height, int mode, const struct stat * source)
+{
     char file_name[1024];
-    sprintf(file_name, "%x_%ix%i%s", camera_id, raw_width, raw_height, file_ext);
-    FILE* f = fopen(file_name, "r");
-    if(!f) return 0;
-    
-    uint32_t cam_id = 0x0;
-    if(fscanf(f, "#FPM%*[ ]%X%*[^\n]", &cam_id) != 1)
+    char mode_suffix[32];
+
+    pthread_mutex_lock(&pixel_maps_mutex);
+    if (!pixel_maps_directory)
     {
-        rewind(f);
+        pthread_mutex_unlock(&pixel_maps_mutex);
+        return;
     }
+    snprintf(mode_suffix, sizeof(mode_suffix), "_%d%s", mode, map->type ? ".bpmc" : ".fpmc");
+    pixel_map_path(file_name, sizeof(file_name), pixel_maps_directory, camera_id, raw_width, raw_height, mode_suffix);
+    pthread_mutex_unlock(&pixel_maps_mutex);
 
-    /* if .fpm has header compare cameraID from this header to cameraID from MLV, if different then return 0 */
-    if(cam_id != 0 && cam_id != camera_id) return 0;
+    pixel_map_file_t header = { "PXMC", PIXEL_MAP_FILE_VERSION, map->type, camera_id, raw_width, raw_height, mode, map->count, 0, 0, 0, 0 };
+    pixel_map_source_stamp(source, &header.source_mtime, &header.source_size);
+    uint8_t * data = compile_pixel_map(map->pixels, map->count, &header.data_size);
+    if (!data) return;
 
-    int x, y;
-    while (fscanf(f, "%d%*[ \t]%d%*[^\n]", &x, &y) != EOF)
+    FILE * f = fopen(file_name, "wb");
+    if (f)
     {
-        if(!add_pixel_to_map(map, x, y))
+        if (fwrite(&header, sizeof(header), 1, f) != 1 || fwrite(data, header.data_size, 1, f) != 1)
         {
             fclose(f);
-            return 0; //malloc error
+            remove(file_name);
+        }
+        else
+        {
+            fclose(f);
+        }
+    }
+    free(data);
+}
+
+/* keeps a copy of the map for the process, replacing one that was kept before */
+static void cache_pixel_map(pixel_map * map, uint32_t camera_id, int raw_width, int raw_height, int mode, const struct stat * source)
+{
+    if (!map->count) return;
+
+    pixel_xy * pixels = malloc(sizeof(pixel_xy) * map->count);
+    if (!pixels) return;
+    memcpy(pixels, map->pixels, sizeof(pixel_xy) * map->count);
+
+    pthread_mutex_lock(&pixel_maps_mutex);
+    cached_pixel_map * entry = pixel_maps_cache;
+    while (entry && !(entry->type == map->type && entry->camera_id == camera_id && entry->raw_width == raw_width &&
+                      entry->raw_height == raw_height && entry->mode == mode)) entry = entry->next;
+    if (!entry)
+    {
+        entry = calloc(1, sizeof(cached_pixel_map));
+        if (!entry)
+        {
+            pthread_mutex_unlock(&pixel_maps_mutex);
+            free(pixels);
+            return;
+        }
+        entry->type = map->type;
+        entry->camera_id = camera_id;
+        entry->raw_width = raw_width;
+        entry->raw_height = raw_height;
+        entry->mode = mode;
+        entry->next = pixel_maps_cache;
+        pixel_maps_cache = entry;
+    }
+    free(entry->pixels);
+    entry->pixels = pixels;
+    entry->count = map->count;
+    pixel_map_source_stamp(source, &entry->source_mtime, &entry->source_size);
+    pthread_mutex_unlock(&pixel_maps_mutex);
+}
+
+/* source: text map in the pixel map directory, a kept map made from something else is not used then */
+static int get_cached_pixel_map(pixel_map * map, uint32_t camera_id, int raw_width, int raw_height, int mode, const struct stat * source)
+{
+    int found = 0;
+    int64_t source_mtime;
+    uint64_t source_size;
+    pixel_map_source_stamp(source, &source_mtime, &source_size);
+
+    pthread_mutex_lock(&pixel_maps_mutex);
+    for (cached_pixel_map * entry = pixel_maps_cache; entry; entry = entry->next)
+    {
+        if (entry->type == map->type && entry->camera_id == camera_id && entry->raw_width == raw_width &&
+            entry->raw_height == raw_height && entry->mode == mode)
+        {
+            if (source && (entry->source_mtime != source_mtime || entry->source_size != source_size)) break;
+            pixel_xy * pixels = malloc(sizeof(pixel_xy) * entry->count);
+            if (pixels)
+            {
+                memcpy(pixels, entry->pixels, sizeof(pixel_xy) * entry->count);
+                free(map->pixels);
+                map->pixels = pixels;
+                map->count = entry->count;
+                map->capacity = entry->count;
+                found = 1;
+            }
+            break;
         }
     }
+    pthread_mutex_unlock(&pixel_maps_mutex);
+
+    return found;
+}
+
+/* map_fd: caller opened .fpm/.bpm (text or compiled), -1 = look in the pixel map directory */
+static int load_pixel_map(pixel_map * map, uint32_t camera_id, int raw_width, int raw_height, int mode, int map_fd)
+{
+#ifndef STDOUT_SILENT
+    const char * map_type = map->type ? "bad" : "focus";
+#endif
+    size_t size = 0;
+    char * buf = NULL;
+
+    if (map_fd >= 0)
+    {
+        /* a map the user picked always wins over the one kept */
+        buf = read_pixel_map_fd(map_fd, &size);
+        int loaded = buf && load_pixel_map_data(map, buf, size, camera_id, raw_width, raw_height);
+        free(buf);
+        if (!loaded) return 0;
+        struct stat picked;
+        const struct stat * source = (fstat(map_fd, &picked) == 0) ? &picked : NULL;
+        cache_pixel_map(map, camera_id, raw_width, raw_height, mode, source);
+        save_compiled_pixel_map(map, camera_id, raw_width, raw_height, mode, source);
+#ifndef STDOUT_SILENT
+        printf("\nUsing %s pixel map from fd %d\n"FMT_SIZE" pixels loaded\n", map_type, map_fd, map->count);
+#endif
+        return 1;
+    }
 
+    char compiled_name[1024];
+    char file_name[1024];
+    char mode_suffix[32];
+    snprintf(mode_suffix, sizeof(mode_suffix), "_%d%s", mode, map->type ? ".bpmc" : ".fpmc");
+    pthread_mutex_lock(&pixel_maps_mutex);
+    pixel_map_path(compiled_name, sizeof(compiled_name), pixel_maps_directory, camera_id, raw_width, raw_height, mode_suffix);
+    pixel_map_path(file_name, sizeof(file_name), pixel_maps_directory, camera_id, raw_width, raw_height, map->type ? ".bpm" : ".fpm");
+    pthread_mutex_unlock(&pixel_maps_mutex);
+
+    /* when there is a text map, kept and compiled maps are only good if they were made from it as it is now */
+    struct stat text;
+    const struct stat * source = (stat(file_name, &text) == 0) ? &text : NULL;
+
+    if (get_cached_pixel_map(map, camera_id, raw_width, raw_height, mode, source))
+    {
 #ifndef STDOUT_SILENT
-    printf("\nUsing %s pixel map: '%s'\n"FMT_SIZE" pixels loaded\n", map_type, file_name, map->count);
+        printf("\nUsing kept %s pixel map, "FMT_SIZE" pixels\n", map_type, map->count);
 #endif
+        return 1;
+    }
 
-    fclose(f);
+    /* compiled one first, the text one is only parsed when there is none or it is out of date */
+    int compiled = 1;
+    int loaded = 0;
+    buf = read_pixel_map_file(compiled_name, &size);
+    if (buf && (!source || compiled_pixel_map_matches(buf, size, source)))
+        loaded = load_pixel_map_data(map, buf, size, camera_id, raw_width, raw_height);
+    free(buf);
+    if (!loaded && source)
+    {
+        compiled = 0;
+        buf = read_pixel_map_file(file_name, &size);
+        loaded = buf && load_pixel_map_data(map, buf, size, camera_id, raw_width, raw_height);
+        free(buf);
+    }
+    if (!loaded) return 0;
+
+    cache_pixel_map(map, camera_id, raw_width, raw_height, mode, source);
+    if (!compiled) save_compiled_pixel_map(map, camera_id, raw_width, raw_height, mode, source);
+
+#ifndef STDOUT_SILENT
+    printf("\nUsing %s pixel map: '%s'\n"FMT_SIZE" pixels loaded\n", map_type, compiled ? compiled_name : file_name, map->count);
+#endif
     return 1;
 }
 
@@ -1068,6 +1752,218 @@ static int fpm_get_video_mode(int32_t raw_width, int32_t raw_height, int crop_re
     }
 }
 
+/* Map pixels are fixed one after the other, each one reading the ones fixed before it:
+ * interpolate_pixel reads 4 rows away and edge pixels wrap in to the next row. Large maps are
+ * cut in bands of at least PIXEL_BAND_ROWS rows, with the cuts set by the map alone. Pixels
+ * more than PIXEL_REACH_ROWS away from a cut only reach pixels of their own band, so the band
+ * interiors are fixed side by side first. The seams, the pixels within PIXEL_REACH_ROWS of a
+ * cut, come after that, side by side too as the bands keep them apart. Pixels keep their list
+ * order within an interior or a seam, the result is the same for any thread count */
+#define PIXEL_REACH_ROWS 5
+#define PIXEL_BAND_ROWS (PIXEL_REACH_ROWS * 4)
+#define PIXEL_BANDS 16
+
+typedef struct
+{
+    const pixel_map * map;
+    uint16_t * image_data;
+    int w, h;
+    int cropX, cropY;
+    int average_method;
+    int dual_iso;
+    int * raw2ev;
+    int * ev2raw;
+
+    size_t * order;       /* map entries group after group, in list order within a group */
+    size_t * group_start; /* first entry of every group in order, groups + 1 entries */
+    int groups;           /* band interiors, then the seams between them */
+    int end_group;        /* groups of the running pass are next_group to end_group */
+    int next_group;       /* taken with an atomic add */
+} pixel_fix_job_t;
+
+/* frame row a map pixel works on, -1 for pixels outside the frame, those are left alone */
+static inline int fix_pixel_row(pixel_fix_job_t * job, const pixel_xy * pixel)
+{
+    int i = (pixel->x - job->cropX) + (pixel->y - job->cropY) * job->w;
+    return (i > 0 && i < job->w * job->h) ? i / job->w : -1;
+}
+
+static inline void fix_pixel(pixel_fix_job_t * job, int x, int y)
+{
+    uint16_t * image_data = job->image_data;
+    int * raw2ev = job->raw2ev;
+    int * ev2raw = job->ev2raw;
+    int w = job->w;
+    int h = job->h;
+    int dual_iso = job->dual_iso;
+
+    int i = x + y*w;
+    if (x > 2 && x < w - 3 && y > 2 && y < h - 3)
+    {
+        if(dual_iso)
+        {
+            interpolate_horizontal(image_data, i, raw2ev, ev2raw);
+        }
+        else if(job->average_method == 1) // 1 = raw2dng
+        {
+            interpolate_pixel(image_data, x, y, w, h);
+        }
+        else if(job->average_method == 2) // 2 = method from @rewind
+        {
+            interpolate_rewind(image_data, x, y, w, h);
+        }
+        else // 0 = mlvfs
+        {
+            interpolate_around(image_data, i, w, raw2ev, ev2raw);
+        }
+    }
+    else if(i > 0 && i < w * h)
+    {
+        // handle edge pixels
+        int horizontal_edge = (x >= w - 3 && x < w) || (x >= 0 && x <= 3);
+        int vertical_edge = (y >= h - 3 && y < h) || (y >= 0 && y <= 3);
+
+        if (horizontal_edge && !vertical_edge && !dual_iso)
+        {
+            interpolate_vertical(image_data, i, w, raw2ev, ev2raw);
+        }
+        else if (vertical_edge && !horizontal_edge)
+        {
+            interpolate_horizontal(image_data, i, raw2ev, ev2raw);
+        }
+        else if(x >= 0 && x <= 3)
+        {
+            image_data[i] = image_data[i + 2];
+        }
+        else if(x >= w - 3 && x < w)
+        {
+            image_data[i] = image_data[i - 2];
+        }
+    }
+}
+
+static void fix_pixel_group(pixel_fix_job_t * job, int group)
+{
+    const pixel_xy * pixels = job->map->pixels;
+    for (size_t k = job->group_start[group]; k < job->group_start[group + 1]; k++)
+    {
+        size_t m = job->order[k];
+        fix_pixel(job, pixels[m].x - job->cropX, pixels[m].y - job->cropY);
+    }
+}
+
+static void * fix_pixel_groups_thread(void * arg)
+{
+    pixel_fix_job_t * job = (pixel_fix_job_t *)arg;
+    int group;
+    while ((group = __atomic_fetch_add(&job->next_group, 1, __ATOMIC_RELAXED)) < job->end_group)
+    {
+        fix_pixel_group(job, group);
+    }
+    return NULL;
+}
+
+/* groups first to end side by side, on the calling thread alone when there is one */
+static void fix_pixel_groups(pixel_fix_job_t * job, int first, int end, int threads)
+{
+    job->next_group = first;
+    job->end_group = end;
+    threads = MIN(threads, end - first);
+    if (threads <= 1)
+    {
+        fix_pixel_groups_thread(job);
+        return;
+    }
+
+    pthread_t * thread_id = alloca(threads * sizeof(pthread_t));
+    for (int t = 0; t < threads; t++) pthread_create(&thread_id[t], NULL, fix_pixel_groups_thread, job);
+    for (int t = 0; t < threads; t++) pthread_join(thread_id[t], NULL);
+}
+
+static void fix_pixel_map(const pixel_map * map, uint16_t * image_data, int w, int h, int cropX, int cropY, int average_method, int dual_iso, int * raw2ev, int * ev2raw, int threads)
+{
+    pixel_fix_job_t job = { map, image_data, w, h, cropX, cropY, average_method, dual_iso, raw2ev, ev2raw, NULL, NULL, 1, 0, 0 };
+
+    /* only worth bands for maps with a lot of pixels, whatever the thread count, so the order
+     * pixels are fixed in does not depend on it */
+    int * row_group = (map->count >= 4096 && h >= PIXEL_BAND_ROWS * 2) ? malloc(h * sizeof(int)) : NULL;
+    int bands = 1;
+    if (row_group)
+    {
+        /* map pixels on every row first, then the band of every row */
+        memset(row_group, 0, h * sizeof(int));
+        for (size_t m = 0; m < map->count; m++)
+        {
+            int row = fix_pixel_row(&job, &map->pixels[m]);
+            if (row >= 0) row_group[row]++;
+        }
+
+        size_t band_target = map->count / PIXEL_BANDS + 1;
+        size_t band_pixels = 0;
+        int band_top = 0;
+        for (int y = 0; y < h; y++)
+        {
+            if (band_pixels >= band_target && y - band_top >= PIXEL_BAND_ROWS && h - y >= PIXEL_BAND_ROWS)
+            {
+                bands++;
+                band_pixels = 0;
+                band_top = y;
+            }
+            band_pixels += row_group[y];
+            row_group[y] = bands - 1;
+        }
+
+        /* rows within reach of the cut above band b go to seam bands + b - 1 */
+        for (int y = 1; y < h; y++)
+        {
+            if (row_group[y] == row_group[y - 1] || row_group[y - 1] >= bands) continue;
+            int seam = bands + row_group[y] - 1;
+            for (int s = MAX(y - PIXEL_REACH_ROWS, 0); s < MIN(y + PIXEL_REACH_ROWS, h); s++) row_group[s] = seam;
+        }
+        job.groups = bands * 2 - 1;
+    }
+
+    if (job.groups > 1)
+    {
+        job.group_start = calloc(job.groups + 1, sizeof(size_t));
+        job.order = malloc(map->count * sizeof(size_t));
+    }
+    if (!job.order || !job.group_start)
+    {
+        /* one pixel after the other as listed */
+        for (size_t m = 0; m < map->count; m++)
+        {
+            fix_pixel(&job, map->pixels[m].x - cropX, map->pixels[m].y - cropY);
+        }
+        free(job.order);
+        free(job.group_start);
+        free(row_group);
+        return;
+    }
+
+    /* entries sorted by group, keeping their order */
+    for (size_t m = 0; m < map->count; m++)
+    {
+        int row = fix_pixel_row(&job, &map->pixels[m]);
+        if (row >= 0) job.group_start[row_group[row] + 1]++;
+    }
+    for (int g = 0; g < job.groups; g++) job.group_start[g + 1] += job.group_start[g];
+    size_t * fill = alloca(job.groups * sizeof(size_t));
+    memcpy(fill, job.group_start, job.groups * sizeof(size_t));
+    for (size_t m = 0; m < map->count; m++)
+    {
+        int row = fix_pixel_row(&job, &map->pixels[m]);
+        if (row >= 0) job.order[fill[row_group[row]]++] = m;
+    }
+    free(row_group);
+
+    fix_pixel_groups(&job, 0, bands, threads);
+    fix_pixel_groups(&job, bands, job.groups, threads);
+
+    free(job.order);
+    free(job.group_start);
+}
+
 void fix_focus_pixels(pixel_map * focus_pixel_map,
                       int * fpm_status,
                       uint16_t * image_data,
@@ -1082,8 +1978,10 @@ void fix_focus_pixels(pixel_map * focus_pixel_map,
                       int unified_mode,
                       int average_method,
                       int dual_iso,
+                      int map_fd,
                       int * raw2ev,
-                      int * ev2raw)
+                      int * ev2raw,
+                      int threads)
 {
     int w = width;
     int h = height;
@@ -1104,7 +2002,8 @@ fpm_check:
     {
         case 0: // load fpm
         {
-            if(load_pixel_map(focus_pixel_map, camera_id, raw_width, raw_height))
+            int video_mode = fpm_get_video_mode(raw_width, raw_height, crop_rec, unified_mode);
+            if(load_pixel_map(focus_pixel_map, camera_id, raw_width, raw_height, video_mode, map_fd))
             {
                 *fpm_status = 2;
             }
@@ -1205,6 +2104,9 @@ fpm_check:
 #ifndef STDOUT_SILENT
                 printf(""FMT_SIZE" pixels generated\n", focus_pixel_map->count);
 #endif
+                /* next clip from this camera in this mode takes it from the cache */
+                cache_pixel_map(focus_pixel_map, camera_id, raw_width, raw_height, video_mode, NULL);
+                save_compiled_pixel_map(focus_pixel_map, camera_id, raw_width, raw_height, video_mode, NULL);
                 *fpm_status = (focus_pixel_map->count) ? 2 : 3;
             }
             goto fpm_check;
@@ -1229,56 +2131,7 @@ fpm_check:
                 printf("Using fpi method: 'MLVFS'\n");
             }
 #endif
-            #pragma omp parallel for
-            for (size_t m = 0; m < focus_pixel_map->count; m++)
-            {
-                int x = focus_pixel_map->pixels[m].x - cropX;
-                int y = focus_pixel_map->pixels[m].y - cropY;
-
-                int i = x + y*w;
-                if (x > 2 && x < w - 3 && y > 2 && y < h - 3)
-                {
-                    if(dual_iso)
-                    {
-                        interpolate_horizontal(image_data, i, raw2ev, ev2raw);
-                    }
-                    else if(average_method == 1) // 1 = raw2dng
-                    {
-                        interpolate_pixel(image_data, x, y, w, h);
-                    }
-                    else if(average_method == 2) // 2 = method from @rewind
-                    {
-                        interpolate_rewind(image_data, x, y, w, h);
-                    }
-                    else // 0 = mlvfs
-                    {
-                        interpolate_around(image_data, i, w, raw2ev, ev2raw);
-                    }
-                }
-                else if(i > 0 && i < w * h)
-                {
-                    // handle edge pixels
-                    int horizontal_edge = (x >= w - 3 && x < w) || (x >= 0 && x <= 3);
-                    int vertical_edge = (y >= h - 3 && y < h) || (y >= 0 && y <= 3);
-                    
-                    if (horizontal_edge && !vertical_edge && !dual_iso)
-                    {
-                        interpolate_vertical(image_data, i, w, raw2ev, ev2raw);
-                    }
-                    else if (vertical_edge && !horizontal_edge)
-                    {
-                        interpolate_horizontal(image_data, i, raw2ev, ev2raw);
-                    }
-                    else if(x >= 0 && x <= 3)
-                    {
-                        image_data[i] = image_data[i + 2];
-                    }
-                    else if(x >= w - 3 && x < w)
-                    {
-                        image_data[i] = image_data[i - 2];
-                    }
-                }
-            }
+            fix_pixel_map(focus_pixel_map, image_data, w, h, cropX, cropY, average_method, dual_iso, raw2ev, ev2raw, threads);
             break;
         }
         default:
@@ -1301,9 +2154,10 @@ void fix_bad_pixels(pixel_map * bad_pixel_map,
                     int search_method,
                     int average_method,
                     int dual_iso,
+                    int map_fd,
                     int * raw2ev,
-                    int * ev2raw)
-
+                    int * ev2raw,
+                    int threads)
 {
     int w = width;
     int h = height;
@@ -1336,7 +2190,7 @@ bpm_check:
                 case 3: // Map mode
                 {
                     // load .bpm
-                    load_pixel_map(bad_pixel_map, camera_id, raw_width, raw_height);
+                    load_pixel_map(bad_pixel_map, camera_id, raw_width, raw_height, 0, map_fd);
                     *bpm_status = 2; // interpolate no matter map is loaded or not
                     break;
                 }
@@ -1455,56 +2309,7 @@ mem_err:
                 printf("Using bpi method: 'MLVFS'\n");
             }
 #endif
-            #pragma omp parallel for
-            for (size_t m = 0; m < bad_pixel_map->count; m++)
-            {
-                int x = bad_pixel_map->pixels[m].x - cropX;
-                int y = bad_pixel_map->pixels[m].y - cropY;
-
-                int i = x + y*w;
-                if (x > 2 && x < w - 3 && y > 2 && y < h - 3)
-                {
-                    if(dual_iso)
-                    {
-                        interpolate_horizontal(image_data, i, raw2ev, ev2raw);
-                    }
-                    else if(average_method == 1)
-                    {
-                        interpolate_pixel(image_data, x, y, w, h);
-                    }
-                    else if(average_method == 2)
-                    {
-                        interpolate_rewind(image_data, x, y, w, h);
-                    }
-                    else
-                    {
-                        interpolate_around(image_data, i, w, raw2ev, ev2raw);
-                    }
-                }
-                else if(i > 0 && i < w * h)
-                {
-                    // handle edge pixels
-                    int horizontal_edge = (x >= w - 3 && x < w) || (x >= 0 && x <= 3);
-                    int vertical_edge = (y >= h - 3 && y < h) || (y >= 0 && y <= 3);
-
-                    if (horizontal_edge && !vertical_edge && !dual_iso)
-                    {
-                        interpolate_vertical(image_data, i, w, raw2ev, ev2raw);
-                    }
-                    else if (vertical_edge && !horizontal_edge)
-                    {
-                        interpolate_horizontal(image_data, i, raw2ev, ev2raw);
-                    }
-                    else if(x >= 0 && x <= 3)
-                    {
-                        image_data[i] = image_data[i + 2];
-                    }
-                    else if(x >= w - 3 && x < w)
-                    {
-                        image_data[i] = image_data[i - 2];
-                    }
-                }
-            }
+            fix_pixel_map(bad_pixel_map, image_data, w, h, cropX, cropY, average_method, dual_iso, raw2ev, ev2raw, threads);
 
             if(bpm_mode == 2)
             {
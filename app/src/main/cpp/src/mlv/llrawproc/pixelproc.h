@@ -45,7 +45,7 @@ int * get_ev2raw(int black);
 void free_luts(int * raw2ev, int * ev2raw);
 
 /* do chroma smoothing with methods: 2x2, 3x3 and 5x5 */
-void chroma_smooth(int method, uint16_t * image_data, int width, int height, int black, int white, int * raw2ev, int * ev2raw);
+void chroma_smooth(int method, uint16_t * image_data, int width, int height, int black, int white, int * raw2ev, int * ev2raw, int threads);
 
 /* fix focus raw pixels */
 void fix_focus_pixels(pixel_map * focus_pixel_map,
@@ -62,8 +62,10 @@ void fix_focus_pixels(pixel_map * focus_pixel_map,
                       int unified_mode,
                       int average_method,
                       int dual_iso,
+                      int map_fd,
                       int * raw2ev,
-                      int * ev2raw);
+                      int * ev2raw,
+                      int threads);
 
 /* fix all kind of bad raw pixels */
 void fix_bad_pixels(pixel_map * bad_pixel_map,
@@ -81,12 +83,19 @@ void fix_bad_pixels(pixel_map * bad_pixel_map,
                     int search_method,
                     int average_method,
                     int dual_iso,
+                    int map_fd,
                     int * raw2ev,
-                    int * ev2raw);
+                    int * ev2raw,
+                    int threads);
 
 void reset_fpm_status(pixel_map * focus_pixel_map, int * fpm_status);
 void reset_bpm_status(pixel_map * bad_pixel_map, int * bpm_status);
 
+/* directory .fpm/.bpm maps are looked for in, compiled maps are written there too,
+ * NULL = current directory and nothing is written. Maps stay cached for the process */
+void pixel_maps_set_directory(const char * directory);
+void pixel_maps_clear_cache(void);
+
 /* free bufers used for raw processing */
 void free_pixel_maps(pixel_map * focus_pixel_map, pixel_map * bad_pixel_map);
 
@@ -23,6 +23,13 @@
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
+#include <pthread.h>
+#if defined(__linux)
+#include <alloca.h>
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
 #include "stripes.h"
 
 /* Vertical stripes correction code from raw2dng, credits: a1ex */
@@ -38,8 +45,10 @@
  * whether to apply the correction or not.
  *
  * For speed reasons:
- * - Correction factors are computed from the first frame only.
+ * - Correction factors are computed from the first frame only
+ *   (or from a few frames spread over the clip, see llrawproc).
  * - Only channels with error greater than 0.2% are corrected.
+ * - Detection and correction run on bands of rows in parallel.
  */
 
 #define FIXP_ONE 65536
@@ -100,7 +109,50 @@ struct raw_8pixels
 #define F2H(ev) COERCE((int)(FIXP_RANGE/2 + ev * FIXP_RANGE/2), 0, FIXP_RANGE-1)
 #define H2F(x) ((double)((x) - FIXP_RANGE/2) / (FIXP_RANGE/2))
 
-static void add_pixel(int hist[8][FIXP_RANGE], int num[8], int offset, int pa, int pb, int32_t white_level)
+/* Column ratio histograms of one or more frames, the coefficients are their medians */
+struct stripes_stats
+{
+    int hist[8][FIXP_RANGE];
+    int num[8];
+    int64_t frame_size;   /* raw_info frame sizes of all frames that went in */
+};
+
+/* Frames are split in bands of rows for the threads. Bands start on even rows (RG/GB pairs),
+ * and the dither noise of a band only depends on the band, so results don't depend on threads */
+#define STRIPES_BAND_ROWS 64
+
+typedef struct
+{
+    uint16_t * image_data;
+    int32_t black_level;
+    int32_t white_level;
+    uint16_t width;
+    uint16_t height;
+    int bands;
+    int next_band;                  /* taken with an atomic add */
+    pthread_mutex_t mutex;
+
+    stripes_stats * stats;          /* detection: thread histograms are merged in to it */
+    int white;                      /* correction: white level estimate */
+    int32_t coefficients[8];        /* correction: FIXP_ONE where there is no coefficient */
+} stripes_job_t;
+
+static void run_stripes_job(stripes_job_t * job, void * (*thread_function)(void *), int threads)
+{
+    job->next_band = 0;
+    threads = COERCE(threads, 1, job->bands);
+    if (threads < 2)
+    {
+        thread_function(job);
+        return;
+    }
+
+    pthread_t * thread_id = alloca(threads * sizeof(pthread_t));
+    for (int t = 0; t < threads; t++) pthread_create(&thread_id[t], NULL, thread_function, job);
+    for (int t = 0; t < threads; t++) pthread_join(thread_id[t], NULL);
+}
+
+static void add_pixel(int hist[8][FIXP_RANGE], int num[8], int offset, int pa, int pb, int32_t white_level, uint32_t * seed)
 {
     int a = pa;
     int b = pb;
@@ -121,8 +173,10 @@ static void add_pixel(int hist[8][FIXP_RANGE], int num[8], int offset, int pa, i
      * 
      * this removes spikes on the histogram, thus canceling bias towards "round" values
      */
-    double af = a + (rand() % 1024) / 1024.0 - 0.5;
-    double bf = b + (rand() % 1024) / 1024.0 - 0.5;
+    *seed = *seed * 1103515245 + 12345;
+    double af = a + ((*seed >> 16) % 1024) / 1024.0 - 0.5;
+    *seed = *seed * 1103515245 + 12345;
+    double bf = b + ((*seed >> 16) % 1024) / 1024.0 - 0.5;
     double factor = af / bf;
     double ev = log2(factor);
     
@@ -134,98 +188,130 @@ static void add_pixel(int hist[8][FIXP_RANGE], int num[8], int offset, int pa, i
     num[offset] += weight;
 }
 
-
-static void detect_vertical_stripes_coeffs(stripes_correction * correction,
-                                           uint16_t * image_data,
-                                           int32_t black_level,
-                                           int32_t white_level,
-                                           int32_t raw_info_frame_size,
-                                           uint16_t width,
-                                           uint16_t height)
+static void * detect_stripes_thread(void * arg)
 {
-    static int hist[8][FIXP_RANGE];
-    static int num[8];
-    memset(hist, 0, sizeof(hist));
-    memset(num, 0, sizeof(num));
-
-    int pitch = width * 2;
-
-    /* compute 7 histograms: b./a, c./a ... h./a */
-    /* that is, adjust all columns to make them as bright as a */
-    /* process green pixels only, assuming the image is RGGB */
-    struct raw_8pixels * row;
-    for (row = (void*)image_data; (void*)row < (void*)image_data + pitch * height; row += 2 * pitch / sizeof(struct raw_8pixels))
+    stripes_job_t * job = (stripes_job_t *)arg;
+    int32_t black_level = job->black_level;
+    int32_t white_level = job->white_level;
+    int width = job->width;
+    int groups = width / 8;
+
+    /* a histogram of its own, 2MB */
+    int (*hist)[FIXP_RANGE] = calloc(8, sizeof(*hist));
+    int num[8] = { 0 };
+    if (!hist) return NULL;
+
+    int band;
+    while ((band = __atomic_fetch_add(&job->next_band, 1, __ATOMIC_RELAXED)) < job->bands)
     {
-        /* first line is RG */
-        struct raw_8pixels * rg;
-        for (rg = row; (void*)rg < (void*)row + pitch - sizeof(struct raw_8pixels); rg++)
+        uint32_t seed = band * 2654435761u + 1;
+        int y_end = MIN((band + 1) * STRIPES_BAND_ROWS, (int)job->height);
+
+        /* compute 7 histograms: b./a, c./a ... h./a */
+        /* that is, adjust all columns to make them as bright as a */
+        /* process green pixels only, assuming the image is RGGB */
+        for (int y = band * STRIPES_BAND_ROWS; y + 1 < y_end; y += 2)
         {
-            /* next line is GB */
-            struct raw_8pixels * gb = rg + pitch / sizeof(struct raw_8pixels);
-
-            struct raw_8pixels * p = rg;
-            int pb = PB - black_level;
-            int pd = PD - black_level;
-            int pf = PF - black_level;
-            int ph = PH - black_level;
-            p++;
-            int pb2 = PB - black_level;
-            int pd2 = PD - black_level;
-            int pf2 = PF - black_level;
-            int ph2 = PH - black_level;
-            p = gb;
-            //int pa = PA - black_level;
-            int pc = PC - black_level;
-            int pe = PE - black_level;
-            int pg = PG - black_level;
-            p++;
-            int pa2 = PA - black_level;
-            int pc2 = PC - black_level;
-            int pe2 = PE - black_level;
-            int pg2 = PG - black_level;
-            
-            /**
-             * verification: introducing strong banding in one column
-             * should not affect the coefficients from the other columns
-             **/
-
-            //~ pe = pe * 1.1;
-            //~ pe2 = pe2 * 1.1;
-            
-            /**
-             * Make all columns as bright as a2
-             * use linear interpolation, so when processing column b, for example,
-             * let bi = (b * 1 + b2 * 7) / (7+1)
-             * let ei = (e * 4 + e2 * 4) / (4+4)
-             * and so on, to avoid getting tricked by smooth gradients.
-             */
-
-            add_pixel(hist, num, 1, pa2, (pb * 1 + pb2 * 7) / 8, white_level);
-            add_pixel(hist, num, 2, pa2, (pc * 2 + pc2 * 6) / 8, white_level);
-            add_pixel(hist, num, 3, pa2, (pd * 3 + pd2 * 5) / 8, white_level);
-            add_pixel(hist, num, 4, pa2, (pe * 4 + pe2 * 4) / 8, white_level);
-            add_pixel(hist, num, 5, pa2, (pf * 5 + pf2 * 3) / 8, white_level);
-            add_pixel(hist, num, 6, pa2, (pg * 6 + pg2 * 2) / 8, white_level);
-            add_pixel(hist, num, 7, pa2, (ph * 7 + ph2 * 1) / 8, white_level);
+            /* first line is RG */
+            struct raw_8pixels * row = (struct raw_8pixels *)(job->image_data + (size_t)y * width);
+            for (struct raw_8pixels * rg = row; rg + 1 < row + groups; rg++)
+            {
+                /* next line is GB */
+                struct raw_8pixels * gb = (struct raw_8pixels *)((uint16_t *)rg + width);
+
+                struct raw_8pixels * p = rg;
+                int pb = PB - black_level;
+                int pd = PD - black_level;
+                int pf = PF - black_level;
+                int ph = PH - black_level;
+                p++;
+                int pb2 = PB - black_level;
+                int pd2 = PD - black_level;
+                int pf2 = PF - black_level;
+                int ph2 = PH - black_level;
+                p = gb;
+                int pc = PC - black_level;
+                int pe = PE - black_level;
+                int pg = PG - black_level;
+                p++;
+                int pa2 = PA - black_level;
+                int pc2 = PC - black_level;
+                int pe2 = PE - black_level;
+                int pg2 = PG - black_level;
+
+                /**
+                 * Make all columns as bright as a2
+                 * use linear interpolation, so when processing column b, for example,
+                 * let bi = (b * 1 + b2 * 7) / (7+1)
+                 * let ei = (e * 4 + e2 * 4) / (4+4)
+                 * and so on, to avoid getting tricked by smooth gradients.
+                 */
+
+                add_pixel(hist, num, 1, pa2, (pb * 1 + pb2 * 7) / 8, white_level, &seed);
+                add_pixel(hist, num, 2, pa2, (pc * 2 + pc2 * 6) / 8, white_level, &seed);
+                add_pixel(hist, num, 3, pa2, (pd * 3 + pd2 * 5) / 8, white_level, &seed);
+                add_pixel(hist, num, 4, pa2, (pe * 4 + pe2 * 4) / 8, white_level, &seed);
+                add_pixel(hist, num, 5, pa2, (pf * 5 + pf2 * 3) / 8, white_level, &seed);
+                add_pixel(hist, num, 6, pa2, (pg * 6 + pg2 * 2) / 8, white_level, &seed);
+                add_pixel(hist, num, 7, pa2, (ph * 7 + ph2 * 1) / 8, white_level, &seed);
+            }
         }
     }
 
+    pthread_mutex_lock(&job->mutex);
+    for (int j = 1; j < 8; j++)
+    {
+        for (int k = 0; k < FIXP_RANGE; k++) job->stats->hist[j][k] += hist[j][k];
+        job->stats->num[j] += num[j];
+    }
+    pthread_mutex_unlock(&job->mutex);
+
+    free(hist);
+    return NULL;
+}
+
+stripes_stats * stripes_new_stats(void)
+{
+    return calloc(1, sizeof(stripes_stats));
+}
+
+void stripes_free_stats(stripes_stats * stats)
+{
+    free(stats);
+}
+
+void stripes_add_frame(stripes_stats * stats,
+                       uint16_t * image_data,
+                       int32_t black_level,
+                       int32_t white_level,
+                       int32_t raw_info_frame_size,
+                       uint16_t width,
+                       uint16_t height,
+                       int threads)
+{
+    stripes_job_t job = { .image_data = image_data, .black_level = black_level, .white_level = white_level,
+                          .width = width, .height = height, .bands = (height + STRIPES_BAND_ROWS - 1) / STRIPES_BAND_ROWS,
+                          .stats = stats };
+    pthread_mutex_init(&job.mutex, NULL);
+    run_stripes_job(&job, detect_stripes_thread, threads);
+    pthread_mutex_destroy(&job.mutex);
+
+    stats->frame_size += raw_info_frame_size;
+}
+
+void stripes_get_correction(stripes_correction * correction, stripes_stats * stats)
+{
     int j,k;
-    
-    int max[8] = {0};
-    for (j = 0; j < 8; j++)
-        for (k = 1; k < FIXP_RANGE-1; k++)
-            max[j] = MAX(max[j], hist[j][k]);
 
     /* compute the median correction factor (this will reject outliers) */
     for (j = 0; j < 8; j++)
     {
-        if (num[j] < raw_info_frame_size / 128) continue;
+        if (stats->num[j] < stats->frame_size / 128) continue;
         int t = 0;
         for (k = 0; k < FIXP_RANGE; k++)
         {
-            t += hist[j][k];
-            if (t >= num[j]/2)
+            t += stats->hist[j][k];
+            if (t >= stats->num[j]/2)
             {
                 int c = pow(2, H2F(k)) * FIXP_ONE;
                 correction->coeffficients[j] = c;
@@ -234,33 +320,6 @@ static void detect_vertical_stripes_coeffs(stripes_correction * correction,
         }
     }
 
-#if 0
-    /* debug graphs */
-    FILE* f = fopen("debug_graph.m", "w");
-    fprintf(f, "h = {}; x = {}; c = \"rgbcmy\"; \n");
-    for (j = 2; j < 8; j++)
-    {
-        fprintf(f, "h{end+1} = [");
-        for (k = 1; k < FIXP_RANGE-1; k++)
-        {
-            fprintf(f, "%d ", hist[j][k]);
-        }
-        fprintf(f, "];\n");
-
-        fprintf(f, "x{end+1} = [");
-        for (k = 1; k < FIXP_RANGE-1; k++)
-        {
-            fprintf(f, "%f ", H2F(k) );
-        }
-        fprintf(f, "];\n");
-        fprintf(f, "plot(log2(%d/%d) + [0 0], [0 %d], ['*-' c(%d)]); hold on;\n", correction[j], FIXP_ONE, max[j], j-1);
-    }
-    fprintf(f, "for i = 1:6, plot(x{i}, h{i}, c(i)); hold on; end;");
-    fprintf(f, "axis([-0.05 0.05])");
-    fclose(f);
-    //system("octave-cli --persist debug_graph.m");
-#endif
-
     correction->coeffficients[0] = FIXP_ONE;
 
     /* do we really need stripe correction, or it won't be noticeable? or maybe it's just computation error? */
@@ -273,13 +332,118 @@ static void detect_vertical_stripes_coeffs(stripes_correction * correction,
     }
 }
 
+static void detect_vertical_stripes_coeffs(stripes_correction * correction,
+                                           uint16_t * image_data,
+                                           int32_t black_level,
+                                           int32_t white_level,
+                                           int32_t raw_info_frame_size,
+                                           uint16_t width,
+                                           uint16_t height,
+                                           int threads)
+{
+    stripes_stats * stats = stripes_new_stats();
+    if (!stats) return;
+    stripes_add_frame(stats, image_data, black_level, white_level, raw_info_frame_size, width, height, threads);
+    stripes_get_correction(correction, stats);
+    stripes_free_stats(stats);
+}
+
+static void * stripes_white_thread(void * arg)
+{
+    stripes_job_t * job = (stripes_job_t *)arg;
+    int white = 0;
+    int band;
+    while ((band = __atomic_fetch_add(&job->next_band, 1, __ATOMIC_RELAXED)) < job->bands)
+    {
+        size_t start = (size_t)band * STRIPES_BAND_ROWS * job->width;
+        size_t end = (size_t)MIN((band + 1) * STRIPES_BAND_ROWS, (int)job->height) * job->width;
+        for (size_t i = start; i < end; i++) white = MAX(white, job->image_data[i]);
+    }
+
+    pthread_mutex_lock(&job->mutex);
+    job->white = MAX(job->white, white);
+    pthread_mutex_unlock(&job->mutex);
+    return NULL;
+}
+
+/* every pixel of a group of 8 is multiplied by the coefficient of its column, as long as
+ * it is below white and the first pixel of the group is not too dark */
+static void correct_stripes_row(uint16_t * row, int width, const int32_t * coefficients, int black_level, int white)
+{
+    int x = 0;
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    if (black_level + 64 < 0xFFFF)
+    {
+        int32x4_t c_lo = vld1q_s32(coefficients);
+        int32x4_t c_hi = vld1q_s32(coefficients + 4);
+        int32x4_t black = vdupq_n_s32(black_level);
+        int32x4_t white32 = vdupq_n_s32(white);
+        int32x4_t round = vdupq_n_s32(FIXP_ONE - 1);
+        uint16x8_t white16 = vdupq_n_u16(MIN(white, 0xFFFF));
+        for (; x + 8 <= width; x += 8)
+        {
+            if (row[x] <= black_level + 64) continue;
+
+            uint16x8_t px = vld1q_u16(row + x);
+            uint16x8_t mask = vandq_u16(vtstq_u16(px, px), vcltq_u16(px, white16));
+
+            int32x4_t lo = vsubq_s32(vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(px))), black);
+            int32x4_t hi = vsubq_s32(vreinterpretq_s32_u32(vmovl_u16(vget_high_u16(px))), black);
+            lo = vmulq_s32(lo, c_lo);
+            hi = vmulq_s32(hi, c_hi);
+            /* divide by FIXP_ONE rounding towards zero, like RAW_MUL does */
+            lo = vshrq_n_s32(vaddq_s32(lo, vandq_s32(vshrq_n_s32(lo, 31), round)), 16);
+            hi = vshrq_n_s32(vaddq_s32(hi, vandq_s32(vshrq_n_s32(hi, 31), round)), 16);
+            lo = vminq_s32(vaddq_s32(lo, black), white32);
+            hi = vminq_s32(vaddq_s32(hi, black), white32);
+
+            uint16x8_t corrected = vcombine_u16(vmovn_u32(vreinterpretq_u32_s32(lo)), vmovn_u32(vreinterpretq_u32_s32(hi)));
+            vst1q_u16(row + x, vbslq_u16(mask, corrected, px));
+        }
+    }
+#endif
+
+    for (; x < width; x += 8)
+    {
+        int pa = row[x];
+        if (pa <= black_level + 64) continue;
+        int n = MIN(8, width - x);
+        for (int j = 0; j < n; j++)
+        {
+            int p = row[x + j];
+            if (p && p < white) row[x + j] = MIN(white, RAW_MUL(p, coefficients[j]));
+        }
+    }
+}
+
+static void * correct_stripes_thread(void * arg)
+{
+    stripes_job_t * job = (stripes_job_t *)arg;
+    int band;
+    while ((band = __atomic_fetch_add(&job->next_band, 1, __ATOMIC_RELAXED)) < job->bands)
+    {
+        int y_end = MIN((band + 1) * STRIPES_BAND_ROWS, (int)job->height);
+        for (int y = band * STRIPES_BAND_ROWS; y < y_end; y++)
+        {
+            correct_stripes_row(job->image_data + (size_t)y * job->width, job->width, job->coefficients, job->black_level, job->white);
+        }
+    }
+    return NULL;
+}
+
 static void apply_vertical_stripes_correction(stripes_correction * correction,
                                               uint16_t * image_data,
                                               int32_t black_level,
                                               int32_t white_level,
                                               uint16_t width,
-                                              uint16_t height)
+                                              uint16_t height,
+                                              int threads)
 {
+    stripes_job_t job = { .image_data = image_data, .black_level = black_level, .white_level = white_level,
+                          .width = width, .height = height, .bands = (height + STRIPES_BAND_ROWS - 1) / STRIPES_BAND_ROWS };
+    pthread_mutex_init(&job.mutex, NULL);
+
     /**
      * inexact white level will result in banding in highlights, especially if some channels are clipped
      * 
@@ -291,59 +455,24 @@ static void apply_vertical_stripes_correction(stripes_correction * correction,
      *     worst case, the brightest pixel(s) will be underexposed by 0.1 EV or so
      *   - if there are, we will choose the true white level
      */
-     
-    int white = white_level * 2 / 3;
-    int pitch = width * 2;
+    job.white = white_level * 2 / 3;
+    run_stripes_job(&job, stripes_white_thread, threads);
 
-    struct raw_8pixels * row;
-    for (row = (void*)image_data; (void*)row < (void*)image_data + pitch * height; row += pitch / sizeof(struct raw_8pixels))
-    {
-        struct raw_8pixels * p;
-        for (p = row; (void*)p < (void*)row + pitch; p++)
-        {
-            white = MAX(white, PA);
-            white = MAX(white, PB);
-            white = MAX(white, PC);
-            white = MAX(white, PD);
-            white = MAX(white, PE);
-            white = MAX(white, PF);
-            white = MAX(white, PG);
-            white = MAX(white, PH);
-        }
-    }
-    
-    int black = black_level;
-    for (row = (void*)image_data; (void*)row < (void*)image_data + pitch * height; row += pitch / sizeof(struct raw_8pixels))
+    /**
+     * Thou shalt not exceed the white level (the exact one, not the exif one)
+     * otherwise you'll be blessed with banding instead of nice and smooth highlight recovery
+     * 
+     * At very dark levels, you will introduce roundoff errors, so don't correct there
+     *
+     * A missing coefficient leaves the pixel as it is, same as multiplying by one
+     */
+    for (int j = 0; j < 8; j++)
     {
-        struct raw_8pixels * p;
-        for (p = row; (void*)p < (void*)row + pitch; p++)
-        {
-            int pa = PA;
-            int pb = PB;
-            int pc = PC;
-            int pd = PD;
-            int pe = PE;
-            int pf = PF;
-            int pg = PG;
-            int ph = PH;
-            
-            /**
-             * Thou shalt not exceed the white level (the exact one, not the exif one)
-             * otherwise you'll be blessed with banding instead of nice and smooth highlight recovery
-             * 
-             * At very dark levels, you will introduce roundoff errors, so don't correct there
-             */
-            
-            if (correction->coeffficients[0] && pa && pa < white && pa > black + 64) SET_PA(MIN(white, RAW_MUL(pa, correction->coeffficients[0])));
-            if (correction->coeffficients[1] && pb && pb < white && pa > black + 64) SET_PB(MIN(white, RAW_MUL(pb, correction->coeffficients[1])));
-            if (correction->coeffficients[2] && pc && pc < white && pa > black + 64) SET_PC(MIN(white, RAW_MUL(pc, correction->coeffficients[2])));
-            if (correction->coeffficients[3] && pd && pd < white && pa > black + 64) SET_PD(MIN(white, RAW_MUL(pd, correction->coeffficients[3])));
-            if (correction->coeffficients[4] && pe && pe < white && pa > black + 64) SET_PE(MIN(white, RAW_MUL(pe, correction->coeffficients[4])));
-            if (correction->coeffficients[5] && pf && pf < white && pa > black + 64) SET_PF(MIN(white, RAW_MUL(pf, correction->coeffficients[5])));
-            if (correction->coeffficients[6] && pg && pg < white && pa > black + 64) SET_PG(MIN(white, RAW_MUL(pg, correction->coeffficients[6])));
-            if (correction->coeffficients[7] && ph && ph < white && pa > black + 64) SET_PH(MIN(white, RAW_MUL(ph, correction->coeffficients[7])));
-        }
+        job.coefficients[j] = correction->coeffficients[j] ? correction->coeffficients[j] : FIXP_ONE;
     }
+    run_stripes_job(&job, correct_stripes_thread, threads);
+
+    pthread_mutex_destroy(&job.mutex);
 }
 
 void fix_vertical_stripes(stripes_correction * correction,
@@ -354,12 +483,13 @@ void fix_vertical_stripes(stripes_correction * correction,
                           uint16_t width,
                           uint16_t height,
                           int vertical_stripes,
-                          int * compute_stripes)
+                          int * compute_stripes,
+                          int threads)
 {
     /* for speed: only detect correction factors from the first frame if not forced */
     if (*compute_stripes || vertical_stripes == 2)
     {
-        detect_vertical_stripes_coeffs(correction, image_data, black_level, white_level, raw_info_frame_size, width, height);
+        detect_vertical_stripes_coeffs(correction, image_data, black_level, white_level, raw_info_frame_size, width, height, threads);
 #ifndef STDOUT_SILENT
         const char * method = NULL;
         if (vertical_stripes == 2)
@@ -388,5 +518,5 @@ void fix_vertical_stripes(stripes_correction * correction,
         *compute_stripes = 0;
     }
 
-    apply_vertical_stripes_correction(correction, image_data, black_level, white_level, width, height);
+    apply_vertical_stripes_correction(correction, image_data, black_level, white_level, width, height, threads);
 }
@@ -32,6 +32,21 @@ typedef struct {
     int coeffficients[8];
 } stripes_correction;
 
+/* column statistics of one or more frames, for measuring coefficients over several frames */
+typedef struct stripes_stats stripes_stats;
+
+stripes_stats * stripes_new_stats(void);
+void stripes_free_stats(stripes_stats * stats);
+void stripes_add_frame(stripes_stats * stats,
+                       uint16_t * image_data,
+                       int32_t black_level,
+                       int32_t white_level,
+                       int32_t raw_info_frame_size,
+                       uint16_t width,
+                       uint16_t height,
+                       int threads);
+void stripes_get_correction(stripes_correction * correction, stripes_stats * stats);
+
 void fix_vertical_stripes(stripes_correction * correction,
                           uint16_t * image_data,
                           int32_t black_level,
@@ -40,5 +55,6 @@ void fix_vertical_stripes(stripes_correction * correction,
                           uint16_t width,
                           uint16_t height,
                           int vertical_stripes,
-                          int * compute_stripes);
+                          int * compute_stripes,
+                          int threads);
 #endif
@@ -7,6 +7,7 @@
 #define getMlvRawCacheLimitMegaBytes(video) (video)->cache_limit_mb
 #define getMlvRawCacheLimitFrames(video) (video)->cache_limit_frames
 #define isMlvObjectCaching(video) (video)->cache_thread_count
+#define getMlvCacheStorageMode(video) (video)->cache_storage_mode
 /* And here's an UNUSED (at this moment) macrofuntion - ignored */
 #define setMlvCacheStartFrame(video, startFrame) (video)->cache_start_frame = (startFrame)
 
@@ -16,6 +17,9 @@
 /* Useful getting macros */
 #define getMlvWidth(video) (video)->RAWI.xRes
 #define getMlvHeight(video) (video)->RAWI.yRes
+/* Size of the half resolution preview (getMlvProcessedPreviewFrame16) */
+#define getMlvPreviewWidth(video) ((video)->RAWI.xRes / 2)
+#define getMlvPreviewHeight(video) ((video)->RAWI.yRes / 2)
 #define getMlvMaxWidth(video) ((video)->RAWI.raw_info.active_area.x2 - (video)->RAWI.raw_info.active_area.x1)
 #define getMlvMaxHeight(video) ((video)->RAWI.raw_info.active_area.y2 - (video)->RAWI.raw_info.active_area.y1)
 #define getMlvFrames(video) (video)->frames
@@ -6,6 +6,8 @@
 /* TO have processingObject_t */
 #include "../processing/processing_object.h"
 #include "llrawproc/llrawproc_object.h"
+/* Second cache tier */
+#include "disk_cache.h"
 
 /* I guess this has to happen for pthread_t */
 #include "pthread.h"
@@ -16,6 +18,12 @@
 #define MLV_FRAME_NOT_CACHED 0
 #define MLV_FRAME_IS_CACHED 1
 #define MLV_FRAME_BEING_CACHED 2
+#define MLV_FRAME_IS_ON_DISK 3
+
+/* cache storage modes (what is kept in RAM for every cached frame) */
+#define MLV_CACHE_STORE_RGB16 0        /* AMaZE debayered RGB, 48bpp, nothing to do on a hit */
+#define MLV_CACHE_STORE_BAYER16 1      /* Bayer after llrawproc, 16bpp, debayered on a hit */
+#define MLV_CACHE_STORE_BAYER_PACKED 2 /* Same, but bit packed at the raw bit depth (10/12/14bpp) */
 
 /* Struct of index of video and audio frames for quick access */
 typedef struct
@@ -30,7 +38,7 @@ typedef struct
 } frame_index_t;
 
 /* MLV App map file header (.MAPP) */
-#define MAPP_VERSION 3
+#define MAPP_VERSION 4
 typedef struct {
     uint8_t     fileMagic[4];  /* MAPP */
     uint64_t    mapp_size;     /* total MAPP file size */
@@ -87,6 +95,9 @@ typedef struct {
     /* Dark frame info */
     uint64_t dark_frame_offset;
 
+    /* 1 = clip index is kept in a .MAPP file next to the clip */
+    int mapp_in_use;
+
     /* Black and white level copy for resseting to the original */
     uint16_t original_black_level;
     uint16_t original_white_level;
@@ -126,8 +137,8 @@ typedef struct {
     /* 0 = no, 1 = (yes... cache threads are alive right now) */
     int is_caching;
     int cache_thread_count; /* Total active cache threads */
-    uint64_t cache_next; /* Like a cache request (any non-zero frame) */
-    pthread_mutex_t cache_mutex;
+    int64_t cache_next; /* Like a cache request, -1 if none, swapped out atomically */
+    pthread_mutex_t cache_mutex; /* Guards the single cached frame (rgb_raw_current_frame) */
     /* Will be set to 1 for cache threads to stop (probably only by freeMlvObject) */
     int stop_caching;
 
@@ -145,11 +156,39 @@ typedef struct {
     uint64_t cache_limit_mb; /* How many MB of frames can be cached... 
      * Debayered frames are cached with 16 bit channel bitdepth (48bpp) */
 
+    /* What is stored for each cached frame, one of MLV_CACHE_STORE_* */
+    int cache_storage_mode;
+    int cache_pack_bits;        /* Bits per bayer sample in the bayer modes */
+    uint64_t cache_frame_bytes; /* Size of one cached frame in the memory block */
+
+    /* Cache statistics, so the storage mode can be picked per device */
+    uint64_t cache_hits;
+    uint64_t cache_misses;
+    uint64_t cache_decode_ns; /* Total time spent turning cached frames back in to RGB */
+
+    /* Frames beyond what fits in RAM spill here (debayered RGB like MLV_CACHE_STORE_RGB16), NULL if off */
+    diskCacheObject_t * disk_cache;
+
     /* Not used, cache always starts at frame zero... for now */
     uint64_t cache_start_frame;
 
     uint8_t * cached_frames; /* Basically an array with as many elements as frames, cache states are defined above */
-    uint16_t ** rgb_raw_frames; /* Pointers to 16bit cached RGB frames */
+    uint16_t ** rgb_raw_frames; /* Pointers to cache slots within cache_memory_block (one per slot, not per frame) */
+
+    /* Slots are handed out to any frame, all of these are guarded by g_mutexFind */
+    int32_t * cache_frame_slot; /* Slot of every frame, -1 if not in RAM */
+    int32_t * cache_slot_frame; /* Frame in every slot, -1 if free */
+    uint8_t * cache_slot_ref;   /* CLOCK reference bits, set on every hit */
+    uint16_t * cache_slot_pins; /* Hits copying out of the slot right now, it can't be evicted */
+    int32_t * cache_free_slots; /* Free list, used as a stack */
+    int32_t cache_free_count;
+    uint32_t cache_clock_hand;
+    uint32_t cache_generation; /* Bumped when everything is marked uncached, late writers drop their frame */
+
+    /* Caching follows the playhead: a window of frames around it gets cached, ahead first */
+    uint64_t cache_playhead;
+    uint32_t cache_work_pos; /* Next position in the window, taken with an atomic add (lock free) */
+    pthread_cond_t cache_cond; /* Idle cache threads wait here for the playhead to move */
 
     /* A single cached frame, speeds up when asking for the same (non-cached) frame over and over again */
     int current_cached_frame_active;
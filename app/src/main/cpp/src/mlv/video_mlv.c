@@ -26,6 +26,7 @@
 #include "../debayer/debayer.h"
 /* Processing module */
 #include "../processing/raw_processing.h"
+#include "../processing/resize/lancir_wrapper.h"
 
 /* Lossless decompression */
 #include "liblj92/lj92.h"
@@ -346,16 +347,13 @@ void getMlvRawFrameFloat(mlvObject_t * video, uint64_t frameIndex, float * outpu
     size_t unpacked_frame_size = pixels_count * 2;
     uint16_t * unpacked_frame = (uint16_t *)malloc( unpacked_frame_size );
 
-    if(getMlvRawFrameUint16(video, frameIndex, unpacked_frame))
+    if(getMlvRawFrameCorrected(video, frameIndex, unpacked_frame))
     {
         memset(outputFrame, 0, pixels_count * sizeof(float));
         free(unpacked_frame);
         return;
     }
 
-    /* apply low level raw processing to the unpacked_frame */
-    applyLLRawProcObject(video, unpacked_frame, unpacked_frame_size);
-
     /* high quality dualiso buffer consists of real 16 bit values, no converting needed */
     int shift_val = (llrpHQDualIso(video)) ? 0 : (16 - video->RAWI.raw_info.bits_per_pixel);
 
@@ -369,6 +367,19 @@ void getMlvRawFrameFloat(mlvObject_t * video, uint64_t frameIndex, float * outpu
     free(unpacked_frame);
 }
 
+/* Unpacks a frame and applies low level raw processing to it, values stay
+ * in raw bit depth (or are real 16 bit with high quality dual iso) */
+int getMlvRawFrameCorrected(mlvObject_t * video, uint64_t frameIndex, uint16_t * outputFrame)
+{
+    size_t unpacked_frame_size = video->RAWI.xRes * video->RAWI.yRes * sizeof(uint16_t);
+
+    if(getMlvRawFrameUint16(video, frameIndex, outputFrame)) return 1;
+
+    /* apply low level raw processing to the unpacked_frame */
+    applyLLRawProcObject(video, outputFrame, unpacked_frame_size);
+    return 0;
+}
+
 void setMlvProcessing(mlvObject_t * video, processingObject_t * processing)
 {
     //double camera_matrix[9]; commented for now, not used
@@ -376,6 +387,8 @@ void setMlvProcessing(mlvObject_t * video, processingObject_t * processing)
     /* Easy bit */
     video->processing = processing;
 
+    processingLockSettings(video->processing);
+
     /* Link dual_iso value, because it is needed */
     video->processing->dual_iso = &video->llrawproc->dual_iso;
 
@@ -388,6 +401,11 @@ void setMlvProcessing(mlvObject_t * video, processingObject_t * processing)
     /* Gradient alloc */
     video->processing->gradient_mask = realloc( video->processing->gradient_mask, getMlvWidth(video) * getMlvHeight(video) * sizeof( uint16_t ) );
 
+    processingUnlockSettings(video->processing);
+
+    /* Render workers hold the old mask pointers */
+    processingSettingsChanged(video->processing);
+
     /* MATRIX stuff (not working, so commented out - 
      * processing object defaults to 1,0,0,0,1,0,0,0,1) */
 
@@ -449,19 +467,46 @@ void getMlvRawFrameDebayered(mlvObject_t * video, uint64_t frameIndex, uint16_t
     int height = getMlvHeight(video);
     int frame_size = width * height * sizeof(uint16_t) * 3;
 
-    /* If frame was requested last time and is sitting in the "current" frame cache */
-    if ( video->cached_frames[frameIndex] == MLV_FRAME_NOT_CACHED
-         && video->current_cached_frame_active 
-         && video->current_cached_frame == frameIndex )
+    /* Stripes measured over the clip in the background replaced the coefficients the cached
+     * frames were made with. Only marked uncached, the slots stay as they are */
+    if (llrpCacheOutdated(video))
+    {
+        resetMlvCachedFrame(video);
+        mark_mlv_uncached(video);
+    }
+
+    /* Cache follows playback around */
+    set_mlv_cache_playhead(video, frameIndex);
+
+    /* If frame was requested last time and is sitting in the "current" frame cache
+     * (cache_mutex guards that slot, several frames can be debayered at once) */
+    if ( video->cached_frames[frameIndex] == MLV_FRAME_NOT_CACHED )
     {
-        memcpy(outputFrame, video->rgb_raw_current_frame, frame_size);
+        int hit = 0;
+        pthread_mutex_lock(&video->cache_mutex);
+        if (video->current_cached_frame_active && video->current_cached_frame == frameIndex)
+        {
+            memcpy(outputFrame, video->rgb_raw_current_frame, frame_size);
+            hit = 1;
+        }
+        pthread_mutex_unlock(&video->cache_mutex);
+        if (hit) return;
     }
+
     /* Is this next bit even readable? */
-    else switch (video->cached_frames[frameIndex])
+    switch (video->cached_frames[frameIndex])
     {
         case MLV_FRAME_IS_CACHED:
         {
-            memcpy(outputFrame, video->rgb_raw_frames[frameIndex], frame_size);
+            if (get_mlv_cached_frame(video, frameIndex, outputFrame)) return;
+            /* Got evicted in the meantime */
+            break;
+        }
+
+        case MLV_FRAME_IS_ON_DISK:
+        {
+            if (get_mlv_disk_cached_frame(video, frameIndex, outputFrame)) return;
+            /* Got evicted in the meantime */
             break;
         }
 
@@ -469,31 +514,39 @@ void getMlvRawFrameDebayered(mlvObject_t * video, uint64_t frameIndex, uint16_t
         case MLV_FRAME_NOT_CACHED:
         {
             /* If it is within the cache range, request for it to be cached */
-            if (isMlvObjectCaching(video) && frameIndex < getMlvRawCacheLimitFrames(video))
+            if (isMlvObjectCaching(video) && is_mlv_frame_cacheable(video, frameIndex))
             {
-                video->cache_next = frameIndex;
+                video->cache_next = (int64_t)frameIndex;
             }
+            break;
         }
+    }
 
-        case MLV_FRAME_BEING_CACHED:
+    if (doesMlvAlwaysUseAmaze(video) && isMlvObjectCaching(video) && is_mlv_frame_cacheable(video, frameIndex))
+    {
+        /* Wait for the cache threads, unless they give up on it */
+        uint8_t state;
+        while ((state = video->cached_frames[frameIndex]) != MLV_FRAME_IS_CACHED
+               && state != MLV_FRAME_IS_ON_DISK && isMlvObjectCaching(video))
         {
-            if (doesMlvAlwaysUseAmaze(video) && isMlvObjectCaching(video))
-            {
-                while (video->cached_frames[frameIndex] != MLV_FRAME_IS_CACHED) usleep(100);
-                memcpy(outputFrame, video->rgb_raw_frames[frameIndex], frame_size);
-            }
-            else
-            {
-                float * raw_frame = malloc(width * height * sizeof(float));
-                get_mlv_raw_frame_debayered(video, frameIndex, raw_frame, video->rgb_raw_current_frame, doesMlvAlwaysUseAmaze(video));
-                free(raw_frame);
-                memcpy(outputFrame, video->rgb_raw_current_frame, frame_size);
-                video->current_cached_frame_active = 1;
-                video->current_cached_frame = frameIndex;
-            }
-            break;
+            /* Ask again if a thread had to give up on it */
+            if (state == MLV_FRAME_NOT_CACHED) video->cache_next = (int64_t)frameIndex;
+            usleep(100);
         }
+
+        if (state == MLV_FRAME_IS_CACHED && get_mlv_cached_frame(video, frameIndex, outputFrame)) return;
+        if (state == MLV_FRAME_IS_ON_DISK && get_mlv_disk_cached_frame(video, frameIndex, outputFrame)) return;
     }
+
+    count_mlv_cache_request(video, 0, 0);
+    float * raw_frame = malloc(width * height * sizeof(float));
+    get_mlv_raw_frame_debayered(video, frameIndex, raw_frame, outputFrame, doesMlvAlwaysUseAmaze(video));
+    free(raw_frame);
+    pthread_mutex_lock(&video->cache_mutex);
+    memcpy(video->rgb_raw_current_frame, outputFrame, frame_size);
+    video->current_cached_frame_active = 1;
+    video->current_cached_frame = frameIndex;
+    pthread_mutex_unlock(&video->cache_mutex);
 }
 
 /* Get a processed frame in 16 bit, only use more than one thread for preview as
@@ -523,6 +576,181 @@ void getMlvProcessedFrame16(mlvObject_t * video, uint64_t frameIndex, uint16_t *
     free(unprocessed_frame);
 }
 
+/* Get a half resolution processed frame in 16 bit, skips debayering and the cache */
+void getMlvProcessedPreviewFrame16(mlvObject_t * video, uint64_t frameIndex, uint16_t * outputFrame, int threads)
+{
+    int width = getMlvWidth(video);
+    int height = getMlvHeight(video);
+
+    uint16_t * bayer = malloc( width * height * sizeof(uint16_t) );
+    uint16_t * unprocessed_frame = malloc( getMlvPreviewWidth(video) * getMlvPreviewHeight(video) * 3 * sizeof(uint16_t) );
+
+    if (getMlvRawFrameCorrected(video, frameIndex, bayer)) memset(bayer, 0, width * height * sizeof(uint16_t));
+
+    /* high quality dualiso buffer consists of real 16 bit values already */
+    int shift_val = (llrpHQDualIso(video)) ? 0 : (16 - video->RAWI.raw_info.bits_per_pixel);
+    debayerSuperpixel(unprocessed_frame, bayer, width, height, shift_val);
+    free(bayer);
+
+    /* Masks are made for the full size frame */
+    applyProcessingObjectRegion( video->processing,
+                                 width, height,
+                                 0, 0, width, height,
+                                 getMlvPreviewWidth(video), getMlvPreviewHeight(video),
+                                 unprocessed_frame,
+                                 outputFrame,
+                                 threads, 1, frameIndex );
+
+    free(unprocessed_frame);
+}
+
+void getMlvProcessedFrameResized16(mlvObject_t * video, uint64_t frameIndex,
+                                   int outWidth, int outHeight,
+                                   uint16_t * outputFrame, int threads)
+{
+    int width = getMlvWidth(video);
+    int height = getMlvHeight(video);
+
+    uint16_t * debayered_frame = malloc( width * height * 3 * sizeof(uint16_t) );
+    uint16_t * unprocessed_frame = malloc( outWidth * outHeight * 3 * sizeof(uint16_t) );
+
+    getMlvRawFrameDebayered(video, frameIndex, debayered_frame);
+
+    /* Still linear here, resampling is cleanest before the curves */
+    lancir_resize_rgb16_wrap( debayered_frame, width, height,
+                              unprocessed_frame, outWidth, outHeight,
+                              threads );
+    free(debayered_frame);
+
+    applyProcessingObjectRegion( video->processing,
+                                 width, height,
+                                 0, 0, width, height,
+                                 outWidth, outHeight,
+                                 unprocessed_frame,
+                                 outputFrame,
+                                 threads, 1, frameIndex );
+
+    free(unprocessed_frame);
+}
+
+/* How far outside the region filters look, in frame pixels */
+static int get_mlv_region_apron(mlvObject_t * video)
+{
+    processingObject_t * processing = video->processing;
+    int width = getMlvWidth(video);
+    int height = getMlvHeight(video);
+
+    /* Debayer, sharpening, CA filter and 2D median */
+    int apron = 16 + processing->ca_radius + processing->denoiserWindow;
+
+    /* Bilateral filters fade out over sigma * size / sqrt(2) pixels, three of those is enough */
+    float sigma = 0.0f;
+    if (processing->shadows_highlights.shadows <= -0.01 || processing->shadows_highlights.shadows >= 0.01
+     || processing->shadows_highlights.highlights <= -0.01 || processing->shadows_highlights.highlights >= 0.01
+     || processing->clarity <= -0.01 || processing->clarity >= 0.01) sigma = 0.0005f;
+    if (processing->rbfDenoiserLuma > 0 || processing->rbfDenoiserChroma > 0) sigma += 0.0025f;
+    apron += (int)(3.0f * sigma * MAX(width, height) / 1.41421356f + 0.5f);
+
+    return apron;
+}
+
+void getMlvProcessedRegion16(mlvObject_t * video, uint64_t frameIndex,
+                             int x, int y, int w, int h,
+                             int outWidth, int outHeight,
+                             uint16_t * outputFrame, int threads)
+{
+    int width = getMlvWidth(video);
+    int height = getMlvHeight(video);
+
+    /* Region in the frame as displayed */
+    x = MAX(0, MIN(x, width - 1));
+    y = MAX(0, MIN(y, height - 1));
+    w = MAX(1, MIN(w, width - x));
+    h = MAX(1, MIN(h, height - y));
+
+    /* Rotation is done in processing, so the tile comes from the other side of the sensor */
+    int rotated = (video->processing->transformation == TR_ROT180);
+    int sx = rotated ? (width - x - w) : x;
+    int sy = rotated ? (height - y - h) : y;
+
+    /* Tile = region + apron, starting on even pixels for the CFA pattern */
+    int apron = get_mlv_region_apron(video);
+    int tx = MAX(0, sx - apron) & ~1;
+    int ty = MAX(0, sy - apron) & ~1;
+    int tw = MIN(width, sx + w + apron) - tx;
+    int th = MIN(height, sy + h + apron) - ty;
+
+    uint16_t * tile = malloc(tw * th * 3 * sizeof(uint16_t));
+    uint16_t * processed_tile = malloc(tw * th * 3 * sizeof(uint16_t));
+
+    /* Use the whole debayered frame if it is there already. CA correction depends
+     * on where in the frame pixels are, so that needs the whole frame too */
+    uint8_t state = video->cached_frames[frameIndex];
+    if ( state == MLV_FRAME_IS_CACHED || state == MLV_FRAME_IS_ON_DISK
+      || (video->current_cached_frame_active && video->current_cached_frame == frameIndex)
+      || video->ca_red <= -0.1 || video->ca_red >= 0.1
+      || video->ca_blue <= -0.1 || video->ca_blue >= 0.1 )
+    {
+        uint16_t * frame = malloc(width * height * 3 * sizeof(uint16_t));
+        getMlvRawFrameDebayered(video, frameIndex, frame);
+        for (int ly = 0; ly < th; ++ly)
+            memcpy(tile + ly * tw * 3, frame + ((ty + ly) * width + tx) * 3, tw * 3 * sizeof(uint16_t));
+        free(frame);
+    }
+    else
+    {
+        /* Decoding and llrawproc are still whole frame (LJ92 can't start in the middle,
+         * pixel maps and stripe correction are in frame coordinates) */
+        uint16_t * bayer = malloc(width * height * sizeof(uint16_t));
+        float * bayer_tile = malloc(tw * th * sizeof(float));
+
+        if (getMlvRawFrameCorrected(video, frameIndex, bayer)) memset(bayer, 0, width * height * sizeof(uint16_t));
+
+        /* high quality dualiso buffer consists of real 16 bit values already */
+        int shift_val = (llrpHQDualIso(video)) ? 0 : (16 - video->RAWI.raw_info.bits_per_pixel);
+        for (int ly = 0; ly < th; ++ly)
+        {
+            uint16_t * row = bayer + (ty + ly) * width + tx;
+            float * out = bayer_tile + ly * tw;
+            for (int lx = 0; lx < tw; ++lx) out[lx] = (float)(row[lx] << shift_val);
+        }
+        free(bayer);
+
+        debayer_mlv_raw_region(video, bayer_tile, tile, tw, th, doesMlvAlwaysUseAmaze(video));
+        free(bayer_tile);
+    }
+
+    /* Tile as displayed */
+    int dx = rotated ? (width - tx - tw) : tx;
+    int dy = rotated ? (height - ty - th) : ty;
+
+    applyProcessingObjectRegion( video->processing,
+                                 width, height,
+                                 dx, dy, tw, th,
+                                 tw, th,
+                                 tile,
+                                 processed_tile,
+                                 threads, 1, frameIndex );
+
+    /* Cut the region out and scale it */
+    for (int oy = 0; oy < outHeight; ++oy)
+    {
+        int ly = y - dy + (int)(((int64_t)oy * h) / outHeight);
+        uint16_t * row = processed_tile + ly * tw * 3;
+        uint16_t * out = outputFrame + oy * outWidth * 3;
+        for (int ox = 0; ox < outWidth; ++ox)
+        {
+            uint16_t * pix = row + (x - dx + (int)(((int64_t)ox * w) / outWidth)) * 3;
+            out[ox*3+0] = pix[0];
+            out[ox*3+1] = pix[1];
+            out[ox*3+2] = pix[2];
+        }
+    }
+
+    free(tile);
+    free(processed_tile);
+}
+
 /* Get a processed frame in 8 bit */
 void getMlvProcessedFrame8(mlvObject_t * video, uint64_t frameIndex, uint8_t * outputFrame, int threads)
 {
@@ -587,6 +815,8 @@ mlvObject_t * initMlvObject()
     video->rgb_raw_frames = NULL;
     video->rgb_raw_current_frame = NULL;
     video->cached_frames = NULL;
+    /* No frame requested yet */
+    video->cache_next = -1;
     /* All frames in one block of memory for least mallocing during usage */
     video->cache_memory_block = NULL;
     /* Path (so separate cache threads can have their own FILE*s) */
@@ -596,6 +826,7 @@ mlvObject_t * initMlvObject()
     pthread_mutex_init(&video->g_mutexFind, NULL);
     pthread_mutex_init(&video->g_mutexCount, NULL);
     pthread_mutex_init(&video->cache_mutex, NULL);
+    pthread_cond_init(&video->cache_cond, NULL);
 
     /* Set cache limit to allow ~1 second of 1080p and be safe for low ram PCs */
     setMlvRawCacheLimitMegaBytes(video, 290);
@@ -628,6 +859,7 @@ void freeMlvObject(mlvObject_t * video)
     /* Stop caching and make sure using silly sleep trick */
     video->stop_caching = 1;
     while (video->cache_thread_count) usleep(100);
+    llrpStopBackgroundWork(video);
 
     /* Close all MLV file chunks */
     if(video->file) close_all_chunks(video->file, video->filenum);
@@ -649,9 +881,11 @@ void freeMlvObject(mlvObject_t * video)
         free(video->cached_frames);
         video->cached_frames = NULL;
     }
-    if(video->rgb_raw_frames) free(video->rgb_raw_frames);
+    free_mlv_cache_slots(video);
     if(video->rgb_raw_current_frame) free(video->rgb_raw_current_frame);
     if(video->cache_memory_block) free(video->cache_memory_block);
+    freeDiskCache(video->disk_cache);
+    video->disk_cache = NULL;
     if(video->path) free(video->path);
     freeLLRawProcObject(video);
 
@@ -662,6 +896,7 @@ void freeMlvObject(mlvObject_t * video)
     pthread_mutex_destroy(&video->g_mutexFind);
     pthread_mutex_destroy(&video->g_mutexCount);
     pthread_mutex_destroy(&video->cache_mutex);
+    pthread_cond_destroy(&video->cache_cond);
 
     /* Main 1 */
     free(video);
@@ -675,6 +910,7 @@ static int save_mapp(mlvObject_t * video)
     memset(mapp_filename, 0x00, mapp_name_len + 4);
     memcpy(mapp_filename, video->path, mapp_name_len);
     char * dot = strrchr(mapp_filename, '.');
+    if (!dot) return 1; /* no file name to put it next to */
     memcpy(dot, ".MAPP\0", 6);
 
     size_t video_index_size = video->frames * sizeof(frame_index_t);
@@ -695,6 +931,7 @@ static int save_mapp(mlvObject_t * video)
                            sizeof(mlv_diso_hdr_t) +
                            sizeof(mlv_dark_hdr_t) +
                            sizeof(camera_id_t) +
+                           sizeof(diso_calibration_t) +
                            video_index_size +
                            audio_index_size +
                            vers_index_size;
@@ -725,7 +962,8 @@ static int save_mapp(mlvObject_t * video)
     memcpy(ptr += sizeof(mlv_wavi_hdr_t), (uint8_t*)&(video->DISO), sizeof(mlv_diso_hdr_t));
     memcpy(ptr += sizeof(mlv_diso_hdr_t), (uint8_t*)&(video->DARK), sizeof(mlv_dark_hdr_t));
     memcpy(ptr += sizeof(mlv_dark_hdr_t), (uint8_t*)&(video->camid), sizeof(camera_id_t));
-    ptr += sizeof(camera_id_t);
+    memcpy(ptr += sizeof(camera_id_t), (uint8_t*)&(video->llrawproc->diso_calibration), sizeof(diso_calibration_t));
+    ptr += sizeof(diso_calibration_t);
     if(video->video_index)
     {
         memcpy(ptr, (uint8_t*)video->video_index, video_index_size);
@@ -742,11 +980,16 @@ static int save_mapp(mlvObject_t * video)
         ptr += vers_index_size;
     }
 
-    /* open .MAPP file for writing */
-    FILE* mappf = fopen(mapp_filename, "wb");
+    /* Written next to it and renamed over it when complete, so a clip opened meanwhile, or a crash
+     * halfway through an update, never finds a half written .MAPP */
+    char * temp_filename = alloca(mapp_name_len + 8);
+    sprintf(temp_filename, "%s.tmp", mapp_filename);
+
+    /* open temporary .MAPP file for writing */
+    FILE* mappf = fopen(temp_filename, "wb");
     if (!mappf)
     {
-        DEBUG( printf("Could not open %s\n\n", mapp_filename); )
+        DEBUG( printf("Could not open %s\n\n", temp_filename); )
         free(mapp_buf);
         return 1;
     }
@@ -754,26 +997,52 @@ static int save_mapp(mlvObject_t * video)
     /* write mapp buffer */
     if(fwrite(mapp_buf, mapp_buf_size, 1, mappf) != 1)
     {
-        DEBUG( printf("\nCould not save header and metadata to %s\n", mapp_filename); )
-        fclose(mappf);
-        free(mapp_buf);
-        return 1;
+        DEBUG( printf("\nCould not save header and metadata to %s\n", temp_filename); )
+        goto mapp_write_error;
     }
-    DEBUG( printf("\nHeader and metadata saved to %s\n", mapp_filename); )
+    DEBUG( printf("\nHeader and metadata saved to %s\n", temp_filename); )
 
     /* write mapp buffer */
     if(fwrite(video->audio_data, video->audio_size, 1, mappf) != 1)
     {
-        DEBUG( printf("Could not save audio data to %s\n", mapp_filename); )
-        fclose(mappf);
-        free(mapp_buf);
+        DEBUG( printf("Could not save audio data to %s\n", temp_filename); )
+        goto mapp_write_error;
+    }
+    DEBUG( printf("Audio data saved to %s\n", temp_filename); )
+
+    free(mapp_buf);
+    if (fclose(mappf) != 0)
+    {
+        DEBUG( printf("Could not finish writing %s\n", temp_filename); )
+        remove(temp_filename);
         return 1;
     }
-    DEBUG( printf("Audio data saved to %s\n", mapp_filename); )
 
+#if defined(__WIN32)
+    /* rename does not replace an existing file on windows */
+    remove(mapp_filename);
+#endif
+    if (rename(temp_filename, mapp_filename) != 0)
+    {
+        DEBUG( printf("Could not replace %s\n", mapp_filename); )
+        remove(temp_filename);
+        return 1;
+    }
+
+    video->mapp_in_use = 1;
+    return 0;
+
+mapp_write_error:
     fclose(mappf);
+    remove(temp_filename);
     free(mapp_buf);
-    return 0;
+    return 1;
+}
+
+/* Writes the .MAPP again if the clip has one, for what is measured after opening (dual iso calibration) */
+void updateMlvMapp(mlvObject_t * video)
+{
+    if (video->mapp_in_use) save_mapp(video);
 }
 
 /* Load MLV App map file (.MAPP) */
@@ -784,6 +1053,7 @@ static int load_mapp(mlvObject_t * video)
     memset(mapp_filename, 0x00, mapp_name_len + 4);
     memcpy(mapp_filename, video->path, mapp_name_len);
     char * dot = strrchr(mapp_filename, '.');
+    if (!dot) return 1; /* no file name to put it next to */
     memcpy(dot, ".MAPP\0", 6);
 
     /* open .MAPP file for reading */
@@ -848,7 +1118,8 @@ static int load_mapp(mlvObject_t * video)
     ret += fread(&(video->DISO), sizeof(mlv_diso_hdr_t), 1, mappf);
     ret += fread(&(video->DARK), sizeof(mlv_dark_hdr_t), 1, mappf);
     ret += fread(&(video->camid), sizeof(camera_id_t), 1, mappf);
-    if(ret != 14)
+    ret += fread(&(video->llrawproc->diso_calibration), sizeof(diso_calibration_t), 1, mappf);
+    if(ret != 15)
     {
         DEBUG( printf("ret = %d, could not read metadata from %s\n", ret, mapp_filename); )
         goto mapp_error;
@@ -941,10 +1212,12 @@ static int load_mapp(mlvObject_t * video)
     DEBUG( printf("MAPP version %u loaded: %s\n", mapp_header.mapp_version, mapp_filename); )
 
     fclose(mappf);
+    video->mapp_in_use = 1;
     return 0;
 
 mapp_error:
 
+    memset(&(video->llrawproc->diso_calibration), 0, sizeof(diso_calibration_t));
     if(video->video_index)
     {
         free(video->video_index);
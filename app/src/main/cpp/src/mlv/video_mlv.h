@@ -31,6 +31,9 @@ int openMcrawClip(mlvObject_t * video, int fd, char * mcrawPath, int open_mode,
 enum mlv_err { MLV_ERR_NONE, MLV_ERR_OPEN, MLV_ERR_IO, MLV_ERR_CORRUPTED, MLV_ERR_INVALID };
 enum open_mode { MLV_OPEN_FULL, MLV_OPEN_MAPP, MLV_OPEN_PREVIEW };
 
+/* Writes the .MAPP again if the clip has one, for what is measured after opening (dual iso calibration) */
+void updateMlvMapp(mlvObject_t * video);
+
 /* Functions for saving cut or averaged MLV */
 int saveMlvHeaders(mlvObject_t * video, FILE * output_mlv, int export_audio, int export_mode, uint32_t frame_start, uint32_t frame_end, const char * version, char * error_message);
 int saveMlvAVFrame(mlvObject_t * video, FILE * output_mlv, int export_audio, int export_mode, uint32_t frame_start, uint32_t frame_end, uint32_t frame_index, uint64_t * avg_buf, char * error_message);
@@ -49,6 +52,15 @@ void resetMlvCache(mlvObject_t * video);
 /* For setting how much can be cached - "MegaBytes" == MebiBytes (thanks dmilligan) */
 void setMlvRawCacheLimitMegaBytes(mlvObject_t * video, uint64_t megaByteLimit);
 void setMlvRawCacheLimitFrames(mlvObject_t * video, uint64_t frameLimit);
+/* What to keep in RAM per cached frame (MLV_CACHE_STORE_*), bayer modes fit 3-4x more
+ * frames in the same memory but have to debayer on every hit */
+void setMlvCacheStorageMode(mlvObject_t * video, int mode);
+/* Cache hits, misses and total nanoseconds spent getting RGB out of the cache on hits */
+void getMlvCacheStats(mlvObject_t * video, uint64_t * hits, uint64_t * misses, uint64_t * decode_ns);
+void resetMlvCacheStats(mlvObject_t * video);
+/* Lets frames that don't fit in RAM be cached in a file in cache_dir (up to megaByteLimit),
+ * NULL or 0 turns it off. Returns 1 if the disk cache is on after this */
+int setMlvDiskCache(mlvObject_t * video, const char * cache_dir, uint64_t megaByteLimit);
 
 /* Links processing settings() with an MLV object */
 void setMlvProcessing(mlvObject_t * video, processingObject_t * processing);
@@ -61,12 +73,28 @@ void findMlvWhiteBalance(mlvObject_t * video, uint64_t frameIndex, int posX, int
  * as it may have minor artifacts (though I haven't found them yet) */
 void getMlvProcessedFrame8(mlvObject_t * video, uint64_t frameIndex, uint8_t * outputFrame, int threads);
 void getMlvProcessedFrame16(mlvObject_t * video, uint64_t frameIndex, uint16_t * outputFrame, int threads);
+/* Half resolution preview (getMlvPreviewWidth x getMlvPreviewHeight), bayer quads become pixels so
+ * decoding is cheap and processing runs on a quarter of the pixels. For playback, not export */
+void getMlvProcessedPreviewFrame16(mlvObject_t * video, uint64_t frameIndex, uint16_t * outputFrame, int threads);
+/* Processed frame at outWidth x outHeight: the debayered frame is resized (lanczos) before
+ * processing, so processing only runs on the output pixels. For exports smaller than the clip */
+void getMlvProcessedFrameResized16(mlvObject_t * video, uint64_t frameIndex,
+                                   int outWidth, int outHeight,
+                                   uint16_t * outputFrame, int threads);
+/* Processed part of a frame for zoomed in viewing: x, y, w, h in frame pixels scaled (nearest) to
+ * outWidth x outHeight. Only a tile around the region gets debayered and processed */
+void getMlvProcessedRegion16(mlvObject_t * video, uint64_t frameIndex,
+                             int x, int y, int w, int h,
+                             int outWidth, int outHeight,
+                             uint16_t * outputFrame, int threads);
 
 /* Unpacks the bits of a frame to get a bayer B&W image (without black level correction)
  * Needs memory to return to, sized: sizeof(float) * getMlvHeight(urvid) * getMlvWidth(urvid)
  * Output values will be in range 0-65535 (16 bit), float is only because AMAzE uses it */
 int getMlvRawFrameUint16(mlvObject_t * video, uint64_t frameIndex, uint16_t * unpackedFrame);
 void getMlvRawFrameFloat(mlvObject_t * video, uint64_t frameIndex, float * outputFrame);
+/* Same as getMlvRawFrameUint16, but with low level raw processing applied */
+int getMlvRawFrameCorrected(mlvObject_t * video, uint64_t frameIndex, uint16_t * outputFrame);
 
 /* Gets a debayered 16 bit frame */
 void getMlvRawFrameDebayered(mlvObject_t * video, uint64_t frameIndex, uint16_t * outputFrame);
@@ -93,8 +121,14 @@ void mark_mlv_uncached(mlvObject_t * video);
 /* Clears cache by freeing then reallocating (RAM usage down until frames written) */
 void clear_mlv_cache(mlvObject_t * video);
 
-/* Returns 1 on success, or 0 if all are cached */
-int find_mlv_frame_to_cache(mlvObject_t * video, uint64_t *index); /* Outputs to *index */
+/* Returns 1 on success, or 0 if everything around the playhead is cached, *to_disk for disk tier frames */
+int find_mlv_frame_to_cache(mlvObject_t * video, uint64_t *index, int * to_disk); /* Outputs to *index */
+
+/* Cache threads cache a window of frames around this, call with every frame playback asks for */
+void set_mlv_cache_playhead(mlvObject_t * video, uint64_t frame_index);
+
+/* Frees slot bookkeeping (freeMlvObject does this) */
+void free_mlv_cache_slots(mlvObject_t * video);
 
 /* Adds one thread, active total can be checked in mlvObject->cache_thread_count */
 void add_mlv_cache_thread(mlvObject_t * video);
@@ -110,10 +144,34 @@ void get_mlv_raw_frame_debayered(mlvObject_t * video,
                                   uint16_t * output_frame,
                                   int debayer_type ); /* Debayer type: 0=bilinear 1=amaze */
 
+/* Debayers a float bayer frame from getMlvRawFrameFloat (it gets modified) */
+void debayer_mlv_raw_frame(mlvObject_t * video,
+                           float * temp_memory,
+                           uint16_t * output_frame,
+                           int debayer_type );
+/* Same, for a width x height part of the frame starting on an even pixel */
+void debayer_mlv_raw_region(mlvObject_t * video,
+                            float * temp_memory,
+                            uint16_t * output_frame,
+                            int width, int height,
+                            int debayer_type );
+
+/* Gets a cached frame as 16 bit RGB, decoding it if needed for the storage mode, 0 if it got evicted */
+int get_mlv_cached_frame(mlvObject_t * video, uint64_t frame_index, uint16_t * output_frame);
+
+/* Reads a frame from the disk cache, returns 0 if it is not there (any more) */
+int get_mlv_disk_cached_frame(mlvObject_t * video, uint64_t frame_index, uint16_t * output_frame);
+
+/* 1 if cache threads would take a request for this frame */
+int is_mlv_frame_cacheable(mlvObject_t * video, uint64_t frame_index);
+
+/* Counts a cache hit or miss for getMlvCacheStats */
+void count_mlv_cache_request(mlvObject_t * video, int hit, uint64_t decode_ns);
+
 /* Thumbnail Creation with a downscaled raw image sub-sampling algorithm is used. */
 void get_sub_sampling_downscale_thumnail(mlvObject_t *video, uint8_t *out_buffer, int downscale_factor, int threads);
 
-/* Thumbnail Creation with full debayer, but downscaled image processing */
+/* Thumbnail Creation by averaging bayer sites per colour in to the thumbnail grid, then processing */
 void get_area_average_downscale_thumnail(mlvObject_t *video, uint8_t *out_buffer, int downscale_factor, int threads);
 
 #endif
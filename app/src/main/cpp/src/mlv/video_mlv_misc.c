@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "llrawproc/llrawproc.h"
 #include "../debayer/debayer.h"
@@ -99,8 +100,9 @@ void get_sub_sampling_downscale_thumnail(mlvObject_t *video, uint8_t *out_buffer
     free(raw_frame);
 }
 
-/* Quality thumbnail: full debayer then area-average downscale.
- * Slower but accurate colours and no aliasing. */
+/* Quality thumbnail: bayer sites are averaged per colour straight in to the
+ * thumbnail grid, so there is no full size debayer or float frame.
+ * Bayer pattern is RGGB like debayerBasic expects */
 void get_area_average_downscale_thumnail(mlvObject_t *video, uint8_t *out_buffer,
                                          int downscale_factor, int threads) {
     if (!video || !out_buffer) return;
@@ -109,60 +111,71 @@ void get_area_average_downscale_thumnail(mlvObject_t *video, uint8_t *out_buffer
     int raw_h = video->RAWI.yRes;
     if (raw_w <= 0 || raw_h <= 0) return;
 
-    float *raw_frame = (float *) malloc(raw_w * raw_h * sizeof(float));
-    if (!raw_frame) return;
+    const int thumb_w = raw_w / downscale_factor;
+    const int thumb_h = raw_h / downscale_factor;
+    if (thumb_w <= 0 || thumb_h <= 0) return;
 
-    getMlvRawFrameFloat(video, 0, raw_frame);
+    int pixel_count = thumb_w * thumb_h;
 
-    uint16_t *debayered_frame = (uint16_t *) malloc(
-            (size_t) (raw_w * raw_h * 3) * sizeof(uint16_t));
-    if (!debayered_frame) {
+    /* Low level raw processing works on the whole frame, only unpacked copy that is needed */
+    uint16_t *raw_frame = (uint16_t *) malloc((size_t) raw_w * raw_h * sizeof(uint16_t));
+    if (!raw_frame) return;
+
+    if (getMlvRawFrameCorrected(video, 0, raw_frame)) {
         free(raw_frame);
         return;
     }
 
-    debayerBasic(debayered_frame, raw_frame, raw_w, raw_h, 1);
-
-    const int thumb_w = raw_w / downscale_factor;
-    const int thumb_h = raw_h / downscale_factor;
-
-    int pixel_count = thumb_w * thumb_h;
+    /* high quality dualiso buffer consists of real 16 bit values, no converting needed */
+    int shift_val = llrpHQDualIso(video) ? 0 : (16 - video->RAWI.raw_info.bits_per_pixel);
 
     uint16_t *downscaled_frame = (uint16_t *) malloc(pixel_count * 3 * sizeof(uint16_t));
-    if (!downscaled_frame) {
+    /* Sums and site counts of one thumbnail row: R, G, B for every cell */
+    uint32_t *sums = (uint32_t *) malloc(thumb_w * 3 * sizeof(uint32_t));
+    uint32_t *counts = (uint32_t *) malloc(thumb_w * 3 * sizeof(uint32_t));
+    if (!downscaled_frame || !sums || !counts) {
         free(raw_frame);
-        free(debayered_frame);
+        free(downscaled_frame);
+        free(sums);
+        free(counts);
         return;
     }
 
-    /* Area-average downscale */
     for (int out_y = 0; out_y < thumb_h; ++out_y) {
-        for (int out_x = 0; out_x < thumb_w; ++out_x) {
-            uint64_t sum_r = 0, sum_g = 0, sum_b = 0;
-            int start_y = out_y * downscale_factor;
-            int start_x = out_x * downscale_factor;
-
-            for (int dy = 0; dy < downscale_factor; dy++) {
-                for (int dx = 0; dx < downscale_factor; dx++) {
-                    size_t src = ((size_t) (start_y + dy) * raw_w + (start_x + dx)) * 3;
-                    sum_r += debayered_frame[src + 0];
-                    sum_g += debayered_frame[src + 1];
-                    sum_b += debayered_frame[src + 2];
+        memset(sums, 0, thumb_w * 3 * sizeof(uint32_t));
+        memset(counts, 0, thumb_w * 3 * sizeof(uint32_t));
+
+        for (int y = out_y * downscale_factor; y < (out_y + 1) * downscale_factor; ++y) {
+            const uint16_t *row = raw_frame + (size_t) y * raw_w;
+            /* Even rows are R G R G, odd rows G B G B */
+            int even_ch = (y & 1) ? 1 : 0;
+            int odd_ch = (y & 1) ? 2 : 1;
+
+            for (int out_x = 0, x = 0; out_x < thumb_w; ++out_x) {
+                uint32_t *sum = sums + out_x * 3;
+                uint32_t *count = counts + out_x * 3;
+                for (int end = x + downscale_factor; x < end; ++x) {
+                    int ch = (x & 1) ? odd_ch : even_ch;
+                    sum[ch] += row[x];
+                    count[ch]++;
                 }
             }
+        }
 
-            int area = downscale_factor * downscale_factor;
-            size_t dst = ((size_t) out_y * thumb_w + out_x) * 3;
-            downscaled_frame[dst + 0] = (uint16_t) (sum_r / area);
-            downscaled_frame[dst + 1] = (uint16_t) (sum_g / area);
-            downscaled_frame[dst + 2] = (uint16_t) (sum_b / area);
+        uint16_t *out = downscaled_frame + (size_t) out_y * thumb_w * 3;
+        for (int i = 0; i < thumb_w * 3; ++i) {
+            /* A cell of one pixel only has one colour, leave the others black */
+            uint32_t value = counts[i] ? ((sums[i] / counts[i]) << shift_val) : 0;
+            out[i] = (uint16_t) (value > 65535 ? 65535 : value);
         }
     }
 
+    free(counts);
+    free(sums);
+    free(raw_frame);
+
     uint16_t *processed_frame = (uint16_t *) malloc(pixel_count * 3 * sizeof(uint16_t));
     if (!processed_frame) {
-        free(raw_frame);
-        free(debayered_frame);
         free(downscaled_frame);
         return;
     }
@@ -175,6 +188,4 @@ void get_area_average_downscale_thumnail(mlvObject_t *video, uint8_t *out_buffer
 
     free(processed_frame);
     free(downscaled_frame);
-    free(debayered_frame);
-    free(raw_frame);
 }
@@ -170,20 +170,40 @@ typedef struct {
     char * string;
 } tonemap_func_t;
 
+/* Built in curves as tinyexpr strings, every one written once here and turned in to both
+ * the string and tonemap_string_function. CURVE(id, expression), or for
+ * '(x comparison split) ? a : b' SPLIT_CURVE(id, LT/LE/GT/GE, split, a, b). The strings end
+ * up in saved settings, so the spacing of the expressions is part of them */
+#define TONEMAP_CURVES(CURVE, SPLIT_CURVE) \
+    CURVE(TONEMAP_None, x) \
+    SPLIT_CURVE(TONEMAP_Reinhard, LT, 0.0, x, x / (1.0 + x)) \
+    CURVE(TONEMAP_Tangent, atan(x) / atan(8.0)) \
+    SPLIT_CURVE(TONEMAP_AlexaLogC, GT, 0.010591, (0.247190 * log10(5.555556 * x + 0.052272) + 0.385537), (5.367655 * x + 0.092809)) \
+    CURVE(TONEMAP_CineonLog, ((log10(x * (1.0 - 0.0108) + 0.0108)) * 300.0 + 685.0) / 1023.0) \
+    SPLIT_CURVE(TONEMAP_SonySLog, GE, 0.01125000, (420.0 + log10((x + 0.01) / (0.18 + 0.01)) * 261.5) / 1023.0, (x * (171.2102946929 - 95.0) / 0.01125000 + 95.0) / 1023.0) \
+    SPLIT_CURVE(TONEMAP_sRGB, LT, 0.0031308, x * 12.92, (1.055 * pow(x, 1.0 / 2.4)) -0.055) \
+    SPLIT_CURVE(TONEMAP_Rec709, LE, 0.018, (x * 4.5), 1.099 * pow( x, (0.45) ) - 0.099) \
+    SPLIT_CURVE(TONEMAP_HLG, LE, 1.0, (sqrt(x) * 0.5), 0.17883277 * log(x - 0.28466892) + 0.55991073) \
+    SPLIT_CURVE(TONEMAP_DavinciIntermediate, LE, 0.00262409, (x * 10.44426855), (log10(x + 0.0075) / log10(2) + 7.0) * 0.07329248) \
+    SPLIT_CURVE(TONEMAP_Reinhard_3_5, LT, 0.4, x, (((x-0.4)/0.6) / (1.0 + ((x-0.4)/0.6)))*0.6 + 0.4) \
+    CURVE(TONEMAP_CanonLog, (0.529136 * (log10 ( 10.1596 * x + 1 ))) + 0.0730597) \
+    SPLIT_CURVE(TONEMAP_PanasonicVLog, GE, 0.01, (0.241514 * log10(x + 0.00873) + 0.598206), (5.6 * x + 0.125))
+
+#define TONEMAP_COMPARISON_LT "<"
+#define TONEMAP_COMPARISON_LE "<="
+#define TONEMAP_COMPARISON_GT ">"
+#define TONEMAP_COMPARISON_GE ">="
+/* 1 if the first branch is the one for x at or above the split */
+#define TONEMAP_UPPER_FIRST_LT 0
+#define TONEMAP_UPPER_FIRST_LE 0
+#define TONEMAP_UPPER_FIRST_GT 1
+#define TONEMAP_UPPER_FIRST_GE 1
+
+#define TONEMAP_STRING(id, expression) { id, #expression },
+#define TONEMAP_SPLIT_STRING(id, comparison, split, a, b) { id, "(x " TONEMAP_COMPARISON_##comparison " " #split ") ? " #a " : " #b },
+
 static tonemap_func_t tonemap_function_strings[] = {
-    { TONEMAP_None, "x" },
-    { TONEMAP_Reinhard, "(x < 0.0) ? x : x / (1.0 + x)" },
-    { TONEMAP_Tangent, "atan(x) / atan(8.0)" },
-    { TONEMAP_AlexaLogC, "(x > 0.010591) ? (0.247190 * log10(5.555556 * x + 0.052272) + 0.385537) : (5.367655 * x + 0.092809)" },
-    { TONEMAP_CineonLog, "((log10(x * (1.0 - 0.0108) + 0.0108)) * 300.0 + 685.0) / 1023.0" },
-    { TONEMAP_SonySLog, "(x >= 0.01125000) ? (420.0 + log10((x + 0.01) / (0.18 + 0.01)) * 261.5) / 1023.0 : (x * (171.2102946929 - 95.0) / 0.01125000 + 95.0) / 1023.0" },
-    { TONEMAP_sRGB, "(x < 0.0031308) ? x * 12.92 : (1.055 * pow(x, 1.0 / 2.4)) -0.055" },
-    { TONEMAP_Rec709, "(x <= 0.018) ? (x * 4.5) : 1.099 * pow( x, (0.45) ) - 0.099" },
-    { TONEMAP_HLG, "(x <= 1.0) ? (sqrt(x) * 0.5) : 0.17883277 * log(x - 0.28466892) + 0.55991073" },
-    { TONEMAP_DavinciIntermediate, "(x <= 0.00262409) ? (x * 10.44426855) : (log10(x + 0.0075) / log10(2) + 7.0) * 0.07329248" },
-    { TONEMAP_Reinhard_3_5, "(x < 0.4) ? x : (((x-0.4)/0.6) / (1.0 + ((x-0.4)/0.6)))*0.6 + 0.4" },
-    { TONEMAP_CanonLog, "(0.529136 * (log10 ( 10.1596 * x + 1 ))) + 0.0730597" },
-    { TONEMAP_PanasonicVLog, "(x >= 0.01) ? (0.241514 * log10(x + 0.00873) + 0.598206) : (5.6 * x + 0.125)" }
+    TONEMAP_CURVES(TONEMAP_STRING, TONEMAP_SPLIT_STRING)
 };
 
 char * get_tonemap_func_string(int id)
@@ -196,6 +216,43 @@ char * get_tonemap_func_string(int id)
     return tonemap_function_strings[index].string;
 }
 
+/* The strings above evaluated the way tinyexpr does it, so lookup tables can skip
+ * the interpreter and come out the same: ternaries turn in to split(), which
+ * makes '<=' act like '<' and '>' take the upper branch at the split value, and
+ * log is log10. Split values are rounded to six decimals as compile_ternary
+ * prints them. Returns NAN for ids without a string */
+#define TONEMAP_FUNCTION(id, expression) case id: return (expression);
+#define TONEMAP_SPLIT_FUNCTION(id, comparison, split, a, b) \
+    case id: return ((x >= round(split * 1000000.0) / 1000000.0) == TONEMAP_UPPER_FIRST_##comparison) ? (a) : (b);
+
+/* tinyexpr does every operation as its own call, no fused multiply-add */
+#if defined(__GNUC__) && !defined(__clang__)
+__attribute__((optimize("fp-contract=off")))
+#endif
+double tonemap_string_function(int id, double x)
+{
+#ifdef __clang__
+    #pragma STDC FP_CONTRACT OFF
+#endif
+    #define log log10
+    switch (id)
+    {
+        TONEMAP_CURVES(TONEMAP_FUNCTION, TONEMAP_SPLIT_FUNCTION)
+        default: return NAN;
+    }
+    #undef log
+}
+
+/* Tonemap id whose string is exactly function, -1 if none */
+int find_tonemap_func_string(const char * function)
+{
+    for (unsigned long i = 0; i < sizeof(tonemap_function_strings)/sizeof(tonemap_function_strings[0]); ++i)
+    {
+        if (strcmp(function, tonemap_function_strings[i].string) == 0) return tonemap_function_strings[i].id;
+    }
+    return -1;
+}
+
 static void * tonemap_functions[] =
 {
     (void *)&NoTonemap,
@@ -7,6 +7,8 @@
 
 #include "tinyexpr/tinyexpr.h"
 
+#include <pthread.h>
+
 enum transform { TR_NONE, TR_ROT180 };
 
 typedef struct {
@@ -26,6 +28,18 @@ typedef struct {
     lut_t * lut;
     int lut_on;
 
+    /* PROCESSING_DIRTY_* tables that setters changed the inputs of, rebuilt by processing_update_tables */
+    uint32_t dirty_tables;
+    /* Held (recursively) by setters while they write, by table rebuilds and by render workers copying the settings */
+    pthread_mutex_t tables_mutex;
+
+    /* Bumped by every setter, render workers copy the settings again when it has moved */
+    uint32_t generation;
+    /* Idle render workers (private copies of this object), kept between frames */
+    struct processing_worker * workers;
+    pthread_mutex_t workers_mutex;
+    /* (render workers copy everything but tables_mutex .. workers_mutex) */
+
     /* If whitebalance find algorithm is on the run, we need it only for one single RGB -> faster */
     int wbFindActive;
     uint16_t wbR, wbG, wbB;
@@ -112,6 +126,9 @@ typedef struct {
         processing_buffer_t * blur_image;
     } shadows_highlights;
 
+    /* Recursive bilateral filter for shadows/highlights and RBF denoiser, keeps its buffers between frames */
+    void * rbf;
+
     /* White balance */
     double     kelvin; /* from 2500 to 10000 */
     double     wb_tint; /* from -10 to +10 PLEAZ */
@@ -225,7 +242,18 @@ typedef struct {
     double x_value;
     te_variable x_variable;
     te_expr * transfer_function;
+    te_program * transfer_program; /* Flattened transfer_function, for building the tables */
+    int transfer_native; /* TONEMAP_* when the function is a built in curve, run without tinyexpr, -1 otherwise */
+    double transfer_native_gamma; /* Power on top of the built in curve */
 
 } processingObject_t;
 
+/* What one render works on: a copy of the processing object as of 'generation'. The copy
+ * has its own matrices, blur image and bilateral filter, everything else it only reads */
+typedef struct processing_worker {
+    processingObject_t * processing;
+    uint32_t generation;
+    struct processing_worker * next;
+} processing_worker_t;
+
 #endif
@@ -1,9 +1,11 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <math.h>
 #include <pthread.h>
+#include <unistd.h>
 #include <ctype.h>
 #include "blur_threaded.h"
 #include "tinyexpr/tinyexpr.h"
@@ -117,6 +119,7 @@ processingObject_t * initProcessingObject()
     /* Blur buffer images (may change size) */
     processing->shadows_highlights.blur_image = new_image_buffer();
     buffer_set_size(processing->shadows_highlights.blur_image, 2, 2); /* Fix craxh */
+    processing->rbf = init_recursive_bf();
 
     double rgb_to_YCbCr[7] = {  0.299000,  0.587000,  0.114000,
                                -0.168736, -0.331264, /* 0.5 */
@@ -148,6 +151,15 @@ processingObject_t * initProcessingObject()
     processing->x_variable.address = &processing->x_value;
     processing->x_variable.name = "x";
     processing->x_variable.context = 0;
+    processing->transfer_program = NULL;
+    processing->transfer_native = -1;
+    pthread_mutexattr_t tables_mutex_attr;
+    pthread_mutexattr_init(&tables_mutex_attr);
+    pthread_mutexattr_settype(&tables_mutex_attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&processing->tables_mutex, &tables_mutex_attr);
+    pthread_mutexattr_destroy(&tables_mutex_attr);
+    processing->workers = NULL;
+    pthread_mutex_init(&processing->workers_mutex, NULL);
 
     /* Gradient */
     processing->gradient_exposure_stops = 0.0;
@@ -202,9 +214,7 @@ processingObject_t * initProcessingObject()
     processingSetImageProfile(processing, PROFILE_TONEMAPPED);
 
     /* Just in case (should be done tho already) */
-    processing_update_matrices(processing);
-    //processing_update_matrices_gradient(processing);
-    processing_update_shadow_highlight_curve(processing);
+    processingMarkDirty(processing, PROCESSING_DIRTY_MATRICES | PROCESSING_DIRTY_SHADOW_HIGHLIGHT);
 
     processingSetToning(processing, 255, 192, 0, 0);
     processingSetCaDesaturate(processing, 0);
@@ -216,13 +226,12 @@ processingObject_t * initProcessingObject()
 
 void processingSetGamut(processingObject_t * processing, int gamut)
 {
+    processingLockSettings(processing);
     processing->colour_gamut = gamut;
     /* This will update everything necessary to enable tonemapping */
     processingSetWhiteBalance(processing, processingGetWhiteBalanceKelvin(processing), processingGetWhiteBalanceTint(processing));
-    processingSetGamma(processing, processing->gamma_power);
-    processingSetGammaGradient(processing, processing->gamma_power);
-    processing_update_matrices(processing);
-    processing_update_matrices_gradient(processing);
+    processingMarkDirty(processing, PROCESSING_DIRTY_GAMMA | PROCESSING_DIRTY_GAMMA_GRADIENT | PROCESSING_DIRTY_MATRICES | PROCESSING_DIRTY_MATRICES_GRADIENT);
+    processingUnlockSettings(processing);
 }
 
 int processingGetGamut(processingObject_t * processing)
@@ -232,12 +241,11 @@ int processingGetGamut(processingObject_t * processing)
 
 void processingSetTonemappingFunction(processingObject_t * processing, int function)
 {
+    processingLockSettings(processing);
     processing->tonemap_function = function;
     /* This will update everything necessary to enable tonemapping */
-    processingSetGamma(processing, processing->gamma_power);
-    processingSetGammaGradient(processing, processing->gamma_power);
-    processing_update_matrices(processing);
-    processing_update_matrices_gradient(processing);
+    processingMarkDirty(processing, PROCESSING_DIRTY_GAMMA | PROCESSING_DIRTY_GAMMA_GRADIENT | PROCESSING_DIRTY_MATRICES | PROCESSING_DIRTY_MATRICES_GRADIENT);
+    processingUnlockSettings(processing);
 }
 
 int processingGetTonemappingFunction(processingObject_t * processing)
@@ -247,6 +255,7 @@ int processingGetTonemappingFunction(processingObject_t * processing)
 
 void processingSetImageProfile(processingObject_t * processing, int imageProfile)
 {
+    processingLockSettings(processing);
     /* Yes, we still have compatibility with old profile system */
     processingGetAllowedCreativeAdjustments(processing) = default_image_profiles[imageProfile].allow_creative_adjustments;
     processingSetGamut(processing, default_image_profiles[imageProfile].colour_gamut);
@@ -255,31 +264,36 @@ void processingSetImageProfile(processingObject_t * processing, int imageProfile
     /* This updates matrices, so new gamut will be put to use */
     processingSetWhiteBalance(processing, processingGetWhiteBalanceKelvin(processing), processingGetWhiteBalanceTint(processing));
 
-    processing_update_matrices(processing);
-    processing_update_matrices_gradient(processing);
+    processingMarkDirty(processing, PROCESSING_DIRTY_MATRICES | PROCESSING_DIRTY_MATRICES_GRADIENT);
+    processingUnlockSettings(processing);
 }
 
 /* Takes those matrices I learned about on the forum */
 void processingSetCamMatrix(processingObject_t * processing, double * camMatrix, double * camMatrixA)
 {
+    processingLockSettings(processing);
     memcpy(processing->cam_matrix, camMatrix, sizeof(double) * 9);
     memcpy(processing->cam_matrix_A, camMatrixA, sizeof(double) * 9);
     /* TO update matrices really argh so much confusion :( */
     processingSetWhiteBalance(processing, processingGetWhiteBalanceKelvin(processing), processingGetWhiteBalanceTint(processing));
     /* Calculates final main matrix */
-    processing_update_matrices(processing);
-    if( processing->gradient_enable != 0 ) processing_update_matrices_gradient(processing);
+    processingMarkDirty(processing, PROCESSING_DIRTY_MATRICES | PROCESSING_DIRTY_MATRICES_GRADIENT);
+    processingUnlockSettings(processing);
 }
 
 void processingSetHighlights(processingObject_t * processing, double value)
 {
+    processingLockSettings(processing);
     processing->shadows_highlights.highlights = value;
-    processing_update_shadow_highlight_curve(processing);
+    processingMarkDirty(processing, PROCESSING_DIRTY_SHADOW_HIGHLIGHT);
+    processingUnlockSettings(processing);
 }
 void processingSetShadows(processingObject_t * processing, double value)
 {
+    processingLockSettings(processing);
     processing->shadows_highlights.shadows = value;
-    processing_update_shadow_highlight_curve(processing);
+    processingMarkDirty(processing, PROCESSING_DIRTY_SHADOW_HIGHLIGHT);
+    processingUnlockSettings(processing);
 }
 
 void processing_update_shadow_highlight_curve(processingObject_t * processing)
@@ -308,14 +322,18 @@ void processing_update_shadow_highlight_curve(processingObject_t * processing)
 
 void processingSetSimpleContrast(processingObject_t * processing, double value)
 {
+    processingLockSettings(processing);
     processing->contrast = value * 0.65;
-    processing_update_contrast_curve(processing);
+    processingMarkDirty(processing, PROCESSING_DIRTY_CONTRAST);
+    processingUnlockSettings(processing);
 }
 
 void processingSetPivot(processingObject_t * processing, double value)
 {
+    processingLockSettings(processing);
     processing->pivot = value;
-    processing_update_contrast_curve(processing);
+    processingMarkDirty(processing, PROCESSING_DIRTY_CONTRAST);
+    processingUnlockSettings(processing);
 }
 
 void processing_update_contrast_curve(processingObject_t * processing)
@@ -344,8 +362,10 @@ void processing_update_contrast_curve(processingObject_t * processing)
 
 void processingSetSimpleContrastGradient(processingObject_t * processing, double value)
 {
+    processingLockSettings(processing);
     processing->gradient_contrast = value * 0.65;
-    processing_update_contrast_curve_gradient(processing);
+    processingMarkDirty(processing, PROCESSING_DIRTY_CONTRAST_GRADIENT);
+    processingUnlockSettings(processing);
 }
 
 void processing_update_contrast_curve_gradient(processingObject_t * processing)
@@ -374,9 +394,11 @@ void processing_update_contrast_curve_gradient(processingObject_t * processing)
 
 void processingSetClarity(processingObject_t * processing, double value)
 {
+    processingLockSettings(processing);
     if( value < 0 ) value /= 2.0;
     processing->clarity = value;
-    processing_update_clarity_curve(processing);
+    processingMarkDirty(processing, PROCESSING_DIRTY_CLARITY);
+    processingUnlockSettings(processing);
 }
 
 void processing_update_clarity_curve(processingObject_t * processing)
@@ -412,7 +434,132 @@ void processing_object_thread(apply_processing_parameters_t * p)
                              p->outputImage,
                              p->blurImage,
                              p->gradientMask,
-                             p->vignetteMask );
+                             p->vignetteMask,
+                             p->vignetteEnd );
+}
+
+/* Sharpens rows y_start to y_end-1. With masking the sobel edge mask is made
+ * row by row from a ring of three gray rows, no frame sized buffers needed */
+void sharpen_thread(sharpen_parameters_t * p)
+{
+    processingObject_t * processing = p->processing;
+    uint16_t * inputImage = p->inputImage;
+    uint16_t * outputImage = p->outputImage;
+    int imageX = p->imageX;
+    int masking = processing->sh_masking > 0;
+
+    uint32_t y_max = p->imageY - 1;
+    uint32_t x_max = (imageX - 1) * 3; /* X in multiples of 3 for RGB */
+
+    /* Center and outter lut */
+    uint32_t * ka = processing->pre_calc_sharp_a;
+    uint16_t * kx = processing->pre_calc_sharp_x;
+    uint16_t * ky = processing->pre_calc_sharp_y;
+
+    /* Row length elements */
+    uint32_t rl = imageX * 3;
+
+    /* Gray row r lives in gray[r % 3], the zero row stands in above and below the image */
+    uint16_t * mask_mem = NULL, * zero_row = NULL, * gray[3] = { NULL, NULL, NULL }, * cont_row = NULL;
+    if (masking)
+    {
+        mask_mem = calloc(imageX * 5, sizeof(uint16_t));
+        zero_row = mask_mem;
+        for (int i = 0; i < 3; ++i) gray[i] = mask_mem + imageX * (i+1);
+        cont_row = mask_mem + imageX * 4;
+
+        if (p->y_start > 0) rgbRowToGray(inputImage + (p->y_start-1) * rl, gray[(p->y_start-1) % 3], imageX);
+        rgbRowToGray(inputImage + p->y_start * rl, gray[p->y_start % 3], imageX);
+    }
+
+    for (uint32_t y = p->y_start; y < (uint32_t)p->y_end; ++y)
+    {
+        uint16_t * out_row = outputImage + (y * rl); /* current row ouptut */
+        uint16_t * row = inputImage + (y * rl); /* current row */
+        uint16_t * p_row;
+        if( y == 0 ) p_row = row;        /* minimize border artifact */
+        else p_row = inputImage + ((y-1) * rl); /* previous */
+
+        uint16_t * n_row;
+        if( y == y_max ) n_row = row;    /* minimize border artifact */
+        else n_row = inputImage + ((y+1) * rl); /* next */
+
+        if( masking )
+        {
+            if( y < y_max ) rgbRowToGray(n_row, gray[(y+1) % 3], imageX);
+            sobelContourRow( (y > 0) ? gray[(y-1) % 3] : zero_row,
+                             gray[y % 3],
+                             (y < y_max) ? gray[(y+1) % 3] : zero_row,
+                             cont_row, imageX );
+        }
+
+        for (uint32_t x = 3+p->sharp_start; x < x_max; x+=p->sharp_skip)
+        {
+            int32_t sharp = ka[row[x]]
+                          - ky[p_row[x]]
+                          - ky[n_row[x]]
+                          - kx[row[x-3]]
+                          - kx[row[x+3]];
+
+            /* use the edge mask for sharpening only edges */
+            if( masking )
+            {
+                uint32_t x1 = x / 3;
+                /* more contrast & brightness for mask */
+                uint32_t maskIntensity = 15000;
+                uint32_t cont = cont_row[x1] + (100-(uint32_t)processing->sh_masking) * 150;
+                if( cont > maskIntensity ) cont = maskIntensity;
+                /* calc output in dependency to mask slider */
+                out_row[x] = LIMIT16( ( cont / (float)maskIntensity) * LIMIT16(sharp)
+                                  + ( ( maskIntensity - cont ) / (float)maskIntensity ) * row[x] );
+                /* Show mask */
+                //out_row[x] = LIMIT16(cont/(float)maskIntensity*65535.0);
+            }
+            /* sharpen all */
+            else
+            {
+                out_row[x] = LIMIT16(sharp);
+            }
+        }
+
+        /* Edge pixels (basically don't do any changes to them) */
+        out_row[0] = row[0];
+        out_row[1] = row[1];
+        out_row[2] = row[2];
+        out_row += rl;
+        row += rl;
+        out_row[-3] = row[-3];
+        out_row[-2] = row[-2];
+        out_row[-1] = row[-1];
+    }
+
+    free(mask_mem);
+}
+
+/* Picks the samples of a whole frame mask that line up with a region, one per region pixel
+ * (plus a spare one, the vignette loop reads one ahead) */
+static void * get_region_mask( void * mask, size_t element,
+                               int frameX, int frameY,
+                               int regionX, int regionY, int regionW, int regionH,
+                               int imageX, int imageY )
+{
+    uint8_t * region_mask = calloc(imageX * imageY + 1, element);
+    if (!mask) return region_mask;
+
+    for (int y = 0; y < imageY; ++y)
+    {
+        int fy = MIN(MAX(regionY + (int)(((2 * y + 1) * (int64_t)regionH) / (2 * imageY)), 0), frameY - 1);
+        uint8_t * out = region_mask + (size_t)y * imageX * element;
+        uint8_t * row = (uint8_t *)mask + (size_t)fy * frameX * element;
+
+        for (int x = 0; x < imageX; ++x)
+        {
+            int fx = MIN(MAX(regionX + (int)(((2 * x + 1) * (int64_t)regionW) / (2 * imageX)), 0), frameX - 1);
+            memcpy(out + x * element, row + fx * element, element);
+        }
+    }
+
+    return region_mask;
 }
 
 /* Apply it with multiple threads */
@@ -422,6 +569,152 @@ void applyProcessingObject( processingObject_t * processing,
                             uint16_t * __restrict outputImage,
                             int threads, int imageChanged, uint64_t frameIndex )
 {
+    applyProcessingObjectRegion( processing,
+                                 imageX, imageY,
+                                 0, 0, imageX, imageY,
+                                 imageX, imageY,
+                                 inputImage, outputImage,
+                                 threads, imageChanged, frameIndex );
+}
+
+/* Brings a worker up to the current settings, the buffers it owns stay */
+static void processing_sync_worker(processingObject_t * processing, processing_worker_t * worker)
+{
+    uint32_t generation = __atomic_load_n(&processing->generation, __ATOMIC_ACQUIRE);
+    if (worker->generation == generation) return;
+
+    processingObject_t * copy = worker->processing;
+    int32_t * matrix[9], * matrix_gradient[9];
+    memcpy(matrix, copy->pre_calc_matrix, sizeof(matrix));
+    memcpy(matrix_gradient, copy->pre_calc_matrix_gradient, sizeof(matrix_gradient));
+    processing_buffer_t * blur_image = copy->shadows_highlights.blur_image;
+    void * rbf = copy->rbf;
+
+    /* Tables for whatever settings changed since the last frame, built and copied in one go
+     * so no setter gets in between and leaves the copy with settings newer than its tables */
+    pthread_mutex_lock(&processing->tables_mutex);
+    processing_update_tables(processing);
+    /* Everything but the locks, the generation and the idle worker list, those are not
+     * settings and change under other locks */
+    memcpy(copy, processing, offsetof(processingObject_t, tables_mutex));
+    memcpy((char *)copy + offsetof(processingObject_t, wbFindActive), (char *)processing + offsetof(processingObject_t, wbFindActive),
+           sizeof(processingObject_t) - offsetof(processingObject_t, wbFindActive));
+    for (int i = 0; i < 9; ++i) memcpy(matrix[i], processing->pre_calc_matrix[i], 65536 * sizeof(int32_t));
+    if (processing->gradient_enable)
+        for (int i = 0; i < 9; ++i) memcpy(matrix_gradient[i], processing->pre_calc_matrix_gradient[i], 65536 * sizeof(int32_t));
+    pthread_mutex_unlock(&processing->tables_mutex);
+
+    memcpy(copy->pre_calc_matrix, matrix, sizeof(matrix));
+    memcpy(copy->pre_calc_matrix_gradient, matrix_gradient, sizeof(matrix_gradient));
+    copy->shadows_highlights.blur_image = blur_image;
+    copy->rbf = rbf;
+    /* Tables are already built, the copy must never touch the transfer function or the locks */
+    copy->dirty_tables = 0;
+    copy->workers = NULL;
+
+    worker->generation = generation;
+}
+
+static processing_worker_t * processing_get_worker(processingObject_t * processing)
+{
+    pthread_mutex_lock(&processing->workers_mutex);
+    processing_worker_t * worker = processing->workers;
+    if (worker) processing->workers = worker->next;
+    pthread_mutex_unlock(&processing->workers_mutex);
+
+    if (worker == NULL)
+    {
+        worker = malloc(sizeof(processing_worker_t));
+        worker->processing = malloc(sizeof(processingObject_t));
+        for (int i = 0; i < 9; ++i)
+        {
+            worker->processing->pre_calc_matrix[i] = malloc(65536 * sizeof(int32_t));
+            worker->processing->pre_calc_matrix_gradient[i] = malloc(65536 * sizeof(int32_t));
+        }
+        worker->processing->shadows_highlights.blur_image = new_image_buffer();
+        buffer_set_size(worker->processing->shadows_highlights.blur_image, 2, 2);
+        worker->processing->rbf = init_recursive_bf();
+        worker->generation = __atomic_load_n(&processing->generation, __ATOMIC_RELAXED) - 1;
+    }
+
+    processing_sync_worker(processing, worker);
+    return worker;
+}
+
+static void processing_put_worker(processingObject_t * processing, processing_worker_t * worker)
+{
+    pthread_mutex_lock(&processing->workers_mutex);
+    worker->next = processing->workers;
+    processing->workers = worker;
+    pthread_mutex_unlock(&processing->workers_mutex);
+}
+
+static void free_processing_worker(processing_worker_t * worker)
+{
+    for (int i = 8; i >= 0; --i) free(worker->processing->pre_calc_matrix[i]);
+    for (int i = 8; i >= 0; --i) free(worker->processing->pre_calc_matrix_gradient[i]);
+    free_image_buffer(worker->processing->shadows_highlights.blur_image);
+    free_recursive_bf(worker->processing->rbf);
+    free(worker->processing);
+    free(worker);
+}
+
+static void apply_processing_object_region( processingObject_t * processing,
+                                            int frameX, int frameY,
+                                            int regionX, int regionY, int regionW, int regionH,
+                                            int imageX, int imageY,
+                                            uint16_t * __restrict inputImage,
+                                            uint16_t * __restrict outputImage,
+                                            int threads, int imageChanged, uint64_t frameIndex );
+
+/* Every call renders on its own worker, so frames can be processed in parallel and
+ * setters called meanwhile only show up from the next frame on */
+void applyProcessingObjectRegion( processingObject_t * processing,
+                                  int frameX, int frameY,
+                                  int regionX, int regionY, int regionW, int regionH,
+                                  int imageX, int imageY,
+                                  uint16_t * __restrict inputImage,
+                                  uint16_t * __restrict outputImage,
+                                  int threads, int imageChanged, uint64_t frameIndex )
+{
+    processing_worker_t * worker = processing_get_worker(processing);
+    apply_processing_object_region( worker->processing,
+                                    frameX, frameY,
+                                    regionX, regionY, regionW, regionH,
+                                    imageX, imageY,
+                                    inputImage, outputImage,
+                                    threads, imageChanged, frameIndex );
+    processing_put_worker(processing, worker);
+}
+
+static void apply_processing_object_region( processingObject_t * processing,
+                                            int frameX, int frameY,
+                                            int regionX, int regionY, int regionW, int regionH,
+                                            int imageX, int imageY,
+                                            uint16_t * __restrict inputImage,
+                                            uint16_t * __restrict outputImage,
+                                            int threads, int imageChanged, uint64_t frameIndex )
+{
+    /* Masks are made for the whole frame */
+    uint16_t * gradient_mask = processing->gradient_mask;
+    float * vignette_mask = processing->vignette_mask;
+    float * vignette_end = processing->vignette_end;
+    int whole_frame = (regionX == 0 && regionY == 0 && regionW == frameX && regionH == frameY
+                    && imageX == frameX && imageY == frameY);
+    if (!whole_frame && processing->gradient_enable)
+    {
+        gradient_mask = get_region_mask(processing->gradient_mask, sizeof(uint16_t), frameX, frameY, regionX, regionY, regionW, regionH, imageX, imageY);
+    }
+    if (!whole_frame && processing->vignette_strength != 0)
+    {
+        vignette_mask = get_region_mask(processing->vignette_mask, sizeof(float), frameX, frameY, regionX, regionY, regionW, regionH, imageX, imageY);
+        vignette_end = vignette_mask + (imageX * imageY);
+    }
+
+    /* Bilateral filter sizes are relative to image size, keep them relative to the frame
+     * (exact if the region has the frame's aspect ratio, close enough otherwise) */
+    float sigma_scale = sqrtf( ((float)frameX * frameY) / ((float)regionW * regionH) );
+
     /* Do transformation */
     get_frame_transformed(processing, inputImage, imageX, imageY);
 
@@ -453,11 +746,12 @@ void applyProcessingObject( processingObject_t * processing,
             //blur_image(get_buffer(processing->shadows_highlights.blur_image), outputImage, imageX, imageY, blur_radius, 1, 1, 1, 0, imageY-1);
             if(0) blur_image_threaded( get_buffer(processing->shadows_highlights.blur_image), outputImage, imageX, imageY, blur_radius, threads );
             else
-                recursive_bf_wrap(
+                recursive_bf_threaded(
+                        processing->rbf,
                         inputImage,
                         get_buffer(processing->shadows_highlights.blur_image),
-                        0.0005f, 0.075f+(((float)100.0-40.0f)/666.6f),
-                        imageX, imageY, 3);
+                        0.0005f * sigma_scale, 0.075f+(((float)100.0-40.0f)/666.6f),
+                        imageX, imageY, 3, threads);
 
             /* Apply basic levels */
             int img_s = imageX * imageY * 3;
@@ -473,7 +767,7 @@ void applyProcessingObject( processingObject_t * processing,
     /* If threads is 1, no threads are needed */
     if (threads == 1)
     {
-        apply_processing_object(processing, imageX, imageY, inputImage, outputImage, get_buffer(processing->shadows_highlights.blur_image), processing->gradient_mask, processing->vignette_mask);
+        apply_processing_object(processing, imageX, imageY, inputImage, outputImage, get_buffer(processing->shadows_highlights.blur_image), gradient_mask, vignette_mask, vignette_end);
     }
     else
     {
@@ -493,8 +787,9 @@ void applyProcessingObject( processingObject_t * processing,
             params[t].inputImage = inputImage + offset_chunk*t;
             params[t].outputImage = outputImage + offset_chunk*t;
             params[t].blurImage = get_buffer(processing->shadows_highlights.blur_image) + offset_chunk*t;
-            params[t].gradientMask = processing->gradient_mask + (imageX * chunk_size * t);
-            params[t].vignetteMask = processing->vignette_mask + (imageX * chunk_size * t);
+            params[t].gradientMask = gradient_mask + (imageX * chunk_size * t);
+            params[t].vignetteMask = vignette_mask + (imageX * chunk_size * t);
+            params[t].vignetteEnd = vignette_end;
         }
 
         /* To make sure bottom is processed */
@@ -525,11 +820,12 @@ void applyProcessingObject( processingObject_t * processing,
     {
         int img_s = imageX * imageY * 3;
         memcpy( inputImage, outputImage, img_s * sizeof(uint16_t) );
-        recursive_bf_wrap(
+        recursive_bf_threaded(
+                processing->rbf,
                 inputImage,
                 outputImage,
-                0.0025f, 0.075f+(((float)processing->rbfDenoiserRange-40.0f)/666.6f),
-                imageX, imageY, 3);
+                0.0025f * sigma_scale, 0.075f+(((float)processing->rbfDenoiserRange-40.0f)/666.6f),
+                imageX, imageY, 3, threads);
 
         float outL = processing->rbfDenoiserLuma/100.0;
         float inL = 1.0 - outL;
@@ -585,96 +881,31 @@ void applyProcessingObject( processingObject_t * processing,
 
     if (processingGetSharpening(processing) > 0.005)
     {
-        /* Use sobel filter to create a edge mask */
-        uint16_t *gray,
-             *sobel_h_res,
-             *sobel_v_res,
-             *contour_img;
-        if( processing->sh_masking > 0 ) sobelFilter( inputImage, &gray, &sobel_h_res, &sobel_v_res, &contour_img, imageX, imageY );
-
         /* Avoid gaps in pixels if skipping pixels during sharpen */
         if (sharp_skip != 1) memcpy(outputImage, inputImage, img_s * sizeof(uint16_t));
 
-        uint32_t y_max = imageY - 1;
-        uint32_t x_max = (imageX - 1) * 3; /* X in multiples of 3 for RGB */
-
-        /* Center and outter lut */
-        uint32_t * ka = processing->pre_calc_sharp_a;
-        uint16_t * kx = processing->pre_calc_sharp_x;
-        uint16_t * ky = processing->pre_calc_sharp_y;
-
-        /* Row length elements */
-        uint32_t rl = imageX * 3;
-
-#pragma omp parallel for
-        for (uint32_t y = 0; y < y_max+1; ++y)
+        if (threads == 1)
+        {
+            sharpen_parameters_t param = { processing, imageX, imageY, inputImage, outputImage, sharp_start, sharp_skip, 0, imageY };
+            sharpen_thread(&param);
+        }
+        else
         {
-            uint16_t * out_row = outputImage + (y * rl); /* current row ouptut */
-            uint16_t * row = inputImage + (y * rl); /* current row */
-            uint16_t * p_row;
-            if( y == 0 ) p_row = row;        /* minimize border artifact */
-            else p_row = inputImage + ((y-1) * rl); /* previous */
-
-            uint16_t * n_row;
-            if( y == y_max ) p_row = row;    /* minimize border artifact */
-            else n_row = inputImage + ((y+1) * rl); /* next */
-
-            uint16_t * cont_row;
-            if( processing->sh_masking > 0 )
+            sharpen_parameters_t * params = alloca(sizeof(sharpen_parameters_t) * threads);
+            pthread_t * threadid = alloca(threads * sizeof(pthread_t));
+
+            /* Bands of rows, last one takes what is left */
+            int chunk_size = imageY/threads;
+            for (int t = 0; t < threads; ++t)
             {
-                cont_row = contour_img + (y * imageX);
+                params[t] = (sharpen_parameters_t) { processing, imageX, imageY, inputImage, outputImage, sharp_start, sharp_skip,
+                                                     chunk_size * t, (t == threads-1) ? imageY : chunk_size * (t+1) };
+                pthread_create(&threadid[t], NULL, (void *)&sharpen_thread, (void *)(params + t));
             }
-
-            for (uint32_t x = 3+sharp_start; x < x_max; x+=sharp_skip)
+            for (int t = 0; t < threads; ++t)
             {
-                int32_t sharp = ka[row[x]]
-                              - ky[p_row[x]]
-                              - ky[n_row[x]]
-                              - kx[row[x-3]]
-                              - kx[row[x+3]];
-
-                /* use the edge mask for sharpening only edges */
-                if( processing->sh_masking > 0 )
-                {
-                    uint32_t x1 = x / 3;
-                    /* more contrast & brightness for mask */
-                    uint32_t maskIntensity = 15000;
-                    uint32_t cont = cont_row[x1] + (100-(uint32_t)processing->sh_masking) * 150;
-                    if( cont > maskIntensity ) cont = maskIntensity;
-                    /* calc output in dependency to mask slider */
-                    out_row[x] = LIMIT16( ( cont / (float)maskIntensity) * LIMIT16(sharp)
-                                      + ( ( maskIntensity - cont ) / (float)maskIntensity ) * row[x] );
-                    /* Show mask */
-                    //out_row[x] = LIMIT16(cont/(float)maskIntensity*65535.0);
-                }
-                /* sharpen all */
-                else
-                {
-                    out_row[x] = LIMIT16(sharp);
-                }
+                pthread_join(threadid[t], NULL);
             }
-
-            /* Edge pixels (basically don't do any changes to them) */
-            out_row[0] = row[0];
-            out_row[1] = row[1];
-            out_row[2] = row[2];
-            out_row += rl;
-            row += rl;
-            out_row[-3] = row[-3];
-            out_row[-2] = row[-2];
-            out_row[-1] = row[-1];
-        }
-
-        /* Copy top and bottom row */
-        //memcpy(outputImage, inputImage, rl * sizeof(uint16_t));
-        //memcpy(outputImage + (rl*(imageY-1)), inputImage + (rl*(imageY-1)), rl * sizeof(uint16_t));
-
-        if( processing->sh_masking > 0 )
-        {
-            if( gray ) free( gray );
-            if( sobel_h_res ) free( sobel_h_res );
-            if( sobel_v_res ) free( sobel_v_res );
-            if( contour_img ) free( contour_img );
         }
     }
     else
@@ -711,6 +942,9 @@ void applyProcessingObject( processingObject_t * processing,
             outputImage[i+2] = LIMIT16( outputImage[i+2] + grain );
         }
     }
+
+    if (gradient_mask != processing->gradient_mask) free(gradient_mask);
+    if (vignette_mask != processing->vignette_mask) free(vignette_mask);
 }
 
 /* Colour tonemap function for smooth gamut mapping */
@@ -724,7 +958,8 @@ void apply_processing_object( processingObject_t * processing,
                               uint16_t * __restrict outputImage,
                               uint16_t * __restrict blurImage,
                               uint16_t * __restrict gradientMask,
-                              float * __restrict vignetteMask )
+                              float * __restrict vignetteMask,
+                              float * __restrict vignetteEnd )
 {
     /* Number of elements */
     int img_s = imageX * imageY * 3;
@@ -768,7 +1003,7 @@ void apply_processing_object( processingObject_t * processing,
         if( processing->vignette_strength != 0 )
         {
             vmpix++;
-            if( vmpix < processing->vignette_end )  /* just safety - sometimes parameters may change faster than processing */
+            if( vmpix < vignetteEnd )  /* just safety - sometimes parameters may change faster than processing */
             {
                 expo_correction *= pow( 1.0 + ( vmpix[0] * processing->vignette_strength / 128.0 ), 4 );
             }
@@ -1294,6 +1529,7 @@ void processingSetContrast( processingObject_t * processing,
                             double LCFactor, /* Light contrast strength */
                             double lighten   /* 0-1 (for good highlight rolloff) */ )
 {
+    processingLockSettings(processing);
     /* Basic things */
     processing->light_contrast_factor = LCFactor;
     processing->light_contrast_range = LCRange;
@@ -1301,66 +1537,81 @@ void processingSetContrast( processingObject_t * processing,
     processing->dark_contrast_range = DCRange;
     processing->lighten = lighten;
 
-    processing_update_curves(processing);
+    processingMarkDirty(processing, PROCESSING_DIRTY_CURVES);
+    processingUnlockSettings(processing);
 }
 
 void processingSetDCRange(processingObject_t * processing, double DCRange)
 {
+    processingLockSettings(processing);
     processing->dark_contrast_range = DCRange;
-    processing_update_curves(processing);
+    processingMarkDirty(processing, PROCESSING_DIRTY_CURVES);
+    processingUnlockSettings(processing);
 }
 void processingSetDCFactor(processingObject_t * processing, double DCFactor)
 {
+    processingLockSettings(processing);
     processing->dark_contrast_factor = DCFactor;
-    processing_update_curves(processing);
+    processingMarkDirty(processing, PROCESSING_DIRTY_CURVES);
+    processingUnlockSettings(processing);
 }
 void processingSetLCRange(processingObject_t * processing, double LCRange) 
 {
+    processingLockSettings(processing);
     processing->light_contrast_range = LCRange;
-    processing_update_curves(processing);
+    processingMarkDirty(processing, PROCESSING_DIRTY_CURVES);
+    processingUnlockSettings(processing);
 }
 void processingSetLCFactor(processingObject_t * processing, double LCFactor)
 {
+    processingLockSettings(processing);
     processing->light_contrast_factor = LCFactor;
-    processing_update_curves(processing);
+    processingMarkDirty(processing, PROCESSING_DIRTY_CURVES);
+    processingUnlockSettings(processing);
 }
 void processingSetLightening(processingObject_t * processing, double lighten)
 {
+    processingLockSettings(processing);
     processing->lighten = lighten;
-    processing_update_curves(processing);
+    processingMarkDirty(processing, PROCESSING_DIRTY_CURVES);
+    processingUnlockSettings(processing);
 }
 
 /* Have a guess what this does */
 void processingSetExposureStops(processingObject_t * processing, double exposureStops)
 {
+    processingLockSettings(processing);
     processing->exposure_stops = exposureStops;
 
-    processingSetGamma(processing, processing->gamma_power);
-    if( processing->gradient_enable != 0 ) processingSetGammaGradient(processing, processing->gamma_power);
-    processing_update_matrices(processing);
-    if( processing->gradient_enable != 0 ) processing_update_matrices_gradient(processing);
+    processingMarkDirty(processing, PROCESSING_DIRTY_GAMMA | PROCESSING_DIRTY_GAMMA_GRADIENT | PROCESSING_DIRTY_MATRICES | PROCESSING_DIRTY_MATRICES_GRADIENT);
+    processingUnlockSettings(processing);
 }
 
 /* Have a guess what this does */
 void processingSetGradientExposure(processingObject_t * processing, double value)
 {
+    processingLockSettings(processing);
     processing->gradient_exposure_stops = value;
 
-    processingSetGamma(processing, processing->gamma_power);
-    processingSetGammaGradient(processing, processing->gamma_power);
-    processing_update_matrices(processing);
-    processing_update_matrices_gradient(processing);
+    processingMarkDirty(processing, PROCESSING_DIRTY_GAMMA | PROCESSING_DIRTY_GAMMA_GRADIENT | PROCESSING_DIRTY_MATRICES | PROCESSING_DIRTY_MATRICES_GRADIENT);
+    processingUnlockSettings(processing);
 }
 
 /* Sets and precalculaes saturation */
 void processingSetSaturation(processingObject_t * processing, double saturationFactor)
 {
+    processingLockSettings(processing);
     processing->saturation = saturationFactor;
+    processingMarkDirty(processing, PROCESSING_DIRTY_SATURATION);
+    processingUnlockSettings(processing);
+}
 
+static void processing_update_saturation(processingObject_t * processing)
+{
     /* Precaluclate for the algorithm */
     for (int i = 0; i < 131072; ++i)
     {
-        double value = (i - 65536) * saturationFactor;
+        double value = (i - 65536) * processing->saturation;
         processing->pre_calc_sat[i] = value;
     }
 }
@@ -1369,12 +1620,18 @@ void processingSetSaturation(processingObject_t * processing, double saturationF
 /* Sets and precalculaes vibrance */
 void processingSetVibrance(processingObject_t *processing, double vibranceFactor)
 {
+    processingLockSettings(processing);
     processing->vibrance = vibranceFactor;
+    processingMarkDirty(processing, PROCESSING_DIRTY_VIBRANCE);
+    processingUnlockSettings(processing);
+}
 
+static void processing_update_vibrance(processingObject_t * processing)
+{
     /* Precaluclate for the algorithm */
     for (int i = 0; i < 131072; ++i)
     {
-        double value = (i - 65536) * vibranceFactor;
+        double value = (i - 65536) * processing->vibrance;
         processing->pre_calc_vibrance[i] = value;
     }
 }
@@ -1383,18 +1640,26 @@ void processingSetVibrance(processingObject_t *processing, double vibranceFactor
 /* Set direction bias */
 void processingSetSharpeningBias(processingObject_t * processing, double bias)
 {
+    processingLockSettings(processing);
     processing->sharpen_bias = bias;
     /* Recalculates everythin */
-    processingSetSharpening(processing, processingGetSharpening(processing));
+    processingMarkDirty(processing, PROCESSING_DIRTY_SHARPEN);
+    processingUnlockSettings(processing);
 }
 
 
 void processingSetSharpening(processingObject_t * processing, double sharpen)
 {
+    processingLockSettings(processing);
     processing->sharpen = sharpen;
+    processingMarkDirty(processing, PROCESSING_DIRTY_SHARPEN);
+    processingUnlockSettings(processing);
+}
 
+static void processing_update_sharpening(processingObject_t * processing)
+{
     /* Anything more than ~0.5 just looks awful */
-    sharpen = pow(sharpen, 1.5) * 0.55;
+    double sharpen = pow(processing->sharpen, 1.5) * 0.55;
 
     double sharpen_x = sharpen * (1.0 - processing->sharpen_bias);
     double sharpen_y = sharpen * (1.0 + processing->sharpen_bias);
@@ -1411,6 +1676,7 @@ void processingSetSharpening(processingObject_t * processing, double sharpen)
 /* Set white balance by kelvin + tint value */
 void processingSetWhiteBalance(processingObject_t * processing, double WBKelvin, double WBTint)
 {
+    processingLockSettings(processing);
     double * p_xyz_to_rgb;
     double * p_ciecam02;
 
@@ -1473,9 +1739,9 @@ void processingSetWhiteBalance(processingObject_t * processing, double WBKelvin,
 
     for (int i = 0; i < 3; ++i) processing->wb_multipliers[i] /= lowest;
 
-    /* White balance is part of the matrix */
-    processing_update_matrices(processing);
-    if( processing->gradient_enable != 0 ) processing_update_matrices_gradient(processing);
+    /* White balance is part of the matrix, the white balance finder needs its few values straight away */
+    if( processing->wbFindActive ) processing_update_matrices(processing);
+    else processingMarkDirty(processing, PROCESSING_DIRTY_MATRICES | PROCESSING_DIRTY_MATRICES_GRADIENT);
 
 
     /****************************** Now generate the matrix for scientific White Balance ******************************/
@@ -1563,6 +1829,7 @@ void processingSetWhiteBalance(processingObject_t * processing, double WBKelvin,
 
     /* Back to sRGB (maybe something wider in future) */
     multiplyMatrices(p_xyz_to_rgb, back_in_XYZ_matrix, processing->proper_wb_matrix);
+    processingUnlockSettings(processing);
 }
 
 /* WB just by kelvin */
@@ -1579,11 +1846,80 @@ void processingSetWhiteBalanceTint(processingObject_t * processing, double WBTin
                                WBTint );
 }
 
+/* Transfer function of one value, built in curves skip tinyexpr */
+static double eval_transfer_function(processingObject_t * processing, double x)
+{
+    if (processing->transfer_native >= 0)
+    {
+        double y = tonemap_string_function(processing->transfer_native, x);
+        return (processing->transfer_native_gamma != 1.0) ? pow(y, processing->transfer_native_gamma) : y;
+    }
+    return te_run(processing->transfer_program, x);
+}
+
+typedef struct {
+    processingObject_t * processing;
+    double exposure_factor;
+    uint16_t * table;
+    int start, end;
+} transfer_table_parameters_t;
+
+static void transfer_table_thread(transfer_table_parameters_t * p)
+{
+    for (int i = p->start; i < p->end; ++i)
+    {
+        /* Tone mapping also (reinhard) */
+        double pixel = (double)i/65535.0;
+        pixel *= p->exposure_factor;
+        pixel = eval_transfer_function(p->processing, pixel) * 65535.0;
+        p->table[i] = LIMIT16(pixel);
+    }
+}
+
+/* Fills a 16 bit transfer function table, split over all cores as this runs on every slider move */
+static void build_transfer_table(processingObject_t * processing, double exposure_factor, uint16_t * table)
+{
+    /* Too complex to flatten, tinyexpr has to do it with its one variable */
+    if (processing->transfer_native < 0 && !processing->transfer_program)
+    {
+        for (int i = 0; i < 65536; ++i)
+        {
+            double pixel = (double)i/65535.0;
+            pixel *= exposure_factor;
+            processing->x_value = pixel;
+            pixel = te_eval(processing->transfer_function) * 65535.0;
+            table[i] = LIMIT16(pixel);
+        }
+        return;
+    }
+
+    int threads = MIN(MAX((int)sysconf(_SC_NPROCESSORS_ONLN), 1), 8);
+    transfer_table_parameters_t * params = alloca(sizeof(transfer_table_parameters_t) * threads);
+    pthread_t * threadid = alloca(threads * sizeof(pthread_t));
+
+    for (int t = 0; t < threads; ++t)
+    {
+        params[t] = (transfer_table_parameters_t) { processing, exposure_factor, table, 65536 * t / threads, 65536 * (t+1) / threads };
+        if (t) pthread_create(&threadid[t], NULL, (void *)&transfer_table_thread, (void *)(params + t));
+    }
+    transfer_table_thread(params);
+    for (int t = 1; t < threads; ++t)
+    {
+        pthread_join(threadid[t], NULL);
+    }
+}
+
 /* Set gamma (Log-ing / tonemapping done here) */
 void processingSetGamma(processingObject_t * processing, double gammaValue)
 {
+    processingLockSettings(processing);
     processing->gamma_power = gammaValue;
+    processingMarkDirty(processing, PROCESSING_DIRTY_GAMMA | PROCESSING_DIRTY_GAMMA_GRADIENT);
+    processingUnlockSettings(processing);
+}
 
+static void processing_update_gamma(processingObject_t * processing)
+{
     /* Needs to be inverse */
     //double gamma = 1.0 / gammaValue;
 
@@ -1591,27 +1927,23 @@ void processingSetGamma(processingObject_t * processing, double gammaValue)
     double exposure_factor = pow(2.0, processing->exposure_stops);
     if (processing->exposure_stops < 0) exposure_factor = 1;
     /* Precalculate the curve */
-    for (int i = 0; i < 65536; ++i)
-    {
-        /* Tone mapping also (reinhard) */
-        double pixel = (double)i/65535.0;
-        pixel *= exposure_factor;
-        processing->x_value = pixel;
-        pixel = te_eval(processing->transfer_function) * 65535.0;
-        pixel = LIMIT16(pixel);
-        processing->pre_calc_gamma[i] = pixel;
-    }
+    build_transfer_table(processing, exposure_factor, processing->pre_calc_gamma);
 
     /* So highlight reconstruction works */
     processing_update_highest_green(processing);
-    processingSetGammaGradient(processing, gammaValue); /* Cool */
 }
 
 /* Set gamma for gradient image part (Log-ing / tonemapping done here) */
 void processingSetGammaGradient(processingObject_t * processing, double gammaValue)
 {
+    processingLockSettings(processing);
     processing->gamma_power = gammaValue;
+    processingMarkDirty(processing, PROCESSING_DIRTY_GAMMA_GRADIENT);
+    processingUnlockSettings(processing);
+}
 
+static void processing_update_gamma_gradient(processingObject_t * processing)
+{
     /* Needs to be inverse */
     //double gamma = 1.0 / gammaValue;
 
@@ -1619,14 +1951,7 @@ void processingSetGammaGradient(processingObject_t * processing, double gammaVal
     double exposure_factor = pow(2.0, processing->exposure_stops+processing->gradient_exposure_stops);
     if (processing->exposure_stops < 0) exposure_factor = 1;
     /* Precalculate the curve */
-    for (int i = 0; i < 65536; ++i)
-    {
-        /* Tone mapping also (reinhard) */
-        double pixel = (double)i/65535.0;
-        pixel *= exposure_factor;
-        processing->x_value = pixel;
-        processing->pre_calc_gamma_gradient[i] = (uint16_t)LIMIT16(65535.0 * te_eval(processing->transfer_function));
-    }
+    build_transfer_table(processing, exposure_factor, processing->pre_calc_gamma_gradient);
 
     /* So highlight reconstruction works */
     processing_update_highest_green_gradient(processing);
@@ -1638,6 +1963,7 @@ void processingSet3WayCorrection( processingObject_t * processing,
                                   double midtoneHue, double midtoneSaturation,
                                   double shadowHue, double shadowSaturation )
 {
+    processingLockSettings(processing);
     processing->highlight_hue = highlightHue;
     processing->highlight_sat = highlightSaturation;
     processing->midtone_hue = midtoneHue;
@@ -1645,13 +1971,15 @@ void processingSet3WayCorrection( processingObject_t * processing,
     processing->shadow_hue = shadowHue;
     processing->shadow_sat = shadowSaturation;
 
-    processing_update_curves(processing);
+    processingMarkDirty(processing, PROCESSING_DIRTY_CURVES);
+    processingUnlockSettings(processing);
 }
 
 /* Set black and white level */
 void processingSetBlackAndWhiteLevel(processingObject_t * processing,
                                       float mlvBlackLevel, int mlvWhiteLevel, int mlvBitDepth )
 {
+    processingLockSettings(processing);
     /* Convert levels to 16bit */
     int bits_shift = 16 - mlvBitDepth;
     if( mlvBlackLevel >= 0 )
@@ -1687,6 +2015,9 @@ void processingSetBlackAndWhiteLevel(processingObject_t * processing,
             processing->pre_calc_levels[i] = 65535;
         }
     }
+
+    processingSettingsChanged(processing);
+    processingUnlockSettings(processing);
 }
 
 /* Cheat functions */
@@ -1708,7 +2039,34 @@ void processingSetWhiteLevel(processingObject_t * processing, int mlvWhiteLevel,
 /* Set transformation */
 void processingSetTransformation(processingObject_t * processing, int transformation)
 {
+    processingLockSettings(processing);
     processing->transformation = transformation;
+    processingSettingsChanged(processing);
+    processingUnlockSettings(processing);
+}
+
+/* Rebuilds what the setters marked, matrices first as the gamma tables read the green clip from them */
+void processing_update_tables(processingObject_t * processing)
+{
+    pthread_mutex_lock(&processing->tables_mutex);
+    uint32_t skip = processing->gradient_enable ? 0 : PROCESSING_DIRTY_GRADIENT;
+    uint32_t dirty = processing->dirty_tables & ~skip;
+    processing->dirty_tables &= ~dirty;
+
+    if (dirty & PROCESSING_DIRTY_MATRICES) processing_update_matrices(processing);
+    if (dirty & PROCESSING_DIRTY_MATRICES_GRADIENT) processing_update_matrices_gradient(processing);
+    if (dirty & PROCESSING_DIRTY_GAMMA) processing_update_gamma(processing);
+    if (dirty & PROCESSING_DIRTY_GAMMA_GRADIENT) processing_update_gamma_gradient(processing);
+    if (dirty & PROCESSING_DIRTY_CURVES) processing_update_curves(processing);
+    if (dirty & PROCESSING_DIRTY_SHADOW_HIGHLIGHT) processing_update_shadow_highlight_curve(processing);
+    if (dirty & PROCESSING_DIRTY_CONTRAST) processing_update_contrast_curve(processing);
+    if (dirty & PROCESSING_DIRTY_CONTRAST_GRADIENT) processing_update_contrast_curve_gradient(processing);
+    if (dirty & PROCESSING_DIRTY_CLARITY) processing_update_clarity_curve(processing);
+    if (dirty & PROCESSING_DIRTY_SATURATION) processing_update_saturation(processing);
+    if (dirty & PROCESSING_DIRTY_VIBRANCE) processing_update_vibrance(processing);
+    if (dirty & PROCESSING_DIRTY_SHARPEN) processing_update_sharpening(processing);
+
+    pthread_mutex_unlock(&processing->tables_mutex);
 }
 
 /* Decomissions a processing object completely(I hope) */
@@ -1723,6 +2081,16 @@ void freeProcessingObject(processingObject_t * processing)
     for (int i = 6; i >= 0; --i) free(processing->cs_zone.pre_calc_rgb_to_YCbCr[i]);
     for (int i = 3; i >= 0; --i) free(processing->cs_zone.pre_calc_YCbCr_to_rgb[i]);
     free_image_buffer(processing->shadows_highlights.blur_image);
+    free_recursive_bf(processing->rbf);
+    te_program_free(processing->transfer_program);
+    while (processing->workers)
+    {
+        processing_worker_t * worker = processing->workers;
+        processing->workers = worker->next;
+        free_processing_worker(worker);
+    }
+    pthread_mutex_destroy(&processing->workers_mutex);
+    pthread_mutex_destroy(&processing->tables_mutex);
     free(processing);
 }
 
@@ -1732,6 +2100,9 @@ void processingFindWhiteBalance(processingObject_t *processing, int imageX, int
     /* Number of elements */
     int img_s = imageX * imageY * 3;
 
+    /* Levels and gamma are read below */
+    processing_update_tables(processing);
+
     /* (for shorter code) */
     int32_t ** pm = processing->pre_calc_matrix;
     uint16_t * img = inputImage;
@@ -1781,7 +2152,9 @@ void processingFindWhiteBalance(processingObject_t *processing, int imageX, int
         pixB *= 1.0 / (2817.0 / 6069 * 1.678);
     }
 
-    /* activate quick matrix build (we need matrix just for this RGB values) */
+    /* activate quick matrix build (we need matrix just for this RGB values), render
+     * workers must not copy the settings until they are set back */
+    processingLockSettings(processing);
     processing->wbR = pixR;
     processing->wbG = pixG;
     processing->wbB = pixB;
@@ -1845,6 +2218,7 @@ void processingFindWhiteBalance(processingObject_t *processing, int imageX, int
 
     /* set it back to where we began */
     processingSetWhiteBalance( processing, (double)oriTemp, (double)oriTint );
+    processingUnlockSettings(processing);
 
     /* give the GUI what it wanted */
     *wbTemp = nearestTemp;
@@ -1854,6 +2228,7 @@ void processingFindWhiteBalance(processingObject_t *processing, int imageX, int
 /* Vignette Mask Creation */
 void processingSetVignetteMask(processingObject_t *processing, uint16_t width, uint16_t height, float radius, float shape, float xStretch, float yStretch)
 {
+    processingLockSettings(processing);
     double wHalf = width / 2.0;
     double hHalf = height / 2.0;
     double wHalfS = wHalf * xStretch;
@@ -1888,16 +2263,23 @@ void processingSetVignetteMask(processingObject_t *processing, uint16_t width, u
             processing->vignette_mask[(height-1-y)*width+(width-1-x)] = val;
         }
     }
+
+    processingSettingsChanged(processing);
+    processingUnlockSettings(processing);
 }
 
 void processingSetVignetteStrength(processingObject_t *processing, int8_t value)
 {
+    processingLockSettings(processing);
     processing->vignette_strength = value;
+    processingSettingsChanged(processing);
+    processingUnlockSettings(processing);
 }
 
 /* Set and calculate the gradient alpha mask */
 void processingSetGradientMask(processingObject_t *processing, uint16_t width, uint16_t height, float x1, float y1, float x2, float y2)
 {
+    processingLockSettings(processing);
     float A = (x2 - x1);
     float B = (y2 - y1);
     float C1 = A * x1 + B * y1;
@@ -1917,6 +2299,9 @@ void processingSetGradientMask(processingObject_t *processing, uint16_t width, u
             }
         }
     }
+
+    processingSettingsChanged(processing);
+    processingUnlockSettings(processing);
 }
 
 /* Analyse dual iso frame to find highest green for highlight reconstruction */
@@ -1925,6 +2310,8 @@ void analyse_frame_highest_green(processingObject_t *processing, int imageX, int
     //if not dual iso, we don't need to do this
     if ( *processing->dual_iso == 0 ) return;
 
+    processing_update_tables(processing);
+
     uint16_t * img = inputImage;
     int img_s = imageX * imageY * 3;
     uint16_t * img_end = img + img_s;
@@ -2036,7 +2423,10 @@ void analyse_frame_highest_green(processingObject_t *processing, int imageX, int
 //Set LUT strength factor
 void processingSetLutStrength(processingObject_t *processing, uint8_t strength)
 {
+    processingLockSettings(processing);
     processing->lut->intensity = strength;
+    processingSettingsChanged(processing);
+    processingUnlockSettings(processing);
 }
 
 //Set the gradation curve
@@ -2051,10 +2441,13 @@ void processingSetGCurve(processingObject_t *processing, int num, float *pXin, f
     //Init
     if( num < 2 )
     {
+        processingLockSettings(processing);
         for( int i = 0; i < 65536; i++ )
         {
             curve[i] = i;
         }
+        processingUnlockSettings(processing);
+        processingSettingsChanged(processing);
         return;
     }
 
@@ -2076,16 +2469,19 @@ void processingSetGCurve(processingObject_t *processing, int num, float *pXin, f
 
     if( ret == 0 )
     {
+        processingLockSettings(processing);
         for( int i = 0; i < 65536; i++ )
         {
             if( pYout[i] > 1.0 ) pYout[i] = 1.0;
             else if( pYout[i] < 0.0001 ) pYout[i] = 0.0001;
             curve[i] = pYout[i] * 65535.0;
         }
+        processingUnlockSettings(processing);
     }
 
     free( pXout );
     free( pYout );
+    processingSettingsChanged(processing);
 }
 
 //Set the hue vs curves
@@ -2116,11 +2512,14 @@ void processingSetHueVsCurves(processingObject_t *processing, int num, float *pX
     //Init
     if( num < 2 )
     {
+        processingLockSettings(processing);
         for( int i = 0; i < 36000; i++ )
         {
             curve[i] = 0.0;
             *used = 0;
         }
+        processingUnlockSettings(processing);
+        processingSettingsChanged(processing);
         return;
     }
 
@@ -2142,6 +2541,7 @@ void processingSetHueVsCurves(processingObject_t *processing, int num, float *pX
 
     if( ret == 0 )
     {
+        processingLockSettings(processing);
         *used = 0;
         for( int i = 0; i < 36000; i++ )
         {
@@ -2150,19 +2550,24 @@ void processingSetHueVsCurves(processingObject_t *processing, int num, float *pX
             curve[i] = pYout[i];
             if( curve[i] != 0.0 ) *used = 1;
         }
+        processingUnlockSettings(processing);
     }
 
     free( pXout );
     free( pYout );
+    processingSettingsChanged(processing);
 }
 
 /* Toning */
 void processingSetToning(processingObject_t *processing, uint8_t r, uint8_t g, uint8_t b, uint8_t strength)
 {
+    processingLockSettings(processing);
     processing->toning_dry = (100.0 - strength / 3.0) / 100.0;
     processing->toning_wet[0] = (strength / 3.0 / 100.0) * (float)r / 255.0;
     processing->toning_wet[1] = (strength / 3.0 / 100.0) * (float)g / 255.0;
     processing->toning_wet[2] = (strength / 3.0 / 100.0) * (float)b / 255.0;
+    processingSettingsChanged(processing);
+    processingUnlockSettings(processing);
 }
 
 static char * compile_ternary(char * function)
@@ -2246,25 +2651,8 @@ static char * compile_ternary(char * function)
     return function_string;
 }
 
-void processingSetGammaAndTonemapping(processingObject_t * processing, double gamma, int tonemapping)
-{
-    if (gamma < 1.00001 && gamma > 0.99999)
-    {
-        processingSetTransferFunction(processing, get_tonemap_func_string(tonemapping));
-    }
-    else
-    {
-        char * compiled = compile_ternary(get_tonemap_func_string(tonemapping));
-        char * string = malloc(strlen(compiled)+100);
-        sprintf(string, "pow(%s, %lf)", compiled, gamma);
-        processingSetTransferFunction(processing, string);
-        free(string);
-        free(compiled);
-    }
-}
-
-/* Transfer funciton, the correct version of "Gamma" or "Log" */
-int processingSetTransferFunction(processingObject_t * processing, char * function)
+/* native is the TONEMAP_* function is made of (-1 if not known) and native_gamma the power on top of it */
+static int set_transfer_function(processingObject_t * processing, char * function, int native, double native_gamma)
 {
 #if defined(__linux) || defined(__APPLE__)
     setlocale(LC_NUMERIC, "C");
@@ -2276,14 +2664,21 @@ int processingSetTransferFunction(processingObject_t * processing, char * functi
     te_expr * expression = te_compile(function_string, var, 1, NULL);
     if (expression == NULL) {free(function_string); return 1;}
 
+    /* A render may be building the gamma tables from the old one */
+    processingLockSettings(processing);
     if (processing->transfer_function_string != NULL) free(processing->transfer_function_string);
     if (processing->transfer_function_string_formatted != NULL) free(processing->transfer_function_string_formatted);
     te_free(processing->transfer_function);
+    te_program_free(processing->transfer_program);
 
     processing->transfer_function_string = malloc(strlen(function)+1);
     strcpy(processing->transfer_function_string, function);
     processing->transfer_function_string_formatted = function_string;
     processing->transfer_function = expression;
+    processing->transfer_program = te_flatten(expression, &processing->x_value);
+    processing->transfer_native = native;
+    processing->transfer_native_gamma = native_gamma;
+    processingUnlockSettings(processing);
 
     /* This just updates the lookup tables now */
     processingSetGamma(processing, 1);
@@ -2291,6 +2686,31 @@ int processingSetTransferFunction(processingObject_t * processing, char * functi
     return 0;
 }
 
+void processingSetGammaAndTonemapping(processingObject_t * processing, double gamma, int tonemapping)
+{
+    if (gamma < 1.00001 && gamma > 0.99999)
+    {
+        processingSetTransferFunction(processing, get_tonemap_func_string(tonemapping));
+    }
+    else
+    {
+        char * compiled = compile_ternary(get_tonemap_func_string(tonemapping));
+        char * string = malloc(strlen(compiled)+100);
+        sprintf(string, "pow(%s, %lf)", compiled, gamma);
+        /* Native curve gets the gamma as it was printed, so it matches the string */
+        char * gamma_string = strrchr(string, ',') + 1;
+        set_transfer_function(processing, string, find_tonemap_func_string(get_tonemap_func_string(tonemapping)), atof(gamma_string));
+        free(string);
+        free(compiled);
+    }
+}
+
+/* Transfer funciton, the correct version of "Gamma" or "Log" */
+int processingSetTransferFunction(processingObject_t * processing, char * function)
+{
+    return set_transfer_function(processing, function, find_tonemap_func_string(function), 1.0);
+}
+
 char * processingGetTransferFunction(processingObject_t * processing)
 {
     return processing->transfer_function_string;
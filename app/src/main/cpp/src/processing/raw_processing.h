@@ -88,6 +88,17 @@ void applyProcessingObject( processingObject_t * processing,
                             uint16_t * __restrict outputImage,
                             int threads, int imageChanged, uint64_t frameIndex );
 
+/* Same, for a part of a frame (frameX x frameY): regionW x regionH frame pixels starting at regionX, regionY,
+ * resampled to imageX x imageY. Masks and blur sizes are made to line up with the whole frame.
+ * Edges of a region are not exact (filters don't see past them), so give it a margin */
+void applyProcessingObjectRegion( processingObject_t * processing,
+                                  int frameX, int frameY,
+                                  int regionX, int regionY, int regionW, int regionH,
+                                  int imageX, int imageY,
+                                  uint16_t * __restrict inputImage,
+                                  uint16_t * __restrict outputImage,
+                                  int threads, int imageChanged, uint64_t frameIndex );
+
 /* This is for EXR output, works exactly the same as applyprocessing object,
  * except output is float and ready for EXR export. */
 void processingGetFloatOutputForEXR( processingObject_t * processing, 
@@ -98,13 +109,11 @@ void processingGetFloatOutputForEXR( processingObject_t * processing,
 
 
 /* Enable/disable the filter module (filter/filter.h) */
-#define processingEnableFilters(processing) processing->filter_on = 1
-#define processingDisableFilters(processing) processing->filter_on = 0
-
+#define processingEnableFilters(processing) processingSetSetting(processing, filter_on, 1)
+#define processingDisableFilters(processing) processingSetSetting(processing, filter_on, 0)
 /* Enable/disable the LUT module (lut3d.h) */
-#define processingEnableLut(processing) processing->lut_on = 1
-#define processingDisableLut(processing) processing->lut_on = 0
-
+#define processingEnableLut(processing) processingSetSetting(processing, lut_on, 1)
+#define processingDisableLut(processing) processingSetSetting(processing, lut_on, 0)
 /* Setup LUT strength */
 void processingSetLutStrength(processingObject_t *processing, uint8_t strength);
 
@@ -143,9 +152,7 @@ void processingSetSharpening(processingObject_t * processing, double sharpen);
 void processingSetSharpeningBias(processingObject_t * processing, double bias);
 #define processingGetSharpeningBias(processing) (processing)->sharpen_bias
 /* Set sharpen masking, 0..100 */
-#define processingSetSharpenMasking(processing, value) (processing)->sh_masking = (value)
-
-
+#define processingSetSharpenMasking(processing, value) processingSetSetting(processing, sh_masking, value)
 /* 3-way correction, range of saturation and hue is 0.0-1.0 (Currently not doing anything) */
 void processingSet3WayCorrection( processingObject_t * processing,
                                   double highlightHue, double highlightSaturation,
@@ -154,32 +161,31 @@ void processingSet3WayCorrection( processingObject_t * processing,
 
 
 /* Enable/disable highlight reconstruction */
-#define processingEnableChromaSeparation(processing) (processing)->cs_zone.use_cs = 1
-#define processingDisableChromaSeparation(processing) (processing)->cs_zone.use_cs = 0
+#define processingEnableChromaSeparation(processing) processingSetSetting(processing, cs_zone.use_cs, 1)
+#define processingDisableChromaSeparation(processing) processingSetSetting(processing, cs_zone.use_cs, 0)
 #define processingUsesChromaSeparation(processing) (processing)->cs_zone.use_cs /* A checking function */
 
 
 /* Chroma blur - to enable it, you MUST enable chroma separation too. */
-#define processingSetChromaBlurRadius(processing, radius) (processing)->cs_zone.chroma_blur_radius = (radius)
+#define processingSetChromaBlurRadius(processing, radius) processingSetSetting(processing, cs_zone.chroma_blur_radius, radius)
 #define processingGetChromaBlurRadius(processing) (processing)->cs_zone.chroma_blur_radius
 
 /* Denoiser */
-#define processingSetDenoiserWindow(processing, window) (processing)->denoiserWindow = (window)
+#define processingSetDenoiserWindow(processing, window) processingSetSetting(processing, denoiserWindow, window)
 #define processingGetDenoiserWindow(processing) (processing)->denoiserWindow
-#define processingSetDenoiserStrength(processing, strength) (processing)->denoiserStrength = (strength)
+#define processingSetDenoiserStrength(processing, strength) processingSetSetting(processing, denoiserStrength, strength)
 #define processingGetDenoiserStrength(processing) (processing)->denoiserStrength
 
-#define processingSetRbfDenoiserLuma(processing, strength) (processing)->rbfDenoiserLuma = (strength)
+#define processingSetRbfDenoiserLuma(processing, strength) processingSetSetting(processing, rbfDenoiserLuma, strength)
 #define processingGetRbfDenoiserLuma(processing) (processing)->rbfDenoiserLuma
-#define processingSetRbfDenoiserChroma(processing, strength) (processing)->rbfDenoiserChroma = (strength)
+#define processingSetRbfDenoiserChroma(processing, strength) processingSetSetting(processing, rbfDenoiserChroma, strength)
 #define processingGetRbfDenoiserChroma(processing) (processing)->rbfDenoiserChroma
-#define processingSetRbfDenoiserRange(processing, strength) (processing)->rbfDenoiserRange = (strength)
+#define processingSetRbfDenoiserRange(processing, strength) processingSetSetting(processing, rbfDenoiserRange, strength)
 #define processingGetRbfDenoiserRange(processing) (processing)->rbfDenoiserRange
 
 /* Grain */
-#define processingSetGrainStrength(processing, strength) (processing)->grainStrength = (strength)
-#define processingSetGrainLumaWeight(processing, strength) (processing)->grainLumaWeight = (strength)
-
+#define processingSetGrainStrength(processing, strength) processingSetSetting(processing, grainStrength, strength)
+#define processingSetGrainLumaWeight(processing, strength) processingSetSetting(processing, grainLumaWeight, strength)
 /* Vignette */
 void processingSetVignetteStrength(processingObject_t * processing, int8_t value);
 void processingSetVignetteMask(processingObject_t * processing, uint16_t width, uint16_t height, float radius, float shape, float xStretch, float yStretch);
@@ -188,7 +194,7 @@ void processingSetVignetteMask(processingObject_t * processing, uint16_t width,
 void processingSetGradientMask(processingObject_t * processing, uint16_t width, uint16_t height, float x1, float y1, float x2, float y2 );
 void processingSetGradientExposure(processingObject_t * processing, double value);
 #define processingGetGradientExposure(processing) (processing)->gradient_exposure_stops
-#define processingSetGradientEnable(processing, value) (processing)->gradient_enable = (value)
+#define processingSetGradientEnable(processing, value) processingSetSetting(processing, gradient_enable, value)
 #define processingIsGradientEnabled(processing) (processing)->gradient_enable
 /* Gradient simple contrast */
 void processingSetSimpleContrastGradient(processingObject_t * processing, double value);
@@ -198,31 +204,28 @@ void processing_update_contrast_curve_gradient(processingObject_t * processing);
 
 
 /* Enable/disable highlight reconstruction */
-#define processingEnableHighlightReconstruction(processing) (processing)->highlight_reconstruction = 1
-#define processingDisableHighlightReconstruction(processing) (processing)->highlight_reconstruction = 0
-
+#define processingEnableHighlightReconstruction(processing) processingSetSetting(processing, highlight_reconstruction, 1)
+#define processingDisableHighlightReconstruction(processing) processingSetSetting(processing, highlight_reconstruction, 0)
 /* Enable/disable creative adjustments when log active */
-#define processingAllowCreativeAdjustments(processing) (processing)->allow_creative_adjustments = 1
-#define processingDontAllowCreativeAdjustments(processing) (processing)->allow_creative_adjustments = 0
+#define processingAllowCreativeAdjustments(processing) processingSetSetting(processing, allow_creative_adjustments, 1)
+#define processingDontAllowCreativeAdjustments(processing) processingSetSetting(processing, allow_creative_adjustments, 0)
 #define processingGetAllowedCreativeAdjustments(processing) ((processing)->allow_creative_adjustments)
 
 /* Toning */
 void processingSetToning(processingObject_t * processing, uint8_t r, uint8_t g, uint8_t b, uint8_t strength);
 
 /* Use or not use camera matrix - compatibility mode */
-#define processingUseCamMatrix(processing) (processing)->use_cam_matrix = 1
-#define processingUseCamMatrixDanne(processing) (processing)->use_cam_matrix = 2
-#define processingDontUseCamMatrix(processing) (processing)->use_cam_matrix = 0
+#define processingUseCamMatrix(processing) processingSetSetting(processing, use_cam_matrix, 1)
+#define processingUseCamMatrixDanne(processing) processingSetSetting(processing, use_cam_matrix, 2)
+#define processingDontUseCamMatrix(processing) processingSetSetting(processing, use_cam_matrix, 0)
 #define processingGetUsedCamMatrix(processing) ((processing)->use_cam_matrix)
 
 /* EXR mode */
-#define processingEnableExr(processing) (processing)->exr_mode = 1
-#define processingDisableExr(processing) (processing)->exr_mode = 0
-
+#define processingEnableExr(processing) processingSetSetting(processing, exr_mode, 1)
+#define processingDisableExr(processing) processingSetSetting(processing, exr_mode, 0)
 /* AgX mode */
-#define processingEnableAgX(processing) (processing)->AgX = 1
-#define processingDisableAgX(processing) (processing)->AgX = 0
-
+#define processingEnableAgX(processing) processingSetSetting(processing, AgX, 1)
+#define processingDisableAgX(processing) processingSetSetting(processing, AgX, 0)
 /* Set Camera RAW matrix (matrix A is for tungsten) */
 void processingSetCamMatrix(processingObject_t * processing, double * camMatrix, double * camMatrixA);
 
@@ -295,9 +298,8 @@ void processingSetGCurve(processingObject_t * processing, int num, float * pXin,
 void processingSetHueVsCurves(processingObject_t * processing, int num, float * pXin, float * pYin, uint8_t channel);
 
 /* Set CA filter parameter */
-#define processingSetCaDesaturate(processing, value) (processing)->ca_desaturate = (value)
-#define processingSetCaRadius(processing, value) (processing)->ca_radius = (value)
-
+#define processingSetCaDesaturate(processing, value) processingSetSetting(processing, ca_desaturate, value)
+#define processingSetCaRadius(processing, value) processingSetSetting(processing, ca_radius, value)
 /*
  *******************************************************************************
  * THE FOLLOWING FUNCTIONS ARE PRIVATE AND NO USE OUTSIDE OF raw_processing.c
@@ -311,7 +313,8 @@ void apply_processing_object(processingObject_t * processing,
                               uint16_t * __restrict outputImage,
                               uint16_t * __restrict blurImage,
                               uint16_t * __restrict gradientMask,
-                              float *vignetteMask);
+                              float *vignetteMask,
+                              float *vignetteEnd);
 
 /* Pass frame buffer and do the transform on it */
 void get_frame_transformed(processingObject_t * processing, uint16_t * frame_buf , uint16_t imageX, uint16_t imageY);
@@ -328,8 +331,22 @@ typedef struct {
     uint16_t * blurImage;
     uint16_t * gradientMask;
     float * vignetteMask;
+    float * vignetteEnd;
 } apply_processing_parameters_t;
 
+/* Sharpening of a band of rows, for pthreading */
+typedef struct {
+    processingObject_t * processing;
+    int imageX, imageY;
+    uint16_t * inputImage;
+    uint16_t * outputImage;
+    uint32_t sharp_start, sharp_skip;
+    int y_start, y_end;
+} sharpen_parameters_t;
+
+/* Sharpens rows y_start to y_end-1, makes the edge mask on the way if masking is on */
+void sharpen_thread(sharpen_parameters_t * p);
+
 /* applyProcessingObject but with one argument for pthreading  */
 void processing_object_thread(apply_processing_parameters_t * p);
 
@@ -364,6 +381,38 @@ void processing_update_highest_green_gradient(processingObject_t * processing);
 /* Precalculates curve with contrast and colour correction */
 void processing_update_curves(processingObject_t * processing);
 
+/* Setters only mark which lookup tables are out of date, so changing many
+ * settings in a row builds each table once. This brings them up to date, it
+ * runs before processing, anything else reading the tables must call it */
+#define PROCESSING_DIRTY_MATRICES          (1 << 0)
+#define PROCESSING_DIRTY_MATRICES_GRADIENT (1 << 1)
+#define PROCESSING_DIRTY_GAMMA             (1 << 2)
+#define PROCESSING_DIRTY_GAMMA_GRADIENT    (1 << 3)
+#define PROCESSING_DIRTY_CURVES            (1 << 4)
+#define PROCESSING_DIRTY_SHADOW_HIGHLIGHT  (1 << 5)
+#define PROCESSING_DIRTY_CONTRAST          (1 << 6)
+#define PROCESSING_DIRTY_CONTRAST_GRADIENT (1 << 7)
+#define PROCESSING_DIRTY_CLARITY           (1 << 8)
+#define PROCESSING_DIRTY_SATURATION        (1 << 9)
+#define PROCESSING_DIRTY_VIBRANCE          (1 << 10)
+#define PROCESSING_DIRTY_SHARPEN           (1 << 11)
+/* Only used when the gradient is enabled, left out of date until then */
+#define PROCESSING_DIRTY_GRADIENT (PROCESSING_DIRTY_MATRICES_GRADIENT | PROCESSING_DIRTY_GAMMA_GRADIENT)
+#define processingMarkDirty(processing, tables) \
+    (processingLockSettings(processing), (processing)->dirty_tables |= (tables), \
+     processingUnlockSettings(processing), processingSettingsChanged(processing))
+/* Renders work on copies of the processing object (processing_worker_t), every
+ * setter has to bump the generation so they pick up the change */
+#define processingSettingsChanged(processing) __atomic_add_fetch(&(processing)->generation, 1, __ATOMIC_RELEASE)
+/* Setters write the settings holding tables_mutex, the workers copy them holding it,
+ * so a copy never has half of a change. It is recursive as setters call each other */
+#define processingLockSettings(processing) pthread_mutex_lock(&(processing)->tables_mutex)
+#define processingUnlockSettings(processing) pthread_mutex_unlock(&(processing)->tables_mutex)
+#define processingSetSetting(processing, setting, value) \
+    (processingLockSettings(processing), (processing)->setting = (value), \
+     processingUnlockSettings(processing), processingSettingsChanged(processing))
+void processing_update_tables(processingObject_t * processing);
+
 /* Analyse dual iso frame to find highest green for highlight reconstruction */
 void analyse_frame_highest_green(processingObject_t * processing,
                                   int imageX, int imageY,
@@ -28,11 +28,26 @@ Added dual threading by masc4ii (c) 2021
 #include "RBFilterPlain.h"
 #include <algorithm>
 #include <math.h>
+#include <thread>
+#include <vector>
 
 using namespace std;
 
 #define QX_DEF_U16_MAX 65535
 
+// splits [0, count) in to one range per thread, the calling thread takes the first
+template <typename F>
+static void run_split(int threads, int count, F func)
+{
+	threads = max(1, min(threads, count));
+	vector<thread> workers;
+	for (int t = 1; t < threads; t++)
+	{
+		workers.emplace_back(func, count * t / threads, count * (t + 1) / threads);
+	}
+	func(0, count / threads);
+	for (auto& worker : workers) worker.join();
+}
 
 CRBFilterPlain::CRBFilterPlain()
 {
@@ -44,13 +59,25 @@ CRBFilterPlain::~CRBFilterPlain()
 	releaseMemory();
 }
 
-// assumes 3/4 channel images, 1 byte per channel
+// 3 channel images only, 2 bytes per channel
 void CRBFilterPlain::reserveMemory(int max_width, int max_height, int channels)
 {
 	// basic sanity check
     if(!(max_width >= 10 && max_width < 10000))return;
     if(!(max_height >= 10 && max_height < 10000))return;
-    if(!(channels >= 1 && channels <= 4))return;
+    // the passes take the right and up pass differences a fixed 3 and 1 values back, which
+    // only lands on the neighbouring pixel for 3 channels, so nothing else was ever right
+    if(!(channels == 3))return;
+
+	// already big enough, keep what we have
+	if (channels == m_reserve_channels && max_width <= m_reserve_width && max_height <= m_reserve_height) return;
+
+	// grow in both directions, so regions of alternating shape don't reallocate every time
+	if (channels == m_reserve_channels)
+	{
+		max_width = max(max_width, m_reserve_width);
+		max_height = max(max_height, m_reserve_height);
+	}
 
 	releaseMemory();
 
@@ -61,34 +88,10 @@ void CRBFilterPlain::reserveMemory(int max_width, int max_height, int channels)
 	int width_height = m_reserve_width * m_reserve_height;
 	int width_height_channel = width_height * m_reserve_channels;
 
-	m_left_pass_color = new float[width_height_channel];
-	m_left_pass_factor = new float[width_height];
-
-	m_right_pass_color = new float[width_height_channel];
-	m_right_pass_factor = new float[width_height];
-
-	m_down_pass_color = new float[width_height_channel];
-	m_down_pass_factor = new float[width_height];
-
-	m_up_pass_color = new float[width_height_channel];
-	m_up_pass_factor = new float[width_height];
-
-#pragma omp parallel for
-    for( int i = 0; i < width_height_channel; i++ )
-    {
-        m_left_pass_color[i] = 0;
-        m_right_pass_color[i] = 0;
-        m_down_pass_color[i] = 0;
-        m_up_pass_color[i] = 0;
-    }
-#pragma omp parallel for
-    for( int i = 0; i < width_height; i++ )
-    {
-        m_left_pass_factor[i] = 0;
-        m_right_pass_factor[i] = 0;
-        m_down_pass_factor[i] = 0;
-        m_up_pass_factor[i] = 0;
-    }
+	m_hor_color = new float[width_height_channel];
+	m_down_color = new float[width_height_channel];
+	m_down_factor = new float[width_height];
+	m_range_table = new float[QX_DEF_U16_MAX + 1];
 }
 
 void CRBFilterPlain::releaseMemory()
@@ -97,52 +100,28 @@ void CRBFilterPlain::releaseMemory()
 	m_reserve_height = 0;
 	m_reserve_channels = 0;
 
-	if (m_left_pass_color)
+	if (m_hor_color)
 	{
-		delete[] m_left_pass_color;
-		m_left_pass_color = nullptr;
+		delete[] m_hor_color;
+		m_hor_color = nullptr;
 	}
 
-	if (m_left_pass_factor)
+	if (m_down_color)
 	{
-		delete[] m_left_pass_factor;
-		m_left_pass_factor = nullptr;
+		delete[] m_down_color;
+		m_down_color = nullptr;
 	}
 
-	if (m_right_pass_color)
+	if (m_down_factor)
 	{
-		delete[] m_right_pass_color;
-		m_right_pass_color = nullptr;
+		delete[] m_down_factor;
+		m_down_factor = nullptr;
 	}
 
-	if (m_right_pass_factor)
+	if (m_range_table)
 	{
-		delete[] m_right_pass_factor;
-		m_right_pass_factor = nullptr;
-	}
-
-	if (m_down_pass_color)
-	{
-		delete[] m_down_pass_color;
-		m_down_pass_color = nullptr;
-	}
-
-	if (m_down_pass_factor)
-	{
-		delete[] m_down_pass_factor;
-		m_down_pass_factor = nullptr;
-	}
-
-	if (m_up_pass_color)
-	{
-		delete[] m_up_pass_color;
-		m_up_pass_color = nullptr;
-	}
-
-	if (m_up_pass_factor)
-	{
-		delete[] m_up_pass_factor;
-		m_up_pass_factor = nullptr;
+		delete[] m_range_table;
+		m_range_table = nullptr;
 	}
 }
 
@@ -187,12 +166,216 @@ int CRBFilterPlain::getDiffFactor(const uint16_t *color1, const uint16_t *color2
 	return final_diff;
 }
 
+// left and right pass of a range of rows, averaged straight in to m_hor_color
+// the left pass skips the last row and the right pass the first one, those stay zero like they always did
+void CRBFilterPlain::filterRows(const uint16_t* img_src, float inv_alpha_f,
+	int width, int height, int channel, int row_begin, int row_end)
+{
+	const float* range_table_f = m_range_table;
+	int width_channel = width * channel;
+
+	vector<float> scratch((width_channel + width) * 2);
+	float* left_pass_color = scratch.data();
+	float* left_pass_factor = left_pass_color + width_channel;
+	float* right_pass_color = left_pass_factor + width;
+	float* right_pass_factor = right_pass_color + width_channel;
+
+	for (int y = row_begin; y < row_end; y++)
+	{
+		const uint16_t* src_color = img_src + y * width_channel;
+
+		///////////////
+		// Left pass
+		if (y < height - 1)
+		{
+			// process 1st pixel separately since it has no previous
+			left_pass_factor[0] = 1.f;
+			for (int c = 0; c < channel; c++)
+			{
+				left_pass_color[c] = src_color[c];
+			}
+
+			// handle other pixels
+			for (int x = 1; x < width; x++)
+			{
+				int diff = getDiffFactor(src_color + x * channel, src_color + (x - 1) * channel);
+				float alpha_f = range_table_f[diff];
+
+				left_pass_factor[x] = inv_alpha_f + alpha_f * left_pass_factor[x - 1];
+
+				for (int c = 0; c < channel; c++)
+				{
+					int idx = x * channel + c;
+					left_pass_color[idx] = inv_alpha_f * src_color[idx] + alpha_f * left_pass_color[idx - channel];
+				}
+			}
+		}
+		else
+		{
+			fill(left_pass_color, left_pass_color + width_channel, 0.f);
+			fill(left_pass_factor, left_pass_factor + width, 0.f);
+		}
+
+		///////////////
+		// Right pass
+		if (y > 0)
+		{
+			// process 1st pixel separately since it has no previous
+			right_pass_factor[width - 1] = 1.f;
+			for (int c = 0; c < channel; c++)
+			{
+				right_pass_color[width_channel - channel + c] = src_color[width_channel - channel + c];
+			}
+
+			// handle other pixels
+			for (int x = width - 2; x >= 0; x--)
+			{
+				// difference is taken 3 values back from the last channel, same as the original single threaded pass
+				const uint16_t* diff_color = src_color + x * channel + channel - 1;
+				int diff = getDiffFactor(diff_color, diff_color - 3);
+				float alpha_f = range_table_f[diff];
+
+				right_pass_factor[x] = inv_alpha_f + alpha_f * right_pass_factor[x + 1];
+
+				for (int c = 0; c < channel; c++)
+				{
+					int idx = x * channel + c;
+					right_pass_color[idx] = inv_alpha_f * src_color[idx] + alpha_f * right_pass_color[idx + channel];
+				}
+			}
+		}
+		else
+		{
+			fill(right_pass_color, right_pass_color + width_channel, 0.f);
+			fill(right_pass_factor, right_pass_factor + width, 0.f);
+		}
+
+		// average color divided by average factor
+		float* img_out = m_hor_color + y * width_channel;
+		for (int x = 0; x < width; x++)
+		{
+			float factor = 1.f / ((left_pass_factor[x]) + (right_pass_factor[x]));
+			for (int c = 0; c < channel; c++)
+			{
+				int idx = x * channel + c;
+				img_out[idx] = (factor * ((left_pass_color[idx]) + (right_pass_color[idx])));
+			}
+		}
+	}
+}
+
+// down and up pass of a strip of columns, written to img_dst
+// the down pass runs over the first width*height-height+1 pixels, the up pass stops at pixel height-1,
+// the rest stays zero like in the original single threaded version
+void CRBFilterPlain::filterColumns(const uint16_t* img_src, uint16_t* img_dst, float inv_alpha_f,
+	int width, int height, int channel, int col_begin, int col_end)
+{
+	const float* range_table_f = m_range_table;
+	int width_channel = width * channel;
+	int strip_width = col_end - col_begin;
+	int strip_channel = strip_width * channel;
+	int last_down = width * height - height;
+
+	// per element alpha of the current row, lets the color update run as one flat loop the compiler can vectorise
+	vector<float> scratch(strip_channel * 3 + strip_width * 2);
+	float* row_alpha = scratch.data();
+	float* up_pass_color = row_alpha + strip_channel;
+	float* prev_color = up_pass_color + strip_channel;
+	float* up_pass_factor = prev_color + strip_channel;
+	float* prev_factor = up_pass_factor + strip_width;
+
+	///////////////
+	// Down pass
+	for (int y = 0; y < height; y++)
+	{
+		int p0 = y * width + col_begin;
+		const float* src_color_hor = m_hor_color + p0 * channel;
+		float* down_pass_color = m_down_color + p0 * channel;
+		float* down_pass_factor = m_down_factor + p0;
+
+		// 1st line done separately because no previous line
+		if (y == 0)
+		{
+			for (int i = 0; i < strip_width; i++) down_pass_factor[i] = 1.f;
+			for (int i = 0; i < strip_channel; i++) down_pass_color[i] = src_color_hor[i];
+			continue;
+		}
+
+		int valid = min(strip_width, max(0, last_down - p0 + 1));
+		for (int i = 0; i < valid; i++)
+		{
+			int p = p0 + i;
+			int diff = getDiffFactor(img_src + p * channel, img_src + (p - width) * channel);
+			float alpha_f = range_table_f[diff];
+			down_pass_factor[i] = inv_alpha_f + alpha_f * down_pass_factor[i - width];
+			for (int c = 0; c < channel; c++) row_alpha[i * channel + c] = alpha_f;
+		}
+		const float* down_prev_color = down_pass_color - width_channel;
+		for (int i = 0; i < valid * channel; i++)
+		{
+			down_pass_color[i] = inv_alpha_f * src_color_hor[i] + row_alpha[i] * down_prev_color[i];
+		}
+		fill(down_pass_factor + valid, down_pass_factor + strip_width, 0.f);
+		fill(down_pass_color + valid * channel, down_pass_color + strip_channel, 0.f);
+	}
+
+	///////////////
+	// Up pass, averaged with the down pass and written to output straight away
+	for (int y = height - 1; y >= 0; y--)
+	{
+		int p0 = y * width + col_begin;
+		const float* src_color_hor = m_hor_color + p0 * channel;
+
+		// 1st line done separately because no previous line
+		if (y == height - 1)
+		{
+			for (int i = 0; i < strip_width; i++) up_pass_factor[i] = 1.f;
+			for (int i = 0; i < strip_channel; i++) up_pass_color[i] = src_color_hor[i];
+		}
+		else
+		{
+			int first = min(strip_width, max(0, height - 1 - p0));
+			for (int i = first; i < strip_width; i++)
+			{
+				// difference is taken one value before the pixel, same as the original single threaded pass
+				int q = p0 + i;
+				int diff = getDiffFactor(img_src + q * channel - 1, img_src + (q + width) * channel - 1);
+				float alpha_f = range_table_f[diff];
+				up_pass_factor[i] = inv_alpha_f + alpha_f * prev_factor[i];
+				for (int c = 0; c < channel; c++) row_alpha[i * channel + c] = alpha_f;
+			}
+			for (int i = first * channel; i < strip_channel; i++)
+			{
+				up_pass_color[i] = inv_alpha_f * src_color_hor[i] + row_alpha[i] * prev_color[i];
+			}
+			fill(up_pass_factor, up_pass_factor + first, 0.f);
+			fill(up_pass_color, up_pass_color + first * channel, 0.f);
+		}
+
+		// average color divided by average factor
+		const float* down_pass_color = m_down_color + p0 * channel;
+		const float* down_pass_factor = m_down_factor + p0;
+		uint16_t* out = img_dst + p0 * channel;
+		for (int i = 0; i < strip_width; i++)
+		{
+			float factor = 1.f / ((up_pass_factor[i]) + (down_pass_factor[i]));
+			for (int c = 0; c < channel; c++)
+			{
+				int idx = i * channel + c;
+				out[idx] = (uint16_t)(factor * ((up_pass_color[idx]) + (down_pass_color[idx])));
+			}
+		}
+
+		swap(up_pass_color, prev_color);
+		swap(up_pass_factor, prev_factor);
+	}
+}
+
 // memory must be reserved before calling image filter
-// this implementation of filter uses plain C++, single threaded
-// channel count must be 3 or 4 (alpha not used)
+// channel count must be 3, otherwise nothing is reserved and img_dst is left alone
 void CRBFilterPlain::filter(uint16_t* img_src, uint16_t* img_dst,
 	float sigma_spatial, float sigma_range,
-	int width, int height, int channel)
+	int width, int height, int channel, int threads)
 {
     if(!img_src) return;
     if(!img_dst) return;
@@ -204,12 +387,10 @@ void CRBFilterPlain::filter(uint16_t* img_src, uint16_t* img_dst,
     float alpha_f = static_cast<float>(exp(-sqrt(2.0) / (sigma_spatial * QX_DEF_U16_MAX)));
     float inv_alpha_f = 1.f - alpha_f;
 
-
-    float range_table_f[QX_DEF_U16_MAX + 1];
+    float* range_table_f = m_range_table;
     float inv_sigma_range = 1.0f / (sigma_range * QX_DEF_U16_MAX);
     {
         float ii = 0.f;
-#pragma omp parallel for
         for (int i = 0; i <= QX_DEF_U16_MAX; i++)
         {
             ii = -i;
@@ -217,234 +398,14 @@ void CRBFilterPlain::filter(uint16_t* img_src, uint16_t* img_dst,
         }
     }
 
-#pragma omp parallel for
-    for( int par = 0; par < 2; par++ )
-    {
-        ///////////////
-        // Left pass
-        if( !par )
-        {
-            const uint16_t* src_color = img_src;
-            float* left_pass_color = m_left_pass_color;
-            float* left_pass_factor = m_left_pass_factor;
-
-            for (int y = 0; y < height-1; y++)
-            {
-                const uint16_t* src_prev = src_color;
-                const float* prev_factor = left_pass_factor;
-                const float* prev_color = left_pass_color;
-
-                // process 1st pixel separately since it has no previous
-                *left_pass_factor++ = 1.f;
-                for (int c = 0; c < channel; c++)
-                {
-                    *left_pass_color++ = *src_color++;
-                }
-
-                // handle other pixels
-                for (int x = 1; x < width; x++)
-                {
-                    // determine difference in pixel color between current and previous
-                    // calculation is different depending on number of channels
-                    int diff = getDiffFactor(src_color, src_prev);
-                    src_prev = src_color;
-
-                    float alpha_f = range_table_f[diff];
-
-                    *left_pass_factor++ = inv_alpha_f + alpha_f * (*prev_factor++);
-
-                    for (int c = 0; c < channel; c++)
-                    {
-                        *left_pass_color++ = inv_alpha_f * (*src_color++) + alpha_f * (*prev_color++);
-                    }
-                }
-            }
-        }
-        else
-        ///////////////
-        // Right pass
-        {
-            // start from end and then go up to begining
-            int last_index = width * height * channel - 1;
-            const uint16_t* src_color = img_src + last_index;
-            float* right_pass_color = m_right_pass_color + last_index;
-            float* right_pass_factor = m_right_pass_factor + width * height - 1;
-
-            for (int y = 0; y < height-1; y++)
-            {
-                //const uint16_t* src_prev = src_color;
-                const float* prev_factor = right_pass_factor;
-                const float* prev_color = right_pass_color;
-
-                // process 1st pixel separately since it has no previous
-                *right_pass_factor-- = 1.f;
-                for (int c = 0; c < channel; c++)
-                {
-                    *right_pass_color-- = *src_color--;
-                }
-
-                // handle other pixels
-                for (int x = 1; x < width; x++)
-                {
-                    // determine difference in pixel color between current and previous
-                    // calculation is different depending on number of channels
-                    int diff = getDiffFactor(src_color, src_color - 3);
-                    //	src_prev = src_color;
-
-                    float alpha_f = range_table_f[diff];
-
-                    *right_pass_factor-- = inv_alpha_f + alpha_f * (*prev_factor--);
-
-                    for (int c = 0; c < channel; c++)
-                    {
-                        *right_pass_color-- = inv_alpha_f * (*src_color--) + alpha_f * (*prev_color--);
-                    }
-                }
-            }
-        }
-    }
+    // rows are independent for the horizontal pass
+    run_split(threads, height, [&](int row_begin, int row_end) {
+        filterRows(img_src, inv_alpha_f, width, height, channel, row_begin, row_end);
+    });
 
     // vertical pass will be applied on top on horizontal pass, while using pixel differences from original image
-    // result color stored in 'm_left_pass_color' and vertical pass will use it as source color
-    {
-        float* img_out = m_left_pass_color; // use as temporary buffer
-        const float* left_pass_color = m_left_pass_color;
-        const float* left_pass_factor = m_left_pass_factor;
-        const float* right_pass_color = m_right_pass_color;
-        const float* right_pass_factor = m_right_pass_factor;
-
-        int width_height = width * height;
-#pragma omp parallel for
-        for (int i = 0; i < width_height; i++)
-        {
-            // average color divided by average factor
-            float factor = 1.f / ((left_pass_factor[i]) + (right_pass_factor[i]));
-            for (int c = 0; c < channel; c++)
-            {
-                int idx = i + i + i + c;
-                img_out[idx] = (factor * ((left_pass_color[idx]) + (right_pass_color[idx])));
-            }
-        }
-    }
-
-#pragma omp parallel for
-    for( int par = 0; par < 2; par++ )
-    {
-        ///////////////
-        // Down pass
-        if( !par )
-        {
-            const float* src_color_hor = m_left_pass_color; // result of horizontal pass filter
-
-            const uint16_t* src_color = img_src;
-            float* down_pass_color = m_down_pass_color;
-            float* down_pass_factor = m_down_pass_factor;
-
-            const uint16_t* src_prev = src_color;
-            const float* prev_color = down_pass_color;
-            const float* prev_factor = down_pass_factor;
-
-            // 1st line done separately because no previous line
-            for (int x = 0; x < width; x++)
-            {
-                *down_pass_factor++ = 1.f;
-                for (int c = 0; c < channel; c++)
-                {
-                    *down_pass_color++ = *src_color_hor++;
-                }
-                src_color += channel;
-            }
-
-            // handle other lines
-            for (int y = 1; y < height; y++)
-            {
-                for (int x = 0; x < width-1; x++)
-                {
-                    // determine difference in pixel color between current and previous
-                    // calculation is different depending on number of channels
-                    int diff = getDiffFactor(src_color, src_prev);
-                    src_prev += channel;
-                    src_color += channel;
-
-                    float alpha_f = range_table_f[diff];
-
-                    *down_pass_factor++ = inv_alpha_f + alpha_f * (*prev_factor++);
-
-                    for (int c = 0; c < channel; c++)
-                    {
-                        *down_pass_color++ = inv_alpha_f * (*src_color_hor++) + alpha_f * (*prev_color++);
-                    }
-                }
-            }
-        }
-        else
-        ///////////////
-        // Up pass
-        {
-            // start from end and then go up to begining
-            int last_index = width * height * channel - 1;
-            const uint16_t* src_color = img_src + last_index;
-            const float* src_color_hor = m_left_pass_color + last_index; // result of horizontal pass filter
-            float* up_pass_color = m_up_pass_color + last_index;
-            float* up_pass_factor = m_up_pass_factor + (width * height - 1);
-
-            //	const uint16_t* src_prev = src_color;
-            const float* prev_color = up_pass_color;
-            const float* prev_factor = up_pass_factor;
-
-            // 1st line done separately because no previous line
-            for (int x = 0; x < width; x++)
-            {
-                *up_pass_factor-- = 1.f;
-                for (int c = 0; c < channel; c++)
-                {
-                    *up_pass_color-- = *src_color_hor--;
-                }
-                src_color -= channel;
-            }
-
-            // handle other lines
-            for (int y = 1; y < height; y++)
-            {
-                for (int x = 0; x < width-1; x++)
-                {
-                    // determine difference in pixel color between current and previous
-                    // calculation is different depending on number of channels
-                    src_color -= channel;
-                    int diff = getDiffFactor(src_color, src_color + width * channel);
-
-                    float alpha_f = range_table_f[diff];
-
-                    *up_pass_factor-- = inv_alpha_f + alpha_f * (*prev_factor--);
-
-                    for (int c = 0; c < channel; c++)
-                    {
-                        *up_pass_color-- = inv_alpha_f * (*src_color_hor--) + alpha_f * (*prev_color--);
-                    }
-                }
-            }
-        }
-    }
-
-    ///////////////
-    // average result of vertical pass is written to output buffer
-    {
-        const float* down_pass_color = m_down_pass_color;
-        const float* down_pass_factor = m_down_pass_factor;
-        const float* up_pass_color = m_up_pass_color;
-        const float* up_pass_factor = m_up_pass_factor;
-
-        int width_height = width * height;
-#pragma omp parallel for
-        for (int i = 0; i < width_height; i++)
-        {
-            // average color divided by average factor
-            float factor = 1.f / ((up_pass_factor[i]) + (down_pass_factor[i]));
-            for (int c = 0; c < channel; c++)
-            {
-                int idx = i + i + i + c;
-                img_dst[idx] = (uint16_t)(factor * ((up_pass_color[idx]) + (down_pass_color[idx])));
-            }
-        }
-    }
+    // columns are independent for it, every thread takes a strip
+    run_split(threads, width, [&](int col_begin, int col_end) {
+        filterColumns(img_src, img_dst, inv_alpha_f, width, height, channel, col_begin, col_end);
+    });
 }
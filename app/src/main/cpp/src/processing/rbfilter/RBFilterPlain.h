@@ -39,33 +39,36 @@ class CRBFilterPlain
 	int			m_reserve_height = 0;
 	int			m_reserve_channels = 0;
 
-	float*		m_left_pass_color = nullptr;
-	float*		m_left_pass_factor = nullptr;
+	// horizontal result, left/right passes are done per row in scratch
+	float*		m_hor_color = nullptr;
 
-	float*		m_right_pass_color = nullptr;
-	float*		m_right_pass_factor = nullptr;
+	// down pass has to be kept until the up pass meets it
+	float*		m_down_color = nullptr;
+	float*		m_down_factor = nullptr;
 
-	float*		m_down_pass_color = nullptr;
-	float*		m_down_pass_factor = nullptr;
-
-	float*		m_up_pass_color = nullptr;
-	float*		m_up_pass_factor = nullptr;
+	float*		m_range_table = nullptr;
 
     int getDiffFactor(const uint16_t* color1, const uint16_t* color2) const;
 
+    void filterRows(const uint16_t* img_src, float inv_alpha_f,
+        int width, int height, int channel, int row_begin, int row_end);
+    void filterColumns(const uint16_t* img_src, uint16_t* img_dst, float inv_alpha_f,
+        int width, int height, int channel, int col_begin, int col_end);
+
 public:
 
 	CRBFilterPlain();
 	~CRBFilterPlain();
 
-	// assumes 3/4 channel images, 1 byte per channel
+	// 3 channel images only, 2 bytes per channel, other channel counts reserve nothing
+	// memory is kept if it is already big enough, so one object can be reused for every frame
 	void reserveMemory(int max_width, int max_height, int channels);
 	void releaseMemory();
 
 	// memory must be reserved before calling image filter
-	// this implementation of filter uses plain C++, single threaded
-	// channel count must be 3 or 4 (alpha not used)
+	// rows are split between threads for the horizontal pass, column strips for the vertical one
+	// channel count must be 3
     void filter(uint16_t* img_src, uint16_t* img_dst,
 		float sigma_spatial, float sigma_range,
-		int width, int height, int channel);
+		int width, int height, int channel, int threads = 1);
 };
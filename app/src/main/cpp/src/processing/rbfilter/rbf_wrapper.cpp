@@ -37,6 +37,29 @@ void recursive_bf_wrap(uint16_t * img_in,
     }
 }
 
+void * init_recursive_bf(void)
+{
+    return new CRBFilterPlain();
+}
+
+void free_recursive_bf(void * rbf)
+{
+    delete (CRBFilterPlain *)rbf;
+}
+
+void recursive_bf_threaded(void * rbf,
+        uint16_t * img_in,
+        uint16_t * img_out,
+        float sigma_spatial, float sigma_range,
+        int width, int height, int channel,
+        int threads)
+{
+    CRBFilterPlain * filter = (CRBFilterPlain *)rbf;
+    /* Only allocates if the image got bigger */
+    filter->reserveMemory( width, height, channel );
+    filter->filter( img_in, img_out, sigma_spatial, sigma_range, width, height, channel, threads );
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -20,6 +20,18 @@ extern void recursive_bf_wrap(
         float sigma_spatial, float sigma_range,
         int width, int height, int channel);
 
+/* Filter that keeps its buffers, reuse one for every frame */
+extern void * init_recursive_bf(void);
+extern void free_recursive_bf(void * rbf);
+
+extern void recursive_bf_threaded(
+        void * rbf,
+        uint16_t * img_in,
+        uint16_t * img_out,
+        float sigma_spatial, float sigma_range,
+        int width, int height, int channel,
+        int threads);
+
 #ifdef __cplusplus
 }
 #endif
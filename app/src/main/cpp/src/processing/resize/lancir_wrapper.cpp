@@ -0,0 +1,48 @@
+/*!
+* \file lancir_wrapper.cpp
+* \brief Wrapper for the avir lancir resizer
+*/
+
+#include <thread>
+#include <vector>
+
+#include "lancir.h"
+#include "lancir_wrapper.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void lancir_resize_rgb16_wrap(uint16_t * img_in, int width, int height,
+        uint16_t * img_out, int new_width, int new_height,
+        int threads)
+{
+    if( threads < 1 ) threads = 1;
+    if( threads > new_height ) threads = new_height;
+
+    /* Same steps and centering lancir picks for the whole image, so the
+     * stripes line up. Negative steps tell it not to center again */
+    const double kx = (double)width / new_width;
+    const double ky = (double)height / new_height;
+    const int chunk = new_height / threads;
+
+    std::vector<std::thread> workers;
+    for( int t = 0; t < threads; ++t )
+    {
+        const int row = chunk * t;
+        const int rows = ( t == threads - 1 ) ? new_height - row : chunk;
+
+        workers.emplace_back( [=]()
+        {
+            /* Not thread safe, one per stripe */
+            avir::CLancIR lancir;
+            avir::CLancIRParams params( 0, 0, -kx, -ky, ( kx - 1.0 ) * 0.5, row * ky + ( ky - 1.0 ) * 0.5 );
+            lancir.resizeImage( img_in, width, height, img_out + (size_t)row * new_width * 3, new_width, rows, 3, &params );
+        } );
+    }
+    for( auto &worker : workers ) worker.join();
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,25 @@
+/*!
+* \file lancir_wrapper.h
+* \brief Wrapper for the avir lancir resizer
+*/
+
+#ifndef LANCIR_WRAP_H
+#define LANCIR_WRAP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/* Lanczos (a=3) resize of a 16 bit RGB image, output rows are split between threads */
+extern void lancir_resize_rgb16_wrap(
+        uint16_t * img_in, int width, int height,
+        uint16_t * img_out, int new_width, int new_height,
+        int threads);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LANCIR_WRAP_H
@@ -134,6 +134,57 @@ void contour(uint16_t *sobel_h, uint16_t *sobel_v, int gray_size, uint16_t **con
     }
 }
 
+/*
+ * Gray of a single row, same weights as rgbToGray
+ */
+
+void rgbRowToGray(uint16_t *rgb, uint16_t *gray, int width) {
+    for(int i=0; i<width; i++) {
+        gray[i] = 0.30*rgb[0] + 0.59*rgb[1] + 0.11*rgb[2];
+        rgb += 3;
+    }
+}
+
+/*
+ * Both operators and the magnitude at once, t* is the row above, b* the row below
+ */
+
+static inline uint16_t sobelMagnitude(int tl, int t, int tr, int l, int r, int bl, int b, int br) {
+    int h = (tl - tr) + 2*(l - r) + (bl - br);
+    int v = (bl + 2*b + br) - (tl + 2*t + tr);
+
+    // Same clamping as convolution
+    h = h < 0 ? 0 : (h > 65535 ? 65535 : h);
+    v = v < 0 ? 0 : (v > 65535 ? 65535 : v);
+
+    int res = sqrt((double)h*h + (double)v*v);
+    return res > 65535 ? 65535 : res;
+}
+
+/*
+ * Contour of one row straight from three gray rows, gives the same values as
+ * itConv with both operators followed by contour, without any frame sized
+ * buffers. Rows outside the image must be passed as zeros
+ */
+
+void sobelContourRow(uint16_t *gray_prev, uint16_t *gray, uint16_t *gray_next, uint16_t *contour_row, int width) {
+    uint16_t *p = gray_prev, *c = gray, *n = gray_next;
+
+    if( width == 1 ) {
+        contour_row[0] = sobelMagnitude(0, p[0], 0, 0, 0, 0, n[0], 0);
+        return;
+    }
+
+    contour_row[0] = sobelMagnitude(0, p[0], p[1], 0, c[1], 0, n[0], n[1]);
+
+    // No branches in here, so it can be vectorised
+    for(int x=1; x<width-1; x++) {
+        contour_row[x] = sobelMagnitude(p[x-1], p[x], p[x+1], c[x-1], c[x+1], n[x-1], n[x], n[x+1]);
+    }
+
+    contour_row[width-1] = sobelMagnitude(p[width-2], p[width-1], 0, c[width-2], 0, n[width-2], n[width-1], 0);
+}
+
 int sobelFilter(uint16_t *rgb, uint16_t **gray, uint16_t **sobel_h_res, uint16_t **sobel_v_res, uint16_t **contour_img, int width, int height) {
     int sobel_h[] = {-1, 0, 1, -2, 0, 2, -1, 0, 1},
         sobel_v[] = {1, 2, 1, 0, 0, 0, -1, -2, -1};
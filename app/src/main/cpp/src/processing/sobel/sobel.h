@@ -26,6 +26,8 @@ void makeOpMem   (uint16_t *buffer, int buffer_size, int width, int cindex, uint
 int  convolution (uint16_t *X, int *Y, int c_size);
 void itConv      (uint16_t *buffer, int buffer_size, int width, int *op, uint16_t **res);
 void contour     (uint16_t *sobel_h, uint16_t *sobel_v, int gray_size, uint16_t **contour_img);
+void rgbRowToGray(uint16_t *rgb, uint16_t *gray, int width);
+void sobelContourRow(uint16_t *gray_prev, uint16_t *gray, uint16_t *gray_next, uint16_t *contour_row, int width);
 int  sobelFilter (uint16_t *rgb, uint16_t **gray, uint16_t **sobel_h_res, uint16_t **sobel_v_res, uint16_t **contour_img, int width, int height);
 
 #endif
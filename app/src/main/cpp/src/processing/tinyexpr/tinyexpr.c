@@ -657,3 +657,123 @@ static void pn (const te_expr *n, int depth) {
 void te_print(const te_expr *n) {
     pn(n, 0);
 }
+
+
+/* Flattened expression: the tree in post order, evaluated with a small stack.
+ * Calls the same functions as te_eval, so results are identical. */
+
+#define TE_PROGRAM_STACK 64
+
+typedef struct te_op {
+    int type;
+    union {double value; const double *bound; const void *function;};
+    void *context;
+} te_op;
+
+struct te_program {
+    const double *x;
+    int length;
+    te_op ops[1];
+};
+
+static int te_count_ops(const te_expr *n, int depth, int *max_depth) {
+    if (depth > *max_depth) *max_depth = depth;
+    int count = 1;
+    const int arity = ARITY(n->type);
+    for (int i = 0; i < arity; ++i) {
+        count += te_count_ops(n->parameters[i], depth + i + 1, max_depth);
+    }
+    return count;
+}
+
+static void te_flatten_ops(const te_expr *n, te_op *ops, int *pos) {
+    const int arity = ARITY(n->type);
+    for (int i = 0; i < arity; ++i) {
+        te_flatten_ops(n->parameters[i], ops, pos);
+    }
+    te_op *op = ops + (*pos)++;
+    op->type = n->type;
+    if (TYPE_MASK(n->type) == TE_CONSTANT) op->value = n->value;
+    else op->function = n->function;
+    op->context = IS_CLOSURE(n->type) ? n->parameters[arity] : 0;
+}
+
+te_program *te_flatten(const te_expr *n, const double *x) {
+    if (!n) return 0;
+
+    int max_depth = 0;
+    const int length = te_count_ops(n, 1, &max_depth);
+    if (max_depth > TE_PROGRAM_STACK) return 0;
+
+    te_program *p = malloc(sizeof(te_program) + sizeof(te_op) * (length - 1));
+    p->x = x;
+    p->length = length;
+    int pos = 0;
+    te_flatten_ops(n, p->ops, &pos);
+    return p;
+}
+
+#define TE_FUN(...) ((double(*)(__VA_ARGS__))op->function)
+#define S(e) stack[top + (e)]
+
+double te_run(const te_program *p, double x) {
+    double stack[TE_PROGRAM_STACK];
+    int top = 0;
+
+    for (int i = 0; i < p->length; ++i) {
+        const te_op *op = p->ops + i;
+        const int arity = ARITY(op->type);
+        double result;
+
+        switch(TYPE_MASK(op->type)) {
+            case TE_CONSTANT: result = op->value; break;
+            /* The variable the program was made for comes from the argument */
+            case TE_VARIABLE: result = (op->bound == p->x) ? x : *op->bound; break;
+
+            case TE_FUNCTION0: case TE_FUNCTION1: case TE_FUNCTION2: case TE_FUNCTION3:
+            case TE_FUNCTION4: case TE_FUNCTION5: case TE_FUNCTION6: case TE_FUNCTION7:
+                top -= arity;
+                switch(arity) {
+                    case 0: result = TE_FUN(void)(); break;
+                    case 1: result = TE_FUN(double)(S(0)); break;
+                    case 2: result = TE_FUN(double, double)(S(0), S(1)); break;
+                    case 3: result = TE_FUN(double, double, double)(S(0), S(1), S(2)); break;
+                    case 4: result = TE_FUN(double, double, double, double)(S(0), S(1), S(2), S(3)); break;
+                    case 5: result = TE_FUN(double, double, double, double, double)(S(0), S(1), S(2), S(3), S(4)); break;
+                    case 6: result = TE_FUN(double, double, double, double, double, double)(S(0), S(1), S(2), S(3), S(4), S(5)); break;
+                    case 7: result = TE_FUN(double, double, double, double, double, double, double)(S(0), S(1), S(2), S(3), S(4), S(5), S(6)); break;
+                    default: result = NAN; break;
+                }
+                break;
+
+            case TE_CLOSURE0: case TE_CLOSURE1: case TE_CLOSURE2: case TE_CLOSURE3:
+            case TE_CLOSURE4: case TE_CLOSURE5: case TE_CLOSURE6: case TE_CLOSURE7:
+                top -= arity;
+                switch(arity) {
+                    case 0: result = TE_FUN(void*)(op->context); break;
+                    case 1: result = TE_FUN(void*, double)(op->context, S(0)); break;
+                    case 2: result = TE_FUN(void*, double, double)(op->context, S(0), S(1)); break;
+                    case 3: result = TE_FUN(void*, double, double, double)(op->context, S(0), S(1), S(2)); break;
+                    case 4: result = TE_FUN(void*, double, double, double, double)(op->context, S(0), S(1), S(2), S(3)); break;
+                    case 5: result = TE_FUN(void*, double, double, double, double, double)(op->context, S(0), S(1), S(2), S(3), S(4)); break;
+                    case 6: result = TE_FUN(void*, double, double, double, double, double, double)(op->context, S(0), S(1), S(2), S(3), S(4), S(5)); break;
+                    case 7: result = TE_FUN(void*, double, double, double, double, double, double, double)(op->context, S(0), S(1), S(2), S(3), S(4), S(5), S(6)); break;
+                    default: result = NAN; break;
+                }
+                break;
+
+            default: result = NAN; break;
+        }
+
+        stack[top++] = result;
+    }
+
+    return stack[0];
+}
+
+#undef TE_FUN
+#undef S
+
+void te_program_free(te_program *p) {
+    free(p);
+}
@@ -79,6 +79,20 @@ void te_print(const te_expr *n);
 void te_free(te_expr *n);
 
 
+/* Expression flattened for fast repeated evaluation. */
+typedef struct te_program te_program;
+
+/* Flattens a compiled expression, x is the address of the variable that */
+/* te_run takes as argument. Returns NULL if the expression is too deep. */
+te_program *te_flatten(const te_expr *n, const double *x);
+
+/* Evaluates with x as value of the variable, safe to call from many threads. */
+double te_run(const te_program *p, double x);
+
+/* This is safe to call on NULL pointers. */
+void te_program_free(te_program *p);
+
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,141 @@
+/*
+ * Checks the full 20 bit dual ISO processing on synthetic frames, for both interpolation
+ * methods, with and without fullres blending and with several thread counts. The checksums
+ * are of the single threaded version the row bands replaced. The context is kept between
+ * the cases, so it is also resized between them
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "raw.h"
+#include "dualiso.h"
+#include "test_helper.h"
+
+/* Outputs of the single threaded dual ISO processing, in case order */
+static const uint64_t checksums[] = {
+    0xf7f88a1510681786ULL, /* 400x300 interp=0 fullres=0 alias=0 chroma=0 threads=1 */
+    0xb968c8e7fbb89bb5ULL, /* 400x300 interp=0 fullres=0 alias=1 chroma=2 threads=2 */
+    0xa4b9511dab65f3aaULL, /* 400x300 interp=0 fullres=0 alias=0 chroma=3 threads=4 */
+    0xb968c8e7fbb89bb5ULL, /* 400x300 interp=0 fullres=0 alias=1 chroma=5 threads=7 */
+    0xf45ccd4cd8fa3994ULL, /* 400x300 interp=0 fullres=1 alias=1 chroma=0 threads=1 */
+    0x81454ce7c46ee4bbULL, /* 400x300 interp=0 fullres=1 alias=0 chroma=2 threads=2 */
+    0xad13acdda4990c0cULL, /* 400x300 interp=0 fullres=1 alias=1 chroma=3 threads=4 */
+    0xb534b9ede5d62c64ULL, /* 400x300 interp=0 fullres=1 alias=0 chroma=5 threads=7 */
+    0xe01f618c1473a125ULL, /* 400x300 interp=1 fullres=0 alias=0 chroma=0 threads=1 */
+    0xe01f618c1473a125ULL, /* 400x300 interp=1 fullres=0 alias=1 chroma=2 threads=2 */
+    0xe01f618c1473a125ULL, /* 400x300 interp=1 fullres=0 alias=0 chroma=3 threads=4 */
+    0xe01f618c1473a125ULL, /* 400x300 interp=1 fullres=0 alias=1 chroma=5 threads=7 */
+    0x2100e5e4d9275086ULL, /* 400x300 interp=1 fullres=1 alias=1 chroma=0 threads=1 */
+    0x62c86a4559f258ceULL, /* 400x300 interp=1 fullres=1 alias=0 chroma=2 threads=2 */
+    0x8acf0dd974799adbULL, /* 400x300 interp=1 fullres=1 alias=1 chroma=3 threads=4 */
+    0x04ec4ab403a67ebaULL, /* 400x300 interp=1 fullres=1 alias=0 chroma=5 threads=7 */
+    0xb2374d87ef970d46ULL, /* 256x256 interp=0 fullres=0 alias=0 chroma=2 threads=1 */
+    0x19ac55f1f61ca991ULL, /* 256x256 interp=0 fullres=0 alias=1 chroma=3 threads=2 */
+    0xb2374d87ef970d46ULL, /* 256x256 interp=0 fullres=0 alias=0 chroma=5 threads=4 */
+    0x9c07389d95e01544ULL, /* 256x256 interp=0 fullres=0 alias=1 chroma=0 threads=7 */
+    0x4ef10c112b7f62d7ULL, /* 256x256 interp=0 fullres=1 alias=1 chroma=2 threads=1 */
+    0x72c8d7c5fd429dd9ULL, /* 256x256 interp=0 fullres=1 alias=0 chroma=3 threads=2 */
+    0xdb555b22eb3e7a69ULL, /* 256x256 interp=0 fullres=1 alias=1 chroma=5 threads=4 */
+    0xa8362227135b0a20ULL, /* 256x256 interp=0 fullres=1 alias=0 chroma=0 threads=7 */
+    0xc74b47c8c74a2325ULL, /* 256x256 interp=1 fullres=0 alias=0 chroma=2 threads=1 */
+    0xc74b47c8c74a2325ULL, /* 256x256 interp=1 fullres=0 alias=1 chroma=3 threads=2 */
+    0xc74b47c8c74a2325ULL, /* 256x256 interp=1 fullres=0 alias=0 chroma=5 threads=4 */
+    0xc74b47c8c74a2325ULL, /* 256x256 interp=1 fullres=0 alias=1 chroma=0 threads=7 */
+    0x56d00d14932568eeULL, /* 256x256 interp=1 fullres=1 alias=1 chroma=2 threads=1 */
+    0x8adbf57bbcc4f340ULL, /* 256x256 interp=1 fullres=1 alias=0 chroma=3 threads=2 */
+    0x496b6006ee145627ULL, /* 256x256 interp=1 fullres=1 alias=1 chroma=5 threads=4 */
+    0x76b6f26813997d3bULL, /* 256x256 interp=1 fullres=1 alias=0 chroma=0 threads=7 */
+    0x07a3b52049fe6b05ULL, /* 344x211 interp=0 fullres=0 alias=0 chroma=3 threads=1 */
+    0xa2db6899cedeba28ULL, /* 344x211 interp=0 fullres=0 alias=1 chroma=5 threads=2 */
+    0xfab6ada9ef8e7074ULL, /* 344x211 interp=0 fullres=0 alias=0 chroma=0 threads=4 */
+    0xa2db6899cedeba28ULL, /* 344x211 interp=0 fullres=0 alias=1 chroma=2 threads=7 */
+    0xf10d3028f08e573eULL, /* 344x211 interp=0 fullres=1 alias=1 chroma=3 threads=1 */
+    0x939dfbfa8fe01d03ULL, /* 344x211 interp=0 fullres=1 alias=0 chroma=5 threads=2 */
+    0xbfdfe8ce21233c9cULL, /* 344x211 interp=0 fullres=1 alias=1 chroma=0 threads=4 */
+    0x4cf20590b9ad6e06ULL, /* 344x211 interp=0 fullres=1 alias=0 chroma=2 threads=7 */
+    0xc108ca96afd93065ULL, /* 344x211 interp=1 fullres=0 alias=0 chroma=3 threads=1 */
+    0xc108ca96afd93065ULL, /* 344x211 interp=1 fullres=0 alias=1 chroma=5 threads=2 */
+    0xc108ca96afd93065ULL, /* 344x211 interp=1 fullres=0 alias=0 chroma=0 threads=4 */
+    0xc108ca96afd93065ULL, /* 344x211 interp=1 fullres=0 alias=1 chroma=2 threads=7 */
+    0x0310522f3ea0d044ULL, /* 344x211 interp=1 fullres=1 alias=1 chroma=3 threads=1 */
+    0x9c2a68f9598bd132ULL, /* 344x211 interp=1 fullres=1 alias=0 chroma=5 threads=2 */
+    0x787f9c23c8008cbdULL, /* 344x211 interp=1 fullres=1 alias=1 chroma=0 threads=4 */
+    0x7d79fe1dd518353aULL, /* 344x211 interp=1 fullres=1 alias=0 chroma=2 threads=7 */
+    0xc6ecc1ddbd41b325ULL, /* 64x40 interp=0 fullres=0 alias=0 chroma=5 threads=1 */
+    0xc6ecc1ddbd41b325ULL, /* 64x40 interp=0 fullres=0 alias=1 chroma=0 threads=2 */
+    0xc6ecc1ddbd41b325ULL, /* 64x40 interp=0 fullres=0 alias=0 chroma=2 threads=4 */
+    0xc6ecc1ddbd41b325ULL, /* 64x40 interp=0 fullres=0 alias=1 chroma=3 threads=7 */
+    0x6476efe414fc4e84ULL, /* 64x40 interp=0 fullres=1 alias=1 chroma=5 threads=1 */
+    0x094834ee00b6cf61ULL, /* 64x40 interp=0 fullres=1 alias=0 chroma=0 threads=2 */
+    0x3d8bb7b907364ee3ULL, /* 64x40 interp=0 fullres=1 alias=1 chroma=2 threads=4 */
+    0xd499a4827e5982a6ULL, /* 64x40 interp=0 fullres=1 alias=0 chroma=3 threads=7 */
+    0xc6ecc1ddbd41b325ULL, /* 64x40 interp=1 fullres=0 alias=0 chroma=5 threads=1 */
+    0xc6ecc1ddbd41b325ULL, /* 64x40 interp=1 fullres=0 alias=1 chroma=0 threads=2 */
+    0xc6ecc1ddbd41b325ULL, /* 64x40 interp=1 fullres=0 alias=0 chroma=2 threads=4 */
+    0xc6ecc1ddbd41b325ULL, /* 64x40 interp=1 fullres=0 alias=1 chroma=3 threads=7 */
+    0x4b5a2935d7920060ULL, /* 64x40 interp=1 fullres=1 alias=1 chroma=5 threads=1 */
+    0x094834ee00b6cf61ULL, /* 64x40 interp=1 fullres=1 alias=0 chroma=0 threads=2 */
+    0x3ed1025e3168bef9ULL, /* 64x40 interp=1 fullres=1 alias=1 chroma=2 threads=4 */
+    0x452d963d42aeb2e9ULL, /* 64x40 interp=1 fullres=1 alias=0 chroma=3 threads=7 */
+};
+
+/* ISO 100/1600 pairs of rows (BBdd) with clipped highlights on the right. The random dither is
+ * never initialized, so it is the same on every run */
+static const test_frame_t look = { .range = 700, .noise = 20, .colour = 1, .dual_iso = 16, .seed = 1 };
+
+static int run_case(test_run_t * run, diso_context_t * ctx, int w, int h, int interp, int fullres, int alias_map, int chroma_smooth, int threads)
+{
+    struct raw_info raw_info;
+    memset(&raw_info, 0, sizeof(raw_info));
+    raw_info.width = w;
+    raw_info.height = h;
+    raw_info.pitch = w * 14 / 8;
+    raw_info.bits_per_pixel = 14;
+    raw_info.black_level = BLACK;
+    raw_info.white_level = WHITE;
+    raw_info.active_area.x2 = w;
+    raw_info.active_area.y2 = h;
+
+    uint16_t * frame = malloc(w * h * sizeof(uint16_t));
+    make_test_frame(frame, w, h, &look);
+
+    int pattern = 0, auto_correction = 1, black_delta = 0;
+    double ev_correction = 0;
+    diso_get_full20bit(ctx, raw_info, frame, 0, 100, 1600, NULL, 0, &pattern, &auto_correction, &ev_correction, &black_delta, interp, alias_map, fullres, chroma_smooth, threads);
+
+    char what[96];
+    snprintf(what, sizeof(what), "%dx%d interp=%d fullres=%d alias=%d chroma=%d threads=%d",
+             w, h, interp, fullres, alias_map, chroma_smooth, threads);
+    int failed = test_check(run, what, frame, w * h * sizeof(uint16_t));
+
+    free(frame);
+    return failed;
+}
+
+int main(int argc, char ** argv)
+{
+    /* raw widths are multiples of 8, on the others AMaZe leaves the last green columns unset */
+    static const int sizes[][2] = { { 400, 300 }, { 256, 256 }, { 344, 211 }, { 64, 40 } };
+    static const int threads[] = { 1, 2, 4, 7 };
+    static const int chroma_smooth[] = { 0, 2, 3, 5 };
+    test_run_t run;
+    test_begin(&run, "dualiso", checksums, COUNT(checksums), argc, argv);
+
+    diso_context_t * ctx = diso_new_context();
+
+    for (int s = 0; s < COUNT(sizes); s++)
+        for (int interp = 0; interp < 2; interp++)
+            for (int fullres = 0; fullres < 2; fullres++)
+                for (int t = 0; t < COUNT(threads); t++)
+                {
+                    /* alias map and chroma smoothing change along with the other options, so they don't multiply the cases */
+                    int alias_map = (t + fullres) & 1;
+                    int chroma = chroma_smooth[(s + t) % COUNT(chroma_smooth)];
+                    test_case(&run, run_case(&run, ctx, sizes[s][0], sizes[s][1], interp, fullres, alias_map, chroma, threads[t]));
+                }
+
+    diso_free_context(ctx);
+
+    return test_end(&run);
+}
@@ -0,0 +1,60 @@
+#ifndef _test_arm_neon_h
+#define _test_arm_neon_h
+
+/*
+ * The NEON intrinsics the raw passes use, in plain C on GCC/Clang vectors. Lets the *_neon
+ * tests build the NEON paths on a host that is not ARM and check them against the same
+ * checksums as the plain C paths. Lane order is the one of little endian ARM
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+typedef int32_t int32x4_t __attribute__((vector_size(16)));
+typedef uint32_t uint32x4_t __attribute__((vector_size(16)));
+typedef struct { int32x4_t val[2]; } int32x4x2_t;
+
+static inline int32x4_t vld1q_s32(const int32_t * p) { int32x4_t v; memcpy(&v, p, 16); return v; }
+static inline void vst1q_s32(int32_t * p, int32x4_t v) { memcpy(p, &v, 16); }
+static inline int32x4x2_t vld2q_s32(const int32_t * p)
+{
+    int32x4x2_t r;
+    for (int i = 0; i < 4; i++)
+    {
+        r.val[0][i] = p[2 * i];
+        r.val[1][i] = p[2 * i + 1];
+    }
+    return r;
+}
+static inline int32x4_t vdupq_n_s32(int32_t a) { int32x4_t v = { a, a, a, a }; return v; }
+static inline int32x4_t vaddq_s32(int32x4_t a, int32x4_t b) { return (int32x4_t)((uint32x4_t)a + (uint32x4_t)b); }
+static inline int32x4_t vsubq_s32(int32x4_t a, int32x4_t b) { return (int32x4_t)((uint32x4_t)a - (uint32x4_t)b); }
+static inline int32x4_t vminq_s32(int32x4_t a, int32x4_t b) { int32x4_t r; for (int i = 0; i < 4; i++) r[i] = a[i] < b[i] ? a[i] : b[i]; return r; }
+static inline int32x4_t vmaxq_s32(int32x4_t a, int32x4_t b) { int32x4_t r; for (int i = 0; i < 4; i++) r[i] = a[i] > b[i] ? a[i] : b[i]; return r; }
+static inline int32x4_t vabdq_s32(int32x4_t a, int32x4_t b) { int32x4_t r; for (int i = 0; i < 4; i++) r[i] = a[i] > b[i] ? a[i] - b[i] : b[i] - a[i]; return r; }
+static inline int32x4_t vreinterpretq_s32_u32(uint32x4_t a) { return (int32x4_t)a; }
+static inline uint32x4_t vreinterpretq_u32_s32(int32x4_t a) { return (uint32x4_t)a; }
+/* arithmetic for signed lanes, logical for unsigned ones, like the real ones */
+#define vshrq_n_s32(a, n) ((a) >> (n))
+#define vshrq_n_u32(a, n) ((a) >> (n))
+
+typedef int16_t int16x8_t __attribute__((vector_size(16)));
+typedef uint16_t uint16x8_t __attribute__((vector_size(16)));
+
+static inline int16x8_t vld1q_s16(const int16_t * p) { int16x8_t v; memcpy(&v, p, 16); return v; }
+static inline void vst1q_s16(int16_t * p, int16x8_t v) { memcpy(p, &v, 16); }
+static inline void vst1q_u16(uint16_t * p, uint16x8_t v) { memcpy(p, &v, 16); }
+static inline int16x8_t vdupq_n_s16(int16_t a) { int16x8_t v; for (int i = 0; i < 8; i++) v[i] = a; return v; }
+static inline int16x8_t vaddq_s16(int16x8_t a, int16x8_t b) { return (int16x8_t)((uint16x8_t)a + (uint16x8_t)b); }
+static inline int16x8_t vsubq_s16(int16x8_t a, int16x8_t b) { return (int16x8_t)((uint16x8_t)a - (uint16x8_t)b); }
+/* halving add, the sum does not overflow */
+static inline int16x8_t vhaddq_s16(int16x8_t a, int16x8_t b) { int16x8_t r; for (int i = 0; i < 8; i++) r[i] = (int16_t)(((int)a[i] + b[i]) >> 1); return r; }
+static inline int16x8_t vandq_s16(int16x8_t a, int16x8_t b) { return a & b; }
+static inline int16x8_t veorq_s16(int16x8_t a, int16x8_t b) { return a ^ b; }
+static inline uint16x8_t vorrq_u16(uint16x8_t a, uint16x8_t b) { return a | b; }
+static inline uint16x8_t vcgtq_s16(int16x8_t a, int16x8_t b) { uint16x8_t r; for (int i = 0; i < 8; i++) r[i] = a[i] > b[i] ? 0xFFFF : 0; return r; }
+/* saturating, -32768 gives 32767 */
+static inline int16x8_t vqabsq_s16(int16x8_t a) { int16x8_t r; for (int i = 0; i < 8; i++) r[i] = a[i] == INT16_MIN ? INT16_MAX : (a[i] < 0 ? -a[i] : a[i]); return r; }
+#define vshrq_n_s16(a, n) ((a) >> (n))
+
+#endif
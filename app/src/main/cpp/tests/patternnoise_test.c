@@ -0,0 +1,87 @@
+/*
+ * Checks the pattern noise removal on synthetic frames with column and row noise, with and
+ * without the debug outputs, on several frame sizes and thread counts, against checksums of
+ * the single threaded version
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "patternnoise.h"
+#include "test_helper.h"
+
+/* Outputs of the single threaded pattern noise removal, in case order */
+static const uint64_t checksums[] = {
+    0x2387501bcc8cc72eULL, /* 400x300 debug=0 threads=1 */
+    0x3edf755b132273a1ULL, /* 400x300 debug=1 threads=2 */
+    0x9434f93acaef6543ULL, /* 400x300 debug=2 threads=3 */
+    0xe13d68a8be535646ULL, /* 400x300 debug=5 threads=8 */
+    0xfc961e656b060db3ULL, /* 258x130 debug=0 threads=1 */
+    0x5c1184cfd47a7fcfULL, /* 258x130 debug=2 threads=2 */
+    0xbe668e0e533730e8ULL, /* 258x130 debug=5 threads=3 */
+    0xd519d4b353f5e225ULL, /* 258x130 debug=8 threads=8 */
+    0xafcea805a8956ea1ULL, /* 1736x98 debug=0 threads=1 */
+    0xdac038214778258cULL, /* 1736x98 debug=5 threads=2 */
+    0xacaa41bef7010d05ULL, /* 1736x98 debug=8 threads=3 */
+    0xafcea805a8956ea1ULL, /* 1736x98 debug=0 threads=8 */
+    0xb2c061e075bd7579ULL, /* 64x40 debug=0 threads=1 */
+    0x97ab955616c5cdecULL, /* 64x40 debug=8 threads=2 */
+    0xb2c061e075bd7579ULL, /* 64x40 debug=0 threads=3 */
+    0xb98e5d51d33686adULL, /* 64x40 debug=1 threads=8 */
+};
+
+/* Dark scene with edges, an offset on every column and row and a clipped top right corner */
+static const test_frame_t look = { .range = 750, .noise = 20, .column_offset = 15, .row_offset = 10, .seed = 1 };
+
+static void make_frame(uint16_t * frame, int w, int h)
+{
+    make_test_frame(frame, w, h, &look);
+    for (int y = 0; y < h / 3; y++)
+        for (int x = w * 7 / 8 + 1; x < w; x++)
+            frame[x + y * w] = WHITE;
+}
+
+static int run_case(test_run_t * run, int w, int h, int debug_flags, int threads)
+{
+    /* the frame stays well inside int16 */
+    uint16_t * frame = malloc(w * h * sizeof(uint16_t));
+    uint16_t * original = malloc(w * h * sizeof(uint16_t));
+    make_frame(frame, w, h);
+    memcpy(original, frame, w * h * sizeof(uint16_t));
+
+    fix_pattern_noise((int16_t *)frame, w, h, WHITE, debug_flags, threads);
+
+    char what[64];
+    snprintf(what, sizeof(what), "%dx%d debug=%d threads=%d", w, h, debug_flags, threads);
+    int failed = test_check(run, what, frame, w * h * sizeof(uint16_t));
+
+    /* the noise has to have been taken out, not just left alone */
+    if (!debug_flags && !memcmp(frame, original, w * h * sizeof(uint16_t)))
+    {
+        printf("FAIL %s: nothing was fixed\n", what);
+        failed = 1;
+    }
+
+    free(frame);
+    free(original);
+    return failed;
+}
+
+int main(int argc, char ** argv)
+{
+    static const int sizes[][2] = { { 400, 300 }, { 258, 130 }, { 1736, 98 }, { 64, 40 } };
+    static const int threads[] = { 1, 2, 3, 8 };
+    static const int debug_flags[] = { 0, FIXPN_DBG_ROWNOISE, FIXPN_DBG_DENOISED, FIXPN_DBG_NOISE | FIXPN_DBG_ROWNOISE, FIXPN_DBG_MASK };
+    test_run_t run;
+    test_begin(&run, "patternnoise", checksums, COUNT(checksums), argc, argv);
+
+    for (int s = 0; s < COUNT(sizes); s++)
+        for (int t = 0; t < COUNT(threads); t++)
+        {
+            /* the debug outputs change along with the sizes, so they don't multiply the cases */
+            int flags = (t == 0) ? 0 : debug_flags[(s + t) % COUNT(debug_flags)];
+            test_case(&run, run_case(&run, sizes[s][0], sizes[s][1], flags, threads[t]));
+        }
+
+    return test_end(&run);
+}
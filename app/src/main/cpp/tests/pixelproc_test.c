@@ -0,0 +1,287 @@
+/*
+ * Checks the pixel processing passes on synthetic frames against checksums of the single
+ * threaded versions: chroma smoothing with every method, on several frame sizes and thread
+ * counts, and focus and bad pixel fixing with generated, searched and loaded maps, every
+ * interpolation method and several thread counts
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "raw.h"
+#include "pixelproc.h"
+#include "test_helper.h"
+
+/* Outputs of the single threaded chroma smoothing and focus and bad pixel fixing, in case order */
+static const uint64_t checksums[] = {
+    0xb53586a61513e893ULL, /* chroma_smooth 2x2 400x300 threads=1 */
+    0xb53586a61513e893ULL, /* chroma_smooth 2x2 400x300 threads=2 */
+    0xb53586a61513e893ULL, /* chroma_smooth 2x2 400x300 threads=3 */
+    0xb53586a61513e893ULL, /* chroma_smooth 2x2 400x300 threads=8 */
+    0x2797faed42f687f4ULL, /* chroma_smooth 3x3 400x300 threads=1 */
+    0x2797faed42f687f4ULL, /* chroma_smooth 3x3 400x300 threads=2 */
+    0x2797faed42f687f4ULL, /* chroma_smooth 3x3 400x300 threads=3 */
+    0x2797faed42f687f4ULL, /* chroma_smooth 3x3 400x300 threads=8 */
+    0x349754fc6f948e90ULL, /* chroma_smooth 5x5 400x300 threads=1 */
+    0x349754fc6f948e90ULL, /* chroma_smooth 5x5 400x300 threads=2 */
+    0x349754fc6f948e90ULL, /* chroma_smooth 5x5 400x300 threads=3 */
+    0x349754fc6f948e90ULL, /* chroma_smooth 5x5 400x300 threads=8 */
+    0x9bf34a151b57be66ULL, /* chroma_smooth 2x2 258x131 threads=1 */
+    0x9bf34a151b57be66ULL, /* chroma_smooth 2x2 258x131 threads=2 */
+    0x9bf34a151b57be66ULL, /* chroma_smooth 2x2 258x131 threads=3 */
+    0x9bf34a151b57be66ULL, /* chroma_smooth 2x2 258x131 threads=8 */
+    0xaa1b2cf50e5a4b60ULL, /* chroma_smooth 3x3 258x131 threads=1 */
+    0xaa1b2cf50e5a4b60ULL, /* chroma_smooth 3x3 258x131 threads=2 */
+    0xaa1b2cf50e5a4b60ULL, /* chroma_smooth 3x3 258x131 threads=3 */
+    0xaa1b2cf50e5a4b60ULL, /* chroma_smooth 3x3 258x131 threads=8 */
+    0x8c0326073a47aa19ULL, /* chroma_smooth 5x5 258x131 threads=1 */
+    0x8c0326073a47aa19ULL, /* chroma_smooth 5x5 258x131 threads=2 */
+    0x8c0326073a47aa19ULL, /* chroma_smooth 5x5 258x131 threads=3 */
+    0x8c0326073a47aa19ULL, /* chroma_smooth 5x5 258x131 threads=8 */
+    0xd758b7fe1bff0b4bULL, /* chroma_smooth 2x2 64x40 threads=1 */
+    0xd758b7fe1bff0b4bULL, /* chroma_smooth 2x2 64x40 threads=2 */
+    0xd758b7fe1bff0b4bULL, /* chroma_smooth 2x2 64x40 threads=3 */
+    0xd758b7fe1bff0b4bULL, /* chroma_smooth 2x2 64x40 threads=8 */
+    0xa0589766d31ae968ULL, /* chroma_smooth 3x3 64x40 threads=1 */
+    0xa0589766d31ae968ULL, /* chroma_smooth 3x3 64x40 threads=2 */
+    0xa0589766d31ae968ULL, /* chroma_smooth 3x3 64x40 threads=3 */
+    0xa0589766d31ae968ULL, /* chroma_smooth 3x3 64x40 threads=8 */
+    0xa623be4ba067b949ULL, /* chroma_smooth 5x5 64x40 threads=1 */
+    0xa623be4ba067b949ULL, /* chroma_smooth 5x5 64x40 threads=2 */
+    0xa623be4ba067b949ULL, /* chroma_smooth 5x5 64x40 threads=3 */
+    0xa623be4ba067b949ULL, /* chroma_smooth 5x5 64x40 threads=8 */
+    0x3b647e16986b5f1aULL, /* chroma_smooth 2x2 24x18 threads=1 */
+    0x3b647e16986b5f1aULL, /* chroma_smooth 2x2 24x18 threads=2 */
+    0x3b647e16986b5f1aULL, /* chroma_smooth 2x2 24x18 threads=3 */
+    0x3b647e16986b5f1aULL, /* chroma_smooth 2x2 24x18 threads=8 */
+    0x09c0d9c789fb7b7eULL, /* chroma_smooth 3x3 24x18 threads=1 */
+    0x09c0d9c789fb7b7eULL, /* chroma_smooth 3x3 24x18 threads=2 */
+    0x09c0d9c789fb7b7eULL, /* chroma_smooth 3x3 24x18 threads=3 */
+    0x09c0d9c789fb7b7eULL, /* chroma_smooth 3x3 24x18 threads=8 */
+    0x7d16d95d268f71bdULL, /* chroma_smooth 5x5 24x18 threads=1 */
+    0x7d16d95d268f71bdULL, /* chroma_smooth 5x5 24x18 threads=2 */
+    0x7d16d95d268f71bdULL, /* chroma_smooth 5x5 24x18 threads=3 */
+    0x7d16d95d268f71bdULL, /* chroma_smooth 5x5 24x18 threads=8 */
+    0xd75748045d6f89e5ULL, /* fix_focus_pixels 80000301 1808x727 crop_rec=0 unified=0 method=0 dual_iso=0 threads=1 */
+    0x6150c38719d41772ULL, /* fix_focus_pixels 80000301 1808x727 crop_rec=0 unified=0 method=1 dual_iso=0 threads=2 */
+    0xc1ef7c1b86f532bcULL, /* fix_focus_pixels 80000301 1808x727 crop_rec=0 unified=0 method=2 dual_iso=0 threads=3 */
+    0x67cf87315444ddf9ULL, /* fix_focus_pixels 80000301 1808x727 crop_rec=0 unified=0 method=0 dual_iso=1 threads=8 */
+    0xe035653f08df279aULL, /* fix_focus_pixels 80000301 1808x1190 crop_rec=0 unified=0 method=0 dual_iso=0 threads=2 */
+    0x813728a0b6a3519bULL, /* fix_focus_pixels 80000301 1808x1190 crop_rec=0 unified=0 method=1 dual_iso=0 threads=3 */
+    0x1c0a36d451466622ULL, /* fix_focus_pixels 80000301 1808x1190 crop_rec=0 unified=0 method=2 dual_iso=0 threads=8 */
+    0x4adf439aea5adefeULL, /* fix_focus_pixels 80000301 1808x1190 crop_rec=0 unified=0 method=0 dual_iso=1 threads=1 */
+    0xba48fc254dce82a1ULL, /* fix_focus_pixels 80000301 1872x1060 crop_rec=0 unified=0 method=0 dual_iso=0 threads=3 */
+    0xac0919ade3fa4534ULL, /* fix_focus_pixels 80000301 1872x1060 crop_rec=0 unified=0 method=1 dual_iso=0 threads=8 */
+    0xec347af5b447cbb8ULL, /* fix_focus_pixels 80000301 1872x1060 crop_rec=0 unified=0 method=2 dual_iso=0 threads=1 */
+    0xdd1d1a2b0d6a0248ULL, /* fix_focus_pixels 80000301 1872x1060 crop_rec=0 unified=0 method=0 dual_iso=1 threads=2 */
+    0x76068576b6d2f469ULL, /* fix_focus_pixels 80000301 2592x1108 crop_rec=0 unified=0 method=0 dual_iso=0 threads=8 */
+    0xeccd091f5dd7da58ULL, /* fix_focus_pixels 80000301 2592x1108 crop_rec=0 unified=0 method=1 dual_iso=0 threads=1 */
+    0x2fafba0a666e2776ULL, /* fix_focus_pixels 80000301 2592x1108 crop_rec=0 unified=0 method=2 dual_iso=0 threads=2 */
+    0x04b2a721c5347164ULL, /* fix_focus_pixels 80000301 2592x1108 crop_rec=0 unified=0 method=0 dual_iso=1 threads=3 */
+    0x46a07b8133d08923ULL, /* fix_focus_pixels 80000301 1808x727 crop_rec=1 unified=0 method=0 dual_iso=0 threads=1 */
+    0x009e2568d4833d18ULL, /* fix_focus_pixels 80000301 1808x727 crop_rec=1 unified=0 method=1 dual_iso=0 threads=2 */
+    0x2f4f217a1bc13677ULL, /* fix_focus_pixels 80000301 1808x727 crop_rec=1 unified=0 method=2 dual_iso=0 threads=3 */
+    0xc9fe2102570d0479ULL, /* fix_focus_pixels 80000301 1808x727 crop_rec=1 unified=0 method=0 dual_iso=1 threads=8 */
+    0x03c4bb4ffab91587ULL, /* fix_focus_pixels 80000331 1808x1190 crop_rec=0 unified=1 method=0 dual_iso=0 threads=2 */
+    0x1338c54d4fff5ff6ULL, /* fix_focus_pixels 80000331 1808x1190 crop_rec=0 unified=1 method=1 dual_iso=0 threads=3 */
+    0x20201aec12d3cabbULL, /* fix_focus_pixels 80000331 1808x1190 crop_rec=0 unified=1 method=2 dual_iso=0 threads=8 */
+    0x419b12de271fd27bULL, /* fix_focus_pixels 80000331 1808x1190 crop_rec=0 unified=1 method=0 dual_iso=1 threads=1 */
+    0x6aad3cd6f87020a1ULL, /* fix_bad_pixels 400x300 mode=1 search=0 method=0 dual_iso=0 threads=1 */
+    0x6aad3cd6f87020a1ULL, /* fix_bad_pixels 400x300 mode=1 search=0 method=0 dual_iso=0 threads=8 */
+    0xb5de6345a2aeca45ULL, /* fix_bad_pixels 400x300 mode=1 search=0 method=1 dual_iso=0 threads=1 */
+    0xb5de6345a2aeca45ULL, /* fix_bad_pixels 400x300 mode=1 search=0 method=1 dual_iso=0 threads=8 */
+    0x9315ae63d3ec8185ULL, /* fix_bad_pixels 400x300 mode=1 search=0 method=2 dual_iso=0 threads=1 */
+    0x9315ae63d3ec8185ULL, /* fix_bad_pixels 400x300 mode=1 search=0 method=2 dual_iso=0 threads=8 */
+    0x21903789cfbb7b44ULL, /* fix_bad_pixels 400x300 mode=1 search=0 method=0 dual_iso=1 threads=1 */
+    0x21903789cfbb7b44ULL, /* fix_bad_pixels 400x300 mode=1 search=0 method=0 dual_iso=1 threads=8 */
+    0xdea4eca3fea30ee5ULL, /* fix_bad_pixels 400x300 mode=1 search=1 method=0 dual_iso=0 threads=1 */
+    0xdea4eca3fea30ee5ULL, /* fix_bad_pixels 400x300 mode=1 search=1 method=0 dual_iso=0 threads=3 */
+    0xc3e4f8670bf28f68ULL, /* fix_bad_pixels 400x300 mode=1 search=1 method=1 dual_iso=0 threads=1 */
+    0xc3e4f8670bf28f68ULL, /* fix_bad_pixels 400x300 mode=1 search=1 method=1 dual_iso=0 threads=3 */
+    0xbb918a2d003fca58ULL, /* fix_bad_pixels 400x300 mode=1 search=1 method=2 dual_iso=0 threads=1 */
+    0xbb918a2d003fca58ULL, /* fix_bad_pixels 400x300 mode=1 search=1 method=2 dual_iso=0 threads=3 */
+    0x8c38af0dc4ba96d7ULL, /* fix_bad_pixels 400x300 mode=1 search=1 method=0 dual_iso=1 threads=1 */
+    0x8c38af0dc4ba96d7ULL, /* fix_bad_pixels 400x300 mode=1 search=1 method=0 dual_iso=1 threads=3 */
+    0x6c193ff6a88e4847ULL, /* fix_bad_pixels 400x300 mode=3 search=0 method=0 dual_iso=0 threads=1 */
+    0x6c193ff6a88e4847ULL, /* fix_bad_pixels 400x300 mode=3 search=0 method=0 dual_iso=0 threads=8 */
+    0x59afdb2ba87d31bcULL, /* fix_bad_pixels 400x300 mode=3 search=0 method=1 dual_iso=0 threads=1 */
+    0x59afdb2ba87d31bcULL, /* fix_bad_pixels 400x300 mode=3 search=0 method=1 dual_iso=0 threads=8 */
+    0x527effc5627090aaULL, /* fix_bad_pixels 400x300 mode=3 search=0 method=2 dual_iso=0 threads=1 */
+    0x527effc5627090aaULL, /* fix_bad_pixels 400x300 mode=3 search=0 method=2 dual_iso=0 threads=8 */
+    0xe3e7bed6896b4b00ULL, /* fix_bad_pixels 400x300 mode=3 search=0 method=0 dual_iso=1 threads=1 */
+    0xe3e7bed6896b4b00ULL, /* fix_bad_pixels 400x300 mode=3 search=0 method=0 dual_iso=1 threads=8 */
+};
+
+/* Bayer frame with coloured edges, clipped highlights on the right and a dark corner near the
+ * noise floor */
+static const test_frame_t look = { .range = 3000, .noise = 30, .colour = 1, .dark_corner = 1, .seed = 1 };
+
+/* Hot and cold pixels for the bad pixel search, away from the dark corner */
+static void add_bad_pixels(uint16_t * frame, int w, int h)
+{
+    uint32_t state = 2;
+    for (int k = 0; k < w * h / 2000; k++)
+    {
+        int x = w / 6 + test_random(&state) % (w - w / 6);
+        int y = test_random(&state) % h;
+        frame[x + y * w] = (k & 3) ? WHITE : BLACK - 200;
+    }
+}
+
+static int chroma_smooth_case(test_run_t * run, int w, int h, int method, int threads, int * raw2ev, int * ev2raw)
+{
+    uint16_t * frame = malloc(w * h * sizeof(uint16_t));
+    uint16_t * original = malloc(w * h * sizeof(uint16_t));
+    make_test_frame(frame, w, h, &look);
+    memcpy(original, frame, w * h * sizeof(uint16_t));
+
+    chroma_smooth(method, frame, w, h, BLACK, WHITE, raw2ev, ev2raw, threads);
+
+    char what[64];
+    snprintf(what, sizeof(what), "chroma_smooth %dx%d %dx%d threads=%d", method, method, w, h, threads);
+    int failed = test_check(run, what, frame, w * h * sizeof(uint16_t));
+
+    /* frames too small for the filter stay as they are, the others must have been filtered */
+    if (w >= 64 && !memcmp(frame, original, w * h * sizeof(uint16_t)))
+    {
+        printf("FAIL %s: nothing was filtered\n", what);
+        failed = 1;
+    }
+
+    free(frame);
+    free(original);
+    return failed;
+}
+
+/* Focus pixel maps generated for the camera and raw size, frame cropped out of the raw buffer at pan */
+static int focus_case(test_run_t * run, uint32_t camera_id, int raw_w, int raw_h, int crop_rec, int unified, int pan_x, int pan_y,
+                      int average_method, int dual_iso, int threads, int * raw2ev, int * ev2raw)
+{
+    int w = raw_w - pan_x - 8, h = raw_h - pan_y - 2;
+    uint16_t * frame = malloc(w * h * sizeof(uint16_t));
+    make_test_frame(frame, w, h, &look);
+
+    pixel_map focus_map = { PIX_FOCUS, 0, 0, NULL }, no_map = { PIX_BAD, 0, 0, NULL };
+    int status = 0;
+    fix_focus_pixels(&focus_map, &status, frame, camera_id, w, h, pan_x, pan_y, raw_w, raw_h,
+                     crop_rec, unified, average_method, dual_iso, -1, raw2ev, ev2raw, threads);
+
+    char what[96];
+    snprintf(what, sizeof(what), "fix_focus_pixels %x %dx%d crop_rec=%d unified=%d method=%d dual_iso=%d threads=%d",
+             camera_id, raw_w, raw_h, crop_rec, unified, average_method, dual_iso, threads);
+    int failed = test_check(run, what, frame, w * h * sizeof(uint16_t));
+    if (!focus_map.count)
+    {
+        printf("FAIL %s: no map\n", what);
+        failed = 1;
+    }
+
+    free_pixel_maps(&focus_map, &no_map);
+    free(frame);
+    return failed;
+}
+
+/* Bad pixels searched for (bpm_mode 1) or loaded from a .bpm in the current directory (bpm_mode 3) */
+static int bad_case(test_run_t * run, int w, int h, int bpm_mode, int search_method, int average_method, int dual_iso, int threads,
+                    int * raw2ev, int * ev2raw)
+{
+    uint16_t * frame = malloc(w * h * sizeof(uint16_t));
+    make_test_frame(frame, w, h, &look);
+    add_bad_pixels(frame, w, h);
+
+    pixel_map bad_map = { PIX_BAD, 0, 0, NULL }, no_map = { PIX_FOCUS, 0, 0, NULL };
+    int status = 0;
+    fix_bad_pixels(&bad_map, &status, frame, 0x80000301, w, h, 0, 0, w, h, BLACK,
+                   bpm_mode, search_method, average_method, dual_iso, -1, raw2ev, ev2raw, threads);
+
+    char what[96];
+    snprintf(what, sizeof(what), "fix_bad_pixels %dx%d mode=%d search=%d method=%d dual_iso=%d threads=%d",
+             w, h, bpm_mode, search_method, average_method, dual_iso, threads);
+    int failed = test_check(run, what, frame, w * h * sizeof(uint16_t));
+    if (!bad_map.count)
+    {
+        printf("FAIL %s: no map\n", what);
+        failed = 1;
+    }
+
+    free_pixel_maps(&no_map, &bad_map);
+    free(frame);
+    return failed;
+}
+
+/* .bpm in row order, with pixels on the frame edges and next to each other */
+static int write_bad_pixel_map(int w, int h)
+{
+    char file_name[64];
+    snprintf(file_name, sizeof(file_name), "%x_%ix%i.bpm", 0x80000301, w, h);
+    FILE * f = fopen(file_name, "w");
+    if (!f) return 0;
+    fprintf(f, "#FPM 80000301\n");
+    for (int y = 0; y < h; y += 7)
+        for (int x = (y * 13) % 29; x < w; x += 29 + (y & 3))
+        {
+            fprintf(f, "%d %d\n", x, y);
+            if (x + 2 < w && (x & 1)) fprintf(f, "%d %d\n", x + 2, y);
+        }
+    fclose(f);
+    return 1;
+}
+
+int main(int argc, char ** argv)
+{
+    static const int sizes[][2] = { { 400, 300 }, { 258, 131 }, { 64, 40 }, { 24, 18 } };
+    static const int threads[] = { 1, 2, 3, 8 };
+    static const int methods[] = { 2, 3, 5 };
+    test_run_t run;
+    test_begin(&run, "pixelproc", checksums, COUNT(checksums), argc, argv);
+
+    int * raw2ev = get_raw2ev(BLACK);
+    int * ev2raw = get_ev2raw(BLACK);
+
+    for (int s = 0; s < COUNT(sizes); s++)
+        for (int m = 0; m < COUNT(methods); m++)
+            for (int t = 0; t < COUNT(threads); t++)
+            {
+                test_case(&run, chroma_smooth_case(&run, sizes[s][0], sizes[s][1], methods[m], threads[t], raw2ev, ev2raw));
+            }
+
+    /* 650D (mv720, mv1080, 1080 crop, zoom, crop_rec) and EOSM (unified mv1080) maps */
+    static const struct { uint32_t camera_id; int raw_w, raw_h, crop_rec, unified; } focus[] = {
+        { 0x80000301, 1808, 727, 0, 0 }, { 0x80000301, 1808, 1190, 0, 0 }, { 0x80000301, 1872, 1060, 0, 0 },
+        { 0x80000301, 2592, 1108, 0, 0 }, { 0x80000301, 1808, 727, 1, 0 }, { 0x80000331, 1808, 1190, 0, 1 },
+    };
+    for (int f = 0; f < COUNT(focus); f++)
+        for (int method = 0; method < 4; method++)
+        {
+            /* method 3 is dual iso, which always interpolates horizontally */
+            int dual_iso = (method == 3);
+            test_case(&run, focus_case(&run, focus[f].camera_id, focus[f].raw_w, focus[f].raw_h, focus[f].crop_rec, focus[f].unified,
+                                 (f & 1) ? 64 : 0, (f & 1) ? 30 : 0, dual_iso ? 0 : method, dual_iso,
+                                 threads[(f + method) % COUNT(threads)], raw2ev, ev2raw));
+        }
+
+    /* Pixel maps are looked for in the current directory, write the .bpm to an empty one */
+    char dir[] = "/tmp/pixelproc_test_XXXXXX";
+    if (!mkdtemp(dir) || chdir(dir) || !write_bad_pixel_map(400, 300))
+    {
+        printf("FAIL can not write a .bpm in %s\n", dir);
+        return 1;
+    }
+    for (int mode = 1; mode <= 3; mode += 2)
+        for (int search = 0; search < (mode == 1 ? 2 : 1); search++)
+            for (int method = 0; method < 4; method++)
+                for (int t = 0; t < COUNT(threads); t += 3 - search)
+                {
+                    int dual_iso = (method == 3);
+                    test_case(&run, bad_case(&run, 400, 300, mode, search, dual_iso ? 0 : method, dual_iso, threads[t], raw2ev, ev2raw));
+                }
+    char file_name[64];
+    snprintf(file_name, sizeof(file_name), "%x_%ix%i.bpm", 0x80000301, 400, 300);
+    remove(file_name);
+    rmdir(dir);
+
+    free_luts(raw2ev, ev2raw);
+
+    return test_end(&run);
+}
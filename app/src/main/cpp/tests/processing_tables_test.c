@@ -0,0 +1,147 @@
+/*
+ * Changes settings on one thread while others render with the same processing object.
+ * Every frame has to come out exactly as one of the combinations of the settings that
+ * were set, a render copying the settings or tables halfway through a change, or a
+ * table left out of date, gives a frame that matches none of them
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "raw_processing.h"
+
+#define WIDTH 32
+#define HEIGHT 24
+#define PIXELS (WIDTH * HEIGHT * 3)
+#define RENDER_THREADS 4
+#define FRAMES 250 /* per render thread */
+
+static const double exposures[2] = { 0.0, 1.5 };
+
+static int dual_iso = 0;
+static uint16_t input[PIXELS];
+static uint16_t expected[4][PIXELS];
+
+/* processing writes to its input too, so every render gets a copy */
+static void render(processingObject_t * processing, uint16_t * scratch, uint16_t * output, uint64_t frame)
+{
+    memcpy(scratch, input, PIXELS * sizeof(uint16_t));
+    applyProcessingObject(processing, WIDTH, HEIGHT, scratch, output, 1, 1, frame);
+}
+
+static processingObject_t * new_processing(void)
+{
+    processingObject_t * processing = initProcessingObject();
+    processing->dual_iso = &dual_iso;
+    processing->vignette_mask = calloc(WIDTH * HEIGHT, sizeof(float));
+    processing->gradient_mask = calloc(WIDTH * HEIGHT, sizeof(uint16_t));
+    return processing;
+}
+
+/* A curve written straight into the object and a setting its tables are built from */
+static void set_state(processingObject_t * processing, int state)
+{
+    float x[3] = { 0.0f, 0.5f, 1.0f };
+    float y[3] = { 0.0f, 0.6f, 1.0f };
+    processingSetGCurve(processing, (state & 1) ? 3 : 0, x, y, 0);
+    processingSetExposureStops(processing, exposures[state >> 1]);
+}
+
+typedef struct
+{
+    processingObject_t * processing;
+    int * running;
+    int mismatches;
+} render_thread_t;
+
+static void * render_thread(void * arg)
+{
+    render_thread_t * r = arg;
+    uint16_t * scratch = malloc(PIXELS * sizeof(uint16_t));
+    uint16_t * output = malloc(PIXELS * sizeof(uint16_t));
+
+    for (int frame = 0; frame < FRAMES; frame++)
+    {
+        render(r->processing, scratch, output, frame);
+
+        int match = 0;
+        for (int state = 0; state < 4 && !match; state++)
+            match = !memcmp(output, expected[state], PIXELS * sizeof(uint16_t));
+
+        r->mismatches += !match;
+    }
+
+    free(scratch);
+    free(output);
+    __atomic_sub_fetch(r->running, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+int main(void)
+{
+    /* gradients in all three channels, well inside the raw range */
+    for (int i = 0; i < WIDTH * HEIGHT; i++)
+    {
+        input[i * 3 + 0] = 2048 + (i * 37) % 12000;
+        input[i * 3 + 1] = 2048 + (i * 53) % 12000;
+        input[i * 3 + 2] = 2048 + (i * 71) % 12000;
+    }
+
+    uint16_t * scratch = malloc(PIXELS * sizeof(uint16_t));
+    uint16_t * output = malloc(PIXELS * sizeof(uint16_t));
+
+    /* what each combination looks like, rendered without anything else running */
+    for (int state = 0; state < 4; state++)
+    {
+        processingObject_t * processing = new_processing();
+        set_state(processing, state);
+        render(processing, scratch, expected[state], 0);
+        freeProcessingObject(processing);
+    }
+
+    for (int a = 0; a < 4; a++)
+        for (int b = a + 1; b < 4; b++)
+            if (!memcmp(expected[a], expected[b], sizeof(expected[0])))
+            {
+                printf("FAIL: settings %d and %d give the same frame\n", a, b);
+                return 1;
+            }
+
+    processingObject_t * processing = new_processing();
+    set_state(processing, 0);
+
+    int running = RENDER_THREADS;
+    render_thread_t renders[RENDER_THREADS];
+    pthread_t threads[RENDER_THREADS];
+    for (int t = 0; t < RENDER_THREADS; t++)
+    {
+        renders[t] = (render_thread_t) { .processing = processing, .running = &running };
+        pthread_create(&threads[t], NULL, render_thread, &renders[t]);
+    }
+
+    int changes = 0;
+    while (__atomic_load_n(&running, __ATOMIC_ACQUIRE))
+    {
+        set_state(processing, ++changes & 3);
+    }
+    set_state(processing, 3);
+
+    int mismatches = 0;
+    for (int t = 0; t < RENDER_THREADS; t++)
+    {
+        pthread_join(threads[t], NULL);
+        mismatches += renders[t].mismatches;
+    }
+
+    /* and once everything has settled, the last settings */
+    render(processing, scratch, output, 0);
+    int last_ok = !memcmp(output, expected[3], PIXELS * sizeof(uint16_t));
+    free(scratch);
+    free(output);
+    freeProcessingObject(processing);
+
+    printf("processing tables: %d frames rendered during %d changes, %d matched no settings, last frame %s\n",
+           RENDER_THREADS * FRAMES, changes, mismatches, last_ok ? "ok" : "wrong");
+    return (mismatches || !last_ok) ? 1 : 0;
+}
@@ -0,0 +1,151 @@
+/*
+ * Checks the recursive bilateral filter on synthetic RGB48 images, with the sigmas of the
+ * shadows/highlights blur and the RBF denoiser, on several sizes and thread counts, against
+ * checksums of the single threaded filter it replaced. One filter is kept for all the cases,
+ * like one is kept for every frame. Only 3 channels are filtered, anything else is left alone
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rbf_wrapper.h"
+#include "test_helper.h"
+
+/* Outputs of the single threaded filter, in case order */
+static const uint64_t checksums[] = {
+    0xe81e2470c2046f5eULL, /* 400x300 sigma=0.0005,0.165 threads=1 */
+    0xe81e2470c2046f5eULL, /* 400x300 sigma=0.0005,0.165 threads=2 */
+    0xe81e2470c2046f5eULL, /* 400x300 sigma=0.0005,0.165 threads=3 */
+    0xe81e2470c2046f5eULL, /* 400x300 sigma=0.0005,0.165 threads=8 */
+    0x8af56909001b5772ULL, /* 400x300 sigma=0.0025,0.075 threads=1 */
+    0x8af56909001b5772ULL, /* 400x300 sigma=0.0025,0.075 threads=2 */
+    0x8af56909001b5772ULL, /* 400x300 sigma=0.0025,0.075 threads=3 */
+    0x8af56909001b5772ULL, /* 400x300 sigma=0.0025,0.075 threads=8 */
+    0xe09d97e9c20d1f97ULL, /* 400x300 sigma=0.0025,0.24 threads=1 */
+    0xe09d97e9c20d1f97ULL, /* 400x300 sigma=0.0025,0.24 threads=2 */
+    0xe09d97e9c20d1f97ULL, /* 400x300 sigma=0.0025,0.24 threads=3 */
+    0xe09d97e9c20d1f97ULL, /* 400x300 sigma=0.0025,0.24 threads=8 */
+    0x64a0f984bb9e7128ULL, /* 173x97 sigma=0.0005,0.165 threads=1 */
+    0x64a0f984bb9e7128ULL, /* 173x97 sigma=0.0005,0.165 threads=2 */
+    0x64a0f984bb9e7128ULL, /* 173x97 sigma=0.0005,0.165 threads=3 */
+    0x64a0f984bb9e7128ULL, /* 173x97 sigma=0.0005,0.165 threads=8 */
+    0x96845a733a6e281dULL, /* 173x97 sigma=0.0025,0.075 threads=1 */
+    0x96845a733a6e281dULL, /* 173x97 sigma=0.0025,0.075 threads=2 */
+    0x96845a733a6e281dULL, /* 173x97 sigma=0.0025,0.075 threads=3 */
+    0x96845a733a6e281dULL, /* 173x97 sigma=0.0025,0.075 threads=8 */
+    0x056048893d30a0f8ULL, /* 173x97 sigma=0.0025,0.24 threads=1 */
+    0x056048893d30a0f8ULL, /* 173x97 sigma=0.0025,0.24 threads=2 */
+    0x056048893d30a0f8ULL, /* 173x97 sigma=0.0025,0.24 threads=3 */
+    0x056048893d30a0f8ULL, /* 173x97 sigma=0.0025,0.24 threads=8 */
+    0x7dbcfecac619b706ULL, /* 640x360 sigma=0.0005,0.165 threads=1 */
+    0x7dbcfecac619b706ULL, /* 640x360 sigma=0.0005,0.165 threads=2 */
+    0x7dbcfecac619b706ULL, /* 640x360 sigma=0.0005,0.165 threads=3 */
+    0x7dbcfecac619b706ULL, /* 640x360 sigma=0.0005,0.165 threads=8 */
+    0xdc16e12739ae8d0eULL, /* 640x360 sigma=0.0025,0.075 threads=1 */
+    0xdc16e12739ae8d0eULL, /* 640x360 sigma=0.0025,0.075 threads=2 */
+    0xdc16e12739ae8d0eULL, /* 640x360 sigma=0.0025,0.075 threads=3 */
+    0xdc16e12739ae8d0eULL, /* 640x360 sigma=0.0025,0.075 threads=8 */
+    0x7a3d43d61eade195ULL, /* 640x360 sigma=0.0025,0.24 threads=1 */
+    0x7a3d43d61eade195ULL, /* 640x360 sigma=0.0025,0.24 threads=2 */
+    0x7a3d43d61eade195ULL, /* 640x360 sigma=0.0025,0.24 threads=3 */
+    0x7a3d43d61eade195ULL, /* 640x360 sigma=0.0025,0.24 threads=8 */
+    0xbd7375240b9dd293ULL, /* 11x10 sigma=0.0005,0.165 threads=1 */
+    0xbd7375240b9dd293ULL, /* 11x10 sigma=0.0005,0.165 threads=2 */
+    0xbd7375240b9dd293ULL, /* 11x10 sigma=0.0005,0.165 threads=3 */
+    0xbd7375240b9dd293ULL, /* 11x10 sigma=0.0005,0.165 threads=8 */
+    0x50d562d86cec39e4ULL, /* 11x10 sigma=0.0025,0.075 threads=1 */
+    0x50d562d86cec39e4ULL, /* 11x10 sigma=0.0025,0.075 threads=2 */
+    0x50d562d86cec39e4ULL, /* 11x10 sigma=0.0025,0.075 threads=3 */
+    0x50d562d86cec39e4ULL, /* 11x10 sigma=0.0025,0.075 threads=8 */
+    0xb239512ebd3823deULL, /* 11x10 sigma=0.0025,0.24 threads=1 */
+    0xb239512ebd3823deULL, /* 11x10 sigma=0.0025,0.24 threads=2 */
+    0xb239512ebd3823deULL, /* 11x10 sigma=0.0025,0.24 threads=3 */
+    0xb239512ebd3823deULL, /* 11x10 sigma=0.0025,0.24 threads=8 */
+    0x2535b2a5b5256872ULL, /* 64x200 sigma=0.0005,0.165 threads=1 */
+    0x2535b2a5b5256872ULL, /* 64x200 sigma=0.0005,0.165 threads=2 */
+    0x2535b2a5b5256872ULL, /* 64x200 sigma=0.0005,0.165 threads=3 */
+    0x2535b2a5b5256872ULL, /* 64x200 sigma=0.0005,0.165 threads=8 */
+    0x0621bdb7f8e36161ULL, /* 64x200 sigma=0.0025,0.075 threads=1 */
+    0x0621bdb7f8e36161ULL, /* 64x200 sigma=0.0025,0.075 threads=2 */
+    0x0621bdb7f8e36161ULL, /* 64x200 sigma=0.0025,0.075 threads=3 */
+    0x0621bdb7f8e36161ULL, /* 64x200 sigma=0.0025,0.075 threads=8 */
+    0x6aa1abab2044707bULL, /* 64x200 sigma=0.0025,0.24 threads=1 */
+    0x6aa1abab2044707bULL, /* 64x200 sigma=0.0025,0.24 threads=2 */
+    0x6aa1abab2044707bULL, /* 64x200 sigma=0.0025,0.24 threads=3 */
+    0x6aa1abab2044707bULL, /* 64x200 sigma=0.0025,0.24 threads=8 */
+};
+
+static const test_frame_t look = { .range = 9000, .noise = 200, .colour = 1, .seed = 1 };
+
+/* The test frame three times as wide, its samples taken as R, G and B and stretched to 16 bit */
+static void make_image(uint16_t * image, int w, int h)
+{
+    uint16_t * frame = malloc(w * 3 * h * sizeof(uint16_t));
+    make_test_frame(frame, w * 3, h, &look);
+    for (int i = 0; i < w * 3 * h; i++) image[i] = (uint16_t)MIN((frame[i] - BLACK) * 5, 65535);
+    free(frame);
+}
+
+static int run_case(test_run_t * run, void * rbf, int w, int h, float sigma_spatial, float sigma_range, int threads)
+{
+    uint16_t * image = malloc(w * h * 3 * sizeof(uint16_t));
+    uint16_t * filtered = malloc(w * h * 3 * sizeof(uint16_t));
+    make_image(image, w, h);
+    memset(filtered, 0, w * h * 3 * sizeof(uint16_t));
+
+    recursive_bf_threaded(rbf, image, filtered, sigma_spatial, sigma_range, w, h, 3, threads);
+
+    char what[64];
+    snprintf(what, sizeof(what), "%dx%d sigma=%g,%g threads=%d", w, h, sigma_spatial, sigma_range, threads);
+    int failed = test_check(run, what, filtered, w * h * 3 * sizeof(uint16_t));
+
+    free(image);
+    free(filtered);
+    return failed;
+}
+
+/* 4 channels are not filtered, the output has to be left as it was */
+static int other_channels_case(void * rbf)
+{
+    int w = 64, h = 40;
+    uint16_t * image = calloc(w * h * 4, sizeof(uint16_t));
+    uint16_t * filtered = malloc(w * h * 4 * sizeof(uint16_t));
+    make_image(image, w, h);
+    memset(filtered, 0, w * h * 4 * sizeof(uint16_t));
+
+    recursive_bf_threaded(rbf, image, filtered, 0.0025f, 0.165f, w, h, 4, 2);
+
+    int failed = 0;
+    for (int i = 0; i < w * h * 4; i++) failed |= (filtered[i] != 0);
+    if (failed) printf("FAIL %dx%d 4 channels: output was written\n", w, h);
+
+    free(image);
+    free(filtered);
+    return failed;
+}
+
+int main(int argc, char ** argv)
+{
+    /* growing and shrinking, the filter only reallocates when it has to */
+    static const int sizes[][2] = { { 400, 300 }, { 173, 97 }, { 640, 360 }, { 11, 10 }, { 64, 200 } };
+    static const int threads[] = { 1, 2, 3, 8 };
+    /* shadows/highlights blur and the denoiser at two ranges */
+    static const float sigmas[][2] = { { 0.0005f, 0.165f }, { 0.0025f, 0.075f }, { 0.0025f, 0.24f } };
+    test_run_t run;
+    test_begin(&run, "rbf", checksums, COUNT(checksums), argc, argv);
+
+    void * rbf = init_recursive_bf();
+
+    for (int s = 0; s < COUNT(sizes); s++)
+        for (int g = 0; g < COUNT(sigmas); g++)
+            for (int t = 0; t < COUNT(threads); t++)
+            {
+                test_case(&run, run_case(&run, rbf, sizes[s][0], sizes[s][1], sigmas[g][0], sigmas[g][1], threads[t]));
+            }
+
+    test_case(&run, other_channels_case(rbf));
+
+    free_recursive_bf(rbf);
+
+    return test_end(&run);
+}
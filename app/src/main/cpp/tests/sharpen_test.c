@@ -0,0 +1,295 @@
+/*
+ * Checks the masked sharpening. The sobel contour made row by row from three gray rows has to
+ * be the same as what the whole frame sobelFilter chain makes, and the sharpening of row bands
+ * against checksums of the single loop it replaced, with and without the edge mask, on all
+ * channels or luma only, on several sizes and band counts
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "raw_processing.h"
+#include "sobel/sobel.h"
+#include "test_helper.h"
+
+/* Outputs of the single sharpening loop with sobelFilter for the mask, in case order. That loop
+ * read an unset next row pointer on the last row, these are with the row repeated there like on
+ * the first row */
+static const uint64_t checksums[] = {
+    0xd67d21f2a1787381ULL, /* sharpen 400x300 masking=0 luma_only=0 bands=1 */
+    0xd67d21f2a1787381ULL, /* sharpen 400x300 masking=0 luma_only=0 bands=2 */
+    0xd67d21f2a1787381ULL, /* sharpen 400x300 masking=0 luma_only=0 bands=3 */
+    0xd67d21f2a1787381ULL, /* sharpen 400x300 masking=0 luma_only=0 bands=8 */
+    0x3803accc7b21dc82ULL, /* sharpen 400x300 masking=0 luma_only=1 bands=1 */
+    0x3803accc7b21dc82ULL, /* sharpen 400x300 masking=0 luma_only=1 bands=2 */
+    0x3803accc7b21dc82ULL, /* sharpen 400x300 masking=0 luma_only=1 bands=3 */
+    0x3803accc7b21dc82ULL, /* sharpen 400x300 masking=0 luma_only=1 bands=8 */
+    0x4262a09a2a0b844cULL, /* sharpen 400x300 masking=30 luma_only=0 bands=1 */
+    0x4262a09a2a0b844cULL, /* sharpen 400x300 masking=30 luma_only=0 bands=2 */
+    0x4262a09a2a0b844cULL, /* sharpen 400x300 masking=30 luma_only=0 bands=3 */
+    0x4262a09a2a0b844cULL, /* sharpen 400x300 masking=30 luma_only=0 bands=8 */
+    0x058fd1557eca608eULL, /* sharpen 400x300 masking=30 luma_only=1 bands=1 */
+    0x058fd1557eca608eULL, /* sharpen 400x300 masking=30 luma_only=1 bands=2 */
+    0x058fd1557eca608eULL, /* sharpen 400x300 masking=30 luma_only=1 bands=3 */
+    0x058fd1557eca608eULL, /* sharpen 400x300 masking=30 luma_only=1 bands=8 */
+    0x1513b7e86f8815b4ULL, /* sharpen 400x300 masking=100 luma_only=0 bands=1 */
+    0x1513b7e86f8815b4ULL, /* sharpen 400x300 masking=100 luma_only=0 bands=2 */
+    0x1513b7e86f8815b4ULL, /* sharpen 400x300 masking=100 luma_only=0 bands=3 */
+    0x1513b7e86f8815b4ULL, /* sharpen 400x300 masking=100 luma_only=0 bands=8 */
+    0x6f6972c172296d83ULL, /* sharpen 400x300 masking=100 luma_only=1 bands=1 */
+    0x6f6972c172296d83ULL, /* sharpen 400x300 masking=100 luma_only=1 bands=2 */
+    0x6f6972c172296d83ULL, /* sharpen 400x300 masking=100 luma_only=1 bands=3 */
+    0x6f6972c172296d83ULL, /* sharpen 400x300 masking=100 luma_only=1 bands=8 */
+    0x9e4759fd83cbb02eULL, /* sharpen 173x97 masking=0 luma_only=0 bands=1 */
+    0x9e4759fd83cbb02eULL, /* sharpen 173x97 masking=0 luma_only=0 bands=2 */
+    0x9e4759fd83cbb02eULL, /* sharpen 173x97 masking=0 luma_only=0 bands=3 */
+    0x9e4759fd83cbb02eULL, /* sharpen 173x97 masking=0 luma_only=0 bands=8 */
+    0x86790a5dc4d52349ULL, /* sharpen 173x97 masking=0 luma_only=1 bands=1 */
+    0x86790a5dc4d52349ULL, /* sharpen 173x97 masking=0 luma_only=1 bands=2 */
+    0x86790a5dc4d52349ULL, /* sharpen 173x97 masking=0 luma_only=1 bands=3 */
+    0x86790a5dc4d52349ULL, /* sharpen 173x97 masking=0 luma_only=1 bands=8 */
+    0x334aa7e5eae17252ULL, /* sharpen 173x97 masking=30 luma_only=0 bands=1 */
+    0x334aa7e5eae17252ULL, /* sharpen 173x97 masking=30 luma_only=0 bands=2 */
+    0x334aa7e5eae17252ULL, /* sharpen 173x97 masking=30 luma_only=0 bands=3 */
+    0x334aa7e5eae17252ULL, /* sharpen 173x97 masking=30 luma_only=0 bands=8 */
+    0x253fed948d6eefacULL, /* sharpen 173x97 masking=30 luma_only=1 bands=1 */
+    0x253fed948d6eefacULL, /* sharpen 173x97 masking=30 luma_only=1 bands=2 */
+    0x253fed948d6eefacULL, /* sharpen 173x97 masking=30 luma_only=1 bands=3 */
+    0x253fed948d6eefacULL, /* sharpen 173x97 masking=30 luma_only=1 bands=8 */
+    0xd82c6f71bb39ff28ULL, /* sharpen 173x97 masking=100 luma_only=0 bands=1 */
+    0xd82c6f71bb39ff28ULL, /* sharpen 173x97 masking=100 luma_only=0 bands=2 */
+    0xd82c6f71bb39ff28ULL, /* sharpen 173x97 masking=100 luma_only=0 bands=3 */
+    0xd82c6f71bb39ff28ULL, /* sharpen 173x97 masking=100 luma_only=0 bands=8 */
+    0x94bbc14fa2eb25dfULL, /* sharpen 173x97 masking=100 luma_only=1 bands=1 */
+    0x94bbc14fa2eb25dfULL, /* sharpen 173x97 masking=100 luma_only=1 bands=2 */
+    0x94bbc14fa2eb25dfULL, /* sharpen 173x97 masking=100 luma_only=1 bands=3 */
+    0x94bbc14fa2eb25dfULL, /* sharpen 173x97 masking=100 luma_only=1 bands=8 */
+    0xbb563e23c5450057ULL, /* sharpen 11x10 masking=0 luma_only=0 bands=1 */
+    0xbb563e23c5450057ULL, /* sharpen 11x10 masking=0 luma_only=0 bands=2 */
+    0xbb563e23c5450057ULL, /* sharpen 11x10 masking=0 luma_only=0 bands=3 */
+    0xbb563e23c5450057ULL, /* sharpen 11x10 masking=0 luma_only=0 bands=8 */
+    0xf01d1c5375362c6eULL, /* sharpen 11x10 masking=0 luma_only=1 bands=1 */
+    0xf01d1c5375362c6eULL, /* sharpen 11x10 masking=0 luma_only=1 bands=2 */
+    0xf01d1c5375362c6eULL, /* sharpen 11x10 masking=0 luma_only=1 bands=3 */
+    0xf01d1c5375362c6eULL, /* sharpen 11x10 masking=0 luma_only=1 bands=8 */
+    0x1c6399bef6c10651ULL, /* sharpen 11x10 masking=30 luma_only=0 bands=1 */
+    0x1c6399bef6c10651ULL, /* sharpen 11x10 masking=30 luma_only=0 bands=2 */
+    0x1c6399bef6c10651ULL, /* sharpen 11x10 masking=30 luma_only=0 bands=3 */
+    0x1c6399bef6c10651ULL, /* sharpen 11x10 masking=30 luma_only=0 bands=8 */
+    0xfad87038d037e50dULL, /* sharpen 11x10 masking=30 luma_only=1 bands=1 */
+    0xfad87038d037e50dULL, /* sharpen 11x10 masking=30 luma_only=1 bands=2 */
+    0xfad87038d037e50dULL, /* sharpen 11x10 masking=30 luma_only=1 bands=3 */
+    0xfad87038d037e50dULL, /* sharpen 11x10 masking=30 luma_only=1 bands=8 */
+    0xa28ef504cd06503cULL, /* sharpen 11x10 masking=100 luma_only=0 bands=1 */
+    0xa28ef504cd06503cULL, /* sharpen 11x10 masking=100 luma_only=0 bands=2 */
+    0xa28ef504cd06503cULL, /* sharpen 11x10 masking=100 luma_only=0 bands=3 */
+    0xa28ef504cd06503cULL, /* sharpen 11x10 masking=100 luma_only=0 bands=8 */
+    0x3fd18f9e4d7d8655ULL, /* sharpen 11x10 masking=100 luma_only=1 bands=1 */
+    0x3fd18f9e4d7d8655ULL, /* sharpen 11x10 masking=100 luma_only=1 bands=2 */
+    0x3fd18f9e4d7d8655ULL, /* sharpen 11x10 masking=100 luma_only=1 bands=3 */
+    0x3fd18f9e4d7d8655ULL, /* sharpen 11x10 masking=100 luma_only=1 bands=8 */
+    0x8b6f18199355efc9ULL, /* sharpen 7x5 masking=0 luma_only=0 bands=1 */
+    0x8b6f18199355efc9ULL, /* sharpen 7x5 masking=0 luma_only=0 bands=2 */
+    0x8b6f18199355efc9ULL, /* sharpen 7x5 masking=0 luma_only=0 bands=3 */
+    0x8b6f18199355efc9ULL, /* sharpen 7x5 masking=0 luma_only=0 bands=8 */
+    0xce092e764025dcf2ULL, /* sharpen 7x5 masking=0 luma_only=1 bands=1 */
+    0xce092e764025dcf2ULL, /* sharpen 7x5 masking=0 luma_only=1 bands=2 */
+    0xce092e764025dcf2ULL, /* sharpen 7x5 masking=0 luma_only=1 bands=3 */
+    0xce092e764025dcf2ULL, /* sharpen 7x5 masking=0 luma_only=1 bands=8 */
+    0xa924ee966b5265d5ULL, /* sharpen 7x5 masking=30 luma_only=0 bands=1 */
+    0xa924ee966b5265d5ULL, /* sharpen 7x5 masking=30 luma_only=0 bands=2 */
+    0xa924ee966b5265d5ULL, /* sharpen 7x5 masking=30 luma_only=0 bands=3 */
+    0xa924ee966b5265d5ULL, /* sharpen 7x5 masking=30 luma_only=0 bands=8 */
+    0xd0e3bc959f5a7d52ULL, /* sharpen 7x5 masking=30 luma_only=1 bands=1 */
+    0xd0e3bc959f5a7d52ULL, /* sharpen 7x5 masking=30 luma_only=1 bands=2 */
+    0xd0e3bc959f5a7d52ULL, /* sharpen 7x5 masking=30 luma_only=1 bands=3 */
+    0xd0e3bc959f5a7d52ULL, /* sharpen 7x5 masking=30 luma_only=1 bands=8 */
+    0x65a1e82147b917f5ULL, /* sharpen 7x5 masking=100 luma_only=0 bands=1 */
+    0x65a1e82147b917f5ULL, /* sharpen 7x5 masking=100 luma_only=0 bands=2 */
+    0x65a1e82147b917f5ULL, /* sharpen 7x5 masking=100 luma_only=0 bands=3 */
+    0x65a1e82147b917f5ULL, /* sharpen 7x5 masking=100 luma_only=0 bands=8 */
+    0x4fe01da3a127c8d2ULL, /* sharpen 7x5 masking=100 luma_only=1 bands=1 */
+    0x4fe01da3a127c8d2ULL, /* sharpen 7x5 masking=100 luma_only=1 bands=2 */
+    0x4fe01da3a127c8d2ULL, /* sharpen 7x5 masking=100 luma_only=1 bands=3 */
+    0x4fe01da3a127c8d2ULL, /* sharpen 7x5 masking=100 luma_only=1 bands=8 */
+    0x8e6d4305c9ab2749ULL, /* sharpen 2x6 masking=0 luma_only=0 bands=1 */
+    0x8e6d4305c9ab2749ULL, /* sharpen 2x6 masking=0 luma_only=0 bands=2 */
+    0x8e6d4305c9ab2749ULL, /* sharpen 2x6 masking=0 luma_only=0 bands=3 */
+    0x8e6d4305c9ab2749ULL, /* sharpen 2x6 masking=0 luma_only=0 bands=8 */
+    0x8e6d4305c9ab2749ULL, /* sharpen 2x6 masking=0 luma_only=1 bands=1 */
+    0x8e6d4305c9ab2749ULL, /* sharpen 2x6 masking=0 luma_only=1 bands=2 */
+    0x8e6d4305c9ab2749ULL, /* sharpen 2x6 masking=0 luma_only=1 bands=3 */
+    0x8e6d4305c9ab2749ULL, /* sharpen 2x6 masking=0 luma_only=1 bands=8 */
+    0x8e6d4305c9ab2749ULL, /* sharpen 2x6 masking=30 luma_only=0 bands=1 */
+    0x8e6d4305c9ab2749ULL, /* sharpen 2x6 masking=30 luma_only=0 bands=2 */
+    0x8e6d4305c9ab2749ULL, /* sharpen 2x6 masking=30 luma_only=0 bands=3 */
+    0x8e6d4305c9ab2749ULL, /* sharpen 2x6 masking=30 luma_only=0 bands=8 */
+    0x8e6d4305c9ab2749ULL, /* sharpen 2x6 masking=30 luma_only=1 bands=1 */
+    0x8e6d4305c9ab2749ULL, /* sharpen 2x6 masking=30 luma_only=1 bands=2 */
+    0x8e6d4305c9ab2749ULL, /* sharpen 2x6 masking=30 luma_only=1 bands=3 */
+    0x8e6d4305c9ab2749ULL, /* sharpen 2x6 masking=30 luma_only=1 bands=8 */
+    0x8e6d4305c9ab2749ULL, /* sharpen 2x6 masking=100 luma_only=0 bands=1 */
+    0x8e6d4305c9ab2749ULL, /* sharpen 2x6 masking=100 luma_only=0 bands=2 */
+    0x8e6d4305c9ab2749ULL, /* sharpen 2x6 masking=100 luma_only=0 bands=3 */
+    0x8e6d4305c9ab2749ULL, /* sharpen 2x6 masking=100 luma_only=0 bands=8 */
+    0x8e6d4305c9ab2749ULL, /* sharpen 2x6 masking=100 luma_only=1 bands=1 */
+    0x8e6d4305c9ab2749ULL, /* sharpen 2x6 masking=100 luma_only=1 bands=2 */
+    0x8e6d4305c9ab2749ULL, /* sharpen 2x6 masking=100 luma_only=1 bands=3 */
+    0x8e6d4305c9ab2749ULL, /* sharpen 2x6 masking=100 luma_only=1 bands=8 */
+    0xf2a24fdbafd40310ULL, /* sharpen 1x4 masking=0 luma_only=0 bands=1 */
+    0xf2a24fdbafd40310ULL, /* sharpen 1x4 masking=0 luma_only=0 bands=2 */
+    0xf2a24fdbafd40310ULL, /* sharpen 1x4 masking=0 luma_only=0 bands=3 */
+    0xf2a24fdbafd40310ULL, /* sharpen 1x4 masking=0 luma_only=0 bands=8 */
+    0xf2a24fdbafd40310ULL, /* sharpen 1x4 masking=0 luma_only=1 bands=1 */
+    0xf2a24fdbafd40310ULL, /* sharpen 1x4 masking=0 luma_only=1 bands=2 */
+    0xf2a24fdbafd40310ULL, /* sharpen 1x4 masking=0 luma_only=1 bands=3 */
+    0xf2a24fdbafd40310ULL, /* sharpen 1x4 masking=0 luma_only=1 bands=8 */
+    0xf2a24fdbafd40310ULL, /* sharpen 1x4 masking=30 luma_only=0 bands=1 */
+    0xf2a24fdbafd40310ULL, /* sharpen 1x4 masking=30 luma_only=0 bands=2 */
+    0xf2a24fdbafd40310ULL, /* sharpen 1x4 masking=30 luma_only=0 bands=3 */
+    0xf2a24fdbafd40310ULL, /* sharpen 1x4 masking=30 luma_only=0 bands=8 */
+    0xf2a24fdbafd40310ULL, /* sharpen 1x4 masking=30 luma_only=1 bands=1 */
+    0xf2a24fdbafd40310ULL, /* sharpen 1x4 masking=30 luma_only=1 bands=2 */
+    0xf2a24fdbafd40310ULL, /* sharpen 1x4 masking=30 luma_only=1 bands=3 */
+    0xf2a24fdbafd40310ULL, /* sharpen 1x4 masking=30 luma_only=1 bands=8 */
+    0xf2a24fdbafd40310ULL, /* sharpen 1x4 masking=100 luma_only=0 bands=1 */
+    0xf2a24fdbafd40310ULL, /* sharpen 1x4 masking=100 luma_only=0 bands=2 */
+    0xf2a24fdbafd40310ULL, /* sharpen 1x4 masking=100 luma_only=0 bands=3 */
+    0xf2a24fdbafd40310ULL, /* sharpen 1x4 masking=100 luma_only=0 bands=8 */
+    0xf2a24fdbafd40310ULL, /* sharpen 1x4 masking=100 luma_only=1 bands=1 */
+    0xf2a24fdbafd40310ULL, /* sharpen 1x4 masking=100 luma_only=1 bands=2 */
+    0xf2a24fdbafd40310ULL, /* sharpen 1x4 masking=100 luma_only=1 bands=3 */
+    0xf2a24fdbafd40310ULL, /* sharpen 1x4 masking=100 luma_only=1 bands=8 */
+    0xc9b4e9489d05589eULL, /* sharpen 9x1 masking=0 luma_only=0 bands=1 */
+    0xc9b4e9489d05589eULL, /* sharpen 9x1 masking=0 luma_only=0 bands=2 */
+    0xc9b4e9489d05589eULL, /* sharpen 9x1 masking=0 luma_only=0 bands=3 */
+    0xc9b4e9489d05589eULL, /* sharpen 9x1 masking=0 luma_only=0 bands=8 */
+    0x86d7318fc35124e1ULL, /* sharpen 9x1 masking=0 luma_only=1 bands=1 */
+    0x86d7318fc35124e1ULL, /* sharpen 9x1 masking=0 luma_only=1 bands=2 */
+    0x86d7318fc35124e1ULL, /* sharpen 9x1 masking=0 luma_only=1 bands=3 */
+    0x86d7318fc35124e1ULL, /* sharpen 9x1 masking=0 luma_only=1 bands=8 */
+    0xa21d5e682e65e8edULL, /* sharpen 9x1 masking=30 luma_only=0 bands=1 */
+    0xa21d5e682e65e8edULL, /* sharpen 9x1 masking=30 luma_only=0 bands=2 */
+    0xa21d5e682e65e8edULL, /* sharpen 9x1 masking=30 luma_only=0 bands=3 */
+    0xa21d5e682e65e8edULL, /* sharpen 9x1 masking=30 luma_only=0 bands=8 */
+    0xd92fbf8aebda08c0ULL, /* sharpen 9x1 masking=30 luma_only=1 bands=1 */
+    0xd92fbf8aebda08c0ULL, /* sharpen 9x1 masking=30 luma_only=1 bands=2 */
+    0xd92fbf8aebda08c0ULL, /* sharpen 9x1 masking=30 luma_only=1 bands=3 */
+    0xd92fbf8aebda08c0ULL, /* sharpen 9x1 masking=30 luma_only=1 bands=8 */
+    0x4ca33287c467fe2fULL, /* sharpen 9x1 masking=100 luma_only=0 bands=1 */
+    0x4ca33287c467fe2fULL, /* sharpen 9x1 masking=100 luma_only=0 bands=2 */
+    0x4ca33287c467fe2fULL, /* sharpen 9x1 masking=100 luma_only=0 bands=3 */
+    0x4ca33287c467fe2fULL, /* sharpen 9x1 masking=100 luma_only=0 bands=8 */
+    0x8c832b43d1e62f25ULL, /* sharpen 9x1 masking=100 luma_only=1 bands=1 */
+    0x8c832b43d1e62f25ULL, /* sharpen 9x1 masking=100 luma_only=1 bands=2 */
+    0x8c832b43d1e62f25ULL, /* sharpen 9x1 masking=100 luma_only=1 bands=3 */
+    0x8c832b43d1e62f25ULL, /* sharpen 9x1 masking=100 luma_only=1 bands=8 */
+};
+
+static const test_frame_t look = { .range = 9000, .noise = 200, .colour = 1, .seed = 1 };
+
+/* The test frame three times as wide, its samples taken as R, G and B and stretched to 16 bit */
+static void make_image(uint16_t * image, int w, int h)
+{
+    uint16_t * frame = malloc(w * 3 * h * sizeof(uint16_t));
+    make_test_frame(frame, w * 3, h, &look);
+    for (int i = 0; i < w * 3 * h; i++) image[i] = (uint16_t)MIN((frame[i] - BLACK) * 5, 65535);
+    free(frame);
+}
+
+/* Gray rows and their contour, rows outside the image are zeros */
+static int sobel_case(uint16_t * image, int w, int h)
+{
+    uint16_t * gray, * sobel_h, * sobel_v, * contour;
+    sobelFilter(image, &gray, &sobel_h, &sobel_v, &contour, w, h);
+
+    uint16_t * rows = calloc(w * 4, sizeof(uint16_t));
+    uint16_t * zero_row = rows, * gray_rows = rows + w, * contour_rows = malloc(w * h * sizeof(uint16_t));
+    for (int y = 0; y < h; y++)
+    {
+        /* the ring only holds three rows, row y-1 and y are in it from the rows before */
+        if (y == 0) rgbRowToGray(image, gray_rows, w);
+        if (y < h-1) rgbRowToGray(image + (y+1) * w * 3, gray_rows + ((y+1) % 3) * w, w);
+
+        sobelContourRow( (y > 0) ? gray_rows + ((y-1) % 3) * w : zero_row,
+                         gray_rows + (y % 3) * w,
+                         (y < h-1) ? gray_rows + ((y+1) % 3) * w : zero_row,
+                         contour_rows + y * w, w );
+    }
+
+    int failed = compare_test_frames("sobel contour", contour, contour_rows, w, h);
+
+    free(rows);
+    free(contour_rows);
+    free(gray);
+    free(sobel_h);
+    free(sobel_v);
+    free(contour);
+    return failed;
+}
+
+/* Bands split like applyProcessingObjectRegion does, run one after the other */
+static int sharpen_case(test_run_t * run, processingObject_t * processing, uint16_t * image, int w, int h,
+                        int masking, int luma_only, int bands)
+{
+    uint16_t * sharpened = malloc(w * h * 3 * sizeof(uint16_t));
+    uint32_t sharp_start = 0, sharp_skip = luma_only ? 3 : 1;
+    if (luma_only) memcpy(sharpened, image, w * h * 3 * sizeof(uint16_t));
+    else memset(sharpened, 0, w * h * 3 * sizeof(uint16_t));
+
+    processingSetSharpenMasking(processing, masking);
+    int chunk_size = h / bands;
+    for (int t = 0; t < bands; t++)
+    {
+        sharpen_parameters_t param = { processing, w, h, image, sharpened, sharp_start, sharp_skip,
+                                       chunk_size * t, (t == bands-1) ? h : chunk_size * (t+1) };
+        sharpen_thread(&param);
+    }
+
+    char what[80];
+    snprintf(what, sizeof(what), "sharpen %dx%d masking=%d luma_only=%d bands=%d", w, h, masking, luma_only, bands);
+    int failed = test_check(run, what, sharpened, w * h * 3 * sizeof(uint16_t));
+
+    free(sharpened);
+    return failed;
+}
+
+int main(int argc, char ** argv)
+{
+    /* down to a single row and column, and a 2 wide one with no inner pixels to sharpen */
+    static const int sizes[][2] = { { 400, 300 }, { 173, 97 }, { 11, 10 }, { 7, 5 }, { 2, 6 }, { 1, 4 }, { 9, 1 } };
+    static const int masking[] = { 0, 30, 100 };
+    static const int bands[] = { 1, 2, 3, 8 };
+    test_run_t run;
+    test_begin(&run, "sharpen", checksums, COUNT(checksums), argc, argv);
+
+    processingObject_t * processing = initProcessingObject();
+    processingSetSharpening(processing, 0.8);
+    processingSetSharpeningBias(processing, 0.25);
+    processing_update_tables(processing);
+
+    for (int s = 0; s < COUNT(sizes); s++)
+    {
+        int w = sizes[s][0], h = sizes[s][1];
+        uint16_t * image = malloc(w * h * 3 * sizeof(uint16_t));
+        make_image(image, w, h);
+
+        /* clipped and black pixels, to get the operators to clamp */
+        for (int i = 0; i < w * h * 3; i += 7) image[i] = (i % 2) ? 65535 : 0;
+
+        test_case(&run, sobel_case(image, w, h));
+
+        for (int m = 0; m < COUNT(masking); m++)
+            for (int luma_only = 0; luma_only <= 1; luma_only++)
+                for (int b = 0; b < COUNT(bands); b++)
+                {
+                    test_case(&run, sharpen_case(&run, processing, image, w, h, masking[m], luma_only, bands[b]));
+                }
+
+        free(image);
+    }
+
+    freeProcessingObject(processing);
+
+    return test_end(&run);
+}
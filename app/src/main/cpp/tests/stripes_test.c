@@ -0,0 +1,134 @@
+/*
+ * Checks the vertical stripes detection and correction on synthetic frames with a different
+ * gain on each of the 8 column types, measured on the frame or forced, on several frame sizes
+ * and thread counts. Coefficients are checked against the ones the single threaded version
+ * measured, the correction with those against checksums of its output
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stripes.h"
+#include "test_helper.h"
+
+/* Coefficients the single threaded version measured, by size and mode */
+static const int reference_coefficients[][2][8] = {
+    { { 65536, 65477, 66668, 66002, 67165, 67891, 66710, 65578 }, { 65536, 65477, 66665, 65999, 67163, 67891, 66712, 65576 } },
+    { { 65536, 65534, 69598, 68472, 72761, 76061, 76220, 69868 }, { 65536, 65533, 69590, 68467, 72773, 76072, 76214, 69868 } },
+    { { 65536, 65448, 68887, 67678, 71694, 74392, 74447, 73453 }, { 65536, 65447, 68890, 67677, 71697, 74374, 74461, 73458 } },
+    { { 65536, 61193, 61117, 56036, 56176, 54868, 52025, 52811 }, { 65536, 61197, 61104, 56019, 56191, 54880, 52034, 52803 } },
+};
+
+/* Outputs of the single threaded correction with those coefficients, in case order */
+static const uint64_t checksums[] = {
+    0x1580dd0aa708c5a6ULL, /* correction 1024x600 mode=1 threads=1 */
+    0x1580dd0aa708c5a6ULL, /* correction 1024x600 mode=1 threads=2 */
+    0x1580dd0aa708c5a6ULL, /* correction 1024x600 mode=1 threads=3 */
+    0x1580dd0aa708c5a6ULL, /* correction 1024x600 mode=1 threads=8 */
+    0x356a7838bf45bdb4ULL, /* correction 1024x600 mode=2 threads=1 */
+    0x356a7838bf45bdb4ULL, /* correction 1024x600 mode=2 threads=2 */
+    0x356a7838bf45bdb4ULL, /* correction 1024x600 mode=2 threads=3 */
+    0x356a7838bf45bdb4ULL, /* correction 1024x600 mode=2 threads=8 */
+    0x72886165f3ac13edULL, /* correction 400x300 mode=1 threads=1 */
+    0x72886165f3ac13edULL, /* correction 400x300 mode=1 threads=2 */
+    0x72886165f3ac13edULL, /* correction 400x300 mode=1 threads=3 */
+    0x72886165f3ac13edULL, /* correction 400x300 mode=1 threads=8 */
+    0x2ad1d648e68e8378ULL, /* correction 400x300 mode=2 threads=1 */
+    0x2ad1d648e68e8378ULL, /* correction 400x300 mode=2 threads=2 */
+    0x2ad1d648e68e8378ULL, /* correction 400x300 mode=2 threads=3 */
+    0x2ad1d648e68e8378ULL, /* correction 400x300 mode=2 threads=8 */
+    0xdb682335467dc3bcULL, /* correction 1736x98 mode=1 threads=1 */
+    0xdb682335467dc3bcULL, /* correction 1736x98 mode=1 threads=2 */
+    0xdb682335467dc3bcULL, /* correction 1736x98 mode=1 threads=3 */
+    0xdb682335467dc3bcULL, /* correction 1736x98 mode=1 threads=8 */
+    0xa002053a032024fbULL, /* correction 1736x98 mode=2 threads=1 */
+    0xa002053a032024fbULL, /* correction 1736x98 mode=2 threads=2 */
+    0xa002053a032024fbULL, /* correction 1736x98 mode=2 threads=3 */
+    0xa002053a032024fbULL, /* correction 1736x98 mode=2 threads=8 */
+    0xf6f2407191ba426fULL, /* correction 64x40 mode=1 threads=1 */
+    0xf6f2407191ba426fULL, /* correction 64x40 mode=1 threads=2 */
+    0xf6f2407191ba426fULL, /* correction 64x40 mode=1 threads=3 */
+    0xf6f2407191ba426fULL, /* correction 64x40 mode=1 threads=8 */
+    0x666b71c68a5089c3ULL, /* correction 64x40 mode=2 threads=1 */
+    0x666b71c68a5089c3ULL, /* correction 64x40 mode=2 threads=2 */
+    0x666b71c68a5089c3ULL, /* correction 64x40 mode=2 threads=3 */
+    0x666b71c68a5089c3ULL, /* correction 64x40 mode=2 threads=8 */
+};
+
+/* Smooth scene with column gains a few percent off, clipped highlights on the right */
+static const int gains[8] = { 1000, 1020, 990, 1030, 1000, 980, 1010, 1040 };
+static const test_frame_t look = { .range = 6000, .noise = 10, .column_gain = gains, .seed = 1 };
+
+/* The dither of the detection histograms is no longer rand(), so the coefficients may be off
+ * the reference by a hair (COEFF_TOLERANCE of FIXP_ONE, they are up to 24 off on these frames),
+ * but must not depend on the threads. The correction with the same coefficients has to match
+ * exactly */
+#define COEFF_TOLERANCE 32
+
+static int run_case(test_run_t * run, int size, int w, int h, int mode, int threads, stripes_correction * single_thread)
+{
+    uint16_t * frame = malloc(w * h * sizeof(uint16_t));
+    make_test_frame(frame, w, h, &look);
+    int frame_size = w * h * 14 / 8;
+    int failed = 0;
+
+    /* detection (and correction with what it detected) */
+    stripes_correction correction;
+    memset(&correction, 0, sizeof(stripes_correction));
+    int compute = 1;
+    fix_vertical_stripes(&correction, frame, BLACK, WHITE, frame_size, w, h, mode, &compute, threads);
+
+    if (!correction.correction_needed || compute)
+    {
+        printf("FAIL %dx%d mode=%d threads=%d: stripes were not found\n", w, h, mode, threads);
+        failed = 1;
+    }
+    const int * expected = reference_coefficients[size][mode - 1];
+    for (int j = 0; j < 8; j++)
+    {
+        if (abs(expected[j] - correction.coeffficients[j]) > COEFF_TOLERANCE)
+        {
+            printf("FAIL %dx%d mode=%d threads=%d: coefficient %d is %d, reference %d\n",
+                   w, h, mode, threads, j, correction.coeffficients[j], expected[j]);
+            failed = 1;
+        }
+    }
+    if (threads == 1) *single_thread = correction;
+    if (memcmp(single_thread, &correction, sizeof(stripes_correction)))
+    {
+        printf("FAIL %dx%d mode=%d threads=%d: coefficients differ from 1 thread\n", w, h, mode, threads);
+        failed = 1;
+    }
+
+    /* correction with the reference coefficients */
+    make_test_frame(frame, w, h, &look);
+    correction.correction_needed = 1;
+    memcpy(correction.coeffficients, expected, sizeof(correction.coeffficients));
+    compute = 0;
+    fix_vertical_stripes(&correction, frame, BLACK, WHITE, frame_size, w, h, 1, &compute, threads);
+
+    char what[64];
+    snprintf(what, sizeof(what), "correction %dx%d mode=%d threads=%d", w, h, mode, threads);
+    failed |= test_check(run, what, frame, w * h * sizeof(uint16_t));
+
+    free(frame);
+    return failed;
+}
+
+int main(int argc, char ** argv)
+{
+    static const int sizes[][2] = { { 1024, 600 }, { 400, 300 }, { 1736, 98 }, { 64, 40 } };
+    static const int threads[] = { 1, 2, 3, 8 };
+    stripes_correction single_thread;
+    test_run_t run;
+    test_begin(&run, "stripes", checksums, COUNT(checksums), argc, argv);
+
+    for (int s = 0; s < COUNT(sizes); s++)
+        for (int mode = 1; mode <= 2; mode++)
+            for (int t = 0; t < COUNT(threads); t++)
+            {
+                test_case(&run, run_case(&run, s, sizes[s][0], sizes[s][1], mode, threads[t], &single_thread));
+            }
+
+    return test_end(&run);
+}
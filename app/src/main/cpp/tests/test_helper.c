@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "test_helper.h"
+
+uint32_t test_random(uint32_t * state)
+{
+    /* xorshift32 */
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+static int random_offset(uint32_t * state, int amplitude)
+{
+    if (amplitude <= 0) return 0;
+    return (int)(test_random(state) % (2 * amplitude + 1)) - amplitude;
+}
+
+/* Smooth slopes with a ramp to the right, edges (of a different height on every bayer site if
+ * colour) and clipped highlights on the right eighth, 0 to about range */
+static int scene(int x, int y, int w, int range, int colour)
+{
+    int across = abs((x * 5) % 512 - 256);
+    int down = abs((y * 3) % 512 - 256);
+    int site = colour ? (y & 1) * 2 + (x & 1) : 1;
+
+    int64_t s = range / 32;
+    s += (int64_t)range * across * down / (256 * 256 * 2);
+    s += (int64_t)range * x / (4 * w);
+    s += ((x / 8 + y / 6) & 1) * range / 16 * (site + 1);
+    if (x > w * 7 / 8) s *= 4;
+    return (int)s;
+}
+
+void make_test_frame(uint16_t * frame, int w, int h, const test_frame_t * look)
+{
+    uint32_t state = look->seed ^ 0x9E3779B9;
+    int * columns = calloc(w, sizeof(int));
+    int * rows = calloc(h, sizeof(int));
+    for (int x = 0; x < w; x++) columns[x] = random_offset(&state, look->column_offset);
+    for (int y = 0; y < h; y++) rows[y] = random_offset(&state, look->row_offset);
+
+    for (int y = 0; y < h; y++)
+    {
+        for (int x = 0; x < w; x++)
+        {
+            int64_t s = scene(x, y, w, look->range, look->colour);
+            if (look->dual_iso && (y & 3) < 2) s *= look->dual_iso;
+            if (look->column_gain) s = s * look->column_gain[x & 7] / 1000;
+            if (look->dark_corner && x < w / 6 && y < h / 6) s = 20;
+
+            int64_t v = BLACK + s + columns[x] + rows[y] + random_offset(&state, look->noise);
+            frame[x + y * w] = (uint16_t)MAX(0, MIN(v, WHITE));
+        }
+    }
+
+    free(columns);
+    free(rows);
+}
+
+/* FNV-1a */
+static uint64_t checksum(const void * data, size_t bytes)
+{
+    const uint8_t * p = data;
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < bytes; i++)
+    {
+        hash ^= p[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+void test_begin(test_run_t * run, const char * name, const uint64_t * checksums, int count, int argc, char ** argv)
+{
+    memset(run, 0, sizeof(test_run_t));
+    run->name = name;
+    run->checksums = checksums;
+    run->count = count;
+    run->print = (argc > 1 && !strcmp(argv[1], "-g"));
+}
+
+int test_check(test_run_t * run, const char * what, const void * data, size_t bytes)
+{
+    uint64_t hash = checksum(data, bytes);
+    int index = run->next++;
+
+    if (run->print)
+    {
+        printf("    0x%016llxULL, /* %s */\n", (unsigned long long)hash, what);
+        return 0;
+    }
+    if (index >= run->count)
+    {
+        printf("FAIL %s: no checksum for it\n", what);
+        return 1;
+    }
+    if (hash != run->checksums[index])
+    {
+        printf("FAIL %s: checksum %016llx, expected %016llx\n", what,
+               (unsigned long long)hash, (unsigned long long)run->checksums[index]);
+        return 1;
+    }
+    return 0;
+}
+
+void test_case(test_run_t * run, int failed)
+{
+    run->cases++;
+    run->failed += (failed != 0);
+}
+
+int test_end(test_run_t * run)
+{
+    if (run->print) return 0;
+    if (run->next != run->count)
+    {
+        printf("FAIL %d checksums for %d outputs\n", run->count, run->next);
+        run->failed++;
+    }
+    printf("%s: %d of %d cases match their checksums\n", run->name, run->cases - run->failed, run->cases);
+    return run->failed ? 1 : 0;
+}
+
+int compare_test_frames(const char * what, const uint16_t * expected, const uint16_t * actual, int w, int h)
+{
+    int diffs = 0, max_diff = 0, first = -1;
+    for (int i = 0; i < w * h; i++)
+    {
+        int d = abs(expected[i] - actual[i]);
+        if (!d) continue;
+        if (first < 0) first = i;
+        diffs++;
+        max_diff = MAX(max_diff, d);
+    }
+
+    if (diffs)
+    {
+        printf("FAIL %s %dx%d: %d pixels differ (max %d), first at %d,%d\n",
+               what, w, h, diffs, max_diff, first % w, first / w);
+    }
+    return diffs != 0;
+}
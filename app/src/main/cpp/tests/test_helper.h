@@ -0,0 +1,58 @@
+#ifndef _test_helper_h
+#define _test_helper_h
+
+/*
+ * What the host tests share: synthetic raw frames, checksums of what a pass made of them and
+ * the frame compare. Outputs are checked against checksums of the version of the pass each
+ * test was written for, run with -g to print new ones when a pass is meant to change
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define MIN(a,b) ((a) < (b) ? (a) : (b))
+#define MAX(a,b) ((a) > (b) ? (a) : (b))
+#define COUNT(x) ((int)(sizeof(x) / sizeof((x)[0])))
+
+#define BLACK 2048
+#define WHITE 15000
+
+/* What goes on top of the scene. The scene is integer only and the noise comes from our own
+ * generator, so a frame is the same on every host */
+typedef struct {
+    int range;                 /* scene goes from black to about this much above it */
+    int noise;                 /* uniform noise of +- this */
+    int colour;                /* edges of a different height on every bayer site */
+    int dual_iso;              /* rows 0 and 1 of every 4 are this many times brighter (0 = off) */
+    const int * column_gain;   /* gain of the 8 column types in 1/1000, NULL for none */
+    int column_offset;         /* random offset of up to +- this on every column */
+    int row_offset;            /* and on every row */
+    int dark_corner;           /* top left corner near the noise floor */
+    uint32_t seed;
+} test_frame_t;
+
+void make_test_frame(uint16_t * frame, int w, int h, const test_frame_t * look);
+/* Same numbers on every host, for tests that need more random things than a frame */
+uint32_t test_random(uint32_t * state);
+
+typedef struct {
+    const char * name;
+    const uint64_t * checksums; /* of every output, in the order they are checked */
+    int count;
+    int next;
+    int print;                  /* -g: print the checksums instead of checking them */
+    int cases, failed;
+} test_run_t;
+
+void test_begin(test_run_t * run, const char * name, const uint64_t * checksums, int count, int argc, char ** argv);
+/* Checks the next output against its checksum, returns 1 if it does not match */
+int test_check(test_run_t * run, const char * what, const void * data, size_t bytes);
+/* Counts a case, failed if any of its checks failed */
+void test_case(test_run_t * run, int failed);
+/* Prints the summary, returns the exit code */
+int test_end(test_run_t * run);
+
+/* Returns 1 and prints where they differ if two frames are not the same */
+int compare_test_frames(const char * what, const uint16_t * expected, const uint16_t * actual, int w, int h);
+
+#endif
@@ -0,0 +1,168 @@
+/*
+ * The gamma tables are built with te_run on the flattened transfer function, from several
+ * threads. It has to give exactly what te_eval gives on the expression tree, for the built in
+ * curves with and without a gamma on top and for expressions typed in by hand, over the whole
+ * range of the tables and beyond
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include "raw_processing.h"
+
+#define STEPS 65536
+#define THREADS 4
+
+/* What the tables evaluate, 0-1 times the exposure factor, and some way over */
+static const double ranges[] = { 1.0, 16.0 };
+static const double gammas[] = { 1.0, 2.2, 0.45 };
+
+/* Ternaries (one at most, it is all compile_ternary takes), constants, every function */
+static const char * expressions[] = {
+    "pow(x, 1.0 / 2.2)",
+    "x * x - 0.5 * x + sin(x * pi)",
+    "(x < 0.25) ? x * 2 : 1 - exp(-x) * 0.6065",
+    "(x >= 0.5) ? sqrt(x) : x ^ 2",
+    "abs(x - 0.3) ^ 0.7 + floor(x * 10) / 10 + ceil(x * 3)",
+    "ln(x + 1) / ln(2) + log10(x + 1) - log(x + 1)",
+    "atan2(x, 0.5) + tanh(x) - cosh(x) + sinh(x) + atan(x)",
+    "acos(x / 32) + asin(x / 32) + tan(x / 32) + cos(x)",
+    "fac(3) * x / 6 + ncr(5, 2) * x / 10 - npr(4, 2) / 12",
+    "-x + 2 * x - -x + x % 0.3",
+    "e ^ x - pi * x",
+    "1 / x",
+    "sqrt(x - 0.5)",
+    "2 + 3 * 4",
+};
+
+typedef struct {
+    const te_program * program;
+    const double * xs;
+    const double * expected;
+    int start, end;
+    int mismatches;
+} run_thread_t;
+
+static int same(double a, double b)
+{
+    return (isnan(a) && isnan(b)) || !memcmp(&a, &b, sizeof(double));
+}
+
+static void * run_thread(void * arg)
+{
+    run_thread_t * r = arg;
+    for (int i = r->start; i < r->end; i++)
+        r->mismatches += !same(te_run(r->program, r->xs[i]), r->expected[i]);
+    return NULL;
+}
+
+/* te_eval reads x from the processing object, so it goes first on its own */
+static int check_transfer_function(processingObject_t * processing, const char * what)
+{
+    if (!processing->transfer_program)
+    {
+        printf("FAIL %s: not flattened\n", what);
+        return 1;
+    }
+
+    double * xs = malloc(STEPS * sizeof(double));
+    double * expected = malloc(STEPS * sizeof(double));
+    int mismatches = 0;
+
+    for (int r = 0; r < (int)(sizeof(ranges) / sizeof(ranges[0])); r++)
+    {
+        for (int i = 0; i < STEPS; i++)
+        {
+            xs[i] = (double)i / (STEPS-1) * ranges[r];
+            processing->x_value = xs[i];
+            expected[i] = te_eval(processing->transfer_function);
+        }
+
+        run_thread_t runs[THREADS];
+        pthread_t threads[THREADS];
+        for (int t = 0; t < THREADS; t++)
+        {
+            runs[t] = (run_thread_t) { processing->transfer_program, xs, expected,
+                                       STEPS * t / THREADS, STEPS * (t+1) / THREADS, 0 };
+            pthread_create(&threads[t], NULL, run_thread, &runs[t]);
+        }
+        for (int t = 0; t < THREADS; t++)
+        {
+            pthread_join(threads[t], NULL);
+            mismatches += runs[t].mismatches;
+        }
+    }
+
+    if (mismatches) printf("FAIL %s: %d values differ from te_eval\n", what, mismatches);
+
+    free(xs);
+    free(expected);
+    return mismatches != 0;
+}
+
+/* Nested deeper than te_run's stack, has to be left to te_eval */
+static int check_too_deep(processingObject_t * processing)
+{
+    char expression[1024] = "x";
+    char nested[1024];
+    for (int i = 0; i < 80; i++)
+    {
+        snprintf(nested, sizeof(nested), "(0.5 + %s)", expression);
+        strcpy(expression, nested);
+    }
+
+    if (processingSetTransferFunction(processing, expression))
+    {
+        printf("FAIL deep expression: not taken\n");
+        return 1;
+    }
+    if (processing->transfer_program)
+    {
+        printf("FAIL deep expression: flattened\n");
+        return 1;
+    }
+    return 0;
+}
+
+int main(void)
+{
+    processingObject_t * processing = initProcessingObject();
+    char what[160];
+    int cases = 0, failed = 0;
+
+    for (int id = TONEMAP_None; id <= TONEMAP_PanasonicVLog; id++)
+    {
+        for (int g = 0; g < (int)(sizeof(gammas) / sizeof(gammas[0])); g++)
+        {
+            processingSetGammaAndTonemapping(processing, gammas[g], id);
+            snprintf(what, sizeof(what), "tonemap %d gamma %g", id, gammas[g]);
+            failed += check_transfer_function(processing, what);
+            cases++;
+        }
+    }
+
+    for (int e = 0; e < (int)(sizeof(expressions) / sizeof(expressions[0])); e++)
+    {
+        if (processingSetTransferFunction(processing, (char *)expressions[e]))
+        {
+            printf("FAIL '%s': not taken\n", expressions[e]);
+            failed++;
+        }
+        else
+        {
+            snprintf(what, sizeof(what), "'%s'", expressions[e]);
+            failed += check_transfer_function(processing, what);
+        }
+        cases++;
+    }
+
+    failed += check_too_deep(processing);
+    cases++;
+
+    freeProcessingObject(processing);
+
+    printf("tinyexpr: %d of %d transfer functions run the same as te_eval\n", cases - failed, cases);
+    return failed ? 1 : 0;
+}
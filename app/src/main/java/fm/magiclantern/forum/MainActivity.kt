@@ -29,6 +29,10 @@ class MainActivity : ComponentActivity() {
         }
 
         NativeLib.setBaseDir(this.filesDir.absolutePath)
+        // Focus pixel maps are downloaded there, compiled ones are kept next to them
+        NativeLib.setPixelMapDirectory(this.filesDir.absolutePath)
+        // Stacked dark frames can always be made again from their clip
+        NativeLib.setDarkFrameMasterDirectory(this.cacheDir.absolutePath)
         
         setContent {
             MLVappTheme {
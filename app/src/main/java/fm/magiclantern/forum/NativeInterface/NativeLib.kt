@@ -32,6 +32,66 @@ object NativeLib {
         height: Int
     ): Boolean
 
+    /**
+     * Half resolution [fillFrame16]: every 2x2 bayer quad becomes one pixel, so
+     * [width] and [height] must be the clip size / 2. About 4x cheaper, for playback.
+     */
+    external fun fillPreviewFrame16(
+        handle: Long,
+        frameIndex: Int,
+        cores: Int,
+        dst: ByteBuffer,  // direct buffer
+        width: Int,
+        height: Int
+    ): Boolean
+
+    /**
+     * Processed part of a frame for zoomed in viewing. [x], [y], [w], [h] are in frame
+     * pixels (as displayed), the result is scaled to [outWidth] x [outHeight], same
+     * layout as [fillFrame16]. Only a tile around the region is debayered and processed.
+     */
+    external fun fillRegion16(
+        handle: Long,
+        frameIndex: Int,
+        cores: Int,
+        dst: ByteBuffer,  // direct buffer
+        x: Int,
+        y: Int,
+        w: Int,
+        h: Int,
+        outWidth: Int,
+        outHeight: Int
+    ): Boolean
+
+    /**
+     * What the RAM frame cache keeps per frame:
+     * 0 = debayered RGB (48bpp), 1 = bayer 16bpp, 2 = bayer packed at raw bit depth.
+     * Bayer modes fit 3-4x more frames but debayer on every cache hit.
+     */
+    external fun setCacheStorageMode(
+        handle: Long,
+        mode: Int
+    )
+
+    /**
+     * Frame cache statistics: [hits, misses, decodeNs, cacheableFrames].
+     * decodeNs / hits is the average cost of a cache hit in the current mode.
+     */
+    external fun getCacheStats(
+        handle: Long
+    ): LongArray?
+
+    /**
+     * Second frame cache tier: frames that don't fit in RAM are kept debayered in a
+     * file inside [cacheDir] (pass context.cacheDir), up to [megaBytes]. 0 turns it off.
+     * Returns true if the disk tier is active afterwards.
+     */
+    external fun setDiskCache(
+        handle: Long,
+        cacheDir: String?,
+        megaBytes: Long
+    ): Boolean
+
     external fun getVideoFrameTimestamps(
         handle: Long
     ): LongArray?
@@ -67,10 +127,42 @@ object NativeLib {
         path: String
     )
 
+    /**
+     * Where dark frame clips stacked into one frame are kept, so a clip is
+     * only stacked once. Nothing is kept until this is set.
+     */
+    external fun setDarkFrameMasterDirectory(
+        path: String?
+    )
+
     external fun refreshFocusPixelMap(
         handle: Long
     )
 
+    /**
+     * Where .fpm/.bpm maps are looked up, and where their compiled form is kept
+     * so later clips skip parsing. Nothing is written until this is set.
+     */
+    external fun setPixelMapDirectory(
+        path: String?
+    )
+
+    /**
+     * Focus / bad pixel map of the clip read from [fd] (text or compiled)
+     * instead of the pixel map directory, -1 goes back to the directory.
+     * The caller keeps owning the fd and must keep it open while the clip
+     * uses it.
+     */
+    external fun setFocusPixelMapFd(
+        handle: Long,
+        fd: Int
+    )
+
+    external fun setBadPixelMapFd(
+        handle: Long,
+        fd: Int
+    )
+
     external fun cancelExport()
 
     external fun setFocusPixelMode(
@@ -101,6 +193,8 @@ object NativeLib {
      * Batch export handler - processes multiple clips with shared encoder context.
      * More efficient than calling exportHandler for each clip when exporting
      * a queue of clips with the same codec settings.
+     * Clips export concurrently within the memSize and cpuCores budget, progress
+     * reported to the listener covers the whole batch.
      */
     external fun exportBatchHandler(
         memSize: Long,
@@ -114,5 +208,33 @@ object NativeLib {
     external fun testEncoderConfiguration(
         options: ExportOptions
     ): Boolean
+
+    /**
+     * Converts a test frame (pattern 0 = gradients, 1 = noise) to pixelFormat
+     * (ffmpeg name) both directly and through swscale, returns the largest
+     * luma and chroma difference in codes, null if the format is not direct.
+     */
+    external fun compareYuvWithSwscale(
+        pixelFormat: String,
+        swsMatrix: Int,
+        width: Int,
+        height: Int,
+        pattern: Int
+    ): IntArray?
+
+    /**
+     * Average nanoseconds export_sws_scale takes for one RGB48 frame of
+     * width x height to pixelFormat at dstWidth x dstHeight on the given
+     * number of swscale slice threads, -1 on failure.
+     */
+    external fun benchmarkSwscale(
+        pixelFormat: String,
+        width: Int,
+        height: Int,
+        dstWidth: Int,
+        dstHeight: Int,
+        threads: Int,
+        frames: Int
+    ): Long
 }
 
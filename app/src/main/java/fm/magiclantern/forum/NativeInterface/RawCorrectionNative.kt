@@ -27,6 +27,13 @@ object RawCorrectionNative {
      */
     external fun setDarkFrameMode(mlvObjectPtr: Long, mode: Int)
 
+    /**
+     * Set how the frames of the dark frame clip are stacked into one
+     * @param mlvObjectPtr Native pointer to MLV object
+     * @param method 0=Average, 1=Median
+     */
+    external fun setDarkFrameStackMethod(mlvObjectPtr: Long, method: Int)
+
     /**
      * Set focus dots fix mode
      * @param mlvObjectPtr Native pointer to MLV object
@@ -59,7 +66,7 @@ object RawCorrectionNative {
     /**
      * Set vertical stripes fix mode
      * @param mlvObjectPtr Native pointer to MLV object
-     * @param mode 0=Off, 1=Normal, 2=Force
+     * @param mode 0=Off, 1=Normal, 2=Force, 3=Clip (measured over the clip in the background)
      */
     external fun setVerticalStripesMode(mlvObjectPtr: Long, mode: Int)
 
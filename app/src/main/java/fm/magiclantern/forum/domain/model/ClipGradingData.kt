@@ -59,7 +59,7 @@ data class ClipGradingData(
 @Stable
 data class RawCorrectionSettings(
     val enabled: Boolean = true,              // rawFixesEnabled
-    val verticalStripes: Int = 0,             // 0=Off, 1=Normal, 2=Force
+    val verticalStripes: Int = 0,             // 0=Off, 1=Normal, 2=Force, 3=Clip (measured over the whole clip)
     val focusPixels: Int = 0,                 // 0=Off, 1=On, 2=CropRec
     val fpiMethod: Int = 0,                   // Focus pixel interpolation method
     val badPixels: Int = 0,                   // 0=Off, 1=Auto, 2=Force, 3=Map
@@ -76,7 +76,8 @@ data class RawCorrectionSettings(
     val dualIsoWhite: Int = 65013,            // Dual ISO white level
     val dualIsoBlack: Int = 4096,             // Dual ISO black level
     val darkFrameFileName: String = "No file selected",  // Dark frame file path
-    val darkFrameEnabled: Int = 0             // 0=Off, 1=Ext, 2=Int
+    val darkFrameEnabled: Int = 0,            // 0=Off, 1=Ext, 2=Int
+    val darkFrameStack: Int = 0               // Stacking of dark frame clip: 0=Average, 1=Median
 ) : Parcelable
 
 /**
@@ -156,6 +156,19 @@ fun RawCorrectionArea(
                         },
                         enabled = darkFrameFileLoaded
                     )
+
+                    if (state.darkFrameEnabled > 0) {
+                        Text(
+                            text = "Stacking",
+                            style = MaterialTheme.typography.labelMedium,
+                            modifier = Modifier.padding(top = 8.dp)
+                        )
+                        RadioButtonGroup(
+                            options = listOf("Average", "Median"),
+                            selectedIndex = state.darkFrameStack,
+                            onSelectionChange = { gradingViewModel.setDarkFrameStackMethod(it) }
+                        )
+                    }
                 }
 
                 HorizontalDivider()
@@ -259,7 +272,7 @@ fun RawCorrectionArea(
                 // Vertical Stripes
                 RawCorrectionSection(title = "Vertical Stripes") {
                     RadioButtonGroup(
-                        options = listOf("Off", "Normal", "Force"),
+                        options = listOf("Off", "Normal", "Force", "Clip"),
                         selectedIndex = state.verticalStripes,
                         onSelectionChange = { gradingViewModel.setVerticalStripesMode(it) }
                     )
@@ -277,6 +277,21 @@ class GradingViewModel @Inject constructor(
         }
     }
 
+    fun setDarkFrameStackMethod(method: Int) {
+        val handle = clipHandle
+        if (handle == 0L) return
+
+        updateGrading {
+            it.copy(rawCorrection = it.rawCorrection.copy(darkFrameStack = method))
+        }
+
+        try {
+            RawCorrectionNative.setDarkFrameStackMethod(handle, method)
+        } catch (e: Exception) {
+            Log.e("GradingViewModel", "Failed to set dark frame stacking: ${e.message}", e)
+        }
+    }
+
     fun setFocusDotsMode(mode: Int, interpolation: Int) {
         val handle = clipHandle
         if (handle == 0L) return
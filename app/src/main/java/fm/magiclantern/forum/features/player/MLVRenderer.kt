@@ -79,6 +79,8 @@ class MlvRenderer(
     private var lastLoggedStretchY = 1f
 
     private var textureAllocated = false
+    private var textureWidth = 0
+    private var textureHeight = 0
 
     private val quadVertices = floatArrayOf(-1f, -1f, 1f, -1f, -1f, 1f, 1f, 1f)
     private val textureCoords = floatArrayOf(0f, 1f, 1f, 1f, 0f, 0f, 1f, 0f)
@@ -154,25 +156,41 @@ class MlvRenderer(
             return
         }
 
-        if (!textureAllocated) {
-            allocateTextureStorage(videoWidth, videoHeight)
+        // Half resolution while playing, the paused frame gets the full debayer
+        val preview = viewModel.isPlaying.value && videoWidth >= 2 && videoHeight >= 2
+        val frameWidth = if (preview) videoWidth / 2 else videoWidth
+        val frameHeight = if (preview) videoHeight / 2 else videoHeight
+
+        if (!textureAllocated || textureWidth != frameWidth || textureHeight != frameHeight) {
+            allocateTextureStorage(frameWidth, frameHeight)
         }
 
         // Use shared buffer from ViewModel to prevent OOM during rapid view transitions
-        val buf = viewModel.getOrAllocateFrameBuffer(videoWidth, videoHeight) ?: run {
+        val buf = viewModel.getOrAllocateFrameBuffer(frameWidth, frameHeight) ?: run {
             GLES30.glClear(GLES30.GL_COLOR_BUFFER_BIT)
             return
         }
         buf.position(0)
         val decodeStart = System.nanoTime()
-        val ok = NativeLib.fillFrame16(
-            clipHandle,
-            viewModel.currentFrame.value,
-            cpuCores,
-            buf,
-            videoWidth,
-            videoHeight
-        )
+        val ok = if (preview) {
+            NativeLib.fillPreviewFrame16(
+                clipHandle,
+                viewModel.currentFrame.value,
+                cpuCores,
+                buf,
+                frameWidth,
+                frameHeight
+            )
+        } else {
+            NativeLib.fillFrame16(
+                clipHandle,
+                viewModel.currentFrame.value,
+                cpuCores,
+                buf,
+                frameWidth,
+                frameHeight
+            )
+        }
         val decodeNs = System.nanoTime() - decodeStart
 
         val renderStart = System.nanoTime()
@@ -182,14 +200,14 @@ class MlvRenderer(
         if (ok) {
             buf.position(0)
             GLES30.glBindTexture(GLES30.GL_TEXTURE_2D, textureId)
-            // Upload raw uint16 bytes as GL_RG8: width = videoWidth * 3 (one texel per channel)
+            // Upload raw uint16 bytes as GL_RG8: width = frameWidth * 3 (one texel per channel)
             GLES30.glTexSubImage2D(
                 GLES30.GL_TEXTURE_2D,
                 0,
                 0,
                 0,
-                videoWidth * 3,
-                videoHeight,
+                frameWidth * 3,
+                frameHeight,
                 GLES30.GL_RG,
                 GLES30.GL_UNSIGNED_BYTE,
                 buf
@@ -200,7 +218,7 @@ class MlvRenderer(
         // Set uniforms and attributes
         GLES30.glUniform1i(texUniformHandle, 0)
         if (widthUniformHandle >= 0) {
-            GLES30.glUniform1i(widthUniformHandle, videoWidth)
+            GLES30.glUniform1i(widthUniformHandle, frameWidth)
         }
         val processing = viewModel.processingData.value
         val stretchX = sanitizeStretch(processing.stretchFactorX)
@@ -292,6 +310,8 @@ class MlvRenderer(
         )
         checkGlError("glTexImage2D - RG8")
         textureAllocated = true
+        textureWidth = w
+        textureHeight = h
     }
 
     private fun createProgram(vertexSource: String, fragmentSource: String): Int {